@@ -193,6 +193,7 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
            bam_input_fname, 
         ("The input coordinate-sorted and indexed BAM file that is supposed to contain raw reads. "
         "If set to " OPT_ONLY_PRINT_VCF_HEADER ", then only print the VCF header, that describes the output format and is not instantiated from the input files, and then exit with the exit code of zero. "
+        "If set to " OPT_ONLY_BUILD_FASTA_CACHES ", then only build the cache and the tandem-repeat track of the <--fasta> file (see <--fasta-cache-fname> and <--repeat-track-fname>) and then exit. "
         "Important warnings about potential mis-use and mis-understanding are mentioned with the keyword CAVEAT in the VCF header. "))->required();
     ADD_OPTDEF(app, 
         "-f,--fasta", 
@@ -204,6 +205,11 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
         "The output bgzipped VCF file. "
         "If this parameter is set to either the empty string (\"\") or dot (\".\") and the --fam-consensus-out-fastq parameter is not set to either the empty string (\"\") or dot (\".\"), "
         "then do not generate any VCF. ");
+    ADD_OPTDEF(app, 
+        "-O,--output-type", 
+           vcf_out_pass_type, 
+        "The type of the output, where " OUTPUT_TYPE_VCF " means bgzipped VCF and " OUTPUT_TYPE_BCF " means BCF (bgzipped unless the output is stdout). "
+        "The BCF output is encoded directly from the in-memory values of most FORMAT fields without formatting them as text. ");
     
     ADD_OPTDEF(app, 
         "-R,--regions-file", 
@@ -228,7 +234,10 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
            max_cpu_num, 
         "Number of cpu cores or equivalently threads to use. ");
     ADD_OPTDEF2(app, mem_per_thread,
-        "Approximate amount of RAM, in terms of mega-bytes, used per thread. Please note that this is not the exact amount consumed at runtime. ");
+        "Approximate amount of RAM, in terms of mega-bytes, used per thread. "
+        "The regions are sized and admitted for processing by using the memory usage measured from the regions already processed "
+        "(the decoded reads, the allocated per-position data structures including the InDel tables, and the outputs), "
+        "so this amount is not exceeded unless one single region needs more RAM. ");
     
     ADD_OPTDEF(app, 
         "--outvar-flag", 
@@ -269,6 +278,18 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
            vcf_tumor_fname,
         "Block-gzipped VCF file of the tumor sample as input to the BAM file of normal sample. "
         "If specified/unspecified, then the input BAM is considered to be from normal/tumor. ");
+    ADD_OPTDEF(app, 
+        "--normal-bam",
+           bam_normal_fname,
+        "Coordinate-sorted and indexed BAM file of the normal sample matched to the inputBAM of the tumor sample. "
+        "If specified, then each region is called from the tumor and then from the normal in the same process, "
+        "and the VCF of the normal sample (the same as the one generated with the <--tumor-vcf> parameter) is the only output. "
+        "Only one pair of one tumor sample and one normal sample is supported, so more samples cannot be called jointly. "
+        "This parameter is incompatible with <--tumor-vcf> and <--fam-consensus-out-fastq>. ");
+    ADD_OPTDEF(app, 
+        "--normal-sample",
+           sample_name_normal,
+        "Sample name of the <--normal-bam>, where the empty string means the <--sample> name with the suffix _N. ");
     
     ADD_OPTDEF(app, 
         "--fam-consensus-out-fastq",
@@ -291,6 +312,12 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
         "This BED file can be generated by tumor and used by normal. This param overrides the <--regions-file> parameter. ");
     ADD_OPTDEF2(app, bed_in_avg_sequencing_DP,
         "Average sequencing depth in the BED input file specified above. If set to -1, then infer from the input BAM file. ");
+    ADD_OPTDEF2(app, index_partition_bin_size,
+        "If positive, then the number of reads in each genomic region is estimated from the compressed size of the region in the BAM index "
+        "without reading any alignment record, and the genome is partitioned into regions consisting of bins of this size (16384 is recommended). "
+        "This setting removes the pass over the input BAM file that is otherwise made to partition the genome "
+        "or to infer the sequencing depth in <--bed-in-fname> and <--regions-file> if <--bed-in-avg-sequencing-DP> is -1, "
+        "but the resulting regions are coarser than the ones from the pass over the BAM file. ");
     
 // *** 02. parameters that control input, output, and logs (driven by computational requirements and resources)
     
@@ -298,6 +325,30 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
         "Boolean (0: false, 1: true) indicating if the format from the tumor VCF should be retrieved in the tumor-normal comparison. "
         "This boolean has no effect if <--tumor-vcf> is not provided. ");
     
+    ADD_OPTDEF2(app, intra_region_max_nthreads,
+        "Maximum number of threads used to process one region with at least <--intra-region-min-nfams> molecule families. "
+        "The threads in addition to the one processing the region are taken only from the idle threads of <--threads>, "
+        "so the total number of running threads never exceeds <--threads>. "
+        "The value of 1 disables the splitting of one region across threads. This parameter does not affect the output. ");
+    ADD_OPTDEF2(app, intra_region_min_nfams,
+        "Minimum number of molecule families in one region above which the region is processed by multiple threads. ");
+    ADD_OPTDEF2(app, output_compress_level,
+        "Compression level (from 0 to 9, or -1 for the default level of zlib) of the bgzipped VCF/BCF and FASTQ outputs. ");
+    ADD_OPTDEF2(app, output_compress_nthreads,
+        "Number of threads that compress the outputs in parallel with the variant-calling threads, where 0 means the value of <--threads>. ");
+    ADD_OPTDEF2(app, is_output_indexed,
+        "Boolean (0: false, 1: true) indicating if the index of the <--output> file is generated while the file is written. "
+        "The index is tabix (.tbi) for VCF and CSI (.csi) for BCF or for any template longer than 2^29 bases. "
+        "This boolean has no effect if the output is stdout. ");
+    ADD_OPTDEF2(app, fasta_cache_fname,
+        "The cache of the <--fasta> file in uppercase that is memory-mapped and shared by all threads. "
+        "The cache is built if it does not exist or is older than the <--fasta> file. "
+        "The empty string means the <--fasta> file name with the suffix " FASTA_CACHE_SUFFIX ", and NA means not using any cache. ");
+    ADD_OPTDEF2(app, repeat_track_fname,
+        "The tandem-repeat track of the <--fasta> file that is built by running this program with inputBAM set to " OPT_ONLY_BUILD_FASTA_CACHES " and then memory-mapped. "
+        "If the track does not exist, is older than the <--fasta> file, or was built with different <--indel-*> parameters, then the tandem repeats are computed for each region. "
+        "The empty string means the <--fasta> file name with the suffix " REPEAT_TRACK_SUFFIX ", and NA means not using any track. ");
+    
     ADD_OPTDEF2(app, kept_aln_min_aln_len,
         "Minimum alignment length below which the alignment is filtered out. ");
     ADD_OPTDEF2(app, kept_aln_min_mapqual,
@@ -313,6 +364,14 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
     ADD_OPTDEF2(app, min_altdp_thres, 
         "Minimum allele depth of fragments below which allele record is not in the <--output> VCF. "
         "The paramters <--all-out> and <--all-germline-out> take precedence over this parameter. ");
+    ADD_OPTDEF2(app, lowdepth_skip_min_len, 
+        "Minimum length of a stretch in which the depth of fragments is below <--min-altdp-thres> "
+        "and which is therefore skipped without allocating any per-position data structure. "
+        "Such stretches are never skipped if <--all-out>, gVCF output, or <--fam-consensus-out-fastq> is enabled. "
+        "If <--tumor-vcf> is provided, then the stretches without any tumor variant are skipped instead. "
+        "The reads of the whole region are still grouped into molecules at once, "
+        "so the variants at the covered positions are the same as the ones without skipping. "
+        "Zero means never skipping. ");
     
     ADD_OPTDEF2(app, vdp1,
         "Every variant allele with at least this total depth of highBQ segments is always in the <--output> VCF if the <--vad1> and <--vfa1> conditions are also satisfied. "
@@ -1007,6 +1066,29 @@ CommandLineArgs::initFromArgCV(int & parsing_result_flag, int argc, const char *
         if (bam_input_fname.compare(OPT_ONLY_PRINT_DEBUG_DETAIL) == 0) {
             return;
         }
+        if (bam_input_fname.compare(OPT_ONLY_BUILD_FASTA_CACHES) == 0) {
+            check_file_exist(fasta_ref_fname, "FASTA");
+            check_file_exist(fasta_ref_fname + ".fai", "FASTA index");
+            return;
+        }
+        if (vcf_out_pass_type != OUTPUT_TYPE_VCF && vcf_out_pass_type != OUTPUT_TYPE_BCF) {
+            std::cerr << "The output type " << vcf_out_pass_type << " is neither " OUTPUT_TYPE_VCF " nor " OUTPUT_TYPE_BCF ". " << std::endl;
+            exit(-4);
+        }
+        if (IS_PROVIDED(bam_normal_fname)) {
+            if (IS_PROVIDED(vcf_tumor_fname) || fam_consensus_out_fastq.size() > 0) {
+                std::cerr << "The parameter --normal-bam cannot be used with either --tumor-vcf or --fam-consensus-out-fastq. " << std::endl;
+                exit(-4);
+            }
+            check_file_exist(bam_normal_fname, "BAM");
+            check_file_exist(bam_normal_fname + ".bai", "BAM index");
+            tn_is_paired = true;
+            if (this->inferred_is_joint_normal) {
+                bam_input_fname = bam_normal_fname;
+                sample_name = (IS_PROVIDED(sample_name_normal) ? sample_name_normal : (sample_name + "_N"));
+                vcf_tumor_fname = OPT_JOINT_TUMOR_CALLS;
+            }
+        }
         check_file_exist(bam_input_fname, "BAM");
         check_file_exist(bam_input_fname + ".bai", "BAM index");
         if (fasta_ref_fname.compare(std::string("NA")) != 0) {
@@ -25,6 +25,7 @@ struct CommandLineArgs {
     std::string bam_input_fname = NOT_PROVIDED; // not missing
     std::string fasta_ref_fname = NOT_PROVIDED;
     std::string vcf_out_pass_fname = "-";
+    std::string vcf_out_pass_type = OUTPUT_TYPE_VCF;
     
     std::string bed_region_fname = NOT_PROVIDED;    // bcftools view -R
     std::string tier1_target_region = NOT_PROVIDED; // bcftools view -t
@@ -53,14 +54,26 @@ struct CommandLineArgs {
 // *** 01. parameters of the names of files, samples, regions, etc.
     
     std::string vcf_tumor_fname = NOT_PROVIDED;
+    std::string bam_normal_fname = NOT_PROVIDED;
+    std::string sample_name_normal = NOT_PROVIDED;
     std::string bed_out_fname = NOT_PROVIDED;
     std::string bed_in_fname = NOT_PROVIDED;
     uvc1_readnum_t bed_in_avg_sequencing_DP = -1; // infer from input BAM data
+    uvc1_refgpos_t index_partition_bin_size = 0; // disabled by default
     
 // *** 02. parameters that control input, output, and logs (driven by computational requirements and resources)
     
     bool is_tumor_format_retrieved = true;
     
+    size_t         intra_region_max_nthreads = 4;
+    uvc1_readnum_t intra_region_min_nfams = 4096;
+    
+    int            output_compress_level = 5;
+    size_t         output_compress_nthreads = 0; // same as max_cpu_num
+    bool           is_output_indexed = true;
+    std::string    fasta_cache_fname = "";
+    std::string    repeat_track_fname = "";
+    
     // https://www.biostars.org/p/110670/
     
     uvc1_readpos_t    kept_aln_min_aln_len = 0;
@@ -70,6 +83,7 @@ struct CommandLineArgs {
     bool              kept_aln_is_zero_isize_discarded = false;
     
     uvc1_readnum_t    min_altdp_thres = 2;
+    uvc1_refgpos_t    lowdepth_skip_min_len = 1000;
     
     uvc1_readnum_t     vdp1 = 1000;
     uvc1_readnum_t     vad1 = 4;
@@ -427,6 +441,7 @@ struct CommandLineArgs {
     
     bool inferred_is_fastq_generated = false;
     bool inferred_is_vcf_generated = true;
+    bool inferred_is_joint_normal = false; // set before parsing to get the parameters of the normal sample of the joint tumor-normal calling
     
     int
     initFromArgCV(int & parsing_result_flag, int argc, const char *const* argv);
@@ -3,7 +3,11 @@
 
 #include "common.hpp"
 
+#include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 struct MolecularBarcode {
 
@@ -69,4 +73,58 @@ struct MolecularBarcode {
     uvc1_hash_t calcHash() const;
 };
 
+// Replacement for std::map<MolecularBarcode, TValue> in which the keys are grouped by their hash values (see MolecularBarcode::calcHash), 
+//   so that finding the value of a key costs one hash lookup instead of O(log n) comparisons of strings. 
+// The key-value pairs are stored in the order of insertion, and getSortedIdxs returns the iteration order of std::map<MolecularBarcode, TValue>.
+template <class TValue>
+class MolecularBarcodeIndex {
+    
+    std::vector<std::pair<MolecularBarcode, TValue>> key_value_pairs;
+    std::vector<uint32_t> idx_to_next_idx_with_same_hash; // UINT32_MAX means no more key with the same hash value
+    std::unordered_map<uvc1_hash_t, uint32_t> hash_to_first_idx;
+    
+public:
+    
+    // Returns the value of key, which is value-initialized and is_inserted is set to true if key is not found. 
+    // The hashvalue of key must be already set to key.calcHash(), and key is moved into this index only if it is not found. 
+    TValue &
+    findOrInsert(MolecularBarcode && key, bool & is_inserted) {
+        auto hash_to_idx_it = hash_to_first_idx.insert(std::make_pair(key.hashvalue, UINT32_MAX)).first;
+        for (uint32_t idx = hash_to_idx_it->second; idx != UINT32_MAX; idx = idx_to_next_idx_with_same_hash[idx]) {
+            const MolecularBarcode & idxkey = key_value_pairs[idx].first;
+            if (!(idxkey < key) && !(key < idxkey)) {
+                is_inserted = false;
+                return key_value_pairs[idx].second;
+            }
+        }
+        is_inserted = true;
+        key_value_pairs.push_back(std::make_pair(std::move(key), TValue()));
+        idx_to_next_idx_with_same_hash.push_back(hash_to_idx_it->second);
+        hash_to_idx_it->second = (uint32_t)(key_value_pairs.size() - 1);
+        return key_value_pairs.back().second;
+    };
+    
+    size_t
+    size() const {
+        return key_value_pairs.size();
+    };
+    
+    const std::pair<MolecularBarcode, TValue> &
+    at(size_t idx) const {
+        return key_value_pairs[idx];
+    };
+    
+    std::vector<uint32_t>
+    getSortedIdxs() const {
+        std::vector<uint32_t> ret(key_value_pairs.size());
+        for (uint32_t idx = 0; idx < ret.size(); idx++) {
+            ret[idx] = idx;
+        }
+        std::sort(ret.begin(), ret.end(), [this](const uint32_t idx1, const uint32_t idx2) {
+            return key_value_pairs[idx1].first < key_value_pairs[idx2].first;
+        });
+        return ret;
+    };
+};
+
 #endif
@@ -548,6 +548,7 @@ main(int argc, char **argv) {
     std::cout << "#include<string>\n";
     std::cout << "#include<vector>\n";
     std::cout << "#include<assert.h>\n";
+    std::cout << "#include \"common.hpp\"\n";
     
     std::cout << "namespace bcfrec {\n";
     
@@ -651,28 +652,30 @@ main(int argc, char **argv) {
         }
         std::string addcheck = std::string((fmt.is_SSCS_required) ? "if (fmt.enable_tier2_consensus_format_tags)" : "if (true)");
         
+        // Each value is appended without any temporary string, and the text is the same as the one generated by std::to_string.
+        const std::string append_func = ((BCF_STRING == fmt.type) ? "outstring.append" : ((BCF_FLOAT == fmt.type) ? "uvc_append_float" : "uvc_append_int"));
+        const std::string append_arg1 = ((BCF_STRING == fmt.type) ? "" : "outstring, ");
+        
         std::cout << addcheck << " {\n";
         if (itnum) {
-            std::cout << "    outstring += \":\";" << ";\n"; // The first FORMAT/TAG should always be GT and always be present
+            std::cout << "    outstring.push_back(':');\n"; // The first FORMAT/TAG should always be GT and always be present
         }
         if (BCF_SEP == fmt.type) {
-            std::cout << "    outstring += std::string(FORMAT_IDS[" << itnum << "]) + \"\";\n";
+            std::cout << "    outstring.append(FORMAT_IDS[" << itnum << "], " << fmt.id.size() << ");\n";
         } else if (0 == fmt.in_num_1 || 1 == fmt.in_num_1) {
             if (BCF_STRING == fmt.type && 1 == fmt.in_num_1) {
-                std::cout << "    if (fmt." << fmt.id << ".size() == 0) { outstring += \".\"; }\n";
+                std::cout << "    if (fmt." << fmt.id << ".size() == 0) { outstring.push_back('.'); }\n";
             }
-            std::cout << "    outstring += " << ((BCF_STRING == fmt.type) ? "" : "std::to_string") << "(fmt." << fmt.id << ");\n";
+            std::cout << "    " << append_func << "(" << append_arg1 << "fmt." << fmt.id << ");\n";
         } else if (fmt.in_num_1 > 1) {
             assertUVC(fmt.in_num_1 >= fmt.out_num_2);
             std::cout << "    for (unsigned int i = 0; i < " <<fmt.out_num_2 << "; i++) {\n";
-            std::cout << "        if (0 != i) { outstring += \",\"; }; outstring += " << ((BCF_STRING == fmt.type) ? "" : "std::to_string")
-                    << "(" << "fmt." << fmt.id << "[i]" << ");\n";
+            std::cout << "        if (0 != i) { outstring.push_back(','); }; " << append_func << "(" << append_arg1 << "fmt." << fmt.id << "[i]" << ");\n";
             std::cout << "    };\n";
         } else {
-            std::cout << "    if (fmt." << fmt.id << ".size() == 0) { outstring += \".\"; }\n";
+            std::cout << "    if (fmt." << fmt.id << ".size() == 0) { outstring.push_back('.'); }\n";
             std::cout << "    for (unsigned int i = 0; i < " << " fmt." << fmt.id << ".size()" << "; i++) {\n";
-            std::cout << "        if (0 != i) { outstring += \",\"; }; outstring += " << ((BCF_STRING == fmt.type) ? "" : "std::to_string") 
-                    << "(" << "fmt." << fmt.id << "[i]" << ");\n";
+            std::cout << "        if (0 != i) { outstring.push_back(','); }; " << append_func << "(" << append_arg1 << "fmt." << fmt.id << "[i]" << ");\n";
             std::cout << "    };\n";
         }
         std::cout << "\n}\n";
@@ -680,6 +683,41 @@ main(int argc, char **argv) {
     }
     std::cout << "\n    return 0;};\n";
     
+    // Same as streamAppendBcfFormat except that the value(s) of each FORMAT/TAG is passed with its C++ type to the encoder without being formatted as text.
+    std::cout << "template <class TEncoder>\n";
+    std::cout << "static int streamEncodeBcfFormat(TEncoder & encoder, const BcfFormat & fmt) {\n";
+    itnum = 0;
+    for (auto fmt : FORMAT_VEC) {
+        if (fmt.is_not_in_out_vcf) { 
+            std::cout << "/* The FORMAT/TAG " << fmt.id << " is skipped */\n"; 
+            itnum++;
+            continue; 
+        }
+        std::string addcheck = std::string((fmt.is_SSCS_required) ? "if (fmt.enable_tier2_consensus_format_tags)" : "if (true)");
+        const char *const encode_func = ((BCF_S64_INT == fmt.type) ? "encodeInt64s" : ((BCF_FLOAT == fmt.type) ? "encodeFloats" : "encodeInt32s"));
+        
+        std::cout << addcheck << " {\n";
+        if (BCF_SEP == fmt.type) {
+            std::cout << "    encoder.encodeString(" << itnum << ", FORMAT_IDS[" << itnum << "], " << fmt.id.size() << ");\n";
+        } else if (BCF_STRING == fmt.type && "GT" == fmt.id) {
+            std::cout << "    encoder.encodeGenotype(" << itnum << ", fmt." << fmt.id << ");\n";
+        } else if (BCF_STRING == fmt.type && 1 == fmt.in_num_1) {
+            std::cout << "    encoder.encodeString(" << itnum << ", fmt." << fmt.id << ".c_str(), fmt." << fmt.id << ".size());\n";
+        } else if (BCF_STRING == fmt.type) {
+            std::cout << "    encoder.encodeStrings(" << itnum << ", fmt." << fmt.id << ".data(), " 
+                    << ((fmt.in_num_1 > 1) ? std::to_string(fmt.out_num_2) : (std::string("fmt.") + fmt.id + ".size()")) << ");\n";
+        } else if (0 == fmt.in_num_1 || 1 == fmt.in_num_1) {
+            std::cout << "    encoder." << encode_func << "(" << itnum << ", &fmt." << fmt.id << ", 1);\n";
+        } else {
+            assertUVC(fmt.in_num_1 < 0 || fmt.in_num_1 >= fmt.out_num_2);
+            std::cout << "    encoder." << encode_func << "(" << itnum << ", fmt." << fmt.id << ".data(), " 
+                    << ((fmt.in_num_1 > 1) ? std::to_string(fmt.out_num_2) : (std::string("fmt.") + fmt.id + ".size()")) << ");\n";
+        }
+        std::cout << "}\n";
+        itnum++;
+    }
+    std::cout << "\n    return 0;};\n";
+    
     std::cout << "static int resetBcfFormatD(BcfFormat & fmt) {\n";
     
     for (auto fmt : FORMAT_VEC) {
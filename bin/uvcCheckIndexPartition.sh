@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+
+scriptdir="$(dirname "$(which "$0")")"
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 <REF> <bam> <outdir> [<binSize>] [<allParams>]"
+    echo "  Check that the variants called with the BAM-index-based partitioning of the genome (--index-partition-bin-size <binSize>) "
+    echo "    are the same as the variants called with the partitioning based on the scan of the BAM records (--index-partition-bin-size 0). "
+    echo "  <binSize> is 16384 by default. "
+    echo "  <allParams> is the set of other command-line parameters to ${scriptdir}/uvc1 for both runs. "
+    echo "  The exit code is zero if and only if the two runs result in the same variants. "
+    exit 1
+fi
+
+if [ -z "${UVC_BIN_EXE_FULL_NAME}" ]; then
+    UVC_BIN_EXE_FULL_NAME="${scriptdir}/uvc1"
+fi
+
+ref="$1"
+bam="$2"
+outdir="$3"
+binsize="${4:-16384}"
+mkdir -p "${outdir}"
+
+set -evx
+
+"${UVC_BIN_EXE_FULL_NAME}" -f "${ref}" -s sample "${bam}" -o "${outdir}/scan.vcf.gz"  --index-partition-bin-size 0            "${@:5}" 2> "${outdir}/scan.stderr"
+"${UVC_BIN_EXE_FULL_NAME}" -f "${ref}" -s sample "${bam}" -o "${outdir}/index.vcf.gz" --index-partition-bin-size "${binsize}" "${@:5}" 2> "${outdir}/index.stderr"
+
+# CHROM, POS, REF, ALT and FILTER of each variant
+zcat "${outdir}/scan.vcf.gz"  | grep -v "^#" | cut -f1,2,4,5,7 | sort -k1,1 -k2,2n -k3,5 > "${outdir}/scan.calls.tsv"
+zcat "${outdir}/index.vcf.gz" | grep -v "^#" | cut -f1,2,4,5,7 | sort -k1,1 -k2,2n -k3,5 > "${outdir}/index.calls.tsv"
+if [ $(cat "${outdir}/scan.calls.tsv" | wc -l) -eq 0 ]; then
+    echo "No variant is called by the scan of the BAM records, so the check is inconclusive. "
+    exit 2
+fi
+diff "${outdir}/scan.calls.tsv" "${outdir}/index.calls.tsv"
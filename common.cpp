@@ -1,5 +1,7 @@
 #include "common.hpp"
 
+const MathTables STATIC_MATH_TABLES;
+
 const auto _ASSAY_TYPE_TO_MSG = std::array<std::string, 3>({{
     [ASSAY_TYPE_AUTO] = "Assay type of each molecule fragment will be automatically inferred from the data",
     [ASSAY_TYPE_CAPTURE] = "Data is generatd from a capture-based assay with selection by probe hybridization",
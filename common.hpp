@@ -3,18 +3,26 @@
 
 #define COMPILATION_ENABLE_XMGOT 0
 #define COMPILATION_TRY_HIGH_DEPTH_POS_BIAS 0
+// If 1, then the table-driven math functions (uvc_log, etc.) return the same values as the standard math functions bit for bit. 
+// If 0, then the arguments that are not in the tables are evaluated by approximations with an absolute error of at most about 1e-8, 
+//   which is faster but can change the output. 
+#define COMPILATION_EXACT_MATH 1
 
 // #include "precompiled/precompiled_main.hpp"
 
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include <float.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #ifdef __GNUC__
 #if __GNUC__ > 3
@@ -42,6 +50,13 @@
 
 #define MGVCF_REGION_MAX_SIZE 1000
 #define NUM_WORKING_UNITS_PER_THREAD 8
+#define NUM_INFLIGHT_TASKS_PER_THREAD (NUM_WORKING_UNITS_PER_THREAD * 2) // max number of tier-3 regions per thread that are queued or waiting to be written
+
+// at 150*16 average sequencing depth, the two below amount of bytes are approx equal to each other.
+// These are the initial estimates that are refined by the MemoryGovernor with the measured memory usage. 
+#define NUM_BYTES_PER_REF_POS ((size_t)(1024*4)) // initial estimate before any region is measured, see SIZE_PER_GENOMIC_POS in main.hpp
+#define NUM_BYTES_PER_READ ((size_t)(512)) // estimated
+#define NUM_OUT_BYTES_PER_REF_POS ((size_t)(1024)) // estimate from the htslib specs of VCF
 
 #define OUTVAR_GERMLINE 0x1
 #define OUTVAR_SOMATIC 0x2
@@ -56,6 +71,12 @@
 
 #define OPT_ONLY_PRINT_VCF_HEADER "/only-print-vcf-header/"
 #define OPT_ONLY_PRINT_DEBUG_DETAIL "/only-print-debug-detail/"
+#define OPT_ONLY_BUILD_FASTA_CACHES "/only-build-fasta-caches/"
+#define OPT_JOINT_TUMOR_CALLS "/joint-tumor-calls/" // in place of the tumor VCF for the normal sample of the joint tumor-normal calling
+#define OUTPUT_TYPE_VCF "z"
+#define OUTPUT_TYPE_BCF "b"
+#define FASTA_CACHE_SUFFIX ".uvc1upper"
+#define REPEAT_TRACK_SUFFIX ".uvc1repeat"
 #define PLAT_ILLUMINA_LIKE "Illumina/BGI"
 #define PLAT_ION_LIKE "IonTorrent/LifeTechnologies/ThermoFisher"
 
@@ -76,15 +97,77 @@
 #define rtr_endpos(r) ((r).begpos + (r).tracklen)
 #define ispowerof2(num) (((num) & ((num)-1)) == 0)
 
+// table-driven math functions (see COMPILATION_EXACT_MATH)
+
+#define MATH_TABLE_MAX_PHRED 256 // integer Phred scores in [-MATH_TABLE_MAX_PHRED, MATH_TABLE_MAX_PHRED] are looked up
+#define MATH_TABLE_MAX_COUNT (1024*8) // the logs of the integers in [0, MATH_TABLE_MAX_COUNT) are looked up
+#define MATH_TABLE_MANTISSA_NBITS 12 // number of most significant bits of the mantissa used by the approximate log
+
+struct MathTables {
+    std::array<double, MATH_TABLE_MAX_PHRED * 2 + 1> phred_to_numstates; // pow(10.0, phred/10.0)
+    std::array<double, MATH_TABLE_MAX_PHRED + 1> phred_to_prob; // pow(10, -((float)phred) / 10) as in phred2prob
+    std::array<double, MATH_TABLE_MAX_COUNT> count_to_log; // log(count)
+    std::array<double, (1 << MATH_TABLE_MANTISSA_NBITS) + 1> mantissa_to_log; // log(1.0 + i / 2**MATH_TABLE_MANTISSA_NBITS)
+    MathTables() {
+        for (int phred = -MATH_TABLE_MAX_PHRED; phred <= MATH_TABLE_MAX_PHRED; phred++) {
+            phred_to_numstates[phred + MATH_TABLE_MAX_PHRED] = pow(10.0, (phred)/10.0);
+        }
+        for (int phred = 0; phred <= MATH_TABLE_MAX_PHRED; phred++) {
+            phred_to_prob[phred] = pow(10, -((float)phred) / 10);
+        }
+        for (int count = 0; count < MATH_TABLE_MAX_COUNT; count++) {
+            count_to_log[count] = log((double)count);
+        }
+        for (int i = 0; i <= (1 << MATH_TABLE_MANTISSA_NBITS); i++) {
+            mantissa_to_log[i] = log(1.0 + (double)i / (double)(1 << MATH_TABLE_MANTISSA_NBITS));
+        }
+    };
+};
+extern const MathTables STATIC_MATH_TABLES;
+
+// Approximation of log(x) for positive normal x by linear interpolation between the logs of the 2**MATH_TABLE_MANTISSA_NBITS mantissas. 
+inline double
+uvc_approx_log(const double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const int64_t biased_exponent = (int64_t)((bits >> 52) & 0x7FF);
+    if (x <= 0 || 0 == biased_exponent || 0x7FF == biased_exponent) { return log(x); }
+    const uint64_t mantissa = (bits & ((1ULL << 52) - 1));
+    const uint64_t idx = (mantissa >> (52 - MATH_TABLE_MANTISSA_NBITS));
+    const double frac = (double)(mantissa & ((1ULL << (52 - MATH_TABLE_MANTISSA_NBITS)) - 1)) / (double)(1ULL << (52 - MATH_TABLE_MANTISSA_NBITS));
+    const double mlog = STATIC_MATH_TABLES.mantissa_to_log[idx] + frac * (STATIC_MATH_TABLES.mantissa_to_log[idx + 1] - STATIC_MATH_TABLES.mantissa_to_log[idx]);
+    return (double)(biased_exponent - 1023) * 0.6931471805599453 + mlog;
+}
+
+// Same as log(x) if COMPILATION_EXACT_MATH is 1. Integers are always looked up, which is exact. 
+inline double
+uvc_log(const double x) {
+    if (x >= 0 && x < MATH_TABLE_MAX_COUNT) {
+        const int count = (int)x;
+        if (count == x) { return STATIC_MATH_TABLES.count_to_log[count]; }
+    }
+    return (COMPILATION_EXACT_MATH ? log(x) : uvc_approx_log(x));
+}
+
+// Same as pow(10.0, phred/10.0) if COMPILATION_EXACT_MATH is 1. Integers are always looked up, which is exact. 
+inline double
+uvc_phred2numstates(const double phred) {
+    if (phred >= -MATH_TABLE_MAX_PHRED && phred <= MATH_TABLE_MAX_PHRED) {
+        const int iphred = (int)phred;
+        if (iphred == phred) { return STATIC_MATH_TABLES.phred_to_numstates[iphred + MATH_TABLE_MAX_PHRED]; }
+    }
+    return (COMPILATION_EXACT_MATH ? pow(10.0, phred/10.0) : exp(phred * (log(10.0)/10.0)));
+}
+
 // conversion between Phred, nat, bit, frac, and states
 
 #define  phred2nat(x) ((log(10.0)/10.0) * (x))
 #define  nat2phred(x) ((10.0/log(10.0)) * (x))
-#define frac2phred(x) (-(10.0/log(10.0)) * log(x))
-#define phred2frac(x) (pow(10.0, (-x)/10.0))
-#define numstates2phred(x) ((10.0/log(10.0)) * log(x))
-#define phred2numstates(x) (pow(10.0, (x)/10.0))
-#define numstates2deciphred(x) ((uvc1_qual_t)round((100.0/log(10.0)) * log(x)))
+#define frac2phred(x) (-(10.0/log(10.0)) * uvc_log(x))
+#define phred2frac(x) (uvc_phred2numstates((-x)))
+#define numstates2phred(x) ((10.0/log(10.0)) * uvc_log(x))
+#define phred2numstates(x) (uvc_phred2numstates((x)))
+#define numstates2deciphred(x) ((uvc1_qual_t)round((100.0/log(10.0)) * uvc_log(x)))
 
 #define bam_get_strand(aln) ((((aln)->core.flag & 0x81) == 0x81) ? (!!((aln)->core.flag & 0x20)) : (!!((aln)->core.flag & 0x10)))
 
@@ -156,6 +239,10 @@ struct RegionalTandemRepeat {
     uvc1_refgpos_t anyTR_begpos = 0;
     uvc1_readpos_t anyTR_tracklen = 0;
     uvc1_readpos_t anyTR_unitlen = 0;
+    
+    // The short tandem repeat that begins at this position, which ends at fwdSTR_endpos (exclusive)
+    uvc1_readpos_t fwdSTR_unitlen = 0;
+    uvc1_refgpos_t fwdSTR_endpos = 0;
 };
 
 struct RevComplement {
@@ -216,6 +303,65 @@ anyuint2hexstring(T n) {
     return ret;
 }
 
+// Decimal strings of 00 to 99 concatenated, so that integers can be converted to text two digits at a time. 
+const static char TWO_DIGIT_DECIMAL_CHARS[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+const static uint64_t POWERS_OF_TEN[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL, 
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL, 
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL };
+
+// Number of decimal digits of x, which is computed from the bit length of x without any loop (log10(2) is about 1233/4096). 
+inline size_t
+uvc_count_decimal_digits(const uint64_t x) {
+    const uint64_t x1 = (x | 1); // zero has one digit, and no power of ten is between x and x1
+    const size_t t = (((size_t)(64 - __builtin_clzll(x1))) * 1233) >> 12;
+    return t + 1 - (size_t)(x1 < POWERS_OF_TEN[t]);
+}
+
+// Write the decimal digits of x to buf, which must have space for at least 20 chars, and return the number of chars written. 
+inline size_t
+uvc_u64_to_chars(char *buf, uint64_t x) {
+    const size_t ndigits = uvc_count_decimal_digits(x);
+    char *p = buf + ndigits;
+    while (x >= 100) {
+        const size_t i = (size_t)(x % 100) * 2;
+        x /= 100;
+        p -= 2;
+        p[0] = TWO_DIGIT_DECIMAL_CHARS[i];
+        p[1] = TWO_DIGIT_DECIMAL_CHARS[i + 1];
+    }
+    if (x >= 10) {
+        p[-2] = TWO_DIGIT_DECIMAL_CHARS[x * 2];
+        p[-1] = TWO_DIGIT_DECIMAL_CHARS[x * 2 + 1];
+    } else {
+        p[-1] = (char)('0' + x);
+    }
+    return ndigits;
+}
+
+// Same as outstring += std::to_string(x) for any integer x except that no temporary string is allocated. 
+template <class T>
+inline void
+uvc_append_int(std::string & outstring, const T x) {
+    char buf[24];
+    size_t n;
+    if (x < 0) {
+        buf[0] = '-';
+        n = 1 + uvc_u64_to_chars(buf + 1, (uint64_t)0 - (uint64_t)(int64_t)x);
+    } else {
+        n = uvc_u64_to_chars(buf, (uint64_t)x);
+    }
+    outstring.append(buf, n);
+}
+
+// Same as outstring += std::to_string(x), which uses the format %f, except that no temporary string is allocated. 
+inline void
+uvc_append_float(std::string & outstring, const float x) {
+    char buf[64]; // FLT_MAX has 39 digits before the decimal point
+    const int n = snprintf(buf, sizeof(buf), "%f", (double)x);
+    outstring.append(buf, MIN((size_t)n, sizeof(buf) - 1));
+}
+
 template <class T>
 inline void
 compare_diff_less(bool & isdiff, bool & isless, const T & k1, const T & k2) {
@@ -2,13 +2,11 @@
 #include "logging.hpp"
 #include "Hash.hpp"
 
+#include <cmath>
+
 //#define MAX_NUM_REF_BASES (1000*1000)
 //#define MAX_NUM_READS (2000*1000)
 
-// at 150*16 average sequencing depth, the two below amount of bytes are approx equal to each other.
-#define NUM_BYTES_PER_REF_POS ((size_t)(1024*8)) // estimated
-#define NUM_BYTES_PER_READ ((size_t)(512)) // estimated
-
 #define UPDATE_MIN(a, b) ((a) = MIN((a), (b)));
 
 template <class T>
@@ -25,6 +23,33 @@ const uvc1_readpos_t ARRPOS_INNER_RANGE = 3;
 
 // const RevComplement THE_REV_COMPLEMENT;
 
+// Set of read names keyed by their 64-bit hash values (see strhash). 
+// The set refers to the read names without copying them, so each read name must outlive the set. 
+// A read name whose hash value collides with a different read name that is already in the set is kept in a fallback set of strings. 
+struct QnameHashSet {
+    std::unordered_map<uvc1_hash_t, const char *> hash_to_qname;
+    std::set<std::string> collided_qnames;
+    
+    void
+    insert(const char *qname, const uvc1_hash_t qname_hash) {
+        auto hash_to_qname_it = hash_to_qname.insert(std::make_pair(qname_hash, qname)).first;
+        if (hash_to_qname_it->second != qname && strcmp(hash_to_qname_it->second, qname)) {
+            collided_qnames.insert(qname);
+        }
+    };
+    bool
+    contains(const char *qname, const uvc1_hash_t qname_hash) const {
+        auto hash_to_qname_it = hash_to_qname.find(qname_hash);
+        if (hash_to_qname.end() == hash_to_qname_it) { return false; }
+        if (hash_to_qname_it->second == qname || !strcmp(hash_to_qname_it->second, qname)) { return true; }
+        return (collided_qnames.find(qname) != collided_qnames.end());
+    };
+    size_t
+    size() const {
+        return hash_to_qname.size() + collided_qnames.size();
+    };
+};
+
 bool
 check_if_is_over_mem_lim(
         const uvc1_readnum_big_t total_n_reads, 
@@ -34,12 +59,13 @@ check_if_is_over_mem_lim(
         // const uvc1_refgpos_big_t total_n_regions,
         const size_t nthreads, 
         const size_t mem_per_thread,
-        const bool is_fastq_gen) {
+        const bool is_fastq_gen,
+        const std::array<size_t, 3> & mem_rates) {
     
-    const size_t tmp_n_bytes_used_by_reads = INT64MUL(MIN(total_n_reads_x_reads / MAX(1, total_n_reads) * nthreads, (size_t)total_n_reads), NUM_BYTES_PER_READ);
-    const size_t tmp_n_bytes_used_by_rposs = INT64MUL(MIN(total_n_rposs_x_rposs / MAX(1, total_n_rposs) * nthreads, (size_t)total_n_rposs) + (2 * MAX_STR_N_BASES * nthreads), NUM_BYTES_PER_REF_POS);
-    const size_t vcf_n_bytes_used_by_rposs = INT64MUL(total_n_rposs, 1024); // estimate from the htslib specs of VCF
-    const size_t fqs_n_bytes_used_by_reads = (is_fastq_gen ? (INT64MUL(total_n_reads, NUM_BYTES_PER_READ) / 4) : 0); // consensus and compression
+    const size_t tmp_n_bytes_used_by_reads = INT64MUL(MIN(total_n_reads_x_reads / MAX(1, total_n_reads) * nthreads, (size_t)total_n_reads), mem_rates[MemoryGovernor::BYTES_PER_READ]);
+    const size_t tmp_n_bytes_used_by_rposs = INT64MUL(MIN(total_n_rposs_x_rposs / MAX(1, total_n_rposs) * nthreads, (size_t)total_n_rposs) + (2 * MAX_STR_N_BASES * nthreads), mem_rates[MemoryGovernor::BYTES_PER_REF_POS]);
+    const size_t vcf_n_bytes_used_by_rposs = INT64MUL(total_n_rposs, mem_rates[MemoryGovernor::OUT_BYTES_PER_REF_POS]);
+    const size_t fqs_n_bytes_used_by_reads = (is_fastq_gen ? (INT64MUL(total_n_reads, mem_rates[MemoryGovernor::BYTES_PER_READ]) / 4) : 0); // consensus and compression
     
     const size_t tot_n_bytes_used = tmp_n_bytes_used_by_reads + tmp_n_bytes_used_by_rposs + vcf_n_bytes_used_by_rposs + fqs_n_bytes_used_by_reads;
     return (tot_n_bytes_used > ((1024UL*1024UL) * mem_per_thread * nthreads));
@@ -53,10 +79,11 @@ check_if_sub_is_over_mem_lim(
         // const uvc1_readnum_big_t total_n_rposs_x_rposs,
         size_t mem_per_thread,
         size_t curr_beg,
-        size_t block_running_end) {
+        size_t block_running_end,
+        const std::array<size_t, 3> & mem_rates) {
     
-    const size_t tmp_n_bytes_used_by_reads = INT64MUL(region_n_reads, NUM_BYTES_PER_READ);
-    const size_t tmp_n_bytes_used_by_rposs = INT64MUL(region_n_rposs, NUM_BYTES_PER_REF_POS + 1024);
+    const size_t tmp_n_bytes_used_by_reads = INT64MUL(region_n_reads, mem_rates[MemoryGovernor::BYTES_PER_READ]);
+    const size_t tmp_n_bytes_used_by_rposs = INT64MUL(region_n_rposs, mem_rates[MemoryGovernor::BYTES_PER_REF_POS] + mem_rates[MemoryGovernor::OUT_BYTES_PER_REF_POS]);
     
     const size_t memfree = ((1024UL*1024UL) / NUM_WORKING_UNITS_PER_THREAD) * mem_per_thread;
     // more overlap -> more mem -> less likely to return true
@@ -154,6 +181,122 @@ SamIter::bed_fname_to_contigs(
     return 0;
 }
 
+// Approximate offset in the compressed BAM file, where each BAM block is assumed to be compressed about four fold. 
+static uint64_t
+voffset_to_approx_coffset(uint64_t voffset) {
+    return (voffset >> 16) + ((voffset & 0xFFFF) >> 2);
+}
+
+// Approximate number of compressed bytes of the index chunks that may contain the reads overlapping the region. 
+// The chunks are found from the bins and the linear index without reading any alignment record. 
+static uint64_t
+index_region_to_approx_nbytes(const hts_idx_t *sam_idx, uvc1_refgpos_t tid, uvc1_refgpos_t beg, uvc1_refgpos_t end) {
+    hts_itr_t *hts_itr = sam_itr_queryi(sam_idx, tid, beg, end);
+    if (NULL == hts_itr) { return 0; }
+    uint64_t ret = 0;
+    for (int i = 0; i < hts_itr->n_off; i++) {
+        ret += non_neg_minus(voffset_to_approx_coffset(hts_itr->off[i].v), voffset_to_approx_coffset(hts_itr->off[i].u));
+    }
+    sam_itr_destroy(hts_itr);
+    return ret;
+}
+
+int64_t
+SamIter::estimate_nreads_by_index(
+        uvc1_refgpos_t tid,
+        uvc1_refgpos_t beg,
+        uvc1_refgpos_t end) {
+    if (_tid_to_nreads_per_idx_byte[tid] < 0) {
+        uint64_t n_mapped, n_unmapped;
+        if (hts_idx_get_stat(this->sam_idx, tid, &n_mapped, &n_unmapped) < 0) { return -1; }
+        const uint64_t tid_nbytes = index_region_to_approx_nbytes(this->sam_idx, tid, 0, this->samheader->target_len[tid]);
+        _tid_to_nreads_per_idx_byte[tid] = ((0 == n_mapped || 0 == tid_nbytes) ? 0.0 : ((double)n_mapped / (double)tid_nbytes));
+    }
+    if (0 == _tid_to_nreads_per_idx_byte[tid]) { return 0; }
+    const uint64_t nbytes = index_region_to_approx_nbytes(this->sam_idx, tid, beg, end);
+    return (int64_t)ceil((double)nbytes * _tid_to_nreads_per_idx_byte[tid]);
+}
+
+int64_t
+SamIter::iternext_by_index(
+        std::vector<BedLine> & bedlines,
+        const std::array<size_t, 3> & mem_rates) {
+    uvc1_readnum_big_t total_n_reads = 0;
+    uvc1_refgpos_big_t total_n_rposs = 0;
+    uvc1_readnum_big_t total_n_reads_x_reads = 0;
+    uvc1_refgpos_big_t total_n_rposs_x_rposs = 0;
+    uvc1_refgpos_t region_beg = _idx_beg;
+    uvc1_readnum_big_t region_n_reads = 0;
+    // The same flags as in iternext are used to indicate why each region ends. 
+    auto flush_region = [&](uvc1_refgpos_t region_end, uvc1_flag_t region_flag) {
+        if (region_beg < region_end && region_n_reads > 0) {
+            bedlines.push_back(BedLine(_idx_tid, region_beg, region_end, region_flag, region_n_reads));
+            total_n_reads += region_n_reads;
+            total_n_rposs += region_end - region_beg;
+            total_n_reads_x_reads += mathsquare_big(region_n_reads);
+            total_n_rposs_x_rposs += mathsquare_big(region_end - region_beg);
+        }
+        region_beg = region_end;
+        region_n_reads = 0;
+        return check_if_is_over_mem_lim(
+                total_n_reads, total_n_reads_x_reads, 
+                total_n_rposs, total_n_rposs_x_rposs, 
+                this->nthreads, this->mem_per_thread,
+                this->is_fastq_gen, mem_rates);
+    };
+    for (; _idx_tid < UNSIGN2SIGN(this->samheader->n_targets); _idx_tid++, _idx_beg = 0, region_beg = 0) {
+        const uvc1_refgpos_t tlen = this->samheader->target_len[_idx_tid];
+        while (_idx_beg < tlen) {
+            // The bins are aligned to multiples of index_partition_bin_size even if the previous call stopped in the middle of a deep bin, 
+            //   in which case the reads of the rest of the bin are estimated from the whole bin. 
+            const uvc1_refgpos_t aligned_bin_beg = (_idx_beg / index_partition_bin_size) * index_partition_bin_size;
+            const uvc1_refgpos_t bin_end = MIN(tlen, aligned_bin_beg + index_partition_bin_size);
+            const uvc1_readnum_big_t aligned_bin_n_reads = estimate_nreads_by_index(_idx_tid, aligned_bin_beg, bin_end);
+            const uvc1_readnum_big_t bin_n_reads = ((aligned_bin_beg == _idx_beg || aligned_bin_n_reads <= 0) ? aligned_bin_n_reads 
+                    : (aligned_bin_n_reads * (bin_end - _idx_beg) / (bin_end - aligned_bin_beg) + 1));
+            if (bin_n_reads <= 0) {
+                // the uncovered bin is skipped
+                const bool is_over_mem_lim = flush_region(_idx_beg, 0x8);
+                region_beg = _idx_beg = bin_end;
+                if (is_over_mem_lim) { return total_n_reads; }
+                continue;
+            }
+            if (region_n_reads > 0 && check_if_sub_is_over_mem_lim(region_n_reads + bin_n_reads, bin_end - region_beg, 
+                    this->mem_per_thread, _idx_beg, bin_end, mem_rates)) {
+                if (flush_region(_idx_beg, 0x4)) { return total_n_reads; }
+            }
+            if (check_if_sub_is_over_mem_lim(bin_n_reads, bin_end - _idx_beg, this->mem_per_thread, _idx_beg, bin_end, mem_rates)) {
+                // The bin is too deep to be one region, so it is split into parts that are assumed to have the same number of reads, 
+                //   because the index cannot resolve the reads at a resolution finer than its smallest bins. 
+                uvc1_refgpos_t nparts = 2;
+                while (nparts < bin_end - _idx_beg && check_if_sub_is_over_mem_lim(bin_n_reads / nparts, (bin_end - _idx_beg) / nparts, 
+                        this->mem_per_thread, _idx_beg, bin_end, mem_rates)) {
+                    nparts *= 2;
+                }
+                nparts = MIN(nparts, bin_end - _idx_beg);
+                const uvc1_refgpos_t bin_beg = _idx_beg;
+                for (uvc1_refgpos_t part_idx = 0; part_idx < nparts; part_idx++) {
+                    region_n_reads = MAX(1, bin_n_reads / nparts);
+                    region_beg = bin_beg + (bin_end - bin_beg) * part_idx / nparts;
+                    const bool is_over_mem_lim = flush_region(bin_beg + (bin_end - bin_beg) * (part_idx + 1) / nparts, 0x4);
+                    _idx_beg = region_beg;
+                    if (is_over_mem_lim) { return total_n_reads; }
+                }
+                continue;
+            }
+            region_n_reads += bin_n_reads;
+            _idx_beg = bin_end;
+        }
+        const bool is_over_mem_lim = flush_region(tlen, 0x10);
+        if (is_over_mem_lim) {
+            _idx_tid++;
+            _idx_beg = 0;
+            return total_n_reads;
+        }
+    }
+    return total_n_reads;
+}
+
 int64_t
 SamIter::iternext(
         uvc1_flag_t & iter_ret_flag,
@@ -165,6 +308,9 @@ SamIter::iternext(
     uvc1_refgpos_big_t total_n_rposs = 0;
     uvc1_readnum_big_t total_n_reads_x_reads = 0;
     uvc1_refgpos_big_t total_n_rposs_x_rposs = 0;
+    // the rates are updated by the workers concurrently, so they are fixed for each tier-1 region
+    const std::array<size_t, 3> mem_rates = ((NULL != this->mem_governor) ? this->mem_governor->get_rates() 
+            : std::array<size_t, 3> {{ NUM_BYTES_PER_READ, NUM_BYTES_PER_REF_POS, NUM_OUT_BYTES_PER_REF_POS }});
     if (this->_bedlines.size() > 0) {
         for (; this->_bedregion_idx < this->_bedlines.size(); this->_bedregion_idx++) {
             const auto & bedline = (this->_bedlines[this->_bedregion_idx]);
@@ -173,7 +319,10 @@ SamIter::iternext(
             const auto bed_beg = bedline.beg_pos;
             const auto bed_end = bedline.end_pos;
             int64_t region_n_reads = INT64MUL(bed_in_avg_sequencing_DP, (bed_end - bed_beg)); // Please note that left-over reads from the previoous iteration are ignored
-            if (-1 == bed_in_avg_sequencing_DP) {
+            if (-1 == bed_in_avg_sequencing_DP && index_partition_bin_size > 0) {
+                region_n_reads = estimate_nreads_by_index(bed_tid, bed_beg, bed_end);
+            }
+            if (-1 == bed_in_avg_sequencing_DP && region_n_reads < 0) {
                 hts_itr_t *hts_itr = sam_itr_queryi(this->sam_idx, bed_tid, bed_beg, bed_end);
                 if (NULL == hts_itr) {
                     LOG(logERROR) << "Error when fetching region tid=" << bed_tid << ":" << bed_beg << "-" <<  bed_end << ", aborting now. ";
@@ -202,12 +351,19 @@ SamIter::iternext(
                     total_n_rposs, total_n_rposs_x_rposs, 
                     // total_n_regions, 
                     this->nthreads, this->mem_per_thread,
-                    this->is_fastq_gen);
+                    this->is_fastq_gen, mem_rates);
             if (is_over_mem_lim) {
                 this->_bedregion_idx++;
                 return total_n_reads;
             }
         }
+    } else if (index_partition_bin_size > 0) {
+        const int64_t ret = iternext_by_index(bedlines, mem_rates);
+        if (_idx_tid >= UNSIGN2SIGN(this->samheader->n_targets)) {
+            // the regions of the last template are returned together with the end-of-iteration flag
+            iter_ret_flag |= 0x1;
+        }
+        return ret;
     } else {
         
         uvc1_refgpos_t block_tid = this->last_it_tid;
@@ -235,7 +391,7 @@ SamIter::iternext(
             const bool is_sub_mem_over_lim = check_if_sub_is_over_mem_lim(
                     region_n_reads, // region_n_reads_x_reads, 
                     region_n_ref_positions + region_n_ref_positions_add, // region_n_rposs_x_rposs,
-                    this->mem_per_thread, curr_beg, block_running_end);
+                    this->mem_per_thread, curr_beg, block_running_end, mem_rates);
             const bool is_template_changed = (curr_tid != block_tid);
             // is_very_far_jumped results in a lot of wasted mem-alloc and computation, so it is not used
             //const bool is_very_far_jumped = ((curr_tid == block_tid) && (block_running_end + MAX_INSERT_SIZE < curr_beg));
@@ -288,7 +444,7 @@ SamIter::iternext(
                         total_n_rposs, total_n_rposs_x_rposs, 
                         // total_n_regions, 
                         this->nthreads, this->mem_per_thread,
-                        this->is_fastq_gen);
+                        this->is_fastq_gen, mem_rates);
                 if (is_over_mem_lim) {
                     this->last_it_tid = block_tid;
                     this->last_it_beg = block_beg;
@@ -423,14 +579,26 @@ poscounter_to_pos2pcenter(
         const std::vector<uvc1_readnum_t> & pos_to_count, 
         const double dedup_center_mult) {
     
+    // dist_to_mult[d] is the same as pow(dedup_center_mult, d)
+    std::array<double, ARRPOS_INNER_RANGE + 1> dist_to_mult;
+    for (uvc1_readpos_t dist = 0; dist <= ARRPOS_INNER_RANGE; dist++) {
+        dist_to_mult[dist] = pow(dedup_center_mult, dist);
+    }
     for (uvc1_refgpos_t locov_pos = ARRPOS_INNER_RANGE; locov_pos < UNSIGN2SIGN(pos_to_count.size()) - ARRPOS_INNER_RANGE; locov_pos++) {
         auto locov_count = pos_to_count[locov_pos];
         pos_to_center_pos[locov_pos] = locov_pos;
+        // A position can be attracted only by a neighbor with a higher count, and most positions (e.g., the ones in the margins) have no such neighbor. 
+        // This branch-free max can be vectorized by the compiler. 
+        uvc1_readnum_t window_max_count = locov_count;
+        for (auto hicov_pos = locov_pos - ARRPOS_INNER_RANGE; hicov_pos < locov_pos + ARRPOS_INNER_RANGE + 1; hicov_pos++) {
+            window_max_count = MAX(window_max_count, pos_to_count[hicov_pos]);
+        }
+        if (window_max_count <= locov_count) { continue; }
         auto max_count = locov_count;
         // check if inner_pos is attracted by outer position
         for (auto hicov_pos = locov_pos - ARRPOS_INNER_RANGE; hicov_pos < locov_pos + ARRPOS_INNER_RANGE + 1; hicov_pos++) {
             auto hicov_count = pos_to_count[hicov_pos];
-            if ((hicov_count > max_count) && ((hicov_count + 1) > (locov_count + 1) * pow(dedup_center_mult, unsigned_diff(locov_pos, hicov_pos)))) {
+            if ((hicov_count > max_count) && ((hicov_count + 1) > (locov_count + 1) * dist_to_mult[unsigned_diff(locov_pos, hicov_pos)])) {
                 pos_to_center_pos[locov_pos] = hicov_pos;
                 max_count = hicov_count;
             }
@@ -439,21 +607,6 @@ poscounter_to_pos2pcenter(
     return 0;
 }
 
-int 
-clean_fill_strand_umi_readset(
-        std::vector<std::array<std::vector<std::vector<bam1_t *>>, 2>> &umi_strand_readset) {
-    for (auto & strand_readset : umi_strand_readset) {
-        for (int strand = 0; strand < 2; strand++) {
-            for (auto & read : strand_readset[strand]) {
-                for (bam1_t *aln : read) {
-                    bam_destroy1(aln);
-                }
-            }
-        }
-    }
-    return 0;
-}
-
 int 
 apply_bq_err_correction3(bam1_t *aln, const uvc1_qual_t assay_sequencing_BQ_max, const uvc1_qual_t assay_sequencing_BQ_inc) {
     if ((0 == aln->core.l_qseq) || (aln->core.flag & 0x4)) { return -1; }
@@ -543,16 +696,18 @@ apply_bq_err_correction3(bam1_t *aln, const uvc1_qual_t assay_sequencing_BQ_max,
 int 
 fill_strand_umi_readset_with_strand_to_umi_to_reads(
         std::vector<std::pair<std::array<std::vector<std::vector<bam1_t *>>, 2>, MolecularBarcode>> &umi_strand_readset,
-        std::map<MolecularBarcode, std::pair<std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>, MolecularBarcode>> &umi_to_strand_to_reads,
+        MoleculeToStrandToReads &umi_to_strand_to_reads,
         const CommandLineArgs & paramset,
         const uvc1_flag_t specialflag IGNORE_UNUSED_PARAM) {
-    for (auto & umi_to_strand_to_reads_element : umi_to_strand_to_reads) {
-        const auto strand_to_reads = umi_to_strand_to_reads_element.second.first;
-        const auto dflag = umi_to_strand_to_reads_element.second.second;
+    // The molecules are sorted by their keys so that the order of the families is deterministic. 
+    for (const uint32_t umi_idx : umi_to_strand_to_reads.getSortedIdxs()) {
+        const auto & umi_to_strand_to_reads_element = umi_to_strand_to_reads.at(umi_idx);
+        const auto & strand_to_reads = umi_to_strand_to_reads_element.second.first;
+        const auto & dflag = umi_to_strand_to_reads_element.second.second;
         umi_strand_readset.push_back(std::make_pair(std::array<std::vector<std::vector<bam1_t *>>, 2>(), dflag));
         for (int strand = 0; strand < 2; strand++) {
-            for (auto read : strand_to_reads[strand]) {
-                const std::vector<bam1_t *> alns = read.second;
+            for (const auto & read : strand_to_reads[strand]) {
+                const std::vector<bam1_t *> & alns = read.second;
                 umi_strand_readset.back().first[strand].push_back(std::vector<bam1_t *>());
                 for (auto aln : alns) {
                     apply_bq_err_correction3(aln, paramset.assay_sequencing_BQ_max, paramset.assay_sequencing_BQ_inc);
@@ -603,11 +758,52 @@ bam2umihash(int & is_umi_found, const bam1_t *aln, const std::vector<uint8_t> &
     return 0;
 };
 
+std::vector<std::pair<uvc1_refgpos_t, uvc1_refgpos_t>>
+depths_to_covered_islands(
+        const std::vector<uvc1_readnum_t> & pos_to_depth,
+        uvc1_refgpos_t fetch_tbeg, 
+        uvc1_refgpos_t fetch_tend, 
+        uvc1_readnum_t min_depth,
+        const std::vector<uvc1_refgpos_t> & forced_positions,
+        uvc1_refgpos_t island_margin,
+        uvc1_refgpos_t min_gap_len) {
+    assertUVC (fetch_tend > fetch_tbeg && pos_to_depth.size() == (size_t)(fetch_tend - fetch_tbeg));
+    std::vector<bool> pos_to_is_covered(fetch_tend - fetch_tbeg, false);
+    for (uvc1_refgpos_t pos = fetch_tbeg; pos < fetch_tend; pos++) {
+        pos_to_is_covered[pos - fetch_tbeg] = (pos_to_depth[pos - fetch_tbeg] >= min_depth);
+    }
+    for (const auto pos : forced_positions) {
+        if (fetch_tbeg <= pos && pos < fetch_tend) { pos_to_is_covered[pos - fetch_tbeg] = true; }
+    }
+    
+    std::vector<std::pair<uvc1_refgpos_t, uvc1_refgpos_t>> islands;
+    for (uvc1_refgpos_t pos = fetch_tbeg; pos < fetch_tend; pos++) {
+        if (!pos_to_is_covered[pos - fetch_tbeg]) { continue; }
+        const uvc1_refgpos_t island_beg = MAX(fetch_tbeg, pos - island_margin);
+        while (pos < fetch_tend && pos_to_is_covered[pos - fetch_tbeg]) { pos++; }
+        const uvc1_refgpos_t island_end = MIN(fetch_tend, pos + island_margin);
+        if (islands.size() > 0 && island_beg < islands.back().second + min_gap_len) {
+            islands.back().second = island_end;
+        } else {
+            islands.push_back(std::make_pair(island_beg, island_end));
+        }
+    }
+    // the gaps at both ends of the region are also kept if they are too short to be skipped
+    if (islands.size() > 0 && islands[0].first < fetch_tbeg + min_gap_len) {
+        islands[0].first = fetch_tbeg;
+    }
+    if (islands.size() > 0 && fetch_tend < islands.back().second + min_gap_len) {
+        islands.back().second = fetch_tend;
+    }
+    return islands;
+}
+
 std::array<uvc1_readnum_big_t, 3>
 bamfname_to_strand_to_familyuid_to_reads(
-        std::map<MolecularBarcode, std::pair<std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>, MolecularBarcode>> &umi_to_strand_to_reads,
+        MoleculeToStrandToReads &umi_to_strand_to_reads,
         uvc1_refgpos_t & extended_inclu_beg_pos, 
         uvc1_refgpos_t & extended_exclu_end_pos,
+        std::vector<uvc1_readnum_t> * pos_to_aln_depth,
         uvc1_refgpos_t tid, 
         uvc1_refgpos_t fetch_tbeg, 
         uvc1_refgpos_t fetch_tend, 
@@ -617,6 +813,8 @@ bamfname_to_strand_to_familyuid_to_reads(
         const std::string UMI_STRUCT_STRING, 
         samFile *sam_infile,
         const hts_idx_t * hts_idx,
+        BamRecordCache * bam_record_cache,
+        BamRecordSlab & bam_record_slab,
         size_t thread_id,
         const CommandLineArgs & paramset,
         const uvc1_flag_t specialflag IGNORE_UNUSED_PARAM) {
@@ -651,18 +849,32 @@ bamfname_to_strand_to_familyuid_to_reads(
     std::vector<uvc1_readnum_big_t> inicount64(fetch_size + 1, 0);
     std::array<std::vector<uvc1_readnum_big_t>, 4> isrc_isr2_to_border_count_prefixsum = {{ inicount64, inicount64, inicount64, inicount64 }};;
     
-    hts_itr_t * hts_itr;
-    bam1_t *aln = bam_init1();
-    
-    std::set<std::string> visited_qnames;
+    QnameHashSet visited_qnames;
     uvc1_readnum_big_t num_iter1_passed_alns = 0;
     // Although the following line can speed up things, it may result in different output depending on tid:fetch_tbeg-fetch_tend
     // hts_itr = sam_itr_queryi(hts_idx, tid, fetch_tbeg, fetch_tend);
     // Hence, the following line is used instead
-    hts_itr = sam_itr_queryi(hts_idx, tid, non_neg_minus(fetch_tbeg, MAX_INSERT_SIZE), (fetch_tend + MAX_INSERT_SIZE));
+    // The records are decoded only once and then kept in memory for the second iteration. 
+    // If no cache is used, then the records are decoded directly into bam_record_slab, 
+    //   so each record that is kept by the second iteration is referred to by umi_to_strand_to_reads without any copy.
+    // Otherwise, the records are owned by the cache shared with the neighboring regions, so each kept record is copied into bam_record_slab
+    //   because its base qualities are modified later. 
+    // In both cases, the records referred to by umi_to_strand_to_reads are released all at once together with bam_record_slab. 
+    const bool is_fetched_alns_in_slab = (NULL == bam_record_cache);
+    int sam_itr_ret = 0;
+    std::vector<bam1_t *> fetched_alns;
+    if (is_fetched_alns_in_slab) {
+        fetched_alns = load_bam_records_into_slab(sam_itr_ret, bam_record_slab, sam_infile, hts_idx, 
+                tid, non_neg_minus(fetch_tbeg, MAX_INSERT_SIZE), (fetch_tend + MAX_INSERT_SIZE));
+    } else {
+        sam_itr_ret = bam_record_cache->query(fetched_alns, sam_infile, hts_idx, 
+                tid, non_neg_minus(fetch_tbeg, MAX_INSERT_SIZE), (fetch_tend + MAX_INSERT_SIZE));
+    }
+    if (sam_itr_ret < -1) {
+        LOG(logWARNING) << "Thread " << thread_id << " encountered the iterator error code " << sam_itr_ret << " while fetching the chunk tid" << tid << ":" << fetch_tbeg << "-" << fetch_tend;
+    }
     
-    while (sam_itr_next(sam_infile, hts_itr, aln) >= 0) { 
-    //for (const bam1_t *aln : bam_list){
+    for (bam1_t *aln : fetched_alns) {
         bool isrc = false;
         bool isr2 = false;
         uvc1_refgpos_t tBeg = 0;
@@ -686,36 +898,62 @@ bamfname_to_strand_to_familyuid_to_reads(
             if (endidx >= 0 && ((size_t)endidx) < isrc_isr2_to_end_count[isrc * 2 + isr2].size()) { isrc_isr2_to_end_count[isrc * 2 + isr2][endidx] += 1; }
             
             if (ARE_INTERVALS_OVERLAPPING(MIN(tBeg, tEnd), MAX(tBeg, tEnd) + 2, fetch_tbeg, fetch_tend)) {
-                visited_qnames.insert(bam_get_qname(aln));
+                visited_qnames.insert(bam_get_qname(aln), strhash(bam_get_qname(aln), 31UL));
             }
             num_iter1_passed_alns++;
         }
     }
-    sam_itr_destroy(hts_itr);
     
+    if (NULL != pos_to_aln_depth) {
+        // The begin is after the end if the fragment is on the reverse strand (isrc xor isr2), 
+        //   so each count array is added to the depth differences with the sign for its strand. 
+        std::vector<uvc1_readnum_big_t> depth_diffs(fetch_size + 1, 0);
+        for (size_t isrc_isr2 = 0; isrc_isr2 < 4; isrc_isr2++) {
+            const bool is_rev = (((isrc_isr2 >> 1) ^ isrc_isr2) & 0x1);
+            const auto & left_to_count = (is_rev ? isrc_isr2_to_end_count[isrc_isr2] : isrc_isr2_to_beg_count[isrc_isr2]);
+            const auto & right_to_count = (is_rev ? isrc_isr2_to_beg_count[isrc_isr2] : isrc_isr2_to_end_count[isrc_isr2]);
+            for (size_t i = 0; i < left_to_count.size(); i++) {
+                depth_diffs[i] += left_to_count[i];
+                depth_diffs[i + 1] -= right_to_count[i];
+            }
+        }
+        pos_to_aln_depth->resize(fetch_tend - fetch_tbeg);
+        uvc1_readnum_big_t depth = 0;
+        for (uvc1_refgpos_t i = 0; i < ARRPOS_MARGIN; i++) {
+            depth += depth_diffs[i];
+        }
+        for (uvc1_refgpos_t pos = fetch_tbeg; pos < fetch_tend; pos++) {
+            depth += depth_diffs[pos + ARRPOS_MARGIN - fetch_tbeg];
+            (*pos_to_aln_depth)[pos - fetch_tbeg] = (uvc1_readnum_t)MIN(depth, (uvc1_readnum_big_t)INT32_MAX);
+        }
+    }
+    
+    // The element-wise sum of the beg and end counts is vectorized by the compiler, so the sequential prefix sum only does one addition per position.
     for (size_t isrc_isr2 = 0; isrc_isr2 < 4; isrc_isr2++) {
-        uvc1_readnum_big_t beg_prefixsum = 0;
-        uvc1_readnum_big_t end_prefixsum = 0;
-        isrc_isr2_to_border_count_prefixsum[isrc_isr2][0] = (beg_prefixsum + end_prefixsum);
-        for (size_t i = 0; i < isrc_isr2_to_border_count_prefixsum[isrc_isr2].size() - 1; i++) {
-            beg_prefixsum += isrc_isr2_to_beg_count[isrc_isr2][i];
-            end_prefixsum += isrc_isr2_to_end_count[isrc_isr2][i];
-            isrc_isr2_to_border_count_prefixsum[isrc_isr2][i+1] = (beg_prefixsum + end_prefixsum);
+        const auto & beg_to_count = isrc_isr2_to_beg_count[isrc_isr2];
+        const auto & end_to_count = isrc_isr2_to_end_count[isrc_isr2];
+        auto & border_count_prefixsum = isrc_isr2_to_border_count_prefixsum[isrc_isr2];
+        for (size_t i = 0; i < border_count_prefixsum.size() - 1; i++) {
+            border_count_prefixsum[i+1] = (uvc1_readnum_big_t)beg_to_count[i] + (uvc1_readnum_big_t)end_to_count[i];
+        }
+        border_count_prefixsum[0] = 0;
+        for (size_t i = 0; i < border_count_prefixsum.size() - 1; i++) {
+            border_count_prefixsum[i+1] += border_count_prefixsum[i];
         }
     }
     std::array<std::vector<uvc1_refgpos_t>, 4> isrc_isr2_to_beg2bcenter = {{ inicount, inicount, inicount, inicount }};
     for (size_t isrc_isr2 = 0; isrc_isr2 < 4; isrc_isr2++) {
-        auto beg_to_count = isrc_isr2_to_beg_count[isrc_isr2];
+        const auto & beg_to_count = isrc_isr2_to_beg_count[isrc_isr2];
         poscounter_to_pos2pcenter(isrc_isr2_to_beg2bcenter[isrc_isr2], beg_to_count, paramset.dedup_center_mult);
     }
     std::array<std::vector<uvc1_refgpos_t>, 4> isrc_isr2_to_end2ecenter = {{ inicount, inicount, inicount, inicount }};
     for (size_t isrc_isr2 = 0; isrc_isr2 < 4; isrc_isr2++) {
-        auto end_to_count = isrc_isr2_to_end_count[isrc_isr2];
+        const auto & end_to_count = isrc_isr2_to_end_count[isrc_isr2];
         poscounter_to_pos2pcenter(isrc_isr2_to_end2ecenter[isrc_isr2], end_to_count, paramset.dedup_center_mult);
     }
     
     uvc1_readnum_t beg_peak_max = 0;
-    for (auto beg_count : isrc_isr2_to_beg_count) {
+    for (const auto & beg_count : isrc_isr2_to_beg_count) {
         for (auto countval : beg_count) {
             beg_peak_max = MAX(beg_peak_max, countval);
         }
@@ -725,12 +963,13 @@ bamfname_to_strand_to_familyuid_to_reads(
     
     uvc1_readnum_big_t alnidx = 0;
     // hts_itr = sam_itr_queryi(hts_idx, tid, fetch_tbeg, fetch_tend);
-    hts_itr = sam_itr_queryi(hts_idx, tid, non_neg_minus(fetch_tbeg, MAX_INSERT_SIZE), (fetch_tend + MAX_INSERT_SIZE));
-    while (sam_itr_next(sam_infile, hts_itr, aln) >= 0) {
+    for (bam1_t *aln : fetched_alns) {
         if (aln->core.pos < non_neg_minus(fetch_tbeg, MAX_INSERT_SIZE + 1) || bam_endpos(aln) > (fetch_tend + MAX_INSERT_SIZE + 1)) {
             continue;
         }
-        if (visited_qnames.find(bam_get_qname(aln)) == visited_qnames.end()) {
+        const char *qname = bam_get_qname(aln);
+        const uvc1_hash_t qname_hash = strhash(qname, 31UL);
+        if (!visited_qnames.contains(qname, qname_hash)) {
             continue;
         }
         
@@ -759,8 +998,6 @@ bamfname_to_strand_to_familyuid_to_reads(
         extended_inclu_beg_pos = MIN(extended_inclu_beg_pos, SIGN2UNSIGN(aln->core.pos));
         extended_exclu_end_pos = MAX(extended_exclu_end_pos, SIGN2UNSIGN(bam_endpos(aln)));
 
-        const char *qname = bam_get_qname(aln);
-        const uvc1_hash_t qname_hash = strhash(qname, 31UL);
         const uvc1_hash_t qname_hash2 = strhash(qname, 17UL);
         const size_t qname_len = strlen(qname);
         const char *umi_beg1 = strchr(qname,   '#');
@@ -934,10 +1171,12 @@ bamfname_to_strand_to_familyuid_to_reads(
         
         MolecularBarcode mbkey = mb.createKey();
         mb.hashvalue = mbkey.hashvalue = mbkey.calcHash();
-        umi_to_strand_to_reads.insert(std::make_pair(mbkey, std::make_pair(std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>(), mb)));
-        umi_to_strand_to_reads[mbkey].first[strand].insert(std::make_pair(qname_hash2, std::vector<bam1_t *>()));
-        
-        umi_to_strand_to_reads[mbkey].first[strand][qname_hash2].push_back(bam_dup1(aln));
+        bool is_new_molecule = false;
+        auto & strand_to_reads_and_mb = umi_to_strand_to_reads.findOrInsert(std::move(mbkey), is_new_molecule);
+        if (is_new_molecule) {
+            strand_to_reads_and_mb.second = mb;
+        }
+        strand_to_reads_and_mb.first[strand][qname_hash2].push_back(is_fetched_alns_in_slab ? aln : bam_record_slab.add(aln));
         // umi_to_strand_to_reads[molecule_hash].first[strand][qname_hash2].push_back((mut_aln));
         
         const bool should_log_read = (ispowerof2(alnidx + 1));
@@ -963,19 +1202,16 @@ bamfname_to_strand_to_familyuid_to_reads(
                     << "beg_tid_pos = " << begpair.first << "," << begpair.second << " ; "
                     << "end_tid_pos = " << endpair.first << "," << endpair.second << " ; "
                     << "barcode_umihash = " << (is_umi_found ? umihash : 0) << " ; "
-                    << "molecule_hash = " << anyuint2hexstring(mbkey.hashvalue) << " ; "
+                    << "molecule_hash = " << anyuint2hexstring(mb.hashvalue) << " ; "
                     << "qname_hash = " << anyuint2hexstring(qname_hash) << " ; "
                     << "qname_hash2 = " << anyuint2hexstring(qname_hash2) << " ; "
                     << "dflag = " << mb.duplexflag << " ; "
                     << "UMIstring = " << umi_beg << " ; "
                     << "UMIsize = " << umi_len << " ; "
-                    << "num_qname_from_molecule_so_far = " << umi_to_strand_to_reads[mbkey].first[strand].size() << " ; ";
+                    << "num_qname_from_molecule_so_far = " << strand_to_reads_and_mb.first[strand].size() << " ; ";
         }
         alnidx += 1;
     }
-    sam_itr_destroy(hts_itr);
-    
-    bam_destroy1(aln);
     // sam_close(sam_infile);
     
     const bool is_min_DP_failed_1 = (
@@ -5,6 +5,7 @@
 #include "common.hpp"
 #include "iohts.hpp"
 #include "MolecularID.hpp"
+#include "pipeline.hpp"
 
 #include "htslib/sam.h"
 
@@ -15,6 +16,7 @@
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <limits.h>
@@ -24,6 +26,9 @@
 
 #define logDEBUGx1 logDEBUG // set to logINFO to enable it
 
+// molecule key -> (strand -> qname hash -> reads, barcode of the first read)
+typedef MolecularBarcodeIndex<std::pair<std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>, MolecularBarcode>> MoleculeToStrandToReads;
+
 struct SamIter {
     const std::string input_bam_fname;
     const std::string & tier1_target_region; 
@@ -32,6 +37,7 @@ struct SamIter {
     const size_t nthreads; 
     const int64_t mem_per_thread;
     const bool is_fastq_gen;
+    MemoryGovernor *const mem_governor; // NULL means using the initial estimates of the memory usage
     samFile *sam_infile = NULL;
     bam_hdr_t *samheader = NULL;
     hts_idx_t *sam_idx = NULL; 
@@ -45,14 +51,22 @@ struct SamIter {
     std::vector<BedLine> _bedlines;
     size_t _bedregion_idx = 0;
     
-    SamIter(const CommandLineArgs &paramset):
+    // state of the partitioning by the BAM index
+    uvc1_refgpos_t index_partition_bin_size; // set to zero if the index has no statistics of the number of mapped reads
+    std::vector<double> _tid_to_nreads_per_idx_byte; // negative if not computed yet, zero if the template has no mapped read
+    uvc1_refgpos_t _idx_tid = 0;
+    uvc1_refgpos_t _idx_beg = 0;
+    
+    SamIter(const CommandLineArgs &paramset, MemoryGovernor *a_mem_governor = NULL):
             input_bam_fname(paramset.bam_input_fname), 
             tier1_target_region(paramset.tier1_target_region), 
             region_bed_fname(paramset.bed_region_fname),
             bed_in_avg_sequencing_DP(paramset.bed_in_avg_sequencing_DP),
             nthreads(paramset.max_cpu_num),
             mem_per_thread(paramset.mem_per_thread),
-            is_fastq_gen(paramset.fam_consensus_out_fastq.size() > 0) {
+            is_fastq_gen(paramset.fam_consensus_out_fastq.size() > 0),
+            mem_governor(a_mem_governor),
+            index_partition_bin_size(paramset.index_partition_bin_size) {
         this->sam_infile = sam_open(input_bam_fname.c_str(), "r");
         if (NULL == this->sam_infile) {
             fprintf(stderr, "Failed to open the file %s!", input_bam_fname.c_str());
@@ -83,6 +97,25 @@ struct SamIter {
             }
             bed_fname_to_contigs(this->_bedlines, this->region_bed_fname, this->samheader); 
         }
+        if (index_partition_bin_size > 0) {
+            hts_idx_t *stat_idx = ((NULL != this->sam_idx) ? this->sam_idx : sam_index_load(this->sam_infile, input_bam_fname.c_str()));
+            bool has_stat = false;
+            for (int32_t tid = 0; NULL != stat_idx && tid < this->samheader->n_targets && !has_stat; tid++) {
+                uint64_t n_mapped, n_unmapped;
+                has_stat = (hts_idx_get_stat(stat_idx, tid, &n_mapped, &n_unmapped) >= 0);
+            }
+            if (!has_stat) {
+                if (index_partition_bin_size > 0) {
+                    fprintf(stderr, "The index for the file %s is not found or has no read statistics, so the reads are scanned to partition the genome.\n", 
+                            input_bam_fname.c_str());
+                }
+                index_partition_bin_size = 0;
+                if (NULL != stat_idx && stat_idx != this->sam_idx) { hts_idx_destroy(stat_idx); }
+            } else {
+                this->sam_idx = stat_idx;
+            }
+        }
+        _tid_to_nreads_per_idx_byte.resize(this->samheader->n_targets, -1.0);
     }
     ~SamIter() {
         bam_destroy1(alnrecord);
@@ -104,6 +137,18 @@ struct SamIter {
             const std::string & tier1_target_region,
             const bam_hdr_t *bam_hdr);
     
+    // Estimated number of reads overlapping the region from the compressed size of the region in the index, or -1 if not estimable. 
+    int64_t
+    estimate_nreads_by_index(
+            uvc1_refgpos_t tid,
+            uvc1_refgpos_t beg,
+            uvc1_refgpos_t end);
+    
+    int64_t
+    iternext_by_index(
+            std::vector<BedLine> & bedlines,
+            const std::array<size_t, 3> & mem_rates);
+    
     int64_t
     iternext(
             uvc1_flag_t & iter_ret_flag, 
@@ -116,22 +161,33 @@ samfname_to_tid_to_tname_tseq_tup_vec(
         std::vector<std::tuple<std::string, uvc1_refgpos_t>> & tid_to_tname_tseqlen_tuple_vec, 
         const std::string & bam_input_fname);
 
-int 
-clean_fill_strand_umi_readset(
-        std::vector<std::array<std::vector<std::vector<bam1_t *>>, 2>> &umi_strand_readset);
-
 int 
 fill_strand_umi_readset_with_strand_to_umi_to_reads(
         std::vector<std::pair<std::array<std::vector<std::vector<bam1_t *>>, 2>, MolecularBarcode>> &umi_strand_readset,
-        std::map<MolecularBarcode, std::pair<std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>, MolecularBarcode>> &umi_to_strand_to_reads,
+        MoleculeToStrandToReads &umi_to_strand_to_reads,
         const CommandLineArgs & paramset,
         uvc1_flag_t specialflag);
 
+// Sub-regions (islands) of the region from fetch_tbeg to fetch_tend in which pos_to_depth (indexed from fetch_tbeg) is at least min_depth, 
+//   or which contain any of forced_positions. Each island is extended by island_margin, and the islands separated by less than min_gap_len are merged. 
+std::vector<std::pair<uvc1_refgpos_t, uvc1_refgpos_t>>
+depths_to_covered_islands(
+        const std::vector<uvc1_readnum_t> & pos_to_depth,
+        uvc1_refgpos_t fetch_tbeg, 
+        uvc1_refgpos_t fetch_tend, 
+        uvc1_readnum_t min_depth,
+        const std::vector<uvc1_refgpos_t> & forced_positions,
+        uvc1_refgpos_t island_margin,
+        uvc1_refgpos_t min_gap_len);
+
+// If pos_to_aln_depth is not NULL, then it is filled with the number of alignments passing the filters at each position from fetch_tbeg to fetch_tend, 
+//   which is computed from the begin and end counts used for dedupping. 
 std::array<uvc1_readnum_big_t, 3>
 bamfname_to_strand_to_familyuid_to_reads(
-        std::map<MolecularBarcode, std::pair<std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>, MolecularBarcode>> &umi_to_strand_to_reads,
+        MoleculeToStrandToReads &umi_to_strand_to_reads,
         uvc1_refgpos_t & extended_inclu_beg_pos,
         uvc1_refgpos_t & extended_exclu_end_pos,
+        std::vector<uvc1_readnum_t> * pos_to_aln_depth,
         uvc1_refgpos_t tid, 
         uvc1_refgpos_t fetch_tbeg, 
         uvc1_refgpos_t fetch_tend, 
@@ -141,6 +197,8 @@ bamfname_to_strand_to_familyuid_to_reads(
         const std::string UMI_STRUCT_STRING, 
         samFile *sam_file,
         const hts_idx_t * hts_idx,
+        BamRecordCache * bam_record_cache,
+        BamRecordSlab & bam_record_slab,
         size_t thread_id,
         const CommandLineArgs & paramset,
         uvc1_flag_t specialflag);
@@ -18,10 +18,10 @@ fill_by_indel_info2_2
         const int strand, 
         const uvc1_refgpos_t refpos, 
         const AlignmentSymbol symbol,
-        const std::map<uvc1_refgpos_t, std::map<INDELTYPE, uvc1_readnum_t>> & bq_tsum_depth,
-        const std::map<uvc1_refgpos_t, std::map<INDELTYPE, uvc1_readnum_t>> & fq_tsum_depth,
-        const std::map<uvc1_refgpos_t, std::map<INDELTYPE, uvc1_readnum_t>> & fq_tsum_depth_c2DP,
-        const std::map<uvc1_refgpos_t, std::map<INDELTYPE, uvc1_readnum_t>> & fq_tsum_depth_c2dDP,
+        const PosToIndelToCountTable<INDELTYPE> & bq_tsum_depth,
+        const PosToIndelToCountTable<INDELTYPE> & fq_tsum_depth,
+        const PosToIndelToCountTable<INDELTYPE> & fq_tsum_depth_c2DP,
+        const PosToIndelToCountTable<INDELTYPE> & fq_tsum_depth_c2dDP,
 
         const std::string & refchars IGNORE_UNUSED_PARAM,
         const uvc1_flag_t specialflag IGNORE_UNUSED_PARAM) {
@@ -36,27 +36,25 @@ fill_by_indel_info2_2
                 !fprintf(stderr, "Symbol %s does not match any of {%s, %s, %s}", 
                 SYMBOL_TO_DESC_ARR[symbol], SYMBOL_TO_DESC_ARR[LINK_D1], SYMBOL_TO_DESC_ARR[LINK_D2], SYMBOL_TO_DESC_ARR[LINK_D3P]));
     }
-    assertUVC(bq_tsum_depth.find(refpos) != bq_tsum_depth.end());
+    assertUVC(bq_tsum_depth.hasPos(refpos));
     
     std::vector<std::tuple<uvc1_readnum_t, uvc1_readnum_t, uvc1_readnum_t, uvc1_readnum_t, std::string>> bqfq_depth_mutform_tuples;
-    for (auto indel2data4 : bq_tsum_depth.at(refpos)) {
-        const auto indel = indel2data4.first;
+    bq_tsum_depth.forEachIndelAtPos(refpos, [&](const INDELTYPE & indel, const uvc1_readnum_t bqdata) {
 #if INDEL_ID == 1
-        const std::string indelstring = indel2data4.first;
+        const std::string indelstring = indel;
 #else
-        const std::string indelstring = refchars.substr(refpos - symbol2CountCoverageSet.getUnifiedIncluBegPosition(), indel2data4.first); 
+        const std::string indelstring = refchars.substr(refpos - symbol2CountCoverageSet.getUnifiedIncluBegPosition(), indel); 
 #endif
         if (indelstring.size() == 0) {
-            continue;
+            return;
         }
         
-        const uvc1_readnum_t bqdata = posToIndelToData_get(bq_tsum_depth, refpos, indel);
         const uvc1_readnum_t fqdata = posToIndelToData_get(fq_tsum_depth, refpos, indel);
         const uvc1_readnum_t fqdata_c2DP = posToIndelToData_get(fq_tsum_depth_c2DP, refpos, indel);
         const uvc1_readnum_t fqdata_c2dDP = posToIndelToData_get(fq_tsum_depth_c2dDP, refpos, indel);
         assertUVC(bqdata > 0);
         bqfq_depth_mutform_tuples.push_back(std::make_tuple(fqdata, bqdata, fqdata_c2DP, fqdata_c2dDP, indelstring));
-    }
+    });
     uvc1_readnum_t gapbAD1sum = 0;
     uvc1_readnum_t gapcAD1sum = 0;
     std::sort(bqfq_depth_mutform_tuples.rbegin(), bqfq_depth_mutform_tuples.rend());
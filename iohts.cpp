@@ -1,10 +1,22 @@
 #include "iohts.hpp"
 #include "common.hpp"
+#include "logging.hpp"
 
 #include "htslib/faidx.h"
 #include "htslib/sam.h"
+#include "htslib/tbx.h"
 #include "htslib/vcf.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
 #include <vector>
 
 bool BedLine::is_valid() {
@@ -33,3 +45,1011 @@ load_bam_records(
     return ret;
 }
 
+bam1_t *
+BamRecordSlab::add(const bam1_t *aln) {
+    if (0 == record_blocks.size() || record_blocks.back().size() == record_blocks.back().capacity()) {
+        record_blocks.push_back(std::vector<bam1_t>());
+        record_blocks.back().reserve(BAM_RECORD_SLAB_NUM_RECORDS_PER_BLOCK);
+    }
+    const size_t l_data = aln->l_data;
+    if (0 == data_blocks.size() || data_blocks.back().size() + l_data > data_blocks.back().capacity()) {
+        data_blocks.push_back(std::vector<uint8_t>());
+        data_blocks.back().reserve(MAX(SIGN2UNSIGN(BAM_RECORD_SLAB_NUM_BYTES_PER_BLOCK), l_data));
+    }
+    // Neither push_back nor insert below reallocates because the capacity is checked above.
+    std::vector<uint8_t> & data_block = data_blocks.back();
+    const size_t data_offset = data_block.size();
+    data_block.insert(data_block.end(), aln->data, aln->data + l_data);
+    record_blocks.back().push_back(*aln);
+    bam1_t *ret = &(record_blocks.back().back());
+    ret->data = data_block.data() + data_offset;
+    ret->m_data = l_data;
+    nrecords++;
+    return ret;
+}
+
+std::vector<bam1_t *>
+load_bam_records_into_slab(
+        int & sam_itr_ret,
+        BamRecordSlab & bam_record_slab,
+        samFile * sam_infile,
+        const hts_idx_t * hts_idx, 
+        const uvc1_refgpos_t query_tid, 
+        const uvc1_refgpos_t query_beg, 
+        const uvc1_refgpos_t query_end) {
+    
+    std::vector<bam1_t *> ret;
+    bam1_t *aln = bam_init1();
+    hts_itr_t *hts_itr = sam_itr_queryi(hts_idx, query_tid, query_beg, query_end);
+    int itr_result = 0;
+    while ((itr_result = sam_itr_next(sam_infile, hts_itr, aln)) >= 0) { 
+        ret.push_back(bam_record_slab.add(aln));
+    }
+    sam_itr_ret = itr_result;
+    sam_itr_destroy(hts_itr);
+    bam_destroy1(aln);
+    return ret;
+}
+
+void
+BamRecordCache::clear() {
+    for (bam1_t *aln : records) {
+        bam_destroy1(aln);
+    }
+    records.clear();
+    tid = -1;
+    beg_pos = 0;
+    end_pos = 0;
+}
+
+size_t
+BamRecordCache::nbytes() const {
+    size_t ret = records.capacity() * sizeof(bam1_t *);
+    for (const bam1_t *aln : records) {
+        ret += sizeof(bam1_t) + aln->m_data;
+    }
+    return ret;
+}
+
+int
+BamRecordCache::query(
+        std::vector<bam1_t *> & alns,
+        samFile *samfile,
+        const hts_idx_t * hts_idx,
+        const uvc1_refgpos_t query_tid,
+        const uvc1_refgpos_t query_beg, 
+        const uvc1_refgpos_t query_end) {
+    
+    int sam_itr_ret = -1;
+    const bool is_window_sliding = (query_tid == tid && beg_pos <= query_beg && query_beg < end_pos && end_pos <= query_end);
+    if (is_window_sliding) {
+        size_t nkept = 0;
+        for (bam1_t *aln : records) {
+            if (bam_endpos(aln) > query_beg) {
+                records[nkept++] = aln;
+            } else {
+                bam_destroy1(aln);
+            }
+        }
+        records.resize(nkept);
+        if (end_pos < query_end) {
+            // records starting before end_pos are already in the cache
+            std::vector<bam1_t *> new_records = load_bam_records(sam_itr_ret, samfile, hts_idx, query_tid, end_pos, query_end);
+            for (bam1_t *aln : new_records) {
+                if (aln->core.pos >= end_pos) {
+                    records.push_back(aln);
+                } else {
+                    bam_destroy1(aln);
+                }
+            }
+        }
+    } else {
+        clear();
+        records = load_bam_records(sam_itr_ret, samfile, hts_idx, query_tid, query_beg, query_end);
+    }
+    tid = query_tid;
+    beg_pos = query_beg;
+    end_pos = query_end;
+    
+    alns.clear();
+    for (bam1_t *aln : records) {
+        if (aln->core.pos < query_end && bam_endpos(aln) > query_beg) {
+            alns.push_back(aln);
+        }
+    }
+    return sam_itr_ret;
+}
+
+// The smallest values of each BCF integer type that are not reserved (for missing value, end of vector, etc.)
+#define BCF_BYTES_MIN_INT8 (-120)
+#define BCF_BYTES_MIN_INT16 (-32760)
+#define BCF_BYTES_MIN_INT32 (INT_MIN + 8)
+#define BCF_BYTES_INT8_MISSING ((char)0x80)
+#define BCF_BYTES_FLOAT_MISSING (0x7F800001)
+
+template <class T>
+static void
+bcf_bytes_append_le(std::string & out_bytes, const T value) {
+    out_bytes.append((const char*)&value, sizeof(T)); // x86 and ARM are both little-endian
+}
+
+static void
+bcf_bytes_append_int1(std::string & out_bytes, const int32_t x) {
+    if (x >= BCF_BYTES_MIN_INT8 && x <= INT8_MAX) {
+        out_bytes.push_back((char)(1 << 4 | BCF_BT_INT8));
+        bcf_bytes_append_le(out_bytes, (int8_t)x);
+    } else if (x >= BCF_BYTES_MIN_INT16 && x <= INT16_MAX) {
+        out_bytes.push_back((char)(1 << 4 | BCF_BT_INT16));
+        bcf_bytes_append_le(out_bytes, (int16_t)x);
+    } else {
+        out_bytes.push_back((char)(1 << 4 | BCF_BT_INT32));
+        bcf_bytes_append_le(out_bytes, (int32_t)x);
+    }
+}
+
+static void
+bcf_bytes_append_size(std::string & out_bytes, const size_t size, const int type) {
+    if (size < 15) {
+        out_bytes.push_back((char)(size << 4 | type));
+    } else {
+        out_bytes.push_back((char)(15 << 4 | type));
+        bcf_bytes_append_int1(out_bytes, (int32_t)size);
+    }
+}
+
+// Append the values in the smallest BCF integer type that can hold all of them, where bcf_int32_missing is kept as missing. 
+static void
+bcf_bytes_append_int32s(std::string & out_bytes, const int32_t *values, size_t n) {
+    int32_t min_value = INT32_MAX;
+    int32_t max_value = BCF_BYTES_MIN_INT32;
+    for (size_t i = 0; i < n; i++) {
+        if (bcf_int32_missing == values[i]) { continue; }
+        min_value = MIN(min_value, values[i]);
+        max_value = MAX(max_value, values[i]);
+    }
+    if (min_value >= BCF_BYTES_MIN_INT8 && max_value <= INT8_MAX) {
+        bcf_bytes_append_size(out_bytes, n, BCF_BT_INT8);
+        for (size_t i = 0; i < n; i++) { bcf_bytes_append_le(out_bytes, (int8_t)(bcf_int32_missing == values[i] ? bcf_int8_missing : values[i])); }
+    } else if (min_value >= BCF_BYTES_MIN_INT16 && max_value <= INT16_MAX) {
+        bcf_bytes_append_size(out_bytes, n, BCF_BT_INT16);
+        for (size_t i = 0; i < n; i++) { bcf_bytes_append_le(out_bytes, (int16_t)(bcf_int32_missing == values[i] ? bcf_int16_missing : values[i])); }
+    } else {
+        bcf_bytes_append_size(out_bytes, n, BCF_BT_INT32);
+        out_bytes.append((const char*)values, n * sizeof(int32_t));
+    }
+}
+
+static void
+bcf_bytes_append_chars(std::string & out_bytes, const char *value, size_t len) {
+    bcf_bytes_append_size(out_bytes, len, BCF_BT_CHAR);
+    out_bytes.append(value, len);
+}
+
+static void
+bcf_bytes_append_record(std::string & out_bytes, int32_t rid, int32_t pos, int32_t rlen, float qual, uint32_t n_allele, uint32_t n_info, 
+        const char *shared, uint32_t l_shared, const char *indiv, uint32_t l_indiv, uint32_t n_fmt, uint32_t n_sample) {
+    uint32_t qual_bits;
+    memcpy(&qual_bits, &qual, 4);
+    bcf_bytes_append_le(out_bytes, (uint32_t)(l_shared + 24));
+    bcf_bytes_append_le(out_bytes, (uint32_t)l_indiv);
+    bcf_bytes_append_le(out_bytes, rid);
+    bcf_bytes_append_le(out_bytes, pos);
+    bcf_bytes_append_le(out_bytes, rlen);
+    bcf_bytes_append_le(out_bytes, qual_bits);
+    bcf_bytes_append_le(out_bytes, (uint32_t)(n_allele << 16 | n_info));
+    bcf_bytes_append_le(out_bytes, (uint32_t)(n_fmt << 24 | n_sample));
+    out_bytes.append(shared, l_shared);
+    out_bytes.append(indiv, l_indiv);
+}
+
+bcf_hdr_t *
+bcf_hdr_parse_text(const std::string & vcf_header_text) {
+    bcf_hdr_t *ret = bcf_hdr_init("w");
+    std::vector<char> htxt(vcf_header_text.begin(), vcf_header_text.end());
+    htxt.push_back('\0');
+    if (NULL == ret || 0 != bcf_hdr_parse(ret, htxt.data())) {
+        LOG(logCRITICAL) << "Failed to parse the following VCF header into BCF header:\n" << vcf_header_text;
+        exit(-9);
+    }
+    return ret;
+}
+
+BcfOutputHeader::~BcfOutputHeader() {
+    if (NULL != hdr) { bcf_hdr_destroy(hdr); }
+}
+
+int
+BcfOutputHeader::init(const std::string & vcf_header_text, const char *const *tag_ids, size_t n_tags) {
+    hdr = bcf_hdr_parse_text(vcf_header_text);
+    tag_to_hdr_id.clear();
+    for (size_t i = 0; i < n_tags; i++) {
+        tag_to_hdr_id.push_back(bcf_hdr_id2int(hdr, BCF_DT_ID, tag_ids[i]));
+    }
+    return 0;
+}
+
+int
+BcfOutputHeader::appendHeaderBytes(std::string & out_bytes) const {
+    kstring_t htxt = {0, 0, NULL};
+    if (0 != bcf_hdr_format(hdr, 1, &htxt)) {
+        LOG(logCRITICAL) << "Failed to format the BCF header!";
+        exit(-9);
+    }
+    out_bytes.append("BCF\2\2", 5);
+    bcf_bytes_append_le(out_bytes, (uint32_t)(htxt.l + 1));
+    out_bytes.append(htxt.s, htxt.l);
+    out_bytes.push_back('\0');
+    free(htxt.s);
+    return 0;
+}
+
+void
+BcfFormatEncoder::encodeGenotype(size_t tag, const std::string & gt) {
+    int32_buf.clear();
+    int32_t is_phased = 0;
+    const char *t = gt.c_str();
+    while (true) {
+        if ('.' == *t || '\0' == *t) {
+            int32_buf.push_back(is_phased);
+            if ('.' == *t) { t++; }
+        } else {
+            int32_buf.push_back((int32_t)((strtol(t, (char**)&t, 10) + 1) << 1 | is_phased));
+        }
+        is_phased = ('|' == *t);
+        if ('|' != *t && '/' != *t) { break; }
+        t++;
+    }
+    encodeInt32s(tag, int32_buf.data(), int32_buf.size());
+}
+
+void
+BcfFormatEncoder::encodeString(size_t tag, const char *value, size_t len) {
+    if (0 == len) {
+        value = ".";
+        len = 1;
+    }
+    bcf_bytes_append_int1(indiv, tag_to_hdr_id[tag]);
+    bcf_bytes_append_chars(indiv, value, len);
+    n_fmt++;
+}
+
+void
+BcfFormatEncoder::encodeStrings(size_t tag, const std::string *values, size_t n) {
+    string_buf.clear();
+    for (size_t i = 0; i < n; i++) {
+        if (0 != i) { string_buf.push_back(','); }
+        string_buf += values[i];
+    }
+    encodeString(tag, string_buf.c_str(), string_buf.size());
+}
+
+void
+BcfFormatEncoder::encodeInt32s(size_t tag, const int32_t *values, size_t n) {
+    bcf_bytes_append_int1(indiv, tag_to_hdr_id[tag]);
+    n_fmt++;
+    if (0 == n) {
+        bcf_bytes_append_size(indiv, 1, BCF_BT_INT8);
+        indiv.push_back(BCF_BYTES_INT8_MISSING);
+        return;
+    }
+    bcf_bytes_append_int32s(indiv, values, n);
+}
+
+void
+BcfFormatEncoder::encodeInt64s(size_t tag, const int64_t *values, size_t n) {
+    int32_buf.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        int32_buf[i] = (int32_t)MIN((int64_t)INT_MAX, MAX((int64_t)BCF_BYTES_MIN_INT32, values[i]));
+    }
+    encodeInt32s(tag, int32_buf.data(), n);
+}
+
+void
+BcfFormatEncoder::encodeFloats(size_t tag, const float *values, size_t n) {
+    bcf_bytes_append_int1(indiv, tag_to_hdr_id[tag]);
+    n_fmt++;
+    if (0 == n) {
+        bcf_bytes_append_size(indiv, 1, BCF_BT_FLOAT);
+        bcf_bytes_append_le(indiv, (uint32_t)BCF_BYTES_FLOAT_MISSING);
+        return;
+    }
+    bcf_bytes_append_size(indiv, n, BCF_BT_FLOAT);
+    indiv.append((const char*)values, n * sizeof(float));
+}
+
+int
+BcfSitesEncoder::encodeSite(const char *tname, int64_t vcfpos, const std::string & ref, const std::string & alts, float a_qual, const char *filter_id) {
+    rid = bcf_hdr_name2id(hdr, tname);
+    pos = (int32_t)(vcfpos - 1);
+    rlen = (int32_t)ref.size();
+    if (isnan(a_qual)) {
+        const uint32_t missing_bits = BCF_BYTES_FLOAT_MISSING;
+        memcpy(&qual, &missing_bits, 4);
+    } else {
+        qual = a_qual;
+    }
+    n_allele = 1;
+    n_info = 0;
+    errcode = 0;
+    shared.clear();
+    bcf_bytes_append_size(shared, 0, BCF_BT_CHAR); // ID
+    bcf_bytes_append_chars(shared, ref.data(), ref.size());
+    size_t alt_beg = 0;
+    while (alt_beg < alts.size()) {
+        size_t alt_end = alts.find(',', alt_beg);
+        if (std::string::npos == alt_end) { alt_end = alts.size(); }
+        bcf_bytes_append_chars(shared, alts.data() + alt_beg, alt_end - alt_beg);
+        n_allele++;
+        alt_beg = alt_end + 1;
+    }
+    if (NULL == filter_id) {
+        bcf_bytes_append_size(shared, 0, BCF_BT_NULL);
+    } else {
+        const int32_t filter_hdr_id = bcf_hdr_id2int(hdr, BCF_DT_ID, filter_id);
+        bcf_bytes_append_int32s(shared, &filter_hdr_id, 1);
+        if (filter_hdr_id < 0) { errcode = BCF_ERR_TAG_UNDEF; }
+    }
+    if (rid < 0) { errcode = BCF_ERR_CTG_UNDEF; }
+    if (errcode) {
+        LOG(logWARNING) << "Skipped the record at " << tname << ":" << vcfpos << " whose CHROM or FILTER is not in the BCF header.";
+        return -1;
+    }
+    return 0;
+}
+
+void
+BcfSitesEncoder::encodeInfoFlag(const char *key) {
+    bcf_bytes_append_int1(shared, bcf_hdr_id2int(hdr, BCF_DT_ID, key));
+    bcf_bytes_append_size(shared, 0, BCF_BT_NULL);
+    n_info++;
+}
+
+void
+BcfSitesEncoder::encodeInfoString(const char *key, const std::string & value) {
+    bcf_bytes_append_int1(shared, bcf_hdr_id2int(hdr, BCF_DT_ID, key));
+    bcf_bytes_append_chars(shared, value.data(), value.size());
+    n_info++;
+}
+
+void
+BcfSitesEncoder::encodeInfoInt32s(const char *key, const int32_t *values, size_t n) {
+    bcf_bytes_append_int1(shared, bcf_hdr_id2int(hdr, BCF_DT_ID, key));
+    bcf_bytes_append_int32s(shared, values, n);
+    n_info++;
+}
+
+void
+BcfSitesEncoder::encodeInfoFloats(const char *key, const float *values, size_t n) {
+    bcf_bytes_append_int1(shared, bcf_hdr_id2int(hdr, BCF_DT_ID, key));
+    bcf_bytes_append_size(shared, n, BCF_BT_FLOAT);
+    shared.append((const char*)values, n * sizeof(float));
+    n_info++;
+}
+
+BcfLineEncoder::BcfLineEncoder(const BcfOutputHeader & a_bcf_output_header) : bcf_output_header(a_bcf_output_header) {
+    bcf1_record = bcf_init();
+    sites_encoder.hdr = bcf_output_header.hdr;
+    format_encoder.tag_to_hdr_id = bcf_output_header.tag_to_hdr_id.data();
+}
+
+BcfLineEncoder::~BcfLineEncoder() {
+    bcf_destroy(bcf1_record);
+    free(line_kstring.s);
+}
+
+// vcf_parse tokenizes the line in place, so the line is copied into the reusable buffer first. 
+static kstring_t *
+copy_to_kstring(kstring_t *ks, const std::string & line) {
+    if (ks->m < line.size() + 1) {
+        char *s = (char*)realloc(ks->s, line.size() + 1);
+        if (NULL == s) {
+            fprintf(stderr, "The library function realloc failed at line %d in file %s!\n", __LINE__, __FILE__);
+            exit(-2);
+        }
+        ks->s = s;
+        ks->m = line.size() + 1;
+    }
+    memcpy(ks->s, line.c_str(), line.size() + 1);
+    ks->l = line.size();
+    return ks;
+}
+
+int
+BcfLineEncoder::appendVcfLine(std::string & out_bytes, const std::string & vcf_line) {
+    if (vcf_parse(copy_to_kstring(&line_kstring, vcf_line), bcf_output_header.hdr, bcf1_record) < 0 || bcf1_record->errcode) {
+        LOG(logWARNING) << "Skipped the following VCF line that cannot be converted into BCF: " << vcf_line;
+        return -1;
+    }
+    bcf_bytes_append_record(out_bytes, bcf1_record->rid, bcf1_record->pos, bcf1_record->rlen, bcf1_record->qual, 
+            bcf1_record->n_allele, bcf1_record->n_info, bcf1_record->shared.s, bcf1_record->shared.l, 
+            bcf1_record->indiv.s, bcf1_record->indiv.l, bcf1_record->n_fmt, bcf1_record->n_sample);
+    return 0;
+}
+
+int
+BcfLineEncoder::appendSitesAndFormat(std::string & out_bytes) const {
+    if (sites_encoder.errcode) { return -1; }
+    bcf_bytes_append_record(out_bytes, sites_encoder.rid, sites_encoder.pos, sites_encoder.rlen, sites_encoder.qual, 
+            sites_encoder.n_allele, sites_encoder.n_info, sites_encoder.shared.data(), sites_encoder.shared.size(), 
+            format_encoder.indiv.data(), format_encoder.indiv.size(), format_encoder.n_fmt, 1);
+    return 0;
+}
+
+int
+append_vcf_line(std::string & out_string, BcfLineEncoder *bcf_line_encoder, const std::string & vcf_line) {
+    if (NULL == bcf_line_encoder) {
+        out_string += vcf_line;
+        out_string += "\n";
+        return 0;
+    }
+    return bcf_line_encoder->appendVcfLine(out_string, vcf_line);
+}
+
+#define REFERENCE_STORE_MAGIC "UVC1REF1"
+
+static bool
+is_file_older(const std::string & fname1, const std::string & fname2) {
+    struct stat stat1, stat2;
+    if (0 != stat(fname1.c_str(), &stat1) || 0 != stat(fname2.c_str(), &stat2)) { return true; }
+    return (stat1.st_mtime < stat2.st_mtime);
+}
+
+static int
+build_reference_store_cache(const std::string & cache_fname, const faidx_t *fai) {
+    // Written into a temporary file which is then renamed, so that concurrent runs never see a partially written cache. 
+    const std::string tmp_fname = cache_fname + ".tmp" + std::to_string(getpid());
+    FILE *fp = fopen(tmp_fname.c_str(), "wb");
+    if (NULL == fp) { return -1; }
+    const uint64_t nseqs = faidx_nseq(fai);
+    bool is_ok = (1 == fwrite(REFERENCE_STORE_MAGIC, 8, 1, fp)) && (1 == fwrite(&nseqs, 8, 1, fp));
+    for (uint64_t tid = 0; tid < nseqs && is_ok; tid++) {
+        const uint64_t seqlen = faidx_seq_len(fai, faidx_iseq(fai, tid));
+        is_ok = (1 == fwrite(&seqlen, 8, 1, fp));
+    }
+    for (uint64_t tid = 0; tid < nseqs && is_ok; tid++) {
+        const char *tname = faidx_iseq(fai, tid);
+        int seqlen = faidx_seq_len(fai, tname);
+        if (0 == seqlen) { continue; }
+        int fetchedlen = 0;
+        char *fetchedseq = faidx_fetch_seq(fai, tname, 0, seqlen - 1, &fetchedlen);
+        is_ok = (NULL != fetchedseq && fetchedlen == seqlen);
+        for (int i = 0; i < fetchedlen && is_ok; i++) {
+            fetchedseq[i] = toupper(fetchedseq[i]);
+        }
+        is_ok = is_ok && (1 == fwrite(fetchedseq, seqlen, 1, fp));
+        free(fetchedseq);
+    }
+    is_ok = (0 == fclose(fp)) && is_ok;
+    if (!is_ok || 0 != rename(tmp_fname.c_str(), cache_fname.c_str())) {
+        unlink(tmp_fname.c_str());
+        return -2;
+    }
+    return 0;
+}
+
+// Returns NULL if the file cannot be mapped or has fewer than min_size bytes. 
+static const char *
+mmap_file_readonly(size_t & mapped_size, const std::string & fname, size_t min_size) {
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) { return NULL; }
+    struct stat file_stat;
+    void *mapped = MAP_FAILED;
+    if (0 == fstat(fd, &file_stat) && (size_t)file_stat.st_size >= min_size) {
+        mapped = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd); // the mapping is still valid after the file descriptor is closed
+    if (MAP_FAILED == mapped) { return NULL; }
+    mapped_size = file_stat.st_size;
+    return (const char*)mapped;
+}
+
+ReferenceStore::~ReferenceStore() {
+    if (NULL != data) {
+        munmap((void*)data, mapped_size);
+    }
+}
+
+int
+ReferenceStore::load(const std::string & fasta_fname, const std::string & cache_fname) {
+    if (is_file_older(cache_fname, fasta_fname) || is_file_older(cache_fname, fasta_fname + ".fai")) {
+        faidx_t *fai = fai_load(fasta_fname.c_str());
+        if (NULL == fai) { return -1; }
+        LOG(logINFO) << "Building the uppercase reference cache " << cache_fname << " from " << fasta_fname;
+        const int build_ret = build_reference_store_cache(cache_fname, fai);
+        fai_destroy(fai);
+        if (0 != build_ret) {
+            LOG(logWARNING) << "Failed to write the uppercase reference cache " << cache_fname;
+            return -2;
+        }
+    }
+    data = mmap_file_readonly(mapped_size, cache_fname, 16);
+    if (NULL == data) { return -3; }
+    uint64_t nseqs = 0;
+    memcpy(&nseqs, data + 8, 8);
+    uint64_t offset = 16 + nseqs * 8;
+    for (uint64_t tid = 0; tid < nseqs && nseqs <= (mapped_size - 16) / 8 && offset <= mapped_size; tid++) {
+        uint64_t seqlen;
+        memcpy(&seqlen, data + 16 + tid * 8, 8);
+        tid_to_offset.push_back(offset);
+        tid_to_len.push_back((uvc1_refgpos_t)seqlen);
+        offset += seqlen;
+    }
+    if (0 != memcmp(data, REFERENCE_STORE_MAGIC, 8) || offset != mapped_size) {
+        LOG(logWARNING) << "The uppercase reference cache " << cache_fname << " is corrupted, please delete it. ";
+        munmap((void*)data, mapped_size);
+        data = NULL;
+        tid_to_offset.clear();
+        tid_to_len.clear();
+        return -5;
+    }
+    return 0;
+}
+
+#define REPEAT_TRACK_MAGIC "UVC1RTR1"
+#define REPEAT_TRACK_HEADER_SIZE (8 + sizeof(RepeatTrackParams) + 8)
+
+static const std::array<size_t, NUM_REPEAT_TRACK_STREAMS> REPEAT_TRACK_STREAM_TO_NFIELDS = {{ 4, 3, 2 }};
+
+// The fields of one stream, where the first field is the position field that is encoded relative to the position of the run. 
+static std::array<int64_t, 4>
+rtr_to_stream_fields(const RegionalTandemRepeat & rtr, size_t stream_idx, int64_t offset) {
+    if (0 == stream_idx) {
+        return std::array<int64_t, 4> {{ rtr.begpos + offset, rtr.tracklen, rtr.unitlen, rtr.indelphred }};
+    } else if (1 == stream_idx) {
+        return std::array<int64_t, 4> {{ rtr.anyTR_begpos + offset, rtr.anyTR_tracklen, rtr.anyTR_unitlen, 0 }};
+    } else {
+        return std::array<int64_t, 4> {{ rtr.fwdSTR_endpos + offset, rtr.fwdSTR_unitlen, 0, 0 }};
+    }
+}
+
+static void
+stream_fields_to_rtr(RegionalTandemRepeat & rtr, size_t stream_idx, const std::array<int64_t, 4> & fields, int64_t offset) {
+    if (0 == stream_idx) {
+        rtr.begpos = fields[0] - offset;
+        rtr.tracklen = fields[1];
+        rtr.unitlen = fields[2];
+        rtr.indelphred = fields[3];
+    } else if (1 == stream_idx) {
+        rtr.anyTR_begpos = fields[0] - offset;
+        rtr.anyTR_tracklen = fields[1];
+        rtr.anyTR_unitlen = fields[2];
+    } else {
+        rtr.fwdSTR_endpos = fields[0] - offset;
+        rtr.fwdSTR_unitlen = fields[1];
+    }
+}
+
+static void
+append_varint(std::string & bytes, uint64_t x) {
+    while (x >= 0x80) {
+        bytes.push_back((char)((x & 0x7F) | 0x80));
+        x >>= 7;
+    }
+    bytes.push_back((char)x);
+}
+
+static uint64_t
+read_varint(const char *& p) {
+    uint64_t ret = 0;
+    for (int shift = 0; ; shift += 7) {
+        const uint8_t c = (uint8_t)*(p++);
+        ret |= ((uint64_t)(c & 0x7F) << shift);
+        if (c < 0x80) { return ret; }
+    }
+}
+
+// Each run is encoded as (run length * 2 + is_sliding), the zigzag-encoded (run position - position field), and then the other fields. 
+static void
+append_repeat_track_run(std::string & bytes, std::vector<RepeatTrackCheckpoint> & checkpoints, size_t & nruns, size_t stream_idx, 
+        int64_t run_pos, int64_t run_len, bool is_sliding, const std::array<int64_t, 4> & fields) {
+    if (0 == (nruns % REPEAT_TRACK_CHECKPOINT_NRUNS)) {
+        checkpoints.push_back(RepeatTrackCheckpoint {run_pos, bytes.size()});
+    }
+    nruns++;
+    const int64_t posdiff = run_pos - fields[0];
+    append_varint(bytes, (uint64_t)run_len * 2 + (is_sliding ? 1 : 0));
+    append_varint(bytes, (posdiff >= 0) ? ((uint64_t)posdiff * 2) : ((uint64_t)(-posdiff) * 2 - 1));
+    for (size_t i = 1; i < REPEAT_TRACK_STREAM_TO_NFIELDS[stream_idx]; i++) {
+        append_varint(bytes, (uint64_t)fields[i]);
+    }
+}
+
+void
+RepeatTrackRuns::append(const std::vector<RegionalTandemRepeat> & region_repeatvec, uvc1_refgpos_t region_offset, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend) {
+    for (size_t stream_idx = 0; stream_idx < NUM_REPEAT_TRACK_STREAMS; stream_idx++) {
+        std::string & bytes = stream_to_bytes[stream_idx];
+        std::vector<RepeatTrackCheckpoint> & checkpoints = stream_to_checkpoints[stream_idx];
+        size_t nruns = 0;
+        int64_t run_pos = incbeg;
+        int64_t run_len = 0;
+        bool is_sliding = false;
+        std::array<int64_t, 4> run_fields = {{ 0 }};
+        for (int64_t pos = incbeg; pos < excend; pos++) {
+            const auto fields = rtr_to_stream_fields(region_repeatvec[pos - region_offset], stream_idx, region_offset);
+            bool is_extended = (run_len > 0);
+            for (size_t i = 1; i < REPEAT_TRACK_STREAM_TO_NFIELDS[stream_idx] && is_extended; i++) {
+                is_extended = (fields[i] == run_fields[i]);
+            }
+            if (is_extended && 1 == run_len) {
+                is_sliding = (fields[0] == run_fields[0] + 1);
+                is_extended = (is_sliding || fields[0] == run_fields[0]);
+            } else if (is_extended) {
+                is_extended = (fields[0] == run_fields[0] + (is_sliding ? run_len : 0));
+            }
+            if (is_extended) {
+                run_len++;
+                continue;
+            }
+            if (run_len > 0) {
+                append_repeat_track_run(bytes, checkpoints, nruns, stream_idx, run_pos, run_len, is_sliding, run_fields);
+            }
+            run_pos = pos;
+            run_len = 1;
+            is_sliding = false;
+            run_fields = fields;
+        }
+        if (run_len > 0) {
+            append_repeat_track_run(bytes, checkpoints, nruns, stream_idx, run_pos, run_len, is_sliding, run_fields);
+        }
+    }
+}
+
+void
+RepeatTrackRuns::append(const RepeatTrackRuns & other) {
+    for (size_t stream_idx = 0; stream_idx < NUM_REPEAT_TRACK_STREAMS; stream_idx++) {
+        for (const auto & checkpoint : other.stream_to_checkpoints[stream_idx]) {
+            stream_to_checkpoints[stream_idx].push_back(RepeatTrackCheckpoint {checkpoint.pos, checkpoint.offset + stream_to_bytes[stream_idx].size()});
+        }
+        stream_to_bytes[stream_idx] += other.stream_to_bytes[stream_idx];
+    }
+}
+
+int
+repeat_track_save(const std::string & track_fname, const RepeatTrackParams & params, size_t ntemplates, 
+        const std::function<int(RepeatTrackRuns &, size_t)> & tid_to_runs_func) {
+    const std::string tmp_fname = track_fname + ".tmp" + std::to_string(getpid());
+    FILE *fp = fopen(tmp_fname.c_str(), "wb");
+    if (NULL == fp) { return -1; }
+    const uint64_t nseqs = ntemplates;
+    std::vector<std::array<std::array<uint64_t, 4>, NUM_REPEAT_TRACK_STREAMS>> tid_to_stream_to_locs(ntemplates);
+    const size_t locs_nbytes = ntemplates * sizeof(tid_to_stream_to_locs[0]);
+    bool is_ok = (1 == fwrite(REPEAT_TRACK_MAGIC, 8, 1, fp)) && (1 == fwrite(&params, sizeof(params), 1, fp)) && (1 == fwrite(&nseqs, 8, 1, fp));
+    is_ok = is_ok && (0 == fseek(fp, REPEAT_TRACK_HEADER_SIZE + locs_nbytes, SEEK_SET)); // the locations are written after all templates
+    uint64_t offset = REPEAT_TRACK_HEADER_SIZE + locs_nbytes;
+    for (size_t tid = 0; tid < ntemplates && is_ok; tid++) {
+        RepeatTrackRuns runs;
+        is_ok = (0 == tid_to_runs_func(runs, tid));
+        for (size_t stream_idx = 0; stream_idx < NUM_REPEAT_TRACK_STREAMS && is_ok; stream_idx++) {
+            const auto & checkpoints = runs.stream_to_checkpoints[stream_idx];
+            const auto & bytes = runs.stream_to_bytes[stream_idx];
+            const size_t checkpoints_nbytes = checkpoints.size() * sizeof(RepeatTrackCheckpoint);
+            const size_t padding_nbytes = (8 - (bytes.size() % 8)) % 8; // keeps the checkpoints aligned
+            tid_to_stream_to_locs[tid][stream_idx] = {{ offset, checkpoints.size(), offset + checkpoints_nbytes, bytes.size() }};
+            is_ok = (checkpoints.size() == fwrite(checkpoints.data(), sizeof(RepeatTrackCheckpoint), checkpoints.size(), fp))
+                    && (bytes.size() == fwrite(bytes.data(), 1, bytes.size(), fp))
+                    && (padding_nbytes == fwrite("\0\0\0\0\0\0\0", 1, padding_nbytes, fp));
+            offset += checkpoints_nbytes + bytes.size() + padding_nbytes;
+        }
+    }
+    is_ok = is_ok && (0 == fseek(fp, REPEAT_TRACK_HEADER_SIZE, SEEK_SET)) 
+            && (ntemplates == fwrite(tid_to_stream_to_locs.data(), sizeof(tid_to_stream_to_locs[0]), ntemplates, fp));
+    is_ok = (0 == fclose(fp)) && is_ok;
+    if (!is_ok || 0 != rename(tmp_fname.c_str(), track_fname.c_str())) {
+        unlink(tmp_fname.c_str());
+        return -2;
+    }
+    return 0;
+}
+
+RepeatTrack::~RepeatTrack() {
+    if (NULL != data) {
+        munmap((void*)data, mapped_size);
+    }
+}
+
+int
+RepeatTrack::load(const std::string & track_fname, const std::string & fasta_fname, const RepeatTrackParams & params, size_t ntemplates) {
+    if (is_file_older(track_fname, fasta_fname)) {
+        LOG(logINFO) << "The tandem-repeat track " << track_fname << " does not exist or is older than " << fasta_fname << ", so the tandem repeats are computed for each region. ";
+        return -1;
+    }
+    data = mmap_file_readonly(mapped_size, track_fname, REPEAT_TRACK_HEADER_SIZE);
+    if (NULL == data) { return -2; }
+    uint64_t nseqs = 0;
+    memcpy(&nseqs, data + 8 + sizeof(RepeatTrackParams), 8);
+    bool is_valid = (0 == memcmp(data, REPEAT_TRACK_MAGIC, 8)) && (nseqs >= ntemplates)
+            && (nseqs <= (mapped_size - REPEAT_TRACK_HEADER_SIZE) / sizeof(tid_to_stream_to_locs[0]));
+    if (is_valid) {
+        tid_to_stream_to_locs.resize(nseqs);
+        memcpy(tid_to_stream_to_locs.data(), data + REPEAT_TRACK_HEADER_SIZE, nseqs * sizeof(tid_to_stream_to_locs[0]));
+        for (const auto & stream_to_locs : tid_to_stream_to_locs) {
+            for (const auto & locs : stream_to_locs) {
+                is_valid = is_valid && (locs[0] + locs[1] * sizeof(RepeatTrackCheckpoint) == locs[2]) && (locs[2] + locs[3] <= mapped_size);
+            }
+        }
+    }
+    if (!is_valid) {
+        LOG(logWARNING) << "The tandem-repeat track " << track_fname << " is corrupted, please delete it. ";
+    } else if (0 != memcmp(data + 8, &params, sizeof(RepeatTrackParams))) {
+        LOG(logWARNING) << "The tandem-repeat track " << track_fname << " was built with different indel parameters, so the tandem repeats are computed for each region. ";
+        is_valid = false;
+    }
+    if (!is_valid) {
+        munmap((void*)data, mapped_size);
+        data = NULL;
+        tid_to_stream_to_locs.clear();
+        return -3;
+    }
+    return 0;
+}
+
+void
+RepeatTrack::fetch(std::vector<RegionalTandemRepeat> & region_repeatvec, uvc1_refgpos_t tid, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend) const {
+    region_repeatvec.clear();
+    region_repeatvec.resize(excend - incbeg);
+    for (size_t stream_idx = 0; stream_idx < NUM_REPEAT_TRACK_STREAMS; stream_idx++) {
+        const auto & locs = tid_to_stream_to_locs[tid][stream_idx];
+        const RepeatTrackCheckpoint *checkpoints = (const RepeatTrackCheckpoint*)(data + locs[0]);
+        const auto checkpoint_it = std::upper_bound(checkpoints, checkpoints + locs[1], (int64_t)incbeg, 
+                [](int64_t pos, const RepeatTrackCheckpoint & checkpoint) { return pos < checkpoint.pos; });
+        if (checkpoint_it == checkpoints) { continue; }
+        int64_t run_pos = (checkpoint_it - 1)->pos;
+        const char *p = data + locs[2] + (checkpoint_it - 1)->offset;
+        const char *const endp = data + locs[2] + locs[3];
+        while (p < endp && run_pos < excend) {
+            const uint64_t len_and_flag = read_varint(p);
+            const uint64_t zigzag_posdiff = read_varint(p);
+            const int64_t run_len = (int64_t)(len_and_flag >> 1);
+            const bool is_sliding = (len_and_flag & 1);
+            std::array<int64_t, 4> fields = {{ 0 }};
+            fields[0] = run_pos - ((zigzag_posdiff & 1) ? -(int64_t)((zigzag_posdiff + 1) / 2) : (int64_t)(zigzag_posdiff / 2));
+            for (size_t i = 1; i < REPEAT_TRACK_STREAM_TO_NFIELDS[stream_idx]; i++) {
+                fields[i] = (int64_t)read_varint(p);
+            }
+            const int64_t pos_field = fields[0];
+            for (int64_t pos = MAX(run_pos, (int64_t)incbeg); pos < MIN(run_pos + run_len, (int64_t)excend); pos++) {
+                fields[0] = pos_field + (is_sliding ? (pos - run_pos) : 0);
+                stream_fields_to_rtr(region_repeatvec[pos - incbeg], stream_idx, fields, incbeg);
+            }
+            run_pos += run_len;
+        }
+    }
+    const RegionalTandemRepeat last_rtr = region_repeatvec.back();
+    region_repeatvec.push_back(last_rtr);
+}
+
+int
+vcf_text_to_index_records(std::vector<BgzfIndexRecord> & index_records, const std::string & vcf_text, const int32_t tid) {
+    size_t line_beg = 0;
+    while (line_beg < vcf_text.size()) {
+        size_t line_end = vcf_text.find('\n', line_beg);
+        line_end = ((std::string::npos == line_end) ? vcf_text.size() : (line_end + 1));
+        // The interval of a VCF record is from POS to POS + length(REF), which is the same as the one computed by tabix. 
+        const char *p = vcf_text.c_str() + line_beg;
+        const char *pos_field = strchr(p, '\t') + 1;
+        const hts_pos_t pos = strtoll(pos_field, NULL, 10);
+        const char *ref_field = strchr(strchr(pos_field, '\t') + 1, '\t') + 1;
+        const hts_pos_t ref_len = (hts_pos_t)(strchr(ref_field, '\t') - ref_field);
+        index_records.push_back(BgzfIndexRecord({(uint32_t)line_end, tid, pos - 1, pos - 1 + ref_len}));
+        line_beg = line_end;
+    }
+    return 0;
+}
+
+int
+bcf_bytes_to_index_records(std::vector<BgzfIndexRecord> & index_records, const std::string & bcf_bytes) {
+    size_t rec_beg = 0;
+    while (rec_beg + 32 <= bcf_bytes.size()) {
+        uint32_t x[8];
+        memcpy(x, bcf_bytes.data() + rec_beg, sizeof(x));
+        const size_t rec_end = rec_beg + 8 + (size_t)x[0] + (size_t)x[1];
+        index_records.push_back(BgzfIndexRecord({(uint32_t)rec_end, (int32_t)x[2], (hts_pos_t)(int32_t)x[3], (hts_pos_t)(int32_t)x[3] + (hts_pos_t)(int32_t)x[4]}));
+        rec_beg = rec_end;
+    }
+    return 0;
+}
+
+BgzfRecordIndexer::BgzfRecordIndexer(bool a_is_vcf, const std::vector<std::string> & a_tnames, const std::vector<hts_pos_t> & tlens) 
+        : is_vcf(a_is_vcf), tnames(a_tnames) {
+    hts_pos_t max_tlen = 0;
+    for (const auto tlen : tlens) {
+        max_tlen = MAX(max_tlen, tlen);
+    }
+    min_shift = 14;
+    if (is_vcf && max_tlen < ((hts_pos_t)1 << 29)) {
+        fmt = HTS_FMT_TBI;
+        n_lvls = 5;
+    } else {
+        // same as what bcftools index does for CSI
+        fmt = HTS_FMT_CSI;
+        n_lvls = 0;
+        for (hts_pos_t s = ((hts_pos_t)1 << min_shift); max_tlen + 256 > s; s <<= 3) {
+            n_lvls++;
+        }
+    }
+}
+
+void
+BgzfRecordIndexer::push(const BgzfIndexRecord & record, uint64_t beg_voffset, uint64_t end_voffset) {
+    if (is_failed) { return; }
+    if (NULL == idx) {
+        idx = hts_idx_init((int)tnames.size(), fmt, beg_voffset, min_shift, n_lvls);
+    }
+    if (NULL == idx || hts_idx_push(idx, record.tid, record.beg_pos, record.end_pos, end_voffset, 1) < 0) {
+        LOG(logERROR) << "Failed to index the record at tid=" << record.tid << " pos=" << record.beg_pos << ", so no index will be generated!";
+        is_failed = true;
+    }
+}
+
+int
+BgzfRecordIndexer::save(const std::string & fname, uint64_t final_voffset) {
+    if (is_failed) { return -1; }
+    if (NULL == idx) {
+        idx = hts_idx_init((int)tnames.size(), fmt, final_voffset, min_shift, n_lvls);
+    }
+    if (NULL == idx || hts_idx_finish(idx, final_voffset) < 0) {
+        LOG(logERROR) << "Failed to finish the index of the file " << fname;
+        return -2;
+    }
+    if (is_vcf) {
+        // The same meta data as what tbx_index saves, with the template names in the order of their tids. 
+        std::string names;
+        for (const auto & tname : tnames) {
+            names += tname;
+            names.push_back('\0');
+        }
+        int32_t x[7];
+        memcpy(x, &tbx_conf_vcf, 24);
+        x[6] = (int32_t)names.size();
+        uint8_t *meta = (uint8_t*)malloc(28 + names.size());
+        if (NULL == meta) {
+            fprintf(stderr, "The library function malloc failed at line %d in file %s!\n", __LINE__, __FILE__);
+            exit(-1);
+        }
+        memcpy(meta, x, 28);
+        memcpy(meta + 28, names.data(), names.size());
+        hts_idx_set_meta(idx, 28 + names.size(), meta, 0);
+    }
+    if (0 != hts_idx_save_as(idx, fname.c_str(), NULL, fmt)) {
+        LOG(logERROR) << "Failed to save the index of the file " << fname;
+        return -3;
+    }
+    return 0;
+}
+
+BgzfOrderedWriter::BgzfOrderedWriter(size_t n_threads, int a_compress_level, size_t a_max_inflight_nbytes) 
+        : compress_level(a_compress_level), max_inflight_nbytes(a_max_inflight_nbytes) {
+    for (size_t i = 0; i < MAX(n_threads, (size_t)1); i++) {
+        threads.push_back(std::thread([this]() { compressBlocks(); }));
+    }
+}
+
+size_t
+BgzfOrderedWriter::addStream(BGZF *fp, bool is_to_stdout, BgzfRecordIndexer *indexer) {
+    std::unique_lock<std::mutex> lock(mtx);
+    streams.push_back(Stream());
+    streams.back().fp = fp;
+    streams.back().is_to_stdout = is_to_stdout;
+    streams.back().indexer = ((NULL != fp) ? indexer : NULL);
+    return streams.size() - 1;
+}
+
+uint64_t
+BgzfOrderedWriter::getEndVirtualOffset(size_t stream_idx) {
+    std::unique_lock<std::mutex> lock(mtx);
+    return (streams[stream_idx].compressed_nbytes << 16);
+}
+
+void
+BgzfOrderedWriter::submit(size_t stream_idx, std::string && uncompressed, std::vector<BgzfIndexRecord> && index_records) {
+    std::unique_lock<std::mutex> lock(mtx);
+    const size_t nbytes = uncompressed.size();
+    submit_cv.wait(lock, [this, nbytes]{ return (0 == inflight_nbytes || inflight_nbytes + nbytes <= max_inflight_nbytes); });
+    Stream & stream = streams[stream_idx];
+    const size_t seq = stream.n_submitted_chunks;
+    stream.n_submitted_chunks++;
+    inflight_nbytes += nbytes;
+    Chunk & chunk = stream.seq_to_chunk[seq];
+    chunk.uncompressed = std::move(uncompressed);
+    chunk.index_records = std::move(index_records);
+    if (NULL != stream.fp) {
+        const size_t n_blocks = (nbytes + BGZF_BLOCK_SIZE - 1) / BGZF_BLOCK_SIZE;
+        chunk.compressed_blocks.resize(n_blocks);
+        for (size_t block_idx = 0; block_idx < n_blocks; block_idx++) {
+            jobs.push_back(Job({stream_idx, seq, block_idx}));
+        }
+        job_cv.notify_all();
+        if (n_blocks > 0) { return; }
+    }
+    writeReadyChunks(lock, stream_idx);
+}
+
+void
+BgzfOrderedWriter::compressBlocks() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        job_cv.wait(lock, [this]{ return (jobs.size() > 0 || is_closed); });
+        if (0 == jobs.size()) { return; }
+        const Job job = jobs.front();
+        jobs.pop_front();
+        Chunk & chunk = streams[job.stream_idx].seq_to_chunk[job.seq]; // the chunk cannot be erased before all of its blocks are compressed
+        lock.unlock();
+        const size_t beg = job.block_idx * BGZF_BLOCK_SIZE;
+        const size_t block_len = MIN(chunk.uncompressed.size() - beg, (size_t)BGZF_BLOCK_SIZE);
+        std::string & compressed_block = chunk.compressed_blocks[job.block_idx];
+        compressed_block.resize(BGZF_MAX_BLOCK_SIZE);
+        size_t compressed_len = BGZF_MAX_BLOCK_SIZE;
+        if (0 != bgzf_compress(&compressed_block[0], &compressed_len, chunk.uncompressed.data() + beg, block_len, compress_level)) {
+            LOG(logCRITICAL) << "Failed to compress a block of " << block_len << " bytes into the BGZF format!";
+            exit(-9);
+        }
+        compressed_block.resize(compressed_len);
+        lock.lock();
+        chunk.n_compressed_blocks++;
+        if (chunk.n_compressed_blocks == chunk.compressed_blocks.size()) {
+            writeReadyChunks(lock, job.stream_idx);
+        }
+    }
+}
+
+void
+BgzfOrderedWriter::writeReadyChunks(std::unique_lock<std::mutex> & lock, size_t stream_idx) {
+    Stream & stream = streams[stream_idx];
+    if (stream.is_being_written) { return; } // the thread that is writing this stream will also write the chunk that is just completed
+    stream.is_being_written = true;
+    while (true) {
+        auto chunk_it = stream.seq_to_chunk.find(stream.n_written_chunks);
+        if (chunk_it == stream.seq_to_chunk.end() || chunk_it->second.n_compressed_blocks < chunk_it->second.compressed_blocks.size()) {
+            break;
+        }
+        Chunk chunk = std::move(chunk_it->second);
+        stream.seq_to_chunk.erase(chunk_it);
+        lock.unlock();
+        if (NULL != stream.fp) {
+            std::vector<uint64_t> block_addresses;
+            block_addresses.reserve(chunk.compressed_blocks.size());
+            for (const auto & compressed_block : chunk.compressed_blocks) {
+                if (bgzf_raw_write(stream.fp, compressed_block.data(), compressed_block.size()) < 0) {
+                    LOG(logCRITICAL) << "Failed to write " << compressed_block.size() << " bytes of compressed data!";
+                    exit(-9);
+                }
+                block_addresses.push_back(stream.compressed_nbytes);
+                stream.compressed_nbytes += compressed_block.size();
+            }
+            if (NULL != stream.indexer) {
+                // The end of a chunk is the beginning of the block right after this chunk. 
+                auto to_voffset = [&](uint32_t offset) -> uint64_t { 
+                    return ((offset == chunk.uncompressed.size()) 
+                            ? (stream.compressed_nbytes << 16) 
+                            : ((block_addresses[offset / BGZF_BLOCK_SIZE] << 16) | (offset % BGZF_BLOCK_SIZE)));
+                };
+                uint32_t beg_offset = 0;
+                for (const auto & index_record : chunk.index_records) {
+                    stream.indexer->push(index_record, to_voffset(beg_offset), to_voffset(index_record.end_offset));
+                    beg_offset = index_record.end_offset;
+                }
+            }
+        } else if (stream.is_to_stdout) {
+            std::cout << chunk.uncompressed;
+        }
+        lock.lock();
+        stream.n_written_chunks++;
+        inflight_nbytes -= chunk.uncompressed.size();
+        submit_cv.notify_all();
+    }
+    stream.is_being_written = false;
+}
+
+void
+BgzfOrderedWriter::close() {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (is_closed) { return; }
+    is_closed = true;
+    job_cv.notify_all();
+    lock.unlock();
+    // The jobs are always run before the threads exit, and the last completed chunk of each stream triggers its writing. 
+    for (auto & t : threads) {
+        t.join();
+    }
+    std::cout.flush();
+}
@@ -3,13 +3,24 @@
 
 #include "common.hpp"
 
+#include "htslib/bgzf.h"
 #include "htslib/sam.h"
 #include "htslib/hts.h"
+#include "htslib/vcf.h"
 
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #define BED_END_TO_END_BIT 0x1
+#define BAM_RECORD_SLAB_NUM_RECORDS_PER_BLOCK 4096
+#define BAM_RECORD_SLAB_NUM_BYTES_PER_BLOCK (1024*1024)
 
 struct BedLine {
     std::string tname; // can be set to empty if tid != -1
@@ -43,5 +54,329 @@ load_bam_records(
         const uvc1_refgpos_t query_beg, 
         const uvc1_refgpos_t query_end);
 
-#endif
+// Arena of BAM records that is owned by one region and is released all at once. 
+// The record structs are stored in fixed-capacity blocks and their variable-length data are packed into large byte blocks, 
+//   so adding a record usually does not allocate memory and the address of each added record never changes. 
+// The records must not be passed to bam_destroy1 or to any htslib function that reallocates bam1_t::data. 
+struct BamRecordSlab {
+    std::vector<std::vector<bam1_t>> record_blocks;
+    std::vector<std::vector<uint8_t>> data_blocks;
+    size_t nrecords = 0;
+    
+    BamRecordSlab() {};
+    BamRecordSlab(const BamRecordSlab &) = delete;
+    BamRecordSlab & operator=(const BamRecordSlab &) = delete;
+    
+    // Returns the copy of aln that is owned by this slab.
+    bam1_t *add(const bam1_t *aln);
+    size_t size() const { return nrecords; };
+    // The number of bytes allocated for the records and their data. 
+    size_t nbytes() const {
+        size_t ret = 0;
+        for (const auto & record_block : record_blocks) { ret += record_block.capacity() * sizeof(bam1_t); }
+        for (const auto & data_block : data_blocks) { ret += data_block.capacity(); }
+        return ret;
+    };
+};
+
+// Same as load_bam_records except that the records are decoded into bam_record_slab which owns them. 
+std::vector<bam1_t *>
+load_bam_records_into_slab(
+        int & sam_itr_queryi_ret,
+        BamRecordSlab & bam_record_slab,
+        samFile *samfile,
+        const hts_idx_t * hts_idx,
+        const uvc1_refgpos_t query_tid,
+        const uvc1_refgpos_t query_beg, 
+        const uvc1_refgpos_t query_end);
+
+// Sliding window of decoded BAM records that is owned by one thread. 
+// Consecutive queries moving forward on the same tid reuse the records already decoded for the overlapping part of the windows.
+struct BamRecordCache {
+    uvc1_refgpos_t tid = -1;
+    uvc1_refgpos_t beg_pos = 0;
+    uvc1_refgpos_t end_pos = 0;
+    std::vector<bam1_t *> records; // in the same order as in the BAM file
+    
+    BamRecordCache() {};
+    BamRecordCache(const BamRecordCache &) = delete;
+    BamRecordCache & operator=(const BamRecordCache &) = delete;
+    ~BamRecordCache() { clear(); };
+    
+    void clear();
+    // The number of bytes allocated for the cached records and their data. 
+    size_t nbytes() const;
+    // Fill alns with the records overlapping query_tid:query_beg-query_end in the same order as returned by sam_itr_queryi. 
+    // The records are still owned by the cache and are only valid until the next call to query or clear. 
+    int query(
+            std::vector<bam1_t *> & alns,
+            samFile *samfile,
+            const hts_idx_t * hts_idx,
+            const uvc1_refgpos_t query_tid,
+            const uvc1_refgpos_t query_beg, 
+            const uvc1_refgpos_t query_end);
+};
+
+// Header of the BCF output, which is parsed from the text of the VCF header. 
+struct BcfOutputHeader {
+    bcf_hdr_t *hdr = NULL;
+    std::vector<int> tag_to_hdr_id; // FORMAT/TAG index to its ID in the dictionary of hdr
+    
+    BcfOutputHeader() {};
+    BcfOutputHeader(const BcfOutputHeader &) = delete;
+    BcfOutputHeader & operator=(const BcfOutputHeader &) = delete;
+    ~BcfOutputHeader();
+    
+    int init(const std::string & vcf_header_text, const char *const *tag_ids, size_t n_tags);
+    // Append the magic string and the header of the BCF file.
+    int appendHeaderBytes(std::string & out_bytes) const;
+};
+
+// Encoder of the FORMAT fields of one sample into the per-sample part of one BCF record. 
+// The values are written in the smallest BCF type that can hold all of them, just as what vcf_parse does. 
+struct BcfFormatEncoder {
+    const int *tag_to_hdr_id = NULL;
+    std::string indiv;
+    uint32_t n_fmt = 0;
+    std::vector<int32_t> int32_buf;
+    std::string string_buf;
+    
+    void clear() { indiv.clear(); n_fmt = 0; };
+    void encodeGenotype(size_t tag, const std::string & gt);
+    void encodeString(size_t tag, const char *value, size_t len); // the empty string is encoded as the dot
+    void encodeStrings(size_t tag, const std::string *values, size_t n); // comma-separated
+    void encodeInt32s(size_t tag, const int32_t *values, size_t n); // no value is encoded as missing
+    void encodeInt64s(size_t tag, const int64_t *values, size_t n); // values are clamped to the range of int32
+    void encodeFloats(size_t tag, const float *values, size_t n);
+};
+
+// Encoder of the first eight columns of one record into the shared part of one BCF record. 
+// The INFO values are written in the same way as the FORMAT values of BcfFormatEncoder. 
+struct BcfSitesEncoder {
+    const bcf_hdr_t *hdr = NULL;
+    std::string shared;
+    int32_t rid = -1;
+    int32_t pos = 0;
+    int32_t rlen = 0;
+    float qual = 0;
+    uint32_t n_allele = 0;
+    uint32_t n_info = 0;
+    int errcode = 0; // nonzero if the CHROM or FILTER is not in the header
+    
+    // Start a new record with the ID column missing. vcfpos is one-based, alts is comma-separated, 
+    //   a_qual is missing if it is NAN, and filter_id is missing if it is NULL. 
+    int encodeSite(const char *tname, int64_t vcfpos, const std::string & ref, const std::string & alts, float a_qual, const char *filter_id);
+    void encodeInfoFlag(const char *key);
+    void encodeInfoString(const char *key, const std::string & value);
+    void encodeInfoInt32s(const char *key, const int32_t *values, size_t n);
+    void encodeInfoFloats(const char *key, const float *values, size_t n);
+};
+
+// Converter of the output records into BCF records, which is owned by one thread. 
+struct BcfLineEncoder {
+    const BcfOutputHeader & bcf_output_header;
+    bcf1_t *bcf1_record;
+    kstring_t line_kstring = {0, 0, NULL};
+    BcfSitesEncoder sites_encoder;
+    BcfFormatEncoder format_encoder;
+    
+    BcfLineEncoder(const BcfOutputHeader & a_bcf_output_header);
+    BcfLineEncoder(const BcfLineEncoder &) = delete;
+    BcfLineEncoder & operator=(const BcfLineEncoder &) = delete;
+    ~BcfLineEncoder();
+    
+    // Append the BCF record of the VCF line (without the trailing newline), which is parsed with vcf_parse. 
+    int appendVcfLine(std::string & out_bytes, const std::string & vcf_line);
+    // Append the BCF record consisting of the site encoded by sites_encoder and the single sample encoded by format_encoder. 
+    // Returns -1 and appends nothing if the site cannot be encoded. 
+    int appendSitesAndFormat(std::string & out_bytes) const;
+    // Records can be encoded by sites_encoder and format_encoder only if the header has exactly one sample. 
+    bool hasSingleSample() const { return (1 == bcf_hdr_nsamples(bcf_output_header.hdr)); };
+};
+
+// Append the VCF line (without the trailing newline) as text if bcf_line_encoder is NULL and as a BCF record otherwise. 
+int
+append_vcf_line(std::string & out_string, BcfLineEncoder *bcf_line_encoder, const std::string & vcf_line);
+
+// Parse the header text into a newly allocated header. Exit if the text cannot be parsed. 
+bcf_hdr_t *
+bcf_hdr_parse_text(const std::string & vcf_header_text);
 
+// Read-only reference sequences in uppercase that are shared by all threads. 
+// The sequences are converted from the FASTA file once, saved into a cache file next to the FASTA file, 
+//   and memory-mapped from this cache file by later runs, so the FASTA file is neither parsed nor converted to uppercase again, 
+//   and the pages of the reference are shared by all threads and all concurrent processes. 
+// The cache file consists of a magic string, the number of sequences, the length of each sequence, and then all sequences without newline. 
+struct ReferenceStore {
+    const char *data = NULL;
+    size_t mapped_size = 0;
+    std::vector<uint64_t> tid_to_offset;
+    std::vector<uvc1_refgpos_t> tid_to_len;
+    
+    ReferenceStore() {};
+    ReferenceStore(const ReferenceStore &) = delete;
+    ReferenceStore & operator=(const ReferenceStore &) = delete;
+    ~ReferenceStore();
+    
+    // Returns zero if the cache file is mapped, building the cache file first if it is missing or older than the FASTA file. 
+    int load(const std::string & fasta_fname, const std::string & cache_fname);
+    bool isLoaded() const { return (NULL != data); };
+    // The uppercase sequence of the template tid from incbeg to excend. 
+    std::string fetch(uvc1_refgpos_t tid, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend) const {
+        return std::string(data + tid_to_offset[tid] + incbeg, excend - incbeg);
+    };
+};
+
+// The parameters that the tandem repeats of the reference depend on. 
+struct RepeatTrackParams {
+    int32_t indel_str_repeatsize_max;
+    int32_t indel_vntr_repeatsize_max;
+    int32_t indel_BQ_max;
+    int32_t reserved;
+    double indel_polymerase_slip_rate;
+    double indel_del_to_ins_err_ratio;
+};
+
+#define NUM_REPEAT_TRACK_STREAMS 3 // short tandem repeats, any tandem repeats, and short tandem repeats beginning at each position
+#define REPEAT_TRACK_CHECKPOINT_NRUNS 64
+
+struct RepeatTrackCheckpoint {
+    int64_t pos;
+    uint64_t offset;
+};
+
+// The tandem repeats (RegionalTandemRepeat) of consecutive positions of one template, run-length encoded in one stream per group of fields. 
+// Each run consists of consecutive positions whose fields are identical, 
+//   except that the position field of the group (e.g., begpos) is either constant or increasing by one per position. 
+// Each run is encoded as varints, and the position and byte offset of every REPEAT_TRACK_CHECKPOINT_NRUNS runs are kept for random access. 
+struct RepeatTrackRuns {
+    std::array<std::string, NUM_REPEAT_TRACK_STREAMS> stream_to_bytes;
+    std::array<std::vector<RepeatTrackCheckpoint>, NUM_REPEAT_TRACK_STREAMS> stream_to_checkpoints;
+    
+    // Encode the positions from incbeg to excend, where region_repeatvec[i] is at the position region_offset + i. 
+    void append(const std::vector<RegionalTandemRepeat> & region_repeatvec, uvc1_refgpos_t region_offset, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend);
+    // Concatenate the runs of the positions that come right after the positions of this object. 
+    void append(const RepeatTrackRuns & other);
+};
+
+// The tandem-repeat track of the reference, which is built once by the command in main.cpp and then memory-mapped. 
+// The file consists of a magic string, the RepeatTrackParams, the number of templates, 
+//   the (checkpoint offset, number of checkpoints, byte offset, number of bytes) of each stream of each template, and then the data. 
+struct RepeatTrack {
+    const char *data = NULL;
+    size_t mapped_size = 0;
+    std::vector<std::array<std::array<uint64_t, 4>, NUM_REPEAT_TRACK_STREAMS>> tid_to_stream_to_locs;
+    
+    RepeatTrack() {};
+    RepeatTrack(const RepeatTrack &) = delete;
+    RepeatTrack & operator=(const RepeatTrack &) = delete;
+    ~RepeatTrack();
+    
+    // Returns zero if the track file is mapped and was built from the reference with the same params. 
+    int load(const std::string & track_fname, const std::string & fasta_fname, const RepeatTrackParams & params, size_t ntemplates);
+    bool isLoaded() const { return (NULL != data); };
+    // Decode the same vector as refstring2repeatvec on the reference from incbeg to excend does, with the positions relative to incbeg. 
+    void fetch(std::vector<RegionalTandemRepeat> & region_repeatvec, uvc1_refgpos_t tid, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend) const;
+};
+
+// Write the track of ntemplates templates, where tid_to_runs_func(runs, tid) encodes all positions of the template tid into runs. 
+// The templates are encoded one after another, so only the runs of one template are kept in memory. 
+int repeat_track_save(const std::string & track_fname, const RepeatTrackParams & params, size_t ntemplates, 
+        const std::function<int(RepeatTrackRuns &, size_t)> & tid_to_runs_func);
+
+// Genomic interval of one output record and the offset of the end of this record in the uncompressed chunk that contains it. 
+struct BgzfIndexRecord {
+    uint32_t end_offset;
+    int32_t tid;
+    hts_pos_t beg_pos;
+    hts_pos_t end_pos;
+};
+
+// Append the index records of the chunk of VCF lines that are all on the template tid. 
+int
+vcf_text_to_index_records(std::vector<BgzfIndexRecord> & index_records, const std::string & vcf_text, const int32_t tid);
+// Append the index records of the chunk of BCF records. 
+int
+bcf_bytes_to_index_records(std::vector<BgzfIndexRecord> & index_records, const std::string & bcf_bytes);
+
+// Tabix (.tbi) or CSI (.csi) index of a bgzipped VCF or BCF file that is built while the blocks of this file are written, 
+//   so that the file does not have to be read and decompressed again for indexing. 
+// TBI is used for VCF if all templates are shorter than 2**29 bases, and CSI is used otherwise. 
+class BgzfRecordIndexer {
+    hts_idx_t *idx = NULL;
+    int fmt;
+    int min_shift;
+    int n_lvls;
+    bool is_vcf;
+    std::vector<std::string> tnames;
+    bool is_failed = false;
+
+public:
+    BgzfRecordIndexer(bool a_is_vcf, const std::vector<std::string> & a_tnames, const std::vector<hts_pos_t> & tlens);
+    BgzfRecordIndexer(const BgzfRecordIndexer &) = delete;
+    BgzfRecordIndexer & operator=(const BgzfRecordIndexer &) = delete;
+    ~BgzfRecordIndexer() { if (NULL != idx) { hts_idx_destroy(idx); } };
+    
+    // The record starts at beg_voffset (which is the end of the previous record) and ends at end_voffset. 
+    void push(const BgzfIndexRecord & record, uint64_t beg_voffset, uint64_t end_voffset);
+    int save(const std::string & fname, uint64_t final_voffset);
+};
+
+// Writer of multiple bgzipped output streams. The chunks submitted to each stream are written in the order of their submission. 
+// Each chunk is split into BGZF blocks and the blocks of all streams are compressed by a pool of threads. 
+// The thread that completes the oldest unwritten chunk of a stream writes all of the completed chunks at the head of this stream, 
+//   so compression overlaps with the computation that produces the chunks and with the writing of the other chunks. 
+class BgzfOrderedWriter {
+    struct Chunk {
+        std::string uncompressed;
+        std::vector<BgzfIndexRecord> index_records;
+        std::vector<std::string> compressed_blocks;
+        size_t n_compressed_blocks = 0;
+    };
+    struct Stream {
+        BGZF *fp = NULL; // NULL means that the chunks are either written to stdout without compression or discarded
+        bool is_to_stdout = false;
+        BgzfRecordIndexer *indexer = NULL;
+        uint64_t compressed_nbytes = 0; // all bytes are written by bgzf_raw_write, so this is the address of the next block
+        size_t n_submitted_chunks = 0;
+        size_t n_written_chunks = 0;
+        bool is_being_written = false;
+        std::map<size_t, Chunk> seq_to_chunk;
+    };
+    struct Job {
+        size_t stream_idx;
+        size_t seq;
+        size_t block_idx;
+    };
+    
+    std::mutex mtx;
+    std::condition_variable job_cv;
+    std::condition_variable submit_cv;
+    std::deque<Stream> streams; // the address of each stream never changes
+    std::deque<Job> jobs;
+    std::vector<std::thread> threads;
+    size_t inflight_nbytes = 0;
+    bool is_closed = false;
+    const int compress_level;
+    const size_t max_inflight_nbytes;
+    
+    void compressBlocks();
+    void writeReadyChunks(std::unique_lock<std::mutex> & lock, size_t stream_idx);
+
+public:
+    BgzfOrderedWriter(size_t n_threads, int a_compress_level, size_t a_max_inflight_nbytes);
+    BgzfOrderedWriter(const BgzfOrderedWriter &) = delete;
+    BgzfOrderedWriter & operator=(const BgzfOrderedWriter &) = delete;
+    ~BgzfOrderedWriter() { close(); };
+    
+    // Returns the index of the new stream. The stream does not own fp and indexer, and indexer is NULL if the stream is not indexed. 
+    size_t addStream(BGZF *fp, bool is_to_stdout, BgzfRecordIndexer *indexer = NULL);
+    // Blocks until the number of bytes that are submitted but not written yet is small enough. 
+    void submit(size_t stream_idx, std::string && uncompressed, std::vector<BgzfIndexRecord> && index_records = std::vector<BgzfIndexRecord>());
+    // The virtual offset of the end of the stream, which is valid only after close is called. 
+    uint64_t getEndVirtualOffset(size_t stream_idx);
+    // Waits until all chunks are written. After this call, the BGZF files of the streams can be closed. 
+    void close();
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include "common.hpp"
 #include "grouping.hpp"
 #include "iohts.hpp"
+#include "pipeline.hpp"
 #include "version.h"
 
 #include "htslib/bgzf.h"
@@ -13,6 +14,7 @@
 
 #include <chrono>
 #include <ctime>
+#include <memory>
 #include <thread>
 #include <tuple>
 
@@ -25,34 +27,13 @@ xfree(void *ptr) {
     if (NULL != ptr) { free(ptr); }
 }
 
-template <bool TIsInputCompressed>
-int 
-clearstring(BGZF * bgzip_file, const std::string & outstring_allp, bool is_output_to_stdout = false, bool flush = !TIsInputCompressed) {
-    if (is_output_to_stdout) {
-        std::cout << outstring_allp;
-        return outstring_allp.size();
-    }
-    if (NULL == bgzip_file) { return -1; }
-    int ret = 0;
-    if (TIsInputCompressed) {
-        ret = bgzf_raw_write(bgzip_file, outstring_allp.c_str(), outstring_allp.size());
-        LOG(logINFO) << "Written " << ret << " bytes of compressed data from " << outstring_allp.size()  << " bytes of compressed data.";
-    } else {
-        ret = bgzf_write(bgzip_file, outstring_allp.c_str(), outstring_allp.size());
-        LOG(logINFO) << "Written " << ret << " bytes of compressed data from " << outstring_allp.size()  << " bytes of raw data.";
-    }
-    if (flush) { 
-        int flushret = bgzf_flush(bgzip_file); 
-        if (flushret != 0) {
-            return flushret;
-        }
-    }
-    return ret;
-};
-
 std::string 
-load_refstring(const faidx_t *ref_faidx, uvc1_refgpos_t tid, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend) {
+load_refstring(const ReferenceStore *ref_store, const faidx_t *ref_faidx, uvc1_refgpos_t tid, uvc1_refgpos_t incbeg, uvc1_refgpos_t excend) {
     assertUVC(incbeg < excend);
+    if (NULL != ref_store) {
+        assertUVC(tid < (uvc1_refgpos_t)ref_store->tid_to_len.size() && excend <= ref_store->tid_to_len[tid]);
+        return ref_store->fetch(tid, incbeg, excend);
+    }
     if (NULL == ref_faidx) {
         return std::string(excend - incbeg, 'n');
     }
@@ -68,6 +49,88 @@ load_refstring(const faidx_t *ref_faidx, uvc1_refgpos_t tid, uvc1_refgpos_t incb
     return ret;
 };
 
+void
+load_ref_store(ReferenceStore & ref_store, const CommandLineArgs & paramset) {
+    if (paramset.fasta_ref_fname.size() > 0 && paramset.fasta_cache_fname != "NA") {
+        const std::string cache_fname = ((paramset.fasta_cache_fname.size() > 0) ? paramset.fasta_cache_fname : (paramset.fasta_ref_fname + FASTA_CACHE_SUFFIX));
+        if (0 != ref_store.load(paramset.fasta_ref_fname, cache_fname)) {
+            LOG(logWARNING) << "Failed to use the reference cache " << cache_fname << ", so each thread loads the reference " << paramset.fasta_ref_fname << " by itself. ";
+        }
+    }
+}
+
+std::string
+get_repeat_track_fname(const CommandLineArgs & paramset) {
+    if (0 == paramset.fasta_ref_fname.size() || paramset.repeat_track_fname == "NA") {
+        return "";
+    }
+    return ((paramset.repeat_track_fname.size() > 0) ? paramset.repeat_track_fname : (paramset.fasta_ref_fname + REPEAT_TRACK_SUFFIX));
+}
+
+RepeatTrackParams
+paramset_to_repeat_track_params(const CommandLineArgs & paramset) {
+    RepeatTrackParams ret;
+    memset(&ret, 0, sizeof(ret)); // the params are compared byte by byte
+    ret.indel_str_repeatsize_max = paramset.indel_str_repeatsize_max;
+    ret.indel_vntr_repeatsize_max = paramset.indel_vntr_repeatsize_max;
+    ret.indel_BQ_max = paramset.indel_BQ_max;
+    ret.indel_polymerase_slip_rate = paramset.indel_polymerase_slip_rate;
+    ret.indel_del_to_ins_err_ratio = paramset.indel_del_to_ins_err_ratio;
+    return ret;
+}
+
+#define REPEAT_TRACK_BUILD_WINDOW_SIZE (1024 * 1024)
+#define REPEAT_TRACK_BUILD_WINDOW_MARGIN (MAX_STR_N_BASES * 16)
+
+// Build the tandem-repeat track of the reference by running refstring2repeatvec on overlapping windows in parallel. 
+// Each window is extended by a margin on both sides, so that only the tandem repeats longer than the margin are truncated at the window borders. 
+int
+build_repeat_track(const std::string & track_fname, const ReferenceStore *ref_store, const CommandLineArgs & paramset, size_t nthreads) {
+    faidx_t *fai = fai_load(paramset.fasta_ref_fname.c_str());
+    if (NULL == fai) { return -1; }
+    std::vector<uvc1_refgpos_t> tid_to_tlen;
+    for (int tid = 0; tid < faidx_nseq(fai); tid++) {
+        tid_to_tlen.push_back(faidx_seq_len(fai, faidx_iseq(fai, tid)));
+    }
+    fai_destroy(fai);
+    return repeat_track_save(track_fname, paramset_to_repeat_track_params(paramset), tid_to_tlen.size(), [&](RepeatTrackRuns & runs, size_t tid) {
+        const uvc1_refgpos_t tlen = tid_to_tlen[tid];
+        const size_t nwindows = (tlen + REPEAT_TRACK_BUILD_WINDOW_SIZE - 1) / REPEAT_TRACK_BUILD_WINDOW_SIZE;
+        std::vector<RepeatTrackRuns> window_to_runs(nwindows);
+        parallel_for_parts(nthreads, nwindows, [&](size_t part_idx IGNORE_UNUSED_PARAM, size_t beg_window_idx, size_t end_window_idx) {
+            faidx_t *part_fai = ((NULL == ref_store) ? fai_load(paramset.fasta_ref_fname.c_str()) : NULL);
+            if (NULL == ref_store && NULL == part_fai) {
+                LOG(logCRITICAL) << "Failed to load reference index for file " << paramset.fasta_ref_fname;
+                exit(-5);
+            }
+            for (size_t window_idx = beg_window_idx; window_idx < end_window_idx; window_idx++) {
+                const uvc1_refgpos_t incbeg = window_idx * REPEAT_TRACK_BUILD_WINDOW_SIZE;
+                const uvc1_refgpos_t excend = MIN(tlen, incbeg + REPEAT_TRACK_BUILD_WINDOW_SIZE);
+                const uvc1_refgpos_t extended_incbeg = MAX(0, incbeg - REPEAT_TRACK_BUILD_WINDOW_MARGIN);
+                const uvc1_refgpos_t extended_excend = MIN(tlen, excend + REPEAT_TRACK_BUILD_WINDOW_MARGIN);
+                const std::string refstring = load_refstring(ref_store, part_fai, tid, extended_incbeg, extended_excend);
+                const std::vector<RegionalTandemRepeat> region_repeatvec = refstring2repeatvec(
+                        refstring, 
+                        paramset.indel_str_repeatsize_max,
+                        paramset.indel_vntr_repeatsize_max,
+                        paramset.indel_BQ_max,
+                        paramset.indel_polymerase_slip_rate,
+                        paramset.indel_del_to_ins_err_ratio,
+                        0);
+                window_to_runs[window_idx].append(region_repeatvec, extended_incbeg, incbeg, excend);
+            }
+            if (NULL != part_fai) {
+                fai_destroy(part_fai);
+            }
+        });
+        for (const auto & window_runs : window_to_runs) {
+            runs.append(window_runs);
+        }
+        LOG(logINFO) << "Built the tandem-repeat track of the template with ID " << tid;
+        return 0;
+    });
+}
+
 template <class TKey, class TVal>
 std::vector<std::pair<TKey, TVal>>
 map2vector(const std::map<TKey, TVal> & key2val4map) {
@@ -95,39 +158,6 @@ mutform2count4vec_to_simplemut2indices(
     return simplemut2indices;
 };
 
-int 
-bgzip_string(std::string & compressed_outstring, const std::string & uncompressed_outstring) {
-    char *compressed_outstr = (char*)malloc(uncompressed_outstring.size() * sizeof(char));
-    if (NULL == compressed_outstr) {
-        fprintf(stderr, "The library function malloc failed at line %d in file %s!\n", __LINE__, __FILE__);
-        exit(-1);
-    }
-    size_t compressed_capacity = uncompressed_outstring.size();
-    size_t compressed_totlen = 0;
-    size_t uncompress_totlen = 0;
-    do {
-        if (compressed_totlen + BGZF_BLOCK_SIZE >= compressed_capacity) {
-            char *compressed_outstr_tmp = (char*)realloc(compressed_outstr, (compressed_capacity * 2 + BGZF_BLOCK_SIZE) * sizeof(char));
-            if (NULL == compressed_outstr_tmp) {
-                fprintf(stderr, "The library function realloc failed at line %d in file %s!\n", __LINE__, __FILE__);
-                exit(-2);
-            }
-            compressed_outstr = compressed_outstr_tmp;
-            compressed_capacity = compressed_capacity * 2 + BGZF_BLOCK_SIZE;
-        }
-        size_t block_len = MIN(uncompressed_outstring.size() - uncompress_totlen, (size_t)BGZF_BLOCK_SIZE);
-        if (0 == block_len) { break; }
-        size_t compressed_len = 0;
-        bgzf_compress(compressed_outstr + compressed_totlen, &compressed_len, uncompressed_outstring.c_str() + uncompress_totlen, block_len, 5);
-        uncompress_totlen += block_len;
-        compressed_totlen += compressed_len;
-    } while (uncompress_totlen < uncompressed_outstring.size());
-    
-    compressed_outstring += std::string(compressed_outstr, compressed_totlen);
-    free(compressed_outstr);
-    return 0;
-}
-
 struct BatchArg {
     std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> outstring3fastq; // outstring_fastq;
     std::string outstring_allp;
@@ -135,21 +165,63 @@ struct BatchArg {
     int thread_id;
     samFile *samfile;
     hts_idx_t *hts_idx;
+    BamRecordCache *bam_record_cache;
     faidx_t *ref_faidx;
+    const ReferenceStore *ref_store; // NULL if the reference is not memory-mapped
+    const RepeatTrack *repeat_track; // NULL if the tandem repeats are computed for each region
     bcf_hdr_t *bcf_hdr;
-    bcf_srs_t *sr;
+    BcfLineEncoder *bcf_line_encoder; // NULL if the output is VCF
+    ThreadBudget *thread_budget; // shared by all workers
+    // Only used by the tumor pass of the joint calling, which fills the variants for the normal pass instead of generating the VCF. 
+    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> *joint_tid_pos_symb_to_tkis;
+    bool is_joint_tumor_format_retrieved;
     
     BedLine prev_bedline;
     BedLine bedline;
     std::tuple<std::string, uint32_t> tname_tseqlen_tuple;
     size_t regionbatch_ordinal;
     size_t regionbatch_tot_num;
+    size_t region_read_nbytes; // measured by process_batch for the MemoryGovernor
+    size_t region_pos_nbytes; // measured by process_batch for the MemoryGovernor
+    size_t region_n_reads; // number of reads held by the region_read_nbytes
+    size_t region_n_positions; // number of positions of the bedline for which the region_pos_nbytes is held
 
     const CommandLineArgs paramset;
     const std::string UMI_STRUCT_STRING;
     const bool is_vcf_out_pass_to_stdout;
 };
 
+// One tier-1 region shared by all of its tier-2 regions. The rescued variants are freed after the last tier-2 region is processed. 
+// The bcf1_t records of the rescued variants are owned by the TumorVariantStore. 
+struct Tier1Region {
+    std::vector<BedLine> bedlines;
+    BedLine prev_bedline; // the last tier-3 region of the previous tier-1 region
+    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> tid_pos_symb_to_tkis;
+    
+    Tier1Region() : prev_bedline(BedLine(-1, 0, 0, 0, 0)) {};
+    Tier1Region(const Tier1Region &) = delete;
+    Tier1Region & operator=(const Tier1Region &) = delete;
+};
+
+// One tier-3 region, which is the unit of work that can be stolen by another thread. 
+struct Tier3Task {
+    std::shared_ptr<const Tier1Region> tier1region;
+    size_t bedline_idx;
+    size_t tier2_end_idx; // the end of the tier-2 region that this tier-3 region is initially assigned to
+    size_t mem_nbytes; // acquired from the MemoryGovernor
+    
+    Tier3Task() : bedline_idx(0), tier2_end_idx(0), mem_nbytes(0) {};
+    Tier3Task(const std::shared_ptr<const Tier1Region> & a_tier1region, size_t a_bedline_idx, size_t a_tier2_end_idx, size_t a_mem_nbytes) 
+            : tier1region(a_tier1region), bedline_idx(a_bedline_idx), tier2_end_idx(a_tier2_end_idx), mem_nbytes(a_mem_nbytes) {};
+};
+
+struct Tier3Result {
+    size_t mem_nbytes = 0; // still held in the MemoryGovernor until the output is written
+    std::string outstring_pass;
+    std::vector<BgzfIndexRecord> index_records_pass;
+    std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> outstring3fastq;
+};
+
 std::string 
 als_to_string(const char *const* const allele, uint32_t n_allele) {
     std::string ret;
@@ -179,198 +251,287 @@ als_to_string(const char *const* const allele, uint32_t n_allele) {
         assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for %s and line %ld!\n", ndst_val, valsize, v, line->pos)); \
         (k) = (bcfints[0] + bcfints[1]);
 
-template <class T1, class T2, class T3>
-const std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>>
-rescue_variants_from_vcf(
-        const T1 & bedlines,
-        const T2 & tid_to_tname_tlen_tuple_vec,
-        const std::string & vcf_tumor_fname, 
+// Fill the key and the info of the variant from the unpacked record of the tumor VCF, and return false if this record cannot be used to rescue any variant. 
+// The buffers bcfstring and bcfints are reused across the records and must be freed by the caller. 
+template <class T3>
+bool
+bcf1_to_tumor_key_info(
+        std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol> & retkey,
+        TumorKeyInfo & tki,
+        char *& bcfstring,
+        int32_t *& bcfints,
+        bcf1_t *line,
         const T3 *bcf_hdr,
         const bool is_tumor_format_retrieved) {
-    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> ret;
-    if (ISNT_PROVIDED(vcf_tumor_fname)) {
-        return ret;
-    }
-    std::string regionstring;
-    for (const auto & bedline : bedlines) {
-        const uvc1_refgpos_t tid = bedline.tid; // std::get<0>(tid_beg_end_e2e);
-        const uvc1_refgpos_t rpos_inclu_beg = bedline.beg_pos; // std::get<1>(tid_beg_end_e2e);
-        const uvc1_refgpos_t rpos_exclu_end = bedline.end_pos; // std::get<2>(tid_beg_end_e2e);
-        
-        const auto & tname_tseqlen_tuple = tid_to_tname_tlen_tuple_vec[tid];
-        if (0 < regionstring.size()) { regionstring += std::string(","); }
-        regionstring += (std::get<0>(tname_tseqlen_tuple) + ":" + std::to_string(rpos_inclu_beg+1) + "-" + std::to_string(rpos_exclu_end+1-1)); 
-    }
-    
-    { 
-        LOG(logINFO) << "Region is " << regionstring;
-    }
-    if (regionstring.size() == 0) {
-        return ret;
-    }
-    bcf_srs_t *const sr = bcf_sr_init();
-    if (NULL == sr) {
-        LOG(logCRITICAL) << "Failed to initialize bcf sr";
-        exit(-6);
-    }
-    
-    bcf_sr_set_regions(sr, regionstring.c_str(), false);
-    int sr_set_opt_retval = bcf_sr_set_opt(sr, BCF_SR_REQUIRE_IDX);
-    if (sr_set_opt_retval < 0) {
-        LOG(logCRITICAL) << "The validation of the index file for the tumor vcf " << vcf_tumor_fname << " failed with return code " << sr_set_opt_retval;
-        exit(-8);
-    }
-    int sr_add_reader_retval = bcf_sr_add_reader(sr, vcf_tumor_fname.c_str());
-    if (sr_add_reader_retval != 1) {
-        LOG(logCRITICAL) << "Failed to synchronize-read the tumor vcf " << vcf_tumor_fname << " with return code " << sr_add_reader_retval;
-        exit(-9);
-    }
-    
     int valsize = 0; 
     int ndst_val = 0;
-    char *bcfstring = NULL;
-    float *bcffloats = NULL;
-    int32_t *bcfints = NULL;
     
-    while (bcf_sr_next_line(sr)) {
-        bcf1_t *line = bcf_sr_get_line(sr, 0);
-        bcf_unpack(line, BCF_UN_ALL);
-        
-        // skip over all symbolic alleles except MGVCF_SYMBOL and ADDITIONAL_INDEL_CANDIDATE_SYMBOL
-        bool should_continue = false;
-        for (uint32_t i = 1; i < line->n_allele; i++) {
-            if ('<' == line->d.allele[i][0] && ((strcmp("<NON_REF>", line->d.allele[i]) && strcmp("<ADDITIONAL_INDEL_CANDIDATE>", line->d.allele[i])) || !is_tumor_format_retrieved)) {
-                should_continue = true;
-            }
+    // skip over all symbolic alleles except MGVCF_SYMBOL and ADDITIONAL_INDEL_CANDIDATE_SYMBOL
+    bool should_continue = false;
+    for (uint32_t i = 1; i < line->n_allele; i++) {
+        if ('<' == line->d.allele[i][0] && ((strcmp("<NON_REF>", line->d.allele[i]) && strcmp("<ADDITIONAL_INDEL_CANDIDATE>", line->d.allele[i])) || !is_tumor_format_retrieved)) {
+            should_continue = true;
         }
+    }
 
-        if (should_continue) { continue; }
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "VTI", &bcfints, &ndst_val);
-        if (valsize <= 0) { continue; }
-        assertUVC((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for VTI and line %ld!\n", ndst_val, valsize, line->pos));
-        assertUVC((2 == line->n_allele) || !fprintf(stderr, "Bcf line %ld has %d alleles!\n", line->pos, line->n_allele));
-        const AlignmentSymbol symbol = AlignmentSymbol(bcfints[1]);
-        
-        auto symbolpos = ((isSymbolSubstitution(symbol) || MGVCF_SYMBOL == symbol || ADDITIONAL_INDEL_CANDIDATE_SYMBOL == symbol) ? (line->pos) : (line->pos + 1));
-        TumorKeyInfo tki;
-        tki.VTI = bcfints[1];
+    if (should_continue) { return false; }
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "VTI", &bcfints, &ndst_val);
+    if (valsize <= 0) { return false; }
+    assertUVC((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for VTI and line %ld!\n", ndst_val, valsize, line->pos));
+    assertUVC((2 == line->n_allele) || !fprintf(stderr, "Bcf line %ld has %d alleles!\n", line->pos, line->n_allele));
+    const AlignmentSymbol symbol = AlignmentSymbol(bcfints[1]);
+    
+    auto symbolpos = ((isSymbolSubstitution(symbol) || MGVCF_SYMBOL == symbol || ADDITIONAL_INDEL_CANDIDATE_SYMBOL == symbol) ? (line->pos) : (line->pos + 1));
+    tki.VTI = bcfints[1];
 
 if (MGVCF_SYMBOL == symbol) {
-        LOG(logINFO) << "gVCFblock with pos " << symbolpos << " was retrieved";
+    LOG(logINFO) << "gVCFblock with pos " << symbolpos << " was retrieved";
 }
 if (ADDITIONAL_INDEL_CANDIDATE_SYMBOL == symbol) {
-        LOG(logINFO) << "ADDITIONAL_INDEL_CANDIDATE symbol with pos " << symbolpos << " was retrieved";
+    LOG(logINFO) << "ADDITIONAL_INDEL_CANDIDATE symbol with pos " << symbolpos << " was retrieved";
 }
 
 if (MGVCF_SYMBOL != symbol && ADDITIONAL_INDEL_CANDIDATE_SYMBOL != symbol) {
 
-        BCF_GET_FORMAT_INT32B_WITH_CHECK(tki.BDP, "BDPb");
-        /*
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "BDPf", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for BDPf and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.BDP = bcfints[0];
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "BDPr", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for BDPr and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.BDP += bcfints[0];
-        */
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "bDPf", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for bDPf and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.bDP = bcfints[1];
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "bDPr", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for bDPr and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.bDP += bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "CDP1x", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for CDP1x and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.CDP1x = bcfints[0];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "cDP1x", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cDP1x and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.cDP1x = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "cVQ1", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cVQ1 and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.cVQ1 = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "cPCQ1", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cPCQ1 and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.cPCQ1 = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "CDP2x", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for CDP2x and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.CDP2x = bcfints[0];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "cDP2x", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cDP2x and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.cDP2x = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "cVQ2", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cVQ2 and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.cVQ2 = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "cPCQ2", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cPCQ2 and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.cPCQ2 = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "bNMQ", &bcfints, &ndst_val);
-        assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for bNMQ and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.bNMQ = bcfints[1];
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_int32(bcf_hdr, line, "vHGQ", &bcfints, &ndst_val);
-        assertAlways((1 == ndst_val && 1 == valsize) || !fprintf(stderr, "1 == %d && 1 == %d failed for vHGQ and line %ld!\n", ndst_val, valsize, line->pos));
-        tki.vHGQ = bcfints[0];
-        
-        // extra code for backward compatibility
-        
-        BCF_GET_FORMAT_INT32B_WITH_CHECK(tki.tDP, "CDP1b");
-        BCF_GET_FORMAT_INT32_WITH_CHECK("cDP1f");
-        tki.tADR = {{ bcfints[0], bcfints[1] }};
-        BCF_GET_FORMAT_INT32_WITH_CHECK("cDP1r");
-        for (int i = 0; i < 2; i++) { tki.tADR[i] += bcfints[i]; }
-        
-        BCF_GET_FORMAT_INT32B_WITH_CHECK(tki.tDPC, "CDP2b");
-        BCF_GET_FORMAT_INT32_WITH_CHECK("cDP2f");
-        tki.tADCR = {{ bcfints[0], bcfints[1] }};
-        BCF_GET_FORMAT_INT32_WITH_CHECK("cDP2r");
-        for (int i = 0; i < 2; i++) { tki.tADCR[i] += bcfints[i]; }
-        
+    BCF_GET_FORMAT_INT32B_WITH_CHECK(tki.BDP, "BDPb");
+    /*
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "BDPf", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for BDPf and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.BDP = bcfints[0];
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "BDPr", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for BDPr and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.BDP += bcfints[0];
+    */
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "bDPf", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for bDPf and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.bDP = bcfints[1];
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "bDPr", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for bDPr and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.bDP += bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "CDP1x", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for CDP1x and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.CDP1x = bcfints[0];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "cDP1x", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cDP1x and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.cDP1x = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "cVQ1", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cVQ1 and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.cVQ1 = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "cPCQ1", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cPCQ1 and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.cPCQ1 = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "CDP2x", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for CDP2x and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.CDP2x = bcfints[0];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "cDP2x", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cDP2x and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.cDP2x = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "cVQ2", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cVQ2 and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.cVQ2 = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "cPCQ2", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for cPCQ2 and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.cPCQ2 = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "bNMQ", &bcfints, &ndst_val);
+    assertAlways((2 == ndst_val && 2 == valsize) || !fprintf(stderr, "2 == %d && 2 == %d failed for bNMQ and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.bNMQ = bcfints[1];
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_int32(bcf_hdr, line, "vHGQ", &bcfints, &ndst_val);
+    assertAlways((1 == ndst_val && 1 == valsize) || !fprintf(stderr, "1 == %d && 1 == %d failed for vHGQ and line %ld!\n", ndst_val, valsize, line->pos));
+    tki.vHGQ = bcfints[0];
+    
+    // extra code for backward compatibility
+    
+    BCF_GET_FORMAT_INT32B_WITH_CHECK(tki.tDP, "CDP1b");
+    BCF_GET_FORMAT_INT32_WITH_CHECK("cDP1f");
+    tki.tADR = {{ bcfints[0], bcfints[1] }};
+    BCF_GET_FORMAT_INT32_WITH_CHECK("cDP1r");
+    for (int i = 0; i < 2; i++) { tki.tADR[i] += bcfints[i]; }
+    
+    BCF_GET_FORMAT_INT32B_WITH_CHECK(tki.tDPC, "CDP2b");
+    BCF_GET_FORMAT_INT32_WITH_CHECK("cDP2f");
+    tki.tADCR = {{ bcfints[0], bcfints[1] }};
+    BCF_GET_FORMAT_INT32_WITH_CHECK("cDP2r");
+    for (int i = 0; i < 2; i++) { tki.tADCR[i] += bcfints[i]; }
+    
 }
-        tki.pos = line->pos;
-        tki.ref_alt = als_to_string(line->d.allele, line->n_allele);
-        if (is_tumor_format_retrieved) {
-            tki.bcf1_record = bcf_dup(line);
-        }
-        
-        ndst_val = 0;
-        valsize = bcf_get_format_char(bcf_hdr, line, "_C2XP", &bcfstring, &ndst_val);
-        tki.enable_tier2_consensus_format_tags = (valsize > 0);
-        
-        const auto retkey = std::make_tuple(line->rid, symbolpos, symbol);
-        ret.insert(std::make_pair(retkey, std::vector<TumorKeyInfo>()));
-        ret[retkey].push_back(tki);
+    tki.pos = line->pos;
+    tki.ref_alt = als_to_string(line->d.allele, line->n_allele);
+    if (is_tumor_format_retrieved) {
+        tki.bcf1_record = bcf_dup(line);
     }
-    xfree(bcfstring);
-    xfree(bcfints);
-    xfree(bcffloats);
-    bcf_sr_destroy(sr);
-    return ret;
+    
+    ndst_val = 0;
+    valsize = bcf_get_format_char(bcf_hdr, line, "_C2XP", &bcfstring, &ndst_val);
+    tki.enable_tier2_consensus_format_tags = (valsize > 0);
+    
+    retkey = std::make_tuple(line->rid, symbolpos, symbol);
+    return true;
+}
+
+// Same as bcf1_to_tumor_key_info for a gVCF block or an additional indel candidate of the tumor pass of the joint calling, 
+//   which is only used for retrieving the FORMAT values of the tumor sample. 
+TumorKeyInfo
+symbolic_record_to_tumor_key_info(
+        const uvc1_refgpos_t pos,
+        const AlignmentSymbol symbol,
+        const std::string & vcfref,
+        const std::string & vcfalt,
+        const std::string & format_values) {
+    TumorKeyInfo tki;
+    tki.VTI = symbol;
+    tki.pos = pos;
+    tki.ref_alt = vcfref + "\t" + vcfalt;
+    tki.tumor_format_string = std::string("\t") + format_values;
+    return tki;
 }
 
+// All variants of the tumor VCF, which is read only once, sorted by (tid, pos, symbol) so that the variants of each tier-1 region are 
+//   retrieved by binary search instead of by re-opening the tumor VCF and its index for each tier-1 region. 
+// The keys are stored apart from the other columns so that the binary search only touches the compact keys. 
+// The running maximum of the end positions is also stored so that the first record overlapping a region is found by binary search 
+//   even if some records (e.g., long deletions and gVCF blocks) span a long reference interval. 
+// The store owns the bcf1_t records of its variants. 
+class TumorVariantStore {
+    std::vector<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>> keys;
+    std::vector<uvc1_refgpos_t> exclu_end_poss; // end of the reference span of each record
+    std::vector<uvc1_refgpos_t> max_exclu_end_poss; // max of exclu_end_poss from the first record of the same tid to each record
+    std::vector<TumorKeyInfo> tkis;
+
+public:
+    TumorVariantStore() {};
+    TumorVariantStore(const TumorVariantStore &) = delete;
+    TumorVariantStore & operator=(const TumorVariantStore &) = delete;
+    ~TumorVariantStore() {
+        for (auto & tki : tkis) {
+            if (NULL != tki.bcf1_record) {
+                bcf_destroy(tki.bcf1_record);
+                tki.bcf1_record = NULL;
+            }
+        }
+    };
+    
+    size_t
+    size() const {
+        return keys.size();
+    };
+    
+    // Only the alleles and the FORMAT fields of each record are unpacked. 
+    template <class T3>
+    void
+    load(const std::string & vcf_tumor_fname, const T3 *bcf_hdr, const bool is_tumor_format_retrieved) {
+        htsFile *infile = bcf_open(vcf_tumor_fname.c_str(), "r");
+        if (NULL == infile) {
+            LOG(logCRITICAL) << "Failed to open the tumor vcf " << vcf_tumor_fname;
+            exit(-9);
+        }
+        bcf_hdr_t *infile_hdr = bcf_hdr_read(infile);
+        if (NULL == infile_hdr) {
+            LOG(logCRITICAL) << "Failed to read the header of the tumor vcf " << vcf_tumor_fname;
+            exit(-9);
+        }
+        std::vector<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>> unsorted_keys;
+        std::vector<uvc1_refgpos_t> unsorted_exclu_end_poss;
+        std::vector<TumorKeyInfo> unsorted_tkis;
+        char *bcfstring = NULL;
+        int32_t *bcfints = NULL;
+        bcf1_t *line = bcf_init();
+        int read_retval = 0;
+        while ((read_retval = bcf_read(infile, infile_hdr, line)) >= 0) {
+            bcf_unpack(line, BCF_UN_STR | BCF_UN_FMT);
+            std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol> retkey;
+            TumorKeyInfo tki;
+            if (bcf1_to_tumor_key_info(retkey, tki, bcfstring, bcfints, line, bcf_hdr, is_tumor_format_retrieved)) {
+                unsorted_keys.push_back(retkey);
+                unsorted_exclu_end_poss.push_back(line->pos + MAX(line->rlen, 1));
+                unsorted_tkis.push_back(tki);
+            }
+        }
+        if (read_retval < -1) {
+            LOG(logCRITICAL) << "Failed to read the tumor vcf " << vcf_tumor_fname << " with return code " << read_retval;
+            exit(-9);
+        }
+        xfree(bcfstring);
+        xfree(bcfints);
+        bcf_destroy(line);
+        bcf_hdr_destroy(infile_hdr);
+        bcf_close(infile);
+        
+        std::vector<size_t> sorted_idxs(unsorted_keys.size());
+        for (size_t i = 0; i < sorted_idxs.size(); i++) {
+            sorted_idxs[i] = i;
+        }
+        std::stable_sort(sorted_idxs.begin(), sorted_idxs.end(), [&unsorted_keys](size_t a, size_t b) { 
+            return unsorted_keys[a] < unsorted_keys[b];
+        });
+        keys.reserve(sorted_idxs.size());
+        exclu_end_poss.reserve(sorted_idxs.size());
+        max_exclu_end_poss.reserve(sorted_idxs.size());
+        tkis.reserve(sorted_idxs.size());
+        for (const size_t idx : sorted_idxs) {
+            const bool is_same_tid = (keys.size() > 0 && std::get<0>(keys.back()) == std::get<0>(unsorted_keys[idx]));
+            keys.push_back(unsorted_keys[idx]);
+            exclu_end_poss.push_back(unsorted_exclu_end_poss[idx]);
+            max_exclu_end_poss.push_back(is_same_tid ? MAX(max_exclu_end_poss.back(), unsorted_exclu_end_poss[idx]) : unsorted_exclu_end_poss[idx]);
+            tkis.push_back(std::move(unsorted_tkis[idx]));
+        }
+    };
+    
+    // Returns the variants whose records overlap with any of the bedlines, as they were returned by the region query of the indexed tumor VCF. 
+    // The returned bcf1_t records are still owned by this store. 
+    template <class T1>
+    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>>
+    query(const T1 & bedlines) const {
+        std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> ret;
+        std::vector<size_t> idxs;
+        for (const auto & bedline : bedlines) {
+            // The key position is at most one base after the record position, and no record before the first one 
+            //   whose running maximum of the end positions is after the region begin can overlap with the region. 
+            const size_t tid_beg_idx = std::lower_bound(keys.begin(), keys.end(), 
+                    std::make_tuple(bedline.tid, INT32_MIN, AlignmentSymbol(0))) - keys.begin();
+            const size_t end_idx = std::lower_bound(keys.begin() + tid_beg_idx, keys.end(), 
+                    std::make_tuple(bedline.tid, bedline.end_pos + 1, AlignmentSymbol(0))) - keys.begin();
+            const size_t beg_idx = std::partition_point(max_exclu_end_poss.begin() + tid_beg_idx, max_exclu_end_poss.begin() + end_idx, 
+                    [&bedline](uvc1_refgpos_t max_exclu_end_pos) { return max_exclu_end_pos <= bedline.beg_pos; }) - max_exclu_end_poss.begin();
+            for (size_t idx = beg_idx; idx < end_idx; idx++) {
+                if (tkis[idx].pos < bedline.end_pos && exclu_end_poss[idx] > bedline.beg_pos) {
+                    idxs.push_back(idx);
+                }
+            }
+        }
+        std::sort(idxs.begin(), idxs.end());
+        idxs.erase(std::unique(idxs.begin(), idxs.end()), idxs.end());
+        for (const size_t idx : idxs) {
+            ret[keys[idx]].push_back(tkis[idx]);
+        }
+        return ret;
+    };
+};
+
 template <bool TIsAnyTandemRepeat = false>
 CoveredRegion<uvc1_qual_big_t> 
 region_repeatvec_to_baq_offsetarr(
@@ -415,20 +576,6 @@ are_depths_diff(uvc1_readnum_t currDP, uvc1_readnum_t prevDP, uvc1_readnum_t mul
     return true;
 }
 
-void
-umi_strand_readset_uvc_destroy(auto & umi_strand_readset) {
-    for (auto strand_readset : umi_strand_readset) {
-        for (int strand = 0; strand < 2; strand++) {
-            auto readset = strand_readset.first[strand]; 
-            for (auto read : readset) {
-                for (bam1_t *b : read) {
-                    bam_destroy1(b);
-                } 
-            }
-        }
-    }
-}
-
 template <class T>
 int 
 process_batch(
@@ -440,7 +587,11 @@ process_batch(
     const faidx_t *const ref_faidx = arg.ref_faidx;
     
     const bcf_hdr_t *const bcf_hdr = arg.bcf_hdr;
+    BcfLineEncoder *const bcf_line_encoder = arg.bcf_line_encoder;
     const CommandLineArgs & paramset = arg.paramset;
+    const bool is_tumor_format_appended = (paramset.is_tumor_format_retrieved && IS_PROVIDED(paramset.vcf_tumor_fname));
+    // The gVCF blocks and the additional indel candidates are encoded into BCF directly unless the tumor sample is appended to them. 
+    const bool is_bcf_encoded = (NULL != bcf_line_encoder && bcf_line_encoder->hasSingleSample() && !is_tumor_format_appended);
     const std::string UMI_STRUCT_STRING = arg.UMI_STRUCT_STRING;
     const BedLine bedline = arg.bedline;
     const std::tuple<std::string, uvc1_refgpos_t> tname_tseqlen_tuple = arg.tname_tseqlen_tuple;
@@ -454,12 +605,24 @@ process_batch(
     
     auto tid = bedline.tid;
     
-    const auto incluBegPosition = bedline.beg_pos;
-    const auto excluEndPosition = bedline.end_pos;
     bool end2end = (bedline.region_flag & BED_END_TO_END_BIT); 
+    // The low-depth stretches can be skipped only if no output is generated there whatever the depth is. 
+    const bool is_skipping_applicable = ((paramset.lowdepth_skip_min_len > 0) 
+            && (bedline.end_pos - bedline.beg_pos > paramset.lowdepth_skip_min_len)
+            && !(end2end)
+            && !(paramset.should_output_all)
+            && !(paramset.outvar_flag & OUTVAR_MGVCF)
+            && (0 == paramset.fam_consensus_out_fastq.size()));
     
-    std::map<MolecularBarcode, std::pair<std::array<std::map<uvc1_hash_t, std::vector<bam1_t *>>, 2>, MolecularBarcode>> umi_to_strand_to_reads;
+    arg.region_read_nbytes = 0;
+    arg.region_pos_nbytes = 0;
+    arg.region_n_reads = 0;
+    arg.region_n_positions = 0;
+    // owns all reads referred to by umi_to_strand_to_reads and umi_strand_readset, and releases them when this function returns
+    BamRecordSlab bam_record_slab;
+    MoleculeToStrandToReads umi_to_strand_to_reads;
     uvc1_refgpos_t bam_inclu_beg_pos, bam_exclu_end_pos; 
+    std::vector<uvc1_readnum_t> pos_to_aln_depth;
     std::vector<std::pair<std::array<std::vector<std::vector<bam1_t *>>, 2>, MolecularBarcode>> umi_strand_readset;
 
     if (is_loginfo_enabled) { LOG(logINFO) << "Thread " << thread_id << " starts bamfname_to_strand_to_familyuid_to_reads with pair_end_merge = " << paramset.pair_end_merge; }
@@ -467,18 +630,24 @@ process_batch(
             umi_to_strand_to_reads,
             bam_inclu_beg_pos,
             bam_exclu_end_pos,
+            (is_skipping_applicable ? &pos_to_aln_depth : NULL),
             tid,
-            incluBegPosition, 
-            excluEndPosition,
+            bedline.beg_pos, 
+            bedline.end_pos,
             end2end,
             regionbatch_ordinal,
             regionbatch_tot_num,
             UMI_STRUCT_STRING,
             arg.samfile,
             arg.hts_idx,
+            arg.bam_record_cache,
+            bam_record_slab,
             thread_id,
             paramset,
             0);
+    // The records held by the cache are counted together with their copies in the slab. 
+    arg.region_read_nbytes = bam_record_slab.nbytes() + ((NULL != arg.bam_record_cache) ? arg.bam_record_cache->nbytes() : 0);
+    arg.region_n_reads = MAX(bam_record_slab.size(), ((NULL != arg.bam_record_cache) ? arg.bam_record_cache->records.size() : 0));
     const auto num_passed_reads = passed_pcrpassed_umipassed[0]; // -1 means that min read depth is not satisfied. 
     const auto num_pcrpassed_reads = passed_pcrpassed_umipassed[1];
     const bool is_by_capture = ((num_pcrpassed_reads) * 2 <= num_passed_reads);
@@ -492,16 +661,66 @@ process_batch(
             0); // bigger region
     
     if ((0 == num_passed_reads) || (-1 == num_passed_reads)) { 
-        umi_strand_readset_uvc_destroy(umi_strand_readset);
         return -1; 
     };
     const uvc1_qual_t minABQ_snv = ((ASSAY_TYPE_AMPLICON == inferred_assay_type) ? paramset.syserr_minABQ_pcr_snv : paramset.syserr_minABQ_cap_snv);
     const uvc1_qual_t minABQ_indel = ((ASSAY_TYPE_AMPLICON == inferred_assay_type) ? paramset.syserr_minABQ_pcr_indel : paramset.syserr_minABQ_cap_indel);
     
-    const uvc1_refgpos_t rpos_inclu_beg = MAX(incluBegPosition, bam_inclu_beg_pos);
-    const uvc1_refgpos_t rpos_exclu_end = MIN(excluEndPosition, bam_exclu_end_pos);
-    const uvc1_refgpos_t extended_inclu_beg_pos = MAX(0, non_neg_minus(MIN(incluBegPosition, bam_inclu_beg_pos), MAX_STR_N_BASES));
-    const uvc1_refgpos_t extended_exclu_end_pos = MIN(std::get<1>(tname_tseqlen_tuple), MAX(excluEndPosition, bam_exclu_end_pos) + MAX_STR_N_BASES);
+    // The stretches of the region in which no variant can be in the output are skipped after all reads of the region are grouped, 
+    //   so the grouping, the inferred assay type, and the calls at the covered positions are the same as without skipping, 
+    //   and only the per-position data structures below are allocated per covered island. 
+    std::vector<std::pair<uvc1_refgpos_t, uvc1_refgpos_t>> islands;
+    if (is_skipping_applicable) {
+        // Only the positions of the tumor variants are in the output if the tumor VCF is provided, and the depth does not matter. 
+        std::vector<uvc1_refgpos_t> rescued_positions;
+        const auto rescued_beg = tid_pos_symb_to_tkis.lower_bound(std::make_tuple(tid, bedline.beg_pos, AlignmentSymbol(0)));
+        const auto rescued_end = tid_pos_symb_to_tkis.upper_bound(std::make_tuple(tid, bedline.end_pos + 1, AlignmentSymbol(0)));
+        for (auto tkis_it = rescued_beg; tkis_it != rescued_end; tkis_it++) {
+            rescued_positions.push_back(std::get<1>(tkis_it->first));
+        }
+        // The additional indel candidates are in the output at the positions with enough depth even without any variant. 
+        const uvc1_readnum_t min_depth = (IS_PROVIDED(paramset.vcf_tumor_fname) ? INT32_MAX 
+                : ((OUTVAR_ADDITIONAL_INDEL_CANDIDATE & paramset.outvar_flag) 
+                        ? MIN(paramset.min_altdp_thres, 2 * paramset.microadjust_alignment_clip_min_count) : paramset.min_altdp_thres));
+        islands = depths_to_covered_islands(pos_to_aln_depth, bedline.beg_pos, bedline.end_pos, min_depth, rescued_positions, 
+                MAX_STR_N_BASES, paramset.lowdepth_skip_min_len);
+        LOG(logDEBUG) << "Thread " << thread_id << " covers the region tid" << tid << ":" << bedline.beg_pos << "-" << bedline.end_pos 
+                << " by " << islands.size() << " covered islands";
+    } else {
+        islands.push_back(std::make_pair(bedline.beg_pos, bedline.end_pos));
+    }
+    
+for (const auto & island : islands) {
+    const uvc1_refgpos_t incluBegPosition = island.first;
+    const uvc1_refgpos_t excluEndPosition = island.second;
+    // Each island is processed with all families overlapping with it together with the margin used for the tandem repeats. 
+    std::vector<std::pair<std::array<std::vector<std::vector<bam1_t *>>, 2>, MolecularBarcode>> island_umi_strand_readset;
+    uvc1_refgpos_t island_bam_inclu_beg_pos = bam_inclu_beg_pos;
+    uvc1_refgpos_t island_bam_exclu_end_pos = bam_exclu_end_pos;
+    const bool is_whole_region = (bedline.beg_pos == incluBegPosition && bedline.end_pos == excluEndPosition);
+    if (!is_whole_region) {
+        island_bam_inclu_beg_pos = INT32_MAX;
+        island_bam_exclu_end_pos = 0;
+        for (const auto & alns2pair2umibarcode : umi_strand_readset) {
+            uvc1_refgpos_t tid2, beg2, end2;
+            initTidBegEnd(tid2, beg2, end2);
+            for (const auto & alns2 : alns2pair2umibarcode.first) {
+                if (alns2.size() > 0) { fillTidBegEndFromAlns2(tid2, beg2, end2, alns2, true); }
+            }
+            if (ARE_INTERVALS_OVERLAPPING(beg2, end2, non_neg_minus(incluBegPosition, MAX_STR_N_BASES), excluEndPosition + MAX_STR_N_BASES + 1)) {
+                island_umi_strand_readset.push_back(alns2pair2umibarcode);
+                island_bam_inclu_beg_pos = MIN(island_bam_inclu_beg_pos, beg2);
+                island_bam_exclu_end_pos = MAX(island_bam_exclu_end_pos, end2);
+            }
+        }
+        if (0 == island_umi_strand_readset.size()) { continue; }
+    }
+    const auto & region_umi_strand_readset = (is_whole_region ? umi_strand_readset : island_umi_strand_readset);
+    
+    const uvc1_refgpos_t rpos_inclu_beg = MAX(incluBegPosition, island_bam_inclu_beg_pos);
+    const uvc1_refgpos_t rpos_exclu_end = MIN(excluEndPosition, island_bam_exclu_end_pos);
+    const uvc1_refgpos_t extended_inclu_beg_pos = MAX(0, non_neg_minus(MIN(incluBegPosition, island_bam_inclu_beg_pos), MAX_STR_N_BASES));
+    const uvc1_refgpos_t extended_exclu_end_pos = MIN(std::get<1>(tname_tseqlen_tuple), MAX(excluEndPosition, island_bam_exclu_end_pos) + MAX_STR_N_BASES);
     
     const auto tkis_beg = tid_pos_symb_to_tkis.lower_bound(std::make_tuple(tid, extended_inclu_beg_pos    , AlignmentSymbol(0)));
     const auto tkis_end = tid_pos_symb_to_tkis.upper_bound(std::make_tuple(tid, extended_exclu_end_pos + 1, AlignmentSymbol(0)));
@@ -523,9 +742,13 @@ process_batch(
     
     if (is_loginfo_enabled) { LOG(logINFO) << "Thread " << thread_id << " starts constructing symbolToCountCoverageSet12 with " << extended_inclu_beg_pos << (" , ") << extended_exclu_end_pos; }
     // + 1 accounts for insertion at the end of the region, this should happen rarely for only re-aligned reads at around once per one billion base pairs
-    if (is_loginfo_enabled) { LOG(logINFO)<< "Thread " << thread_id << " starts updateByRegion3Aln with " << umi_strand_readset.size() << " families"; }
-    const std::string refstring = load_refstring(ref_faidx, tid, extended_inclu_beg_pos, extended_exclu_end_pos);
-    std::vector<RegionalTandemRepeat> region_repeatvec = refstring2repeatvec(
+    if (is_loginfo_enabled) { LOG(logINFO)<< "Thread " << thread_id << " starts updateByRegion3Aln with " << region_umi_strand_readset.size() << " families"; }
+    const std::string refstring = load_refstring(arg.ref_store, ref_faidx, tid, extended_inclu_beg_pos, extended_exclu_end_pos);
+    std::vector<RegionalTandemRepeat> region_repeatvec;
+    if (NULL != arg.repeat_track) {
+        arg.repeat_track->fetch(region_repeatvec, tid, extended_inclu_beg_pos, extended_exclu_end_pos);
+    } else {
+        region_repeatvec = refstring2repeatvec(
             refstring, 
             paramset.indel_str_repeatsize_max,
             paramset.indel_vntr_repeatsize_max, // https://en.wikipedia.org/wiki/Variable_number_tandem_repeat
@@ -533,6 +756,7 @@ process_batch(
             paramset.indel_polymerase_slip_rate,
             paramset.indel_del_to_ins_err_ratio,
             0);
+    }
     const auto & baq_offsetarr = region_repeatvec_to_baq_offsetarr(region_repeatvec, tid, extended_inclu_beg_pos, extended_exclu_end_pos + 1, paramset);
     const auto & baq_offsetarr2 = region_repeatvec_to_baq_offsetarr<true>(region_repeatvec, tid, extended_inclu_beg_pos, extended_exclu_end_pos + 1, paramset);
 
@@ -551,7 +775,7 @@ process_batch(
             mutform2count4vec_bq,
             mutform2count4vec_fq,
             mutform2count4vec_f2q,
-            umi_strand_readset,
+            region_umi_strand_readset,
             
             refstring,
             region_repeatvec,
@@ -561,8 +785,17 @@ process_batch(
             arg.prev_bedline,
             arg.bedline,
             
+            arg.thread_budget,
             paramset,
             0);
+    // The extended margins of the region are included in the bytes per position of the region itself. 
+    // The islands are processed one after another, so the island that needs the most memory is recorded together with its number of positions. 
+    const size_t island_pos_nbytes = symbolToCountCoverageSet12.getNumBytes() + symbolToCountCoverageSet12.intra_region_parts_nbytes + refstring.capacity()
+            + region_repeatvec.capacity() * sizeof(RegionalTandemRepeat) + baq_offsetarr.getNumBytes() + baq_offsetarr2.getNumBytes();
+    if (island_pos_nbytes >= arg.region_pos_nbytes) {
+        arg.region_pos_nbytes = island_pos_nbytes;
+        arg.region_n_positions = excluEndPosition - incluBegPosition;
+    }
 
     std::string buf_out_string_pass;
 
@@ -584,7 +817,7 @@ if (paramset.inferred_is_vcf_generated) {
         uvc1_readpos_t repeatnum = 0;
         
         uvc1_rp_diff_t rridx = zerobased_pos - extended_inclu_beg_pos;
-        indelpos_to_context(repeatunit, repeatnum, refstring, rridx, paramset.indel_str_repeatsize_max);
+        indelpos_to_context(repeatunit, repeatnum, refstring, region_repeatvec, rridx);
         curr_tracklen = repeatnum * UNSIGN2SIGN(repeatunit.size());
         
         const std::array<AlignmentSymbol, 2> symboltype_to_refsymbol = {{
@@ -638,6 +871,20 @@ if (paramset.inferred_is_vcf_generated) {
                 uvc1_qual_t prev_refQ = init_refQ;
                 std::vector<uvc1_rp_diff_t> pos_stype_BDP_CDP_refQ_1dvec;
                 const auto rp2end = MIN(refpos + MGVCF_REGION_MAX_SIZE + 1, symbolToCountCoverageSet12.getUnifiedExcluEndPosition());
+                // The total depths of each symbol type are summed column by column over the whole block before the block is split.
+                std::array<std::vector<uvc1_readnum_t>, NUM_SYMBOL_TYPES> stype_to_tot_bdepths;
+                std::array<std::vector<uvc1_readnum_t>, NUM_SYMBOL_TYPES> stype_to_tot_cdepths;
+                std::array<std::vector<uvc1_readnum_t>, NUM_SYMBOL_TYPES> stype_to_tot_cdep12s;
+                for (SymbolType stype : SYMBOL_TYPES_IN_VCF_ORDER) {
+                    stype_to_tot_bdepths[stype].resize(rp2end - refpos, 0);
+                    stype_to_tot_cdepths[stype].resize(rp2end - refpos, 0);
+                    stype_to_tot_cdep12s[stype].resize(rp2end - refpos, 0);
+                    for (int strand = 0; strand < 2; strand++) {
+                        frag_format_depth_sets[strand].addFieldSumBySymbolType(stype_to_tot_bdepths[stype], stype, FRAG_bDP, refpos, rp2end);
+                        fam_format_depth_sets[strand].addFieldSumBySymbolType(stype_to_tot_cdepths[stype], stype, FAM_cDP1, refpos, rp2end);
+                        fam_format_depth_sets[strand].addFieldSumBySymbolType(stype_to_tot_cdep12s[stype], stype, FAM_cDP12, refpos, rp2end);
+                    }
+                }
                 for (uvc1_refgpos_t rp2 = refpos; rp2 < rp2end; rp2++) {
                     for (SymbolType stype : SYMBOL_TYPES_IN_VCF_ORDER) {
                         const uvc1_rp_diff_t refstring_offset = rp2 - extended_inclu_beg_pos;
@@ -649,14 +896,9 @@ if (paramset.inferred_is_vcf_generated) {
                             ? CHAR_TO_SYMBOL.data[refstring.substr(refstring_offset, 1)[0]] 
                             : BASE_N);
                         const auto refsymbol = ((BASE_SYMBOL == stype) ? (base_m) : (LINK_M));
-                        uvc1_readnum_t curr_tot_bdepth = 0;
-                        uvc1_readnum_t curr_tot_cdepth = 0;
-                        uvc1_readnum_t curr_tot_cdep12 = 0;
-                        for (int strand = 0; strand < 2; strand++) {
-                            curr_tot_bdepth += formatSumBySymbolType(frag_format_depth_sets[strand].getByPos(rp2), stype, FRAG_bDP);
-                            curr_tot_cdepth += formatSumBySymbolType(fam_format_depth_sets[strand].getByPos(rp2), stype, FAM_cDP1);
-                            curr_tot_cdep12 += formatSumBySymbolType(fam_format_depth_sets[strand].getByPos(rp2), stype, FAM_cDP12);
-                        }
+                        const uvc1_readnum_t curr_tot_bdepth = stype_to_tot_bdepths[stype][rp2 - refpos];
+                        const uvc1_readnum_t curr_tot_cdepth = stype_to_tot_cdepths[stype][rp2 - refpos];
+                        const uvc1_readnum_t curr_tot_cdep12 = stype_to_tot_cdep12s[stype][rp2 - refpos];
                         const auto ref_cdepth = 
                                 fam_format_depth_sets[0].getByPos(rp2)[refsymbol][FAM_cDP12] + 
                                 fam_format_depth_sets[1].getByPos(rp2)[refsymbol][FAM_cDP12];
@@ -696,38 +938,60 @@ if (paramset.inferred_is_vcf_generated) {
                 }
                 const auto vcfREF = refstring.substr(refpos - extended_inclu_beg_pos, 1);
                 const AlignmentSymbol match_refsymbol = CHAR_TO_SYMBOL.data[vcfREF[0]];
-                const std::string gvcf_blockline = string_join(std::vector<std::string>{{
-                    std::get<0>(tname_tseqlen_tuple), 
-                    std::to_string(refpos + 1),
-                    std::string("."), 
-                    vcfREF,
-                    std::string("<NON_REF>"),
-                    std::string("."), 
-                    std::string("."), 
-                    std::string("MGVCF_BLOCK"),
-                    std::string("GT:VTI:POS_VT_BDP_CDP_HomRefQ"),
-                    std::string(".") + ":" + std::to_string(match_refsymbol) + "," + std::to_string(MGVCF_SYMBOL) + ":" 
-                            + int32t_join(pos_stype_BDP_CDP_refQ_1dvec, ",") + "," + std::to_string(rp2end),
-                }}, "\t");
-                
-                std::string tumor_gvcf_format = "";
-                if (paramset.is_tumor_format_retrieved && IS_PROVIDED(paramset.vcf_tumor_fname)) { 
-                    const auto tkis_it = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, MGVCF_SYMBOL));
-                    if (tkis_it != tid_pos_symb_to_tkis.end()) {
-                        const auto & tkis = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, MGVCF_SYMBOL))->second;
-                        if (tkis.size() == 1) {
-                            tumor_gvcf_format = bcf1_to_string(bcf_hdr, tkis[0].bcf1_record);
-                            LOG(logDEBUG4) << "gVCFblock at " << refpos << " is indeed found, tumor_gvcf_format == " << tumor_gvcf_format; 
-                        } else {
-                            tumor_gvcf_format = std::string("\t.:.,.:-1");
-                            LOG(logDEBUG4) << "gVCFblock at " << refpos << " is not found, tkis.size() == " << tkis.size();
+                if (NULL == arg.joint_tid_pos_symb_to_tkis && is_bcf_encoded) {
+                    BcfSitesEncoder & sites_encoder = bcf_line_encoder->sites_encoder;
+                    BcfFormatEncoder & format_encoder = bcf_line_encoder->format_encoder;
+                    const std::array<int32_t, 2> gvcf_block_VTI = {{ match_refsymbol, MGVCF_SYMBOL }};
+                    pos_stype_BDP_CDP_refQ_1dvec.push_back(rp2end);
+                    sites_encoder.encodeSite(std::get<0>(tname_tseqlen_tuple).c_str(), refpos + 1, vcfREF, "<NON_REF>", NAN, NULL);
+                    sites_encoder.encodeInfoFlag("MGVCF_BLOCK");
+                    format_encoder.clear();
+                    format_encoder.encodeGenotype(bcfrec::GT, ".");
+                    format_encoder.encodeInt32s(bcfrec::VTI, gvcf_block_VTI.data(), gvcf_block_VTI.size());
+                    format_encoder.encodeInt32s(EXTRA_FORMAT_POS_VT_BDP_CDP_HomRefQ, pos_stype_BDP_CDP_refQ_1dvec.data(), pos_stype_BDP_CDP_refQ_1dvec.size());
+                    bcf_line_encoder->appendSitesAndFormat(buf_out_string_pass);
+                } else {
+                    const std::string gvcf_block_format = std::string(".") + ":" + std::to_string(match_refsymbol) + "," + std::to_string(MGVCF_SYMBOL) + ":" 
+                            + int32t_join(pos_stype_BDP_CDP_refQ_1dvec, ",") + "," + std::to_string(rp2end);
+                    if (NULL != arg.joint_tid_pos_symb_to_tkis) {
+                        if (arg.is_joint_tumor_format_retrieved) {
+                            (*arg.joint_tid_pos_symb_to_tkis)[std::make_tuple(tid, refpos, MGVCF_SYMBOL)].push_back(
+                                    symbolic_record_to_tumor_key_info(refpos, MGVCF_SYMBOL, vcfREF, "<NON_REF>", gvcf_block_format));
                         }
                     } else {
-                        tumor_gvcf_format = std::string("\t.:.,.:.");
-                        LOG(logDEBUG4) << "gVCFblock at " << refpos << " is not found at all.";
+                        const std::string gvcf_blockline = string_join(std::vector<std::string>{{
+                            std::get<0>(tname_tseqlen_tuple), 
+                            std::to_string(refpos + 1),
+                            std::string("."), 
+                            vcfREF,
+                            std::string("<NON_REF>"),
+                            std::string("."), 
+                            std::string("."), 
+                            std::string("MGVCF_BLOCK"),
+                            std::string("GT:VTI:POS_VT_BDP_CDP_HomRefQ"),
+                            gvcf_block_format,
+                        }}, "\t");
+                
+                        std::string tumor_gvcf_format = "";
+                        if (is_tumor_format_appended) { 
+                            const auto tkis_it = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, MGVCF_SYMBOL));
+                            if (tkis_it != tid_pos_symb_to_tkis.end()) {
+                                const auto & tkis = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, MGVCF_SYMBOL))->second;
+                                if (tkis.size() == 1) {
+                                    tumor_gvcf_format = tki_to_tumor_format_string(bcf_hdr, tkis[0]);
+                                    LOG(logDEBUG4) << "gVCFblock at " << refpos << " is indeed found, tumor_gvcf_format == " << tumor_gvcf_format; 
+                                } else {
+                                    tumor_gvcf_format = std::string("\t.:.,.:-1");
+                                    LOG(logDEBUG4) << "gVCFblock at " << refpos << " is not found, tkis.size() == " << tkis.size();
+                                }
+                            } else {
+                                tumor_gvcf_format = std::string("\t.:.,.:.");
+                                LOG(logDEBUG4) << "gVCFblock at " << refpos << " is not found at all.";
+                            }
+                        }
+                        append_vcf_line(buf_out_string_pass, bcf_line_encoder, gvcf_blockline + tumor_gvcf_format);
                     }
                 }
-                buf_out_string_pass += gvcf_blockline + tumor_gvcf_format + "\n";
             }
             
             const auto aCDP = symbolToCountCoverageSet12.seg_format_prep_sets.getByPos(refpos).segprep_a_near_long_clip_dp;
@@ -742,34 +1006,60 @@ if (paramset.inferred_is_vcf_generated) {
                     && (ADP >= 2 * paramset.microadjust_alignment_clip_min_count)) {
                 const auto vcfREF = refstring.substr(refpos - extended_inclu_beg_pos, 1);
                 const AlignmentSymbol match_refsymbol = CHAR_TO_SYMBOL.data[vcfREF[0]];
-                const std::string vcfline = string_join(std::vector<std::string>{{
-                    std::get<0>(tname_tseqlen_tuple), // chrom
-                    std::to_string(refpos + 1), // pos
-                    std::string("."), // id
-                    vcfREF, // ref
-                    SYMBOL_TO_DESC_ARR[ADDITIONAL_INDEL_CANDIDATE_SYMBOL], // alt
-                    std::string("."), // qual
-                    std::string("."), // filter
-                    (std::string("ADDITIONAL_INDEL_CANDIDATE;RU=") + repeatunit + ";RC=" + std::to_string(repeatnum)), // info
-                    std::string("GT:VTI:clipDP"), // format
-                    std::string(".") + ":" + std::to_string(match_refsymbol) + "," + std::to_string(ADDITIONAL_INDEL_CANDIDATE_SYMBOL) 
-                            + ":" + std::to_string(ADP) + "," + std::to_string(aCDP) // format values
-                }}, "\t");
-                std::string tumor_format = "";
-                if (paramset.is_tumor_format_retrieved && IS_PROVIDED(paramset.vcf_tumor_fname)) { 
-                    const auto tkis_it = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, ADDITIONAL_INDEL_CANDIDATE_SYMBOL));
-                    if (tkis_it != tid_pos_symb_to_tkis.end()) {
-                        const auto & tkis = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, ADDITIONAL_INDEL_CANDIDATE_SYMBOL))->second;
-                        if (tkis.size() == 1) {
-                            tumor_format = bcf1_to_string(bcf_hdr, tkis[0].bcf1_record);
-                        } else {
-                            tumor_format = std::string("\t.:-1,-1:-1,-1");
+                if (NULL == arg.joint_tid_pos_symb_to_tkis && is_bcf_encoded) {
+                    BcfSitesEncoder & sites_encoder = bcf_line_encoder->sites_encoder;
+                    BcfFormatEncoder & format_encoder = bcf_line_encoder->format_encoder;
+                    const std::array<int32_t, 2> candidate_VTI = {{ match_refsymbol, ADDITIONAL_INDEL_CANDIDATE_SYMBOL }};
+                    const std::array<int32_t, 2> candidate_clipDP = {{ ADP, aCDP }};
+                    sites_encoder.encodeSite(std::get<0>(tname_tseqlen_tuple).c_str(), refpos + 1, vcfREF, 
+                            SYMBOL_TO_DESC_ARR[ADDITIONAL_INDEL_CANDIDATE_SYMBOL], NAN, NULL);
+                    sites_encoder.encodeInfoFlag("ADDITIONAL_INDEL_CANDIDATE");
+                    sites_encoder.encodeInfoString("RU", repeatunit);
+                    sites_encoder.encodeInfoInt32s("RC", &repeatnum, 1);
+                    format_encoder.clear();
+                    format_encoder.encodeGenotype(bcfrec::GT, ".");
+                    format_encoder.encodeInt32s(bcfrec::VTI, candidate_VTI.data(), candidate_VTI.size());
+                    format_encoder.encodeInt32s(EXTRA_FORMAT_clipDP, candidate_clipDP.data(), candidate_clipDP.size());
+                    bcf_line_encoder->appendSitesAndFormat(buf_out_string_pass);
+                } else {
+                    const std::string candidate_format = std::string(".") + ":" + std::to_string(match_refsymbol) + "," + std::to_string(ADDITIONAL_INDEL_CANDIDATE_SYMBOL) 
+                            + ":" + std::to_string(ADP) + "," + std::to_string(aCDP);
+                    if (NULL != arg.joint_tid_pos_symb_to_tkis) {
+                        if (arg.is_joint_tumor_format_retrieved) {
+                            (*arg.joint_tid_pos_symb_to_tkis)[std::make_tuple(tid, refpos, ADDITIONAL_INDEL_CANDIDATE_SYMBOL)].push_back(
+                                    symbolic_record_to_tumor_key_info(refpos, ADDITIONAL_INDEL_CANDIDATE_SYMBOL, vcfREF, 
+                                    SYMBOL_TO_DESC_ARR[ADDITIONAL_INDEL_CANDIDATE_SYMBOL], candidate_format));
                         }
                     } else {
-                        tumor_format = std::string("\t.:.,.:.,.");
+                        const std::string vcfline = string_join(std::vector<std::string>{{
+                            std::get<0>(tname_tseqlen_tuple), // chrom
+                            std::to_string(refpos + 1), // pos
+                            std::string("."), // id
+                            vcfREF, // ref
+                            SYMBOL_TO_DESC_ARR[ADDITIONAL_INDEL_CANDIDATE_SYMBOL], // alt
+                            std::string("."), // qual
+                            std::string("."), // filter
+                            (std::string("ADDITIONAL_INDEL_CANDIDATE;RU=") + repeatunit + ";RC=" + std::to_string(repeatnum)), // info
+                            std::string("GT:VTI:clipDP"), // format
+                            candidate_format // format values
+                        }}, "\t");
+                        std::string tumor_format = "";
+                        if (is_tumor_format_appended) {
+                            const auto tkis_it = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, ADDITIONAL_INDEL_CANDIDATE_SYMBOL));
+                            if (tkis_it != tid_pos_symb_to_tkis.end()) {
+                                const auto & tkis = tid_pos_symb_to_tkis.find(std::make_tuple(tid, refpos, ADDITIONAL_INDEL_CANDIDATE_SYMBOL))->second;
+                                if (tkis.size() == 1) {
+                                    tumor_format = tki_to_tumor_format_string(bcf_hdr, tkis[0]);
+                                } else {
+                                    tumor_format = std::string("\t.:-1,-1:-1,-1");
+                                }
+                            } else {
+                                tumor_format = std::string("\t.:.,.:.,.");
+                            }
+                        }
+                        append_vcf_line(buf_out_string_pass, bcf_line_encoder, vcfline + tumor_format);
                     }
                 }
-                buf_out_string_pass += vcfline + tumor_format + "\n";
             }
             
             const auto ref_bdepth = 
@@ -1029,6 +1319,7 @@ if (paramset.inferred_is_vcf_generated) {
                 }
                 auto nlodq_fmtptr1_fmtptr2_tup = output_germline(
                         buf_out_string_pass,
+                        bcf_line_encoder,
                         refsymbol,
                         symbol_format_vec,
                         std::get<0>(tname_tseqlen_tuple).c_str(),
@@ -1119,8 +1410,10 @@ if (paramset.inferred_is_vcf_generated) {
                         nlodq = nlodq_singlesample;
                     }
                     fmt.vHGQ = nlodq_singlesample;
-                    append_vcf_record(
+                    TumorKeyInfo joint_tki;
+                    const int is_joint_tki_filled = append_vcf_record(
                             buf_out_string_pass,
+                            bcf_line_encoder,
                             std::get<0>(tname_tseqlen_tuple).c_str(),
                             refpos,
                             extended_inclu_beg_pos,
@@ -1132,6 +1425,8 @@ if (paramset.inferred_is_vcf_generated) {
                             symbol,
                             fmt,
                             tki,
+                            ((NULL != arg.joint_tid_pos_symb_to_tkis) ? &joint_tki : NULL),
+                            arg.is_joint_tumor_format_retrieved,
                             nlodq,
                             argmin_nlodq_symbol,
                             (paramset.should_output_all || is_germline_var_generated),
@@ -1139,13 +1434,15 @@ if (paramset.inferred_is_vcf_generated) {
                             baq_offsetarr,
                             paramset,
                             0);
+                    if (is_joint_tki_filled) {
+                        (*arg.joint_tid_pos_symb_to_tkis)[std::make_tuple(tid, refpos, symbol)].push_back(joint_tki);
+                    }
                 }
             } // fmt_tki_tup_vec
         } // end of SYMBOL_TYPE_ARR
     } // zerobased_pos
 }
     if (is_loginfo_enabled) { LOG(logINFO) << "Thread " << thread_id  << " starts destroying bam records"; }
-    umi_strand_readset_uvc_destroy(umi_strand_readset);
     /*
     if (!is_vcf_out_pass_to_stdout) {
         bgzip_string(outstring_pass, buf_out_string_pass);
@@ -1161,6 +1458,7 @@ if (paramset.inferred_is_vcf_generated) {
             uncompressed_3fastq_string[i] += fqdata3[i];
         }
     }
+} // islands
     if (is_loginfo_enabled) { LOG(logINFO) << "Thread " << thread_id  << " is done with current task"; }
     return 0;
 };
@@ -1218,13 +1516,49 @@ main(int argc, char **argv) {
     if (parsing_result_ret || parsing_result_flag) {
         return parsing_result_ret;
     }
+    if (paramset.bam_input_fname.compare(OPT_ONLY_BUILD_FASTA_CACHES) == 0) {
+        ReferenceStore ref_store;
+        load_ref_store(ref_store, paramset);
+        const std::string track_fname = get_repeat_track_fname(paramset);
+        if (track_fname.size() > 0) {
+            LOG(logINFO) << "Building the tandem-repeat track " << track_fname << " from " << paramset.fasta_ref_fname;
+            if (0 != build_repeat_track(track_fname, (ref_store.isLoaded() ? &ref_store : NULL), paramset, paramset.max_cpu_num)) {
+                LOG(logCRITICAL) << "Failed to build the tandem-repeat track " << track_fname;
+                return -1;
+            }
+        }
+        return 0;
+    }
     LOG(logINFO) << "Program " << argv[0] << " version " << VERSION_DETAIL;
     LOG(logINFO) << "<GIT_DIFF_FULL_DISPLAY_MSG>"; 
     LOG(logINFO) << GIT_DIFF_FULL;
     LOG(logINFO) << "</GIT_DIFF_FULL_DISPLAY_MSG>";
     
+    // In the joint tumor-normal calling, paramset is for the tumor, and nparamset is for the normal and is inferred from the normal BAM. 
+    // Each region is called from the tumor first, and then from the normal by using the tumor VCF lines in memory in place of the tumor VCF. 
+    const bool is_joint_calling = IS_PROVIDED(paramset.bam_normal_fname);
+    CommandLineArgs nparamset;
+    if (is_joint_calling) {
+        int nparsing_result_flag = -1;
+        nparamset.inferred_is_joint_normal = true;
+        int nparsing_result_ret = nparamset.initFromArgCV(nparsing_result_flag, argc, argv);
+        if (nparsing_result_ret || nparsing_result_flag) {
+            LOG(logCRITICAL) << "Failed to parse the command-line arguments for the normal BAM " << paramset.bam_normal_fname;
+            return (nparsing_result_ret ? nparsing_result_ret : -1);
+        }
+    }
+    const CommandLineArgs & out_paramset = (is_joint_calling ? nparamset : paramset);
+    
     std::vector<std::tuple<std::string, uvc1_refgpos_t>> tid_to_tname_tseqlen_tuple_vec;
     samfname_to_tid_to_tname_tseq_tup_vec(tid_to_tname_tseqlen_tuple_vec, paramset.bam_input_fname);
+    if (is_joint_calling) {
+        std::vector<std::tuple<std::string, uvc1_refgpos_t>> normal_tid_to_tname_tseqlen_tuple_vec;
+        samfname_to_tid_to_tname_tseq_tup_vec(normal_tid_to_tname_tseqlen_tuple_vec, nparamset.bam_input_fname);
+        if (normal_tid_to_tname_tseqlen_tuple_vec != tid_to_tname_tseqlen_tuple_vec) {
+            LOG(logCRITICAL) << "The BAM files " << paramset.bam_input_fname << " and " << nparamset.bam_input_fname << " are not aligned to the same reference sequences!";
+            exit(-3);
+        }
+    }
     
     const int nthreads = paramset.max_cpu_num;
     bool is_vcf_out_pass_empty_string = (std::string("") == paramset.vcf_out_pass_fname);
@@ -1236,12 +1570,6 @@ main(int argc, char **argv) {
         fastq_filenames[i] = paramset.fam_consensus_out_fastq + FASTQ_LIKE_SUFFIXES[i];
         fastq_fps[i] = ((paramset.fam_consensus_out_fastq.size() > 0) ? (bgzip_open_wrap1(fastq_filenames[i])) :  NULL);
     }
-    // Commented out for now due to lack of good documentation for these bgzf APIs. Can investigate later.
-    /*
-    if (paramset.vcf_output_fname.size() != 0 && paramset.vcf_output_fname != "-") {
-        bgzf_index_build_init(fp_allp);
-    }
-    */
     // bgzf_mt(fp_allp, nthreads, 128);
     // samFile *sam_infile = sam_open(paramset.bam_input_fname.c_str(), "r");
     
@@ -1250,11 +1578,7 @@ main(int argc, char **argv) {
         bed_out.open(paramset.bed_out_fname, std::ios::out);
     }
 
-#if defined(USE_STDLIB_THREAD)
-    const size_t nidxs = nthreads * 2 + 1;
-#else
     const size_t nidxs = nthreads;
-#endif
     
     bcf_hdr_t *g_bcf_hdr = NULL;
     const char *g_sample = NULL;
@@ -1267,10 +1591,24 @@ main(int argc, char **argv) {
         };
         bcf_close(infile);
     }
+    TumorVariantStore tumor_variant_store;
+    if (IS_PROVIDED(paramset.vcf_tumor_fname)) {
+        tumor_variant_store.load(paramset.vcf_tumor_fname, g_bcf_hdr, paramset.is_tumor_format_retrieved);
+        LOG(logINFO) << "Loaded " << tumor_variant_store.size() << " variants from the tumor vcf " << paramset.vcf_tumor_fname;
+    }
     std::vector<hts_idx_t*> sam_idxs(nidxs, NULL);
     std::vector<samFile*> samfiles(nidxs, NULL);
+    std::vector<BamRecordCache> bam_record_caches(nidxs);
+    std::vector<hts_idx_t*> nsam_idxs(nidxs, NULL);
+    std::vector<samFile*> nsamfiles(nidxs, NULL);
+    std::vector<BamRecordCache> nbam_record_caches(is_joint_calling ? nidxs : 0);
     std::vector<faidx_t*> ref_faidxs(nidxs, NULL);
-    std::vector<bcf_srs_t*> srs(nidxs, NULL);
+    ReferenceStore ref_store;
+    load_ref_store(ref_store, paramset);
+    RepeatTrack repeat_track;
+    if (get_repeat_track_fname(paramset).size() > 0) {
+        repeat_track.load(get_repeat_track_fname(paramset), paramset.fasta_ref_fname, paramset_to_repeat_track_params(paramset), tid_to_tname_tseqlen_tuple_vec.size());
+    }
     for (size_t i = 0; i < nidxs; i++) {
         samfiles[i] = sam_open(paramset.bam_input_fname.c_str(), "r");
         if (NULL == samfiles[i]) {
@@ -1282,7 +1620,19 @@ main(int argc, char **argv) {
             LOG(logCRITICAL) << "Failed to load BAM index " << paramset.bam_input_fname << " for thread with ID = " << i;
             exit(-4);
         }
-        if (paramset.fasta_ref_fname.size() > 0) {
+        if (is_joint_calling) {
+            nsamfiles[i] = sam_open(nparamset.bam_input_fname.c_str(), "r");
+            if (NULL == nsamfiles[i]) {
+                LOG(logCRITICAL) << "Failed to load BAM file " << nparamset.bam_input_fname << " for thread with ID = " << i;
+                exit(-3);
+            }
+            nsam_idxs[i] = sam_index_load(nsamfiles[i], nparamset.bam_input_fname.c_str());
+            if (NULL == nsam_idxs[i]) {
+                LOG(logCRITICAL) << "Failed to load BAM index " << nparamset.bam_input_fname << " for thread with ID = " << i;
+                exit(-4);
+            }
+        }
+        if (paramset.fasta_ref_fname.size() > 0 && !ref_store.isLoaded()) {
             ref_faidxs[i] = fai_load(paramset.fasta_ref_fname.c_str());
             if (NULL == ref_faidxs[i]) {
                 LOG(logCRITICAL) << "Failed to load reference index for file " << paramset.fasta_ref_fname << " for thread with ID = " << i;
@@ -1292,6 +1642,18 @@ main(int argc, char **argv) {
     }
     
     bam_hdr_t * samheader = sam_hdr_read(samfiles[0]);
+    if (is_joint_calling) {
+        // the header of the tumor VCF that would be generated without the normal, used for parsing the tumor VCF lines
+        g_bcf_hdr = bcf_hdr_parse_text(generate_vcf_header(
+                argc, 
+                argv, 
+                samheader->n_targets, 
+                samheader->target_name, 
+                samheader->target_len,
+                NULL, 
+                paramset));
+        g_sample = paramset.sample_name.c_str();
+    }
     std::string header_outstring = generate_vcf_header(
             argc, 
             argv, 
@@ -1299,251 +1661,344 @@ main(int argc, char **argv) {
             samheader->target_name, 
             samheader->target_len,
             g_sample, 
-            paramset);
-    clearstring<false>(fp_pass, header_outstring, is_vcf_out_pass_to_stdout);
+            out_paramset);
+    // The BCF output is compressed and written in exactly the same way as the VCF output because both are just bytes. 
+    // The compression of each task's output overlaps with the computation of the next tasks, and the outputs are written in the order of the tasks. 
+    const size_t compress_nthreads = ((paramset.output_compress_nthreads > 0) ? paramset.output_compress_nthreads : nthreads);
+    BgzfOrderedWriter bgzf_writer(compress_nthreads, paramset.output_compress_level, 
+            (compress_nthreads + nthreads) * NUM_INFLIGHT_TASKS_PER_THREAD * BGZF_BLOCK_SIZE);
+    const bool is_bcf_out_pass = (OUTPUT_TYPE_BCF == paramset.vcf_out_pass_type);
+    // The index is built from the record intervals collected by the worker threads and from the block addresses known to the writer. 
+    const bool is_vcf_out_pass_indexed = (paramset.is_output_indexed && NULL != fp_pass);
+    std::unique_ptr<BgzfRecordIndexer> pass_indexer;
+    if (is_vcf_out_pass_indexed) {
+        std::vector<std::string> tnames;
+        std::vector<hts_pos_t> tlens;
+        for (int i = 0; i < samheader->n_targets; i++) {
+            tnames.push_back(samheader->target_name[i]);
+            tlens.push_back(samheader->target_len[i]);
+        }
+        pass_indexer.reset(new BgzfRecordIndexer(!is_bcf_out_pass, tnames, tlens));
+    }
+    const size_t pass_stream_idx = bgzf_writer.addStream(fp_pass, is_vcf_out_pass_to_stdout, pass_indexer.get());
+    std::array<size_t, NUM_FQLIKE_CON_OUT_FILES> fastq_stream_idxs;
+    for (size_t i = 0; i < NUM_FQLIKE_CON_OUT_FILES; i++) {
+        fastq_stream_idxs[i] = bgzf_writer.addStream(fastq_fps[i], false);
+    }
+    BcfOutputHeader bcf_output_header;
+    if (is_bcf_out_pass) {
+        std::vector<const char*> format_tag_ids(bcfrec::FORMAT_IDS, bcfrec::FORMAT_IDS + bcfrec::FORMAT_NUM);
+        format_tag_ids.insert(format_tag_ids.end(), EXTRA_FORMAT_IDS, EXTRA_FORMAT_IDS + (EXTRA_FORMAT_END - bcfrec::FORMAT_NUM));
+        bcf_output_header.init(header_outstring, format_tag_ids.data(), format_tag_ids.size());
+        std::string header_outbytes;
+        bcf_output_header.appendHeaderBytes(header_outbytes);
+        bgzf_writer.submit(pass_stream_idx, std::move(header_outbytes));
+    } else {
+        bgzf_writer.submit(pass_stream_idx, std::move(header_outstring));
+    }
 
-    std::vector<BedLine> bedlines1;
-    std::vector<BedLine> bedlines2;
-    
-    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> tid_pos_symb_to_tkis1; 
-    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> tid_pos_symb_to_tkis2; 
-    BedLine prev_bedline_tmp = BedLine(-1, 0, 0, 0, 0);
-    SamIter samIter(paramset);
-    int64_t n_sam_iters = 0;
-    uvc1_flag_t iter_ret_flag;
-    int64_t iter_nreads = samIter.iternext(iter_ret_flag, bedlines1, 0);
-    
-    LOG(logINFO) << "PreProcessed " << iter_nreads << " reads in tier-1-region no " << (n_sam_iters);
-    // rescue_variants_from_vcf
-    tid_pos_symb_to_tkis1 = rescue_variants_from_vcf(bedlines1, tid_to_tname_tseqlen_tuple_vec, paramset.vcf_tumor_fname, g_bcf_hdr, paramset.is_tumor_format_retrieved);
-    LOG(logINFO) << "Rescued/retrieved " << tid_pos_symb_to_tkis1.size() << " variants in tier-1-region no " << (n_sam_iters);
-    while (iter_nreads > 0) {
-        n_sam_iters++;
-        std::thread read_bam_thread([&bedlines2, &tid_pos_symb_to_tkis2, &samIter, &iter_nreads, &iter_ret_flag, &n_sam_iters, &paramset, &tid_to_tname_tseqlen_tuple_vec, g_bcf_hdr]() {
-            bedlines2.clear();
-            iter_nreads = samIter.iternext(iter_ret_flag, bedlines2, 0);
+    // Tier-1 regions are generated by the producer thread and each of their tier-3 regions is pushed as one task into the pipeline. 
+    // The tier-3 regions in each tier-2 region are initially assigned to the same worker thread, and idle worker threads steal from busy ones. 
+    // The results are written by this thread in the same order as the tasks are pushed. 
+    // The regions are admitted into the pipeline only if the memory held by the regions in the pipeline stays within the limit. 
+    OrderedPipeline<Tier3Task, Tier3Result> pipeline(nthreads, nthreads * NUM_INFLIGHT_TASKS_PER_THREAD);
+    // The threads processing the parts of one deep region take the cores of the idle workers only. 
+    ThreadBudget thread_budget(nthreads);
+    MemoryGovernor mem_governor((1024UL*1024UL) * paramset.mem_per_thread * nthreads, NUM_BYTES_PER_READ, NUM_BYTES_PER_REF_POS, NUM_OUT_BYTES_PER_REF_POS);
+    SamIter samIter(paramset, &mem_governor);
+    std::thread producer_thread([&pipeline, &mem_governor, &samIter, &bed_out, &tumor_variant_store, &tid_to_tname_tseqlen_tuple_vec, nthreads]() {
+        BedLine prev_bedline_tmp = BedLine(-1, 0, 0, 0, 0);
+        int64_t n_sam_iters = 0;
+        while (true) {
+            auto tier1region = std::make_shared<Tier1Region>();
+            tier1region->prev_bedline = prev_bedline_tmp;
+            uvc1_flag_t iter_ret_flag;
+            int64_t iter_nreads = samIter.iternext(iter_ret_flag, tier1region->bedlines, 0);
             LOG(logINFO) << "PreProcessed " << iter_nreads << " reads in tier-1-region no " << (n_sam_iters);
+            if (iter_nreads <= 0) {
+                break;
+            }
+            tier1region->tid_pos_symb_to_tkis = tumor_variant_store.query(tier1region->bedlines);
+            LOG(logINFO) << "Rescued/retrieved " << tier1region->tid_pos_symb_to_tkis.size() << " variants in tier-1-region no " << (n_sam_iters);
+            n_sam_iters++;
             
-            tid_pos_symb_to_tkis2 = rescue_variants_from_vcf(bedlines2, tid_to_tname_tseqlen_tuple_vec, paramset.vcf_tumor_fname, g_bcf_hdr, paramset.is_tumor_format_retrieved);
-            LOG(logINFO) << "Rescued/retrieved " << tid_pos_symb_to_tkis2.size() << " variants in tier-1-region no " << (n_sam_iters);
-        });
-        const auto & bedlines = bedlines1;
+            const auto & bedlines = tier1region->bedlines;
         
-        const size_t allridx = 0;
-        const size_t incvalue = bedlines.size();
+            const size_t allridx = 0;
+            const size_t incvalue = bedlines.size();
         
-        size_t nreads = 0;
-        size_t npositions = 0;
-        for (size_t j = 0; j < incvalue; j++) {
-            auto region_idx = allridx + j;
-            nreads += bedlines[region_idx].n_reads;
-            npositions += bedlines[region_idx].end_pos - bedlines[region_idx].beg_pos; 
-        }
+            size_t nreads = 0;
+            size_t npositions = 0;
+            for (size_t j = 0; j < incvalue; j++) {
+                auto region_idx = allridx + j;
+                nreads += bedlines[region_idx].n_reads;
+                npositions += bedlines[region_idx].end_pos - bedlines[region_idx].beg_pos; 
+            }
         
-        assertUVC(incvalue > 0);
+            assertUVC(incvalue > 0);
         
-        // distribute inputs as evenly as possible
-#if defined(USE_STDLIB_THREAD)
-        const size_t UNDERLOAD_RATIO = 1;
-#else
-        const size_t UNDERLOAD_RATIO = NUM_WORKING_UNITS_PER_THREAD;
-#endif
-        uvc1_refgpos_t last_tid = ((bedlines.size() > 0) ? (bedlines[0].tid) : -1);
-        uvc1_readnum_big_t curr_nreads = 0;
-        uvc1_refgpos_t curr_npositions = 0;
-        size_t curr_zerobased_region_idx = 0;
-        std::vector<std::pair<size_t, size_t>> beg_end_pair_vec;
-        for (size_t j = 0; j < incvalue; j++) {
-            auto region_idx = allridx + j;
-            const auto curr_tid = bedlines[region_idx].tid;
-            curr_nreads += bedlines[region_idx].n_reads;
-            curr_npositions +=(bedlines[region_idx].end_pos) - (bedlines[region_idx].beg_pos);
-            if ((j > 0) && ((last_tid != curr_tid)
-                    || (curr_nreads * nthreads * UNDERLOAD_RATIO > nreads)
-                    || (curr_npositions * nthreads * UNDERLOAD_RATIO > npositions))) {
-                beg_end_pair_vec.push_back(std::make_pair(curr_zerobased_region_idx, j));
-                curr_zerobased_region_idx = j;
-                last_tid = curr_tid;
-                curr_nreads = 0;
-                curr_npositions = 0;
+            // distribute inputs as evenly as possible, the remaining imbalance is resolved by work stealing
+            const size_t UNDERLOAD_RATIO = 1;
+            uvc1_refgpos_t last_tid = ((bedlines.size() > 0) ? (bedlines[0].tid) : -1);
+            uvc1_readnum_big_t curr_nreads = 0;
+            uvc1_refgpos_t curr_npositions = 0;
+            size_t curr_zerobased_region_idx = 0;
+            std::vector<std::pair<size_t, size_t>> beg_end_pair_vec;
+            for (size_t j = 0; j < incvalue; j++) {
+                auto region_idx = allridx + j;
+                const auto curr_tid = bedlines[region_idx].tid;
+                curr_nreads += bedlines[region_idx].n_reads;
+                curr_npositions +=(bedlines[region_idx].end_pos) - (bedlines[region_idx].beg_pos);
+                if ((j > 0) && ((last_tid != curr_tid)
+                        || (curr_nreads * nthreads * UNDERLOAD_RATIO > nreads)
+                        || (curr_npositions * nthreads * UNDERLOAD_RATIO > npositions))) {
+                    beg_end_pair_vec.push_back(std::make_pair(curr_zerobased_region_idx, j));
+                    curr_zerobased_region_idx = j;
+                    last_tid = curr_tid;
+                    curr_nreads = 0;
+                    curr_npositions = 0;
+                }
             }
-        }
-        beg_end_pair_vec.push_back(std::make_pair(curr_zerobased_region_idx, incvalue));
+            beg_end_pair_vec.push_back(std::make_pair(curr_zerobased_region_idx, incvalue));
 
-        uvc1_readnum_big_t t1_tot_n_reads = 0;
-        uvc1_refgpos_big_t t1_tot_n_bases = 0;
+            uvc1_readnum_big_t t1_tot_n_reads = 0;
+            uvc1_refgpos_big_t t1_tot_n_bases = 0;
 
-        std::string bedstring = "";
-        LOG(logINFO) << "Start-bam-iteration-" << (n_sam_iters-1) << ": will-process-the-following-tier1-regions (all indices are zero-based): ";
-        for (size_t t2_idx = 0; t2_idx < beg_end_pair_vec.size(); t2_idx++) {
-            size_t beg = beg_end_pair_vec[t2_idx].first;
-            size_t end = beg_end_pair_vec[t2_idx].second;
-            uvc1_readnum_big_t t2_tot_n_reads = 0;
-            uvc1_readnum_big_t t2_tot_n_bases = 0;
-            for (size_t t3_idx = beg; t3_idx < end; t3_idx++) {
-                const auto & bedline = bedlines[t3_idx];
-                const auto n_bases = bedline.end_pos - bedline.beg_pos;
-                bedstring += (std::get<0>(tid_to_tname_tseqlen_tuple_vec[bedline.tid ])
-                          + "\t" + std::to_string(bedline.beg_pos)
-                          + "\t" + std::to_string(bedline.end_pos)
-                          + "\tBedLineFlag\t" + std::to_string(bedline.region_flag)
-                          + "\tNumberOfReadsInThisInterval\t" + std::to_string(bedline.n_reads)
-                          + "\tNumberOfRefBasesInThisInterval\t" + std::to_string(n_bases)
-                          + "\tTier1regionIndex\t" + std::to_string(n_sam_iters - 1)
-                          + "\tTier2regionIndex\t" + std::to_string(t2_idx)
-                          + "\tTier3regionIndex\t" + std::to_string(t3_idx)
-                          + "\n");
-                t2_tot_n_reads += bedline.n_reads;
-                t2_tot_n_bases += n_bases;
+            std::string bedstring = "";
+            LOG(logINFO) << "Start-bam-iteration-" << (n_sam_iters-1) << ": will-process-the-following-tier1-regions (all indices are zero-based): ";
+            for (size_t t2_idx = 0; t2_idx < beg_end_pair_vec.size(); t2_idx++) {
+                size_t beg = beg_end_pair_vec[t2_idx].first;
+                size_t end = beg_end_pair_vec[t2_idx].second;
+                uvc1_readnum_big_t t2_tot_n_reads = 0;
+                uvc1_readnum_big_t t2_tot_n_bases = 0;
+                for (size_t t3_idx = beg; t3_idx < end; t3_idx++) {
+                    const auto & bedline = bedlines[t3_idx];
+                    const auto n_bases = bedline.end_pos - bedline.beg_pos;
+                    bedstring += (std::get<0>(tid_to_tname_tseqlen_tuple_vec[bedline.tid ])
+                              + "\t" + std::to_string(bedline.beg_pos)
+                              + "\t" + std::to_string(bedline.end_pos)
+                              + "\tBedLineFlag\t" + std::to_string(bedline.region_flag)
+                              + "\tNumberOfReadsInThisInterval\t" + std::to_string(bedline.n_reads)
+                              + "\tNumberOfRefBasesInThisInterval\t" + std::to_string(n_bases)
+                              + "\tTier1regionIndex\t" + std::to_string(n_sam_iters - 1)
+                              + "\tTier2regionIndex\t" + std::to_string(t2_idx)
+                              + "\tTier3regionIndex\t" + std::to_string(t3_idx)
+                              + "\n");
+                    t2_tot_n_reads += bedline.n_reads;
+                    t2_tot_n_bases += n_bases;
+                }
+                LOG(logINFO) << "End-of-tier-2-region-no-" << t2_idx << " tot_n_reads=" << t2_tot_n_reads << " tot_n_ref_bases=" << t2_tot_n_bases;
+                t1_tot_n_reads += t2_tot_n_reads;
+                t1_tot_n_bases += t2_tot_n_bases;
             }
-            LOG(logINFO) << "End-of-tier-2-region-no-" << t2_idx << " tot_n_reads=" << t2_tot_n_reads << " tot_n_ref_bases=" << t2_tot_n_bases;
-            t1_tot_n_reads += t2_tot_n_reads;
-            t1_tot_n_bases += t2_tot_n_bases;
-        }
-        assertUVC(((size_t)t1_tot_n_bases) == npositions || !fprintf(stderr, "%lu ==%lu failed!", ((size_t)t1_tot_n_bases), npositions));
-        LOG(logINFO) << "End-of-tier-1-region-no-" << (n_sam_iters-1) << " tot_n_reads=" << t1_tot_n_reads << " tot_n_ref_bases=" << t1_tot_n_bases;
-        if (bed_out.is_open()) { 
-            bed_out << bedstring; 
-        }
-        LOG(logINFO) << "The " << (n_sam_iters-1) << "-th tier-1 BED region is as follows " 
-                << "(each tier-1 region is parsed as one unit, each tier-2 region is processed by one thread, "
-                << "and each tier-3 region is one unit of to call variants within):\n" << bedstring;
-        
-        LOG(logINFO) << "Start processing the chunks from " << allridx << " to " << allridx + incvalue
-                << " which contains approximately " << nreads << " reads and " << npositions << " positions divided into " 
-                << beg_end_pair_vec.size() << " sub-chunks";
+            assertUVC(((size_t)t1_tot_n_bases) == npositions || !fprintf(stderr, "%lu ==%lu failed!", ((size_t)t1_tot_n_bases), npositions));
+            LOG(logINFO) << "End-of-tier-1-region-no-" << (n_sam_iters-1) << " tot_n_reads=" << t1_tot_n_reads << " tot_n_ref_bases=" << t1_tot_n_bases;
+            if (bed_out.is_open()) { 
+                bed_out << bedstring; 
+            }
+            LOG(logINFO) << "The " << (n_sam_iters-1) << "-th tier-1 BED region is as follows " 
+                    << "(each tier-1 region is parsed as one unit, each tier-2 region is processed by one thread, "
+                    << "and each tier-3 region is one unit of to call variants within):\n" << bedstring;
         
-#if defined(USE_STDLIB_THREAD)
-        if ( nidxs <= beg_end_pair_vec.size()) {abort();}
-        std::vector<std::thread> threads; 
-        threads.reserve(beg_end_pair_vec.size());
-#endif
-        std::vector<BatchArg> batchargs;
-        batchargs.reserve(beg_end_pair_vec.size());
-        for (size_t beg_end_pair_idx = 0; beg_end_pair_idx < beg_end_pair_vec.size(); beg_end_pair_idx++) {
-            struct BatchArg a = {
+            LOG(logINFO) << "Start processing the chunks from " << allridx << " to " << allridx + incvalue
+                    << " which contains approximately " << nreads << " reads and " << npositions << " positions divided into " 
+                    << beg_end_pair_vec.size() << " sub-chunks";
+            
+            // Each tier-3 region is admitted as soon as its memory and one inflight slot are available, 
+            //   so the next tier-1 region starts while the previous one is still being processed. 
+            for (size_t t2_idx = 0; t2_idx < beg_end_pair_vec.size(); t2_idx++) {
+                for (size_t t3_idx = beg_end_pair_vec[t2_idx].first; t3_idx < beg_end_pair_vec[t2_idx].second; t3_idx++) {
+                    const size_t t3_mem_nbytes = mem_governor.estimate(bedlines[t3_idx].n_reads, bedlines[t3_idx].end_pos - bedlines[t3_idx].beg_pos);
+                    mem_governor.acquire(t3_mem_nbytes);
+                    pipeline.push_task(t2_idx, Tier3Task(tier1region, t3_idx, beg_end_pair_vec[t2_idx].second, t3_mem_nbytes));
+                }
+            }
+            prev_bedline_tmp = (bedlines.size() ? LAST(bedlines) : prev_bedline_tmp);
+        }
+        pipeline.close();
+    });
+    
+    std::vector<std::thread> worker_threads;
+    worker_threads.reserve(nthreads);
+    for (size_t thread_id = 0; thread_id < (size_t)nthreads; thread_id++) {
+        worker_threads.push_back(std::thread([&pipeline, &mem_governor, &thread_budget, &samfiles, &sam_idxs, &bam_record_caches, &ref_faidxs, &ref_store, &repeat_track, 
+                &tid_to_tname_tseqlen_tuple_vec, &paramset, &UMI_STRUCT_STRING, is_vcf_out_pass_to_stdout, g_bcf_hdr, thread_id, 
+                is_bcf_out_pass, &bcf_output_header, is_vcf_out_pass_indexed, 
+                is_joint_calling, &nparamset, &nsamfiles, &nsam_idxs, &nbam_record_caches]() {
+            std::unique_ptr<BcfLineEncoder> bcf_line_encoder(is_bcf_out_pass ? new BcfLineEncoder(bcf_output_header) : NULL);
+            const size_t max_bam_record_cache_nbytes = ((1024UL*1024UL) / NUM_WORKING_UNITS_PER_THREAD) * paramset.mem_per_thread;
+            BatchArg batcharg = {
                     outstring3fastq : (std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> {{ std::string("") }}),
                     outstring_allp : "",
                     outstring_pass : "",
-                    thread_id : 0,
-                    samfile: NULL,
-                    hts_idx : NULL, 
-                    ref_faidx : NULL,
+                    thread_id : (int)thread_id,
+                    samfile: samfiles[thread_id],
+                    hts_idx : sam_idxs[thread_id], 
+                    bam_record_cache : &bam_record_caches[thread_id],
+                    ref_faidx : ref_faidxs[thread_id],
+                    ref_store : (ref_store.isLoaded() ? &ref_store : NULL),
+                    repeat_track : (repeat_track.isLoaded() ? &repeat_track : NULL),
                     bcf_hdr : g_bcf_hdr,
-                    sr : NULL,
+                    bcf_line_encoder : (is_joint_calling ? NULL : bcf_line_encoder.get()), // the text of the tumor pass of the joint calling is discarded
+                    thread_budget : &thread_budget,
+                    joint_tid_pos_symb_to_tkis : NULL,
+                    is_joint_tumor_format_retrieved : (is_joint_calling && nparamset.is_tumor_format_retrieved),
                     
-                    prev_bedline: prev_bedline_tmp,
-                    bedline: BedLine(-1, 0, 0, 0, 0), // bedlines.at(0),
+                    prev_bedline: BedLine(-1, 0, 0, 0, 0),
+                    bedline: BedLine(-1, 0, 0, 0, 0),
                     tname_tseqlen_tuple : tid_to_tname_tseqlen_tuple_vec.at(0),
                     regionbatch_ordinal : 0,
                     regionbatch_tot_num : 0,
+                    region_read_nbytes : 0,
+                    region_pos_nbytes : 0,
+                    region_n_reads : 0,
+                    region_n_positions : 0,
 
                     paramset : paramset, 
                     UMI_STRUCT_STRING : UMI_STRUCT_STRING,
                     is_vcf_out_pass_to_stdout : is_vcf_out_pass_to_stdout,
             };
-            batchargs.push_back(a);
-        }
-        size_t beg_end_pair_size = beg_end_pair_vec.size();
-
-#if defined(_OPENMP) && !defined(USE_STDLIB_THREAD)
-#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
-#endif
-        for (size_t beg_end_pair_idx = 0; beg_end_pair_idx < beg_end_pair_size; beg_end_pair_idx++) {
-            
-#if defined(_OPENMP) && !defined(USE_STDLIB_THREAD)
-            size_t thread_id = omp_get_thread_num();
-#elif defined(USE_STDLIB_THREAD)
-            size_t thread_id = beg_end_pair_idx;
-#else
-            size_t thread_id = 0;
-#endif
-            auto & batcharg = batchargs[beg_end_pair_idx];
-            batcharg.thread_id = thread_id;
-            batcharg.samfile = samfiles[thread_id];
-            batcharg.hts_idx = sam_idxs[thread_id];
-            batcharg.ref_faidx = ref_faidxs[thread_id];
-            batcharg.sr = srs[thread_id];
+            // only used by the joint calling
+            BatchArg nbatcharg = {
+                    outstring3fastq : (std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> {{ std::string("") }}),
+                    outstring_allp : "",
+                    outstring_pass : "",
+                    thread_id : (int)thread_id,
+                    samfile: nsamfiles[thread_id],
+                    hts_idx : nsam_idxs[thread_id], 
+                    bam_record_cache : (is_joint_calling ? &nbam_record_caches[thread_id] : NULL),
+                    ref_faidx : ref_faidxs[thread_id],
+                    ref_store : (ref_store.isLoaded() ? &ref_store : NULL),
+                    repeat_track : (repeat_track.isLoaded() ? &repeat_track : NULL),
+                    bcf_hdr : g_bcf_hdr,
+                    bcf_line_encoder : bcf_line_encoder.get(),
+                    thread_budget : &thread_budget,
+                    joint_tid_pos_symb_to_tkis : NULL,
+                    is_joint_tumor_format_retrieved : false,
+                    
+                    prev_bedline: BedLine(-1, 0, 0, 0, 0),
+                    bedline: BedLine(-1, 0, 0, 0, 0),
+                    tname_tseqlen_tuple : tid_to_tname_tseqlen_tuple_vec.at(0),
+                    regionbatch_ordinal : 0,
+                    regionbatch_tot_num : 0,
+                    region_read_nbytes : 0,
+                    region_pos_nbytes : 0,
+                    region_n_reads : 0,
+                    region_n_positions : 0,
 
-            std::pair<size_t, size_t> beg_end_pair = beg_end_pair_vec[beg_end_pair_idx];
-#if defined(USE_STDLIB_THREAD)
-            std::thread athread([
-                        &batcharg, allridx, beg_end_pair, beg_end_pair_idx, &bedlines, &tid_to_tname_tseqlen_tuple_vec, &tid_pos_symb_to_tkis1
-                        ]() {
-#endif
-                    LOG(logINFO) << "Thread " << batcharg.thread_id << " will process the sub-chunk " << beg_end_pair_idx << " which ranges from " 
-                            << beg_end_pair.first << " to " << beg_end_pair.second;
-                    assertUVC (beg_end_pair.first < beg_end_pair.second);
-                    std::string uncompressed_vcf_string;
-                    std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> uncompressed_3fastq_string;
-                    for (size_t j = beg_end_pair.first; j < beg_end_pair.second; j++) {
-                        batcharg.regionbatch_ordinal = j;
-                        batcharg.regionbatch_tot_num = beg_end_pair.second;
-                        assertUVC (((size_t)(allridx + j) < bedlines.size())
-                                || !fprintf(stderr, "%lu + %lu < %lu failed!\n", allridx, j, bedlines.size()));
-                        if (allridx + j > 0) {
-                            batcharg.prev_bedline = bedlines.at(allridx + j - 1);
+                    paramset : nparamset, 
+                    UMI_STRUCT_STRING : UMI_STRUCT_STRING,
+                    is_vcf_out_pass_to_stdout : is_vcf_out_pass_to_stdout,
+            };
+            size_t seq = 0;
+            Tier3Task task;
+            while (pipeline.pop_task(thread_id, seq, task)) {
+                // If all threads are used by the extra threads of deep regions, then the task is put back so that it can be stolen meanwhile. 
+                if (0 == thread_budget.try_acquire(1)) {
+                    pipeline.unpop_task(thread_id, seq, std::move(task));
+                    thread_budget.wait_until_any_free();
+                    continue;
+                }
+                const auto & bedlines = task.tier1region->bedlines;
+                const size_t j = task.bedline_idx;
+                assertUVC ((j < bedlines.size())
+                        || !fprintf(stderr, "%lu < %lu failed!\n", j, bedlines.size()));
+                std::string uncompressed_vcf_string;
+                std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> uncompressed_3fastq_string;
+                batcharg.regionbatch_ordinal = j;
+                batcharg.regionbatch_tot_num = task.tier2_end_idx;
+                batcharg.prev_bedline = ((j > 0) ? bedlines.at(j - 1) : task.tier1region->prev_bedline);
+                batcharg.bedline = bedlines.at(j);
+                assertUVC (((size_t)(batcharg.bedline.tid)) < tid_to_tname_tseqlen_tuple_vec.size() 
+                        || !fprintf(stderr, "%lu < %lu failed!\n", (size_t)(batcharg.bedline.tid), tid_to_tname_tseqlen_tuple_vec.size()));
+                batcharg.tname_tseqlen_tuple = tid_to_tname_tseqlen_tuple_vec.at((batcharg.bedline.tid));
+                if (is_joint_calling) {
+                    // The tumor variants are passed to the normal pass in memory, so only the germline lines of the tumor pass are generated as text, 
+                    //   which are discarded. 
+                    std::string tumor_vcf_string;
+                    std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> tumor_3fastq_string;
+                    std::map<std::tuple<uvc1_refgpos_t, uvc1_refgpos_t, AlignmentSymbol>, std::vector<TumorKeyInfo>> tumor_tid_pos_symb_to_tkis;
+                    batcharg.joint_tid_pos_symb_to_tkis = &tumor_tid_pos_symb_to_tkis;
+                    process_batch(tumor_vcf_string, tumor_3fastq_string, batcharg, task.tier1region->tid_pos_symb_to_tkis);
+                    batcharg.joint_tid_pos_symb_to_tkis = NULL;
+                    nbatcharg.regionbatch_ordinal = batcharg.regionbatch_ordinal;
+                    nbatcharg.regionbatch_tot_num = batcharg.regionbatch_tot_num;
+                    nbatcharg.prev_bedline = batcharg.prev_bedline;
+                    nbatcharg.bedline = batcharg.bedline;
+                    nbatcharg.tname_tseqlen_tuple = batcharg.tname_tseqlen_tuple;
+                    process_batch(uncompressed_vcf_string, uncompressed_3fastq_string, nbatcharg, tumor_tid_pos_symb_to_tkis);
+                    // The memory of both passes is recorded, together with the tumor variants that are held during the normal pass, 
+                    //   so that the regions of the joint calling are sized for both samples. 
+                    size_t tumor_tkis_nbytes = 0;
+                    for (const auto & tid_pos_symb_to_tkis_pair : tumor_tid_pos_symb_to_tkis) {
+                        for (const auto & tki : tid_pos_symb_to_tkis_pair.second) {
+                            tumor_tkis_nbytes += sizeof(TumorKeyInfo) + tki.ref_alt.capacity() + tki.tumor_format_string.capacity();
                         }
-                        batcharg.bedline = bedlines.at(allridx + j);
-                        assertUVC (((size_t)(batcharg.bedline.tid)) < tid_to_tname_tseqlen_tuple_vec.size() 
-                                || !fprintf(stderr, "%lu < %lu failed!\n", (size_t)(batcharg.bedline.tid), tid_to_tname_tseqlen_tuple_vec.size()));
-                        batcharg.tname_tseqlen_tuple = tid_to_tname_tseqlen_tuple_vec.at((batcharg.bedline.tid));                        
-                        process_batch(uncompressed_vcf_string, uncompressed_3fastq_string, batcharg, tid_pos_symb_to_tkis1);
-                    }
-                    if (batcharg.is_vcf_out_pass_to_stdout) {
-                        batcharg.outstring_pass += uncompressed_vcf_string;
-                    } else {
-                        bgzip_string(batcharg.outstring_pass, uncompressed_vcf_string);
-                    }
-                    for (size_t i = 0; i < NUM_FQLIKE_CON_OUT_FILES; i++) {
-                        bgzip_string(batcharg.outstring3fastq[i], uncompressed_3fastq_string[i]);
                     }
-#if defined(USE_STDLIB_THREAD)
-            });
-            threads.push_back(std::move(athread));
-#endif
-            
-        }
-#if defined(USE_STDLIB_THREAD)
-        for (auto & t : threads) {
-            t.join();
-        }
-#endif
-        for (size_t beg_end_pair_idx = 0; beg_end_pair_idx < beg_end_pair_vec.size(); beg_end_pair_idx++) {
-            if (batchargs[beg_end_pair_idx].outstring_pass.size() > 0) {
-                // empty string means end of file
-                clearstring<true>(fp_pass, batchargs[beg_end_pair_idx].outstring_pass, is_vcf_out_pass_to_stdout);
-            }
-            for (size_t i = 0; i < fastq_fps.size(); i++) { 
-                if (batchargs[beg_end_pair_idx].outstring3fastq[i].size() > 0) {
-                    clearstring<true>(fastq_fps[i], batchargs[beg_end_pair_idx].outstring3fastq[i]); 
+                    batcharg.region_read_nbytes += nbatcharg.region_read_nbytes;
+                    batcharg.region_n_reads += nbatcharg.region_n_reads;
+                    batcharg.region_pos_nbytes += nbatcharg.region_pos_nbytes + tumor_tkis_nbytes;
+                    batcharg.region_n_positions = MAX(batcharg.region_n_positions, nbatcharg.region_n_positions);
+                } else {
+                    process_batch(uncompressed_vcf_string, uncompressed_3fastq_string, batcharg, task.tier1region->tid_pos_symb_to_tkis);
                 }
-            } 
-        }
-        read_bam_thread.join(); // end this iteration
-        for (auto tid_pos_symb_to_tkis1_pair: tid_pos_symb_to_tkis1) {
-            for (auto tki : tid_pos_symb_to_tkis1_pair.second) {
-                if (NULL != tki.bcf1_record) {
-                    bcf_destroy(tki.bcf1_record); 
+                task.tier1region.reset();
+                // The cache is kept for the next task, which is usually the next tier-3 region, only if it fits in one working unit of mem_per_thread. 
+                // Otherwise (e.g., for a stolen task or a region far away), it is refilled by the next query anyway. 
+                if (batcharg.bam_record_cache->nbytes() > max_bam_record_cache_nbytes) { batcharg.bam_record_cache->clear(); }
+                if (is_joint_calling && nbatcharg.bam_record_cache->nbytes() > max_bam_record_cache_nbytes) { nbatcharg.bam_record_cache->clear(); }
+                Tier3Result result;
+                result.outstring_pass = std::move(uncompressed_vcf_string);
+                if (is_vcf_out_pass_indexed && is_bcf_out_pass) {
+                    bcf_bytes_to_index_records(result.index_records_pass, result.outstring_pass);
+                } else if (is_vcf_out_pass_indexed) {
+                    vcf_text_to_index_records(result.index_records_pass, result.outstring_pass, batcharg.bedline.tid);
                 }
+                size_t out_nbytes = result.outstring_pass.size();
+                for (size_t i = 0; i < NUM_FQLIKE_CON_OUT_FILES; i++) {
+                    result.outstring3fastq[i] = std::move(uncompressed_3fastq_string[i]);
+                    out_nbytes += result.outstring3fastq[i].size();
+                }
+                result.mem_nbytes = mem_governor.record(task.mem_nbytes, 
+                        batcharg.region_n_reads, batcharg.region_read_nbytes, 
+                        batcharg.region_n_positions, batcharg.region_pos_nbytes, 
+                        batcharg.bedline.end_pos - batcharg.bedline.beg_pos, out_nbytes);
+                thread_budget.release(1);
+                pipeline.push_result(seq, std::move(result));
+            }
+        }));
+    }
+    
+    Tier3Result result;
+    while (pipeline.pop_next_result(result)) {
+        if (result.outstring_pass.size() > 0) {
+            bgzf_writer.submit(pass_stream_idx, std::move(result.outstring_pass), std::move(result.index_records_pass));
+        }
+        for (size_t i = 0; i < fastq_fps.size(); i++) { 
+            if (result.outstring3fastq[i].size() > 0) {
+                bgzf_writer.submit(fastq_stream_idxs[i], std::move(result.outstring3fastq[i]));
             }
         }
-        prev_bedline_tmp = (bedlines1.size() ? LAST(bedlines1) : prev_bedline_tmp);
-        autoswap(bedlines1, bedlines2);
-        autoswap(tid_pos_symb_to_tkis1, tid_pos_symb_to_tkis2);
+        mem_governor.release(result.mem_nbytes);
+    }
+    producer_thread.join();
+    for (auto & t : worker_threads) {
+        t.join();
     }
+    LOG(logINFO) << "Number of tier-3 regions stolen by idle threads: " << pipeline.get_n_stolen_tasks();
+    const auto mem_rates = mem_governor.get_rates();
+    LOG(logINFO) << "Peak memory held by the regions being processed: " << mem_governor.get_peak_held_nbytes() << " bytes, "
+            << "measured bytes per read: " << mem_rates[MemoryGovernor::BYTES_PER_READ] << ", "
+            << "per reference position: " << mem_rates[MemoryGovernor::BYTES_PER_REF_POS] << ", "
+            << "per reference position of output: " << mem_rates[MemoryGovernor::OUT_BYTES_PER_REF_POS];
     
-    clearstring<true>(fp_pass, std::string(""), is_vcf_out_pass_to_stdout); // write end of file
-    for (auto fastq_fp : fastq_fps) { clearstring<true>(fastq_fp, std::string("")); } // empty string means end of file
+    bgzf_writer.close(); // the end-of-file blocks are written by bgzf_close
 
     bam_hdr_destroy(samheader);
     if (NULL != g_bcf_hdr) {
         bcf_hdr_destroy(g_bcf_hdr);
     }
     for (size_t i = 0; i < nidxs; i++) { 
-        if (NULL != srs[i]) {
-            bcf_sr_destroy(srs[i]);
-        }
         if (NULL != ref_faidxs[i]) { 
             fai_destroy(ref_faidxs[i]); 
         }
@@ -1553,9 +2008,19 @@ main(int argc, char **argv) {
         if (NULL != samfiles[i]) {
             sam_close(samfiles[i]);
         }
+        if (NULL != nsam_idxs[i]) {
+            hts_idx_destroy(nsam_idxs[i]);
+        }
+        if (NULL != nsamfiles[i]) {
+            sam_close(nsamfiles[i]);
+        }
     }
     // bgzf_flush is internally called by bgzf_close
     gzip_close_wrap1(fp_pass, paramset.vcf_out_pass_fname);
+    if (is_vcf_out_pass_indexed) {
+        // saved after the file is closed so that the index is not older than the file
+        pass_indexer->save(paramset.vcf_out_pass_fname, bgzf_writer.getEndVirtualOffset(pass_stream_idx));
+    }
     for (size_t i = 0; i < fastq_fps.size(); i++) { gzip_close_wrap1(fastq_fps[i], fastq_filenames[i]); }
     
     std::clock_t c_end = std::clock();
@@ -10,6 +10,7 @@
 #include "main_consensus.hpp"
 #include "main_conversion.hpp"
 #include "MolecularID.hpp"
+#include "pipeline.hpp"
 
 #include "htslib/faidx.h"
 #include "htslib/hts.h"
@@ -22,6 +23,7 @@
 #include <map>
 #include <set>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <assert.h>
@@ -62,94 +64,214 @@ indelToData_getMajority(const std::map<T, uvc1_readnum_t> & indel2cnt) {
     return std::make_pair(maxcnt, argmaxcnt);
 }
 
+// Flat open-addressing hash table from (position, InDel) to count, where InDel is the deletion length or the inserted sequence.
+// The entries are stored contiguously in the order of their insertion, and the entries at the same position are linked together, 
+//   so that an InDel observation costs no node allocation (short inserted sequences are stored inline by std::string). 
+template <class T>
+class PosToIndelToCountTable {
+    
+    struct Entry {
+        uvc1_refgpos_t pos;
+        uvc1_readnum_t count;
+        uint32_t next_idx_at_pos; // NO_IDX if this entry is the last one at its position
+        T indel;
+    };
+    
+    static const uint32_t NO_IDX = UINT32_MAX;
+    
+    std::vector<Entry> entries;
+    std::vector<uint32_t> key_slots; // entry index plus one for the key (pos, indel), zero means empty
+    std::vector<uint32_t> pos_slots; // entry index plus one for the first entry at pos, zero means empty
+    
+    static uvc1_hash_t
+    mixHash(uvc1_hash_t x) {
+        x ^= (x >> 33);
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= (x >> 33);
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= (x >> 33);
+        return x;
+    };
+    static uvc1_hash_t
+    posHash(const uvc1_refgpos_t pos) {
+        return mixHash((uvc1_hash_t)(uint32_t)pos);
+    };
+    static uvc1_hash_t
+    keyHash(const uvc1_refgpos_t pos, const T & indel) {
+        return mixHash(((uvc1_hash_t)(uint32_t)pos * 0x9E3779B97F4A7C15ULL) ^ (uvc1_hash_t)std::hash<T>()(indel));
+    };
+    
+    uint32_t
+    findEntryIdx(const uvc1_refgpos_t pos, const T & indel) const {
+        if (0 == key_slots.size()) { return NO_IDX; }
+        const size_t mask = key_slots.size() - 1;
+        for (size_t i = (keyHash(pos, indel) & mask); ; i = ((i + 1) & mask)) {
+            const uint32_t slot = key_slots[i];
+            if (0 == slot) { return NO_IDX; }
+            const Entry & entry = entries[slot - 1];
+            if (entry.pos == pos && entry.indel == indel) { return slot - 1; }
+        }
+    };
+    
+    size_t
+    findPosSlot(const uvc1_refgpos_t pos) const {
+        const size_t mask = pos_slots.size() - 1;
+        for (size_t i = (posHash(pos) & mask); ; i = ((i + 1) & mask)) {
+            const uint32_t slot = pos_slots[i];
+            if (0 == slot || entries[slot - 1].pos == pos) { return i; }
+        }
+    };
+    
+    void
+    linkEntry(const uint32_t idx) {
+        const size_t pos_slot = findPosSlot(entries[idx].pos);
+        entries[idx].next_idx_at_pos = ((0 == pos_slots[pos_slot]) ? NO_IDX : (pos_slots[pos_slot] - 1));
+        pos_slots[pos_slot] = idx + 1;
+        const size_t mask = key_slots.size() - 1;
+        size_t i = (keyHash(entries[idx].pos, entries[idx].indel) & mask);
+        while (0 != key_slots[i]) { i = ((i + 1) & mask); }
+        key_slots[i] = idx + 1;
+    };
+    
+    void
+    rehash(const size_t nslots) {
+        key_slots.assign(nslots, 0);
+        pos_slots.assign(nslots, 0);
+        for (uint32_t idx = 0; idx < entries.size(); idx++) {
+            linkEntry(idx);
+        }
+    };
+    
+public:
+    
+    size_t
+    size() const {
+        return entries.size();
+    };
+    
+    // The allocated memory, where the inserted sequences that are too long to be stored inline are not counted.
+    size_t
+    getNumBytes() const {
+        return entries.capacity() * sizeof(Entry) + (key_slots.capacity() + pos_slots.capacity()) * sizeof(uint32_t);
+    };
+    
+    // Removes all entries while keeping the allocated memory for reuse.
+    void
+    clear() {
+        entries.clear();
+        std::fill(key_slots.begin(), key_slots.end(), 0);
+        std::fill(pos_slots.begin(), pos_slots.end(), 0);
+    };
+    
+    bool
+    hasPos(const uvc1_refgpos_t pos) const {
+        return (pos_slots.size() > 0 && 0 != pos_slots[findPosSlot(pos)]);
+    };
+    
+    uvc1_readnum_t
+    get(const uvc1_refgpos_t pos, const T & indel, uvc1_readnum_t default1 = 0, uvc1_readnum_t default2 = 0) const {
+        if (!hasPos(pos)) { return default1; }
+        const uint32_t idx = findEntryIdx(pos, indel);
+        return ((NO_IDX == idx) ? default2 : entries[idx].count);
+    };
+    
+    void
+    inc(const uvc1_refgpos_t pos, const T & indel, uvc1_readnum_t incvalue) {
+        const uint32_t idx = findEntryIdx(pos, indel);
+        if (NO_IDX != idx) {
+            entries[idx].count += incvalue;
+            return;
+        }
+        entries.push_back(Entry({pos, incvalue, NO_IDX, indel}));
+        if (entries.size() * 2 > key_slots.size()) {
+            rehash(MAX(SIGN2UNSIGN(16), key_slots.size() * 2));
+        } else {
+            linkEntry(entries.size() - 1);
+        }
+    };
+    
+    // Calls func(indel, count) for each InDel at pos.
+    template <class F>
+    void
+    forEachIndelAtPos(const uvc1_refgpos_t pos, F func) const {
+        if (0 == pos_slots.size()) { return; }
+        for (uint32_t idx = pos_slots[findPosSlot(pos)]; idx != 0; ) {
+            const Entry & entry = entries[idx - 1];
+            func(entry.indel, entry.count);
+            idx = ((NO_IDX == entry.next_idx_at_pos) ? 0 : (entry.next_idx_at_pos + 1));
+        }
+    };
+    
+    // Calls func(pos, indel, count) for each (pos, indel) in the order of insertion.
+    template <class F>
+    void
+    forEach(F func) const {
+        for (const Entry & entry : entries) {
+            func(entry.pos, entry.indel, entry.count);
+        }
+    };
+};
+
+typedef PosToIndelToCountTable<uvc1_readpos_t> PosToDlenToCountTable;
+typedef PosToIndelToCountTable<std::string> PosToIseqToCountTable;
+
+// The majority InDel at pos, where ties are broken by choosing the greater InDel so that the result does not depend on the order of insertion.
+template <class T>
+std::pair<uvc1_readnum_t, T>
+posToIndelToData_getMajority(const PosToIndelToCountTable<T> & pos2indel2data, const uvc1_refgpos_t pos) {
+    uvc1_readnum_t maxcnt = 0;
+    T argmaxcnt = T();
+    pos2indel2data.forEachIndelAtPos(pos, [&](const T & indel, const uvc1_readnum_t cnt) {
+        if (cnt > maxcnt || ((cnt == maxcnt) && (indel > argmaxcnt))) {
+            maxcnt = cnt;
+            argmaxcnt = indel;
+        }
+    });
+    return std::make_pair(maxcnt, argmaxcnt);
+}
+
 template <class T>
 uvc1_readnum_t
-posToIndelToData_get(const std::map<uvc1_readnum_t, std::map<T, uvc1_readnum_t>> & pos2indel2data, const uvc1_readnum_t refpos, const T & indel, uvc1_readnum_t default1 = 0, uvc1_readnum_t default2 = 0) {
-    if (pos2indel2data.find(refpos) == pos2indel2data.end()) { return default1; }
-    if (pos2indel2data.at(refpos).find(indel) == pos2indel2data.at(refpos).end()) { return default2; }
-    return pos2indel2data.at(refpos).at(indel);
+posToIndelToData_get(const PosToIndelToCountTable<T> & pos2indel2data, const uvc1_refgpos_t refpos, const T & indel, uvc1_readnum_t default1 = 0, uvc1_readnum_t default2 = 0) {
+    return pos2indel2data.get(refpos, indel, default1, default2);
 }
 
 template <class T>
 void
-posToIndelToCount_inc(std::map<uvc1_refgpos_t, std::map<T, uvc1_readnum_t>> & pos2indel2count, uvc1_readpos_t pos, const T indel, uvc1_readnum_t incvalue = 1) {
+posToIndelToCount_inc(PosToIndelToCountTable<T> & pos2indel2count, uvc1_readpos_t pos, const T indel, uvc1_readnum_t incvalue = 1) {
     assertUVC(incvalue > 0);
-    auto pos2indel2count4it = pos2indel2count.insert(std::make_pair(pos, std::map<T, uvc1_readnum_t>()));
-    auto indel2count4it = pos2indel2count4it.first->second.insert(std::make_pair(indel, 0));
-    indel2count4it.first->second += incvalue;
+    pos2indel2count.inc(pos, indel, incvalue);
     assertUVC (posToIndelToData_get(pos2indel2count, pos, indel) > 0);
 }
 
 template <class T>
 T
-posToIndelToCount_updateByConsensus(std::map<uvc1_refgpos_t, std::map<T, uvc1_readnum_t>> & dst, const std::map<uvc1_refgpos_t, std::map<T, uvc1_readnum_t>> & src, uvc1_readnum_t epos, uvc1_readnum_t incvalue = 1) {
-    const auto pos2indel2count4it = src.find(epos);
-    assertUVC(pos2indel2count4it != src.end());
-    auto indel2count = pos2indel2count4it->second;
-    const T & src_indel = (indel2count.size() > 1 ? (indelToData_getMajority(indel2count).second) : indel2count.begin()->first); 
-    // The following code generates null-valued InDels if more than one InDel is found, which is not intended. 
-    // const T & src_indel = (indel2count.size() > 1 ? T() : indel2count.begin()->first); 
-    assertUVC (indel2count.begin()->second > 0);
+posToIndelToCount_updateByConsensus(PosToIndelToCountTable<T> & dst, const PosToIndelToCountTable<T> & src, uvc1_readnum_t epos, uvc1_readnum_t incvalue = 1) {
+    assertUVC(src.hasPos(epos));
+    // The majority of one InDel is this InDel.
+    const T src_indel = posToIndelToData_getMajority(src, epos).second; 
     posToIndelToCount_inc<T>(dst, epos, src_indel, incvalue);
     return src_indel;
 }
 
-// For reason of commenting-out this method, please check the method updateByRepresentative that calls this method
-/*
-template <bool TIsIncVariable, class T>
-uvc1_readnum_t
-posToIndelToCount_updateByRepresentative(std::map<uvc1_readnum_t, std::map<T, uvc1_readnum_t>> & dst, const std::map<uvc1_readnum_t, std::map<T, uvc1_readnum_t>> & src, uvc1_readnum_t epos, uvc1_readnum_t incvalue = 1) {
-    const auto pos2indel2count4it = src.find(epos);
-    assertUVC(pos2indel2count4it != src.end());
-
-    T max_indel;
-    uvc1_readnum_t max_count = 0;
-    uvc1_readnum_t sum_count = 0;
-    for (auto indel2count : pos2indel2count4it->second) {
-        auto indel = indel2count.first;
-        auto count = indel2count.second;
-        if (count > max_count) {
-            max_indel = indel;
-            max_count = count;
-        }
-        if (TIsIncVariable) {sum_count += count; }
-    }
-    assertUVC(0 < max_count);
-    if (TIsIncVariable) {
-        posToIndelToCount_inc<T>(dst, epos, max_indel, sum_count);
-    } else {
-        posToIndelToCount_inc<T>(dst, epos, max_indel, incvalue);
-    }
-    return max_count;
-}
-*/
-
 template <class T>
 void
-posToIndelToCount_updateBySummation(std::map<uvc1_readnum_t, std::map<T, uvc1_readnum_t>> & dst, const std::map<uvc1_readnum_t, std::map<T, uvc1_readnum_t>> & src) {
-    for (auto src_pos2indel2count4it : src) {
-        auto src_pos = src_pos2indel2count4it.first;
-        auto src_indel2count = src_pos2indel2count4it.second;
-        for (auto src_indel2count4it : src_indel2count) {
-            assertUVC(src_indel2count4it.second > 0 || !(
-                std::cerr << src_indel2count4it.second << " > 0 failed for the key " << src_indel2count4it.first << " at position " << src_pos << std::endl
-            ));
-            posToIndelToCount_inc<T>(dst, src_pos, src_indel2count4it.first, src_indel2count4it.second);
-        }
-    }
+posToIndelToCount_updateBySummation(PosToIndelToCountTable<T> & dst, const PosToIndelToCountTable<T> & src) {
+    src.forEach([&](const uvc1_refgpos_t src_pos, const T & src_indel, const uvc1_readnum_t src_count) {
+        assertUVC(src_count > 0 || !(
+            std::cerr << src_count << " > 0 failed for the key " << src_indel << " at position " << src_pos << std::endl
+        ));
+        posToIndelToCount_inc<T>(dst, src_pos, src_indel, src_count);
+    });
 }
 
 void
-posToIndelToCount_DlenToDseq(std::map<uvc1_readnum_t, std::map<std::string, uvc1_readnum_t>> & dst, const std::map<uvc1_readnum_t, std::map<uvc1_readnum_t, uvc1_readnum_t>> & src,
+posToIndelToCount_DlenToDseq(PosToIseqToCountTable & dst, const PosToDlenToCountTable & src,
         const std::string & refchars, uvc1_readnum_t incluBegPos) {
-    for (auto src_pos2indel2count4it : src) {
-        uvc1_readnum_t src_pos = src_pos2indel2count4it.first;
-        auto src_del2count = src_pos2indel2count4it.second;
-        for (auto src_del2count4it : src_del2count) {
-            std::string dseq = refchars.substr(src_pos - incluBegPos, src_del2count4it.first);
-            posToIndelToCount_inc(dst, src_pos, dseq, src_del2count4it.second);
-        }
-    }
+    src.forEach([&](const uvc1_refgpos_t src_pos, const uvc1_readpos_t src_dlen, const uvc1_readnum_t src_count) {
+        std::string dseq = refchars.substr(src_pos - incluBegPos, src_dlen);
+        posToIndelToCount_inc(dst, src_pos, dseq, src_count);
+    });
 }
 
 #define INS_N_ANCHOR_BASES 1 //  https://www.ncbi.nlm.nih.gov/pmc/articles/PMC149199/
@@ -188,11 +310,9 @@ std::pair<uvc1_readnum_t, std::string>
 read_family_con_ampl_getMajority_ins(const auto &read_family_con_ampl, const uvc1_refgpos_t epos) {
     std::map<std::string, uvc1_readnum_t> indel2readnum = { {"", 0} };
     for (const AlignmentSymbol s : INS_SYMBOLS) {
-        auto p2e2d = read_family_con_ampl.getPosToIseqToData(s);
-        if (p2e2d.find(epos) != p2e2d.end()) {
-            std::map<std::string, uvc1_readnum_t> indel2data = p2e2d.find(epos)->second;
-            indel2readnum.insert(indel2data.begin(), indel2data.end());
-        }
+        read_family_con_ampl.getPosToIseqToData(s).forEachIndelAtPos(epos, [&](const std::string & iseq, const uvc1_readnum_t cnt) {
+            indel2readnum.insert(std::make_pair(iseq, cnt));
+        });
     }
     return indelToData_getMajority(indel2readnum);
 }
@@ -201,11 +321,9 @@ std::pair<uvc1_readnum_t, uvc1_refgpos_t>
 read_family_con_ampl_getMajority_del(const auto &read_family_con_ampl, const uvc1_refgpos_t epos) {
     std::map<uvc1_refgpos_t, uvc1_readnum_t> indel2readnum = { {0, 0} };
     for (const AlignmentSymbol s : DEL_SYMBOLS) {
-        auto p2e2d = read_family_con_ampl.getPosToDlenToData(s);
-        if (p2e2d.find(epos) != p2e2d.end()) {
-            std::map<uvc1_refgpos_t, uvc1_readnum_t> indel2data = p2e2d.find(epos)->second; 
-            indel2readnum.insert(indel2data.begin(), indel2data.end());
-        }
+        read_family_con_ampl.getPosToDlenToData(s).forEachIndelAtPos(epos, [&](const uvc1_readpos_t dlen, const uvc1_readnum_t cnt) {
+            indel2readnum.insert(std::make_pair(dlen, cnt));
+        });
     }
     return indelToData_getMajority(indel2readnum);
 }
@@ -317,6 +435,15 @@ public:
         return ret;
     };
 
+    void
+    addSymbolBucketCounts(const GenericSymbol2Bucket2Count<TB2C> & other) {
+        for (size_t i = 0; i < NUM_ALIGNMENT_SYMBOLS; i++) {
+            for (size_t j = 0; j < this->symbol2data[0].size(); j++) {
+                this->symbol2data[i][j] += other.symbol2data[i][j];
+            }
+        }
+    };
+    
     void
     clearSymbolBucketCount() {
         assertUVC(sizeof(TB2C) * NUM_ALIGNMENT_SYMBOLS == sizeof(this->symbol2data) || !fprintf(stderr, "%lu * %u != %lu\n", sizeof(TB2C), NUM_ALIGNMENT_SYMBOLS, sizeof(this->symbol2data)));
@@ -520,20 +647,142 @@ public:
     };
 };
 
+// The updateBySummation functions below merge the data computed from disjoint sets of molecule families (e.g., by different threads).
+
+template <class T>
+void
+updateBySummation(T & dst, const T & src) {
+    dst += src;
+}
+
+void
+updateBySummation(FamFormatInfoSet & dst, const FamFormatInfoSet & src) {
+    dst.faminfo_c2LP1 += src.faminfo_c2LP1;
+    dst.faminfo_c2LP2 += src.faminfo_c2LP2;
+    dst.faminfo_c2LPL += src.faminfo_c2LPL;
+    dst.faminfo_c2RP1 += src.faminfo_c2RP1;
+    dst.faminfo_c2RP2 += src.faminfo_c2RP2;
+    dst.faminfo_c2RPL += src.faminfo_c2RPL;
+    dst.faminfo_c2LP0 += src.faminfo_c2LP0;
+    dst.faminfo_c2RP0 += src.faminfo_c2RP0;
+    dst.faminfo_c2LB1 += src.faminfo_c2LB1;
+    dst.faminfo_c2LB2 += src.faminfo_c2LB2;
+    dst.faminfo_c2LBL += src.faminfo_c2LBL;
+    dst.faminfo_c2RB1 += src.faminfo_c2RB1;
+    dst.faminfo_c2RB2 += src.faminfo_c2RB2;
+    dst.faminfo_c2RBL += src.faminfo_c2RBL;
+    dst.faminfo_c2BQ2 += src.faminfo_c2BQ2;
+}
+
+template <class TB2C>
+void
+updateBySummation(GenericSymbol2Bucket2Count<TB2C> & dst, const GenericSymbol2Bucket2Count<TB2C> & src) {
+    dst.addSymbolBucketCounts(src);
+}
+
+template <class T, size_t N>
+void
+updateBySummation(std::array<T, N> & dst, const std::array<T, N> & src) {
+    for (size_t i = 0; i < N; i++) {
+        updateBySummation(dst[i], src[i]);
+    }
+}
+
+template <class T, size_t N>
+void
+posToIndelToCount_updateBySummation(std::array<T, N> & dst, const std::array<T, N> & src) {
+    for (size_t i = 0; i < N; i++) {
+        posToIndelToCount_updateBySummation(dst[i], src[i]);
+    }
+}
+
+template <class T>
+void
+mutform2count4map_updateBySummation(T & dst, const T & src) {
+    for (const auto & mutform2count4it : src) {
+        auto & dst_counts = dst.insert(std::make_pair(mutform2count4it.first, std::array<uvc1_readnum_t, 2>({0, 0}))).first->second;
+        dst_counts[0] += mutform2count4it.second[0];
+        dst_counts[1] += mutform2count4it.second[1];
+    }
+}
+
+// The position-to-indel-to-count maps shared by the array-of-structs and struct-of-arrays covered regions below.
+class CoveredRegionIndelMaps {
+
+protected:
+    
+    std::array<PosToDlenToCountTable, NUM_INS_SYMBOLS> pos2dlen2data;
+    std::array<PosToIseqToCountTable, NUM_DEL_SYMBOLS> pos2iseq2data;
+    
+    void
+    updateIndelMapsBySummation(const CoveredRegionIndelMaps & other) {
+        for (size_t i = 0; i < pos2dlen2data.size(); i++) {
+            posToIndelToCount_updateBySummation(this->pos2dlen2data[i], other.pos2dlen2data[i]);
+        }
+        for (size_t i = 0; i < pos2iseq2data.size(); i++) {
+            posToIndelToCount_updateBySummation(this->pos2iseq2data[i], other.pos2iseq2data[i]);
+        }
+    };
+    
+    void
+    clearIndelMaps() {
+        for (auto & pos2dlen2count : pos2dlen2data) {
+            pos2dlen2count.clear();
+        }
+        for (auto & pos2iseq2count : pos2iseq2data) {
+            pos2iseq2count.clear();
+        }
+    };
+    
+public:
+    
+    size_t
+    getIndelMapsNumBytes() const {
+        size_t ret = 0;
+        for (const auto & pos2dlen2count : pos2dlen2data) {
+            ret += pos2dlen2count.getNumBytes();
+        }
+        for (const auto & pos2iseq2count : pos2iseq2data) {
+            ret += pos2iseq2count.getNumBytes();
+        }
+        return ret;
+    };
+    
+    const PosToDlenToCountTable & 
+    getPosToDlenToData(const AlignmentSymbol s) const { 
+        int idx = (LINK_D1 == s ? 0 : ((LINK_D2 == s) ? 1: 2));
+        return pos2dlen2data[idx];
+    };
+    const PosToIseqToCountTable & 
+    getPosToIseqToData(const AlignmentSymbol s) const {
+        int idx = (LINK_I1 == s ? 0 : ((LINK_I2 == s) ? 1: 2));
+        return pos2iseq2data[idx];
+    };
+
+    PosToDlenToCountTable & 
+    getRefPosToDlenToData(const AlignmentSymbol s) {
+        int idx = (LINK_D1 == s ? 0 : ((LINK_D2 == s) ? 1: 2));
+        return pos2dlen2data[idx];
+    };
+    PosToIseqToCountTable & 
+    getRefPosToIseqToData(const AlignmentSymbol s) {
+        int idx = (LINK_I1 == s ? 0 : ((LINK_I2 == s) ? 1: 2));
+        return pos2iseq2data[idx];
+    };
+};
+
 template<class T>
-class CoveredRegion {
+class CoveredRegion : public CoveredRegionIndelMaps {
          
 protected:
     
     std::vector<T> idx2symbol2data;
-    std::array<std::map<uvc1_refgpos_t, std::map<uvc1_readpos_t     , uvc1_readnum_t>>, NUM_INS_SYMBOLS> pos2dlen2data;
-    std::array<std::map<uvc1_refgpos_t, std::map<std::string, uvc1_readnum_t>>, NUM_DEL_SYMBOLS> pos2iseq2data;
     std::array<ConsensusBlockSet, NUM_CONSENSUS_BLOCK_CIGAR_TYPES> conblocksets;
     
 public:
     
-    const uvc1_refgpos_t tid;
-    const uvc1_refgpos_t incluBegPosition; // where end_pos = incluBegPosition + idx2symbol2data.size()
+    uvc1_refgpos_t tid;
+    uvc1_refgpos_t incluBegPosition; // where end_pos = incluBegPosition + idx2symbol2data.size()
     
     CoveredRegion() {};
     CoveredRegion(uvc1_refgpos_t tid, uvc1_refgpos_t beg, uvc1_refgpos_t end): tid(tid), incluBegPosition(beg)  {
@@ -571,26 +820,10 @@ public:
         return this->incluBegPosition + UNSIGN2SIGN(idx2symbol2data.size());
     };
     
-    const std::map<uvc1_refgpos_t, std::map<uvc1_refgpos_t    , uvc1_readnum_t>> & 
-    getPosToDlenToData(const AlignmentSymbol s) const { 
-        int idx = (LINK_D1 == s ? 0 : ((LINK_D2 == s) ? 1: 2));
-        return pos2dlen2data[idx];
-    };
-    const std::map<uvc1_refgpos_t, std::map<std::string, uvc1_readnum_t>> & 
-    getPosToIseqToData(const AlignmentSymbol s) const {
-        int idx = (LINK_I1 == s ? 0 : ((LINK_I2 == s) ? 1: 2));
-        return pos2iseq2data[idx];
-    };
-
-    std::map<uvc1_refgpos_t, std::map<uvc1_readpos_t   , uvc1_readnum_t>> & 
-    getRefPosToDlenToData(const AlignmentSymbol s) {
-        int idx = (LINK_D1 == s ? 0 : ((LINK_D2 == s) ? 1: 2));
-        return pos2dlen2data[idx];
-    };
-    std::map<uvc1_refgpos_t, std::map<std::string, uvc1_refgpos_t>> & 
-    getRefPosToIseqToData(const AlignmentSymbol s) {
-        int idx = (LINK_I1 == s ? 0 : ((LINK_I2 == s) ? 1: 2));
-        return pos2iseq2data[idx];
+    // The allocated memory except for the consensus blocks, which are only used by the short-lived family-level objects.
+    size_t
+    getNumBytes() const {
+        return idx2symbol2data.capacity() * sizeof(T) + this->getIndelMapsNumBytes();
     };
     
     const ConsensusBlockSet & 
@@ -601,6 +834,280 @@ public:
     getRefConsensusBlockSet(const ConsensusBlockCigarType cigar_type) {
         return conblocksets[cigar_type];
     };
+    
+    // Equivalent to constructing a new object with (tid, beg, end) except that the allocated memory is kept for reuse.
+    // This is used by the short-lived per-family and per-fragment objects, which are reset once per family or fragment instead of reconstructed.
+    void
+    resetRegion(uvc1_refgpos_t a_tid, uvc1_refgpos_t beg, uvc1_refgpos_t end) {
+        assertUVC (beg < end || !fprintf(stderr, "assertion %d < %d failed!\n", beg, end));
+        this->tid = a_tid;
+        this->incluBegPosition = beg;
+        this->idx2symbol2data.assign(end - beg, T());
+        this->clearIndelMaps();
+        for (auto & conblockset : conblocksets) {
+            conblockset.pos2conblock.clear();
+        }
+    };
+    
+    // The consensus blocks are not merged because they are only used by the family-level coverage objects.
+    void
+    updateBySummation(const CoveredRegion<T> & other) {
+        assertUVC(this->tid == other.tid);
+        assertUVC(this->getIncluBegPosition() == other.getIncluBegPosition() && this->getExcluEndPosition() == other.getExcluEndPosition());
+        for (size_t i = 0; i < idx2symbol2data.size(); i++) {
+            ::updateBySummation(this->idx2symbol2data[i], other.idx2symbol2data[i]);
+        }
+        this->updateIndelMapsBySummation(other);
+    };
+};
+
+// Struct-of-arrays (SoA) counterpart of CoveredRegion<std::array<std::array<TValue, NFields>, NUM_ALIGNMENT_SYMBOLS>>.
+// The values of each (symbol, field) pair at all positions are stored in one contiguous column,
+//   so a scan of one field over consecutive positions reads consecutive memory instead of striding over all other fields.
+// getByPos(pos)[symbol][field] and getRefByPos(pos)[symbol][field] return the same values as with CoveredRegion.
+template <class TValue, size_t NFields>
+class SymbolFieldCoveredRegion : public CoveredRegionIndelMaps {
+
+protected:
+    
+    size_t npositions = 0;
+    std::vector<TValue> symbolfield2pos2data; // the column of (symbol, field) starts at ((symbol * NFields + field) * npositions)
+    
+public:
+    
+    template <class TPtr>
+    class FieldRow {
+        TPtr data;
+        size_t stride;
+    public:
+        FieldRow(TPtr data, size_t stride): data(data), stride(stride) {};
+        auto &
+        operator[](size_t field) const {
+            assertUVC(field < NFields);
+            return data[field * stride];
+        };
+    };
+    
+    template <class TPtr>
+    class SymbolFieldRow {
+        TPtr data;
+        size_t stride;
+    public:
+        SymbolFieldRow(TPtr data, size_t stride): data(data), stride(stride) {};
+        FieldRow<TPtr>
+        operator[](size_t symbol) const {
+            assertUVC(symbol < NUM_ALIGNMENT_SYMBOLS);
+            return FieldRow<TPtr>(data + symbol * NFields * stride, stride);
+        };
+    };
+    
+    const uvc1_refgpos_t tid;
+    const uvc1_refgpos_t incluBegPosition;
+    
+    SymbolFieldCoveredRegion() {};
+    SymbolFieldCoveredRegion(uvc1_refgpos_t tid, uvc1_refgpos_t beg, uvc1_refgpos_t end): tid(tid), incluBegPosition(beg) {
+        assertUVC (beg < end || !fprintf(stderr, "assertion %d < %d failed!\n", beg, end));
+        this->npositions = end - beg;
+        this->symbolfield2pos2data = std::vector<TValue>(NUM_ALIGNMENT_SYMBOLS * NFields * this->npositions);
+    };
+    
+    SymbolFieldRow<TValue *>
+    getRefByPos(const uvc1_refgpos_t pos, const bam1_t *bam = NULL) {
+        assertUVC(pos >= this->incluBegPosition || !fprintf(stderr, "%d >= %d failed for qname %s !\n", pos, this->incluBegPosition, (NULL != bam ? bam_get_qname(bam) : "?")));
+        assertUVC(pos < this->getExcluEndPosition() || !fprintf(stderr, "%d < %d failed for qname %s !\n", pos, this->getExcluEndPosition(), (NULL != bam ? bam_get_qname(bam) : "?")));
+        return SymbolFieldRow<TValue *>(this->symbolfield2pos2data.data() + (pos - this->incluBegPosition), this->npositions);
+    };
+    
+    SymbolFieldRow<const TValue *>
+    getByPos(const uvc1_refgpos_t pos, const bam1_t *bam = NULL) const {
+        assertUVC(pos >= this->incluBegPosition || !fprintf(stderr, "%d >= %d failed for qname %s !\n", pos, this->incluBegPosition, (NULL != bam ? bam_get_qname(bam) : "?")));
+        assertUVC(pos < this->getExcluEndPosition() || !fprintf(stderr, "%d < %d failed for qname %s !\n", pos, this->getExcluEndPosition(), (NULL != bam ? bam_get_qname(bam) : "?")));
+        return SymbolFieldRow<const TValue *>(this->symbolfield2pos2data.data() + (pos - this->incluBegPosition), this->npositions);
+    };
+    
+    // Returns the contiguous values of the field of the symbol from getIncluBegPosition() to getExcluEndPosition().
+    const TValue *
+    getColumn(const AlignmentSymbol symbol, const size_t field) const {
+        assertUVC(field < NFields);
+        return this->symbolfield2pos2data.data() + (symbol * NFields + field) * this->npositions;
+    };
+    
+    // Adds the sum of the field over the symbols of the symbol type at each position from beg to end (exclusive) to the corresponding element of dst.
+    template <class T>
+    void
+    addFieldSumBySymbolType(std::vector<T> & dst, const SymbolType symboltype, const size_t field, const uvc1_refgpos_t beg, const uvc1_refgpos_t end) const {
+        assertUVC(this->incluBegPosition <= beg && beg <= end && end <= this->getExcluEndPosition());
+        assertUVC(dst.size() >= (size_t)(end - beg));
+        for (const auto symbol : SYMBOL_TYPE_TO_SYMBOLS[symboltype]) {
+            const TValue *column = this->getColumn(symbol, field) + (beg - this->incluBegPosition);
+            for (uvc1_refgpos_t i = 0; i < end - beg; i++) {
+                dst[i] += column[i];
+            }
+        }
+    };
+    
+    uvc1_refgpos_t
+    getIncluBegPosition() const {
+        return this->incluBegPosition;
+    };
+    uvc1_refgpos_t
+    getExcluEndPosition() const {
+        return this->incluBegPosition + UNSIGN2SIGN(this->npositions);
+    };
+    
+    size_t
+    getNumBytes() const {
+        return symbolfield2pos2data.capacity() * sizeof(TValue) + this->getIndelMapsNumBytes();
+    };
+    
+    void
+    updateBySummation(const SymbolFieldCoveredRegion<TValue, NFields> & other) {
+        assertUVC(this->tid == other.tid);
+        assertUVC(this->getIncluBegPosition() == other.getIncluBegPosition() && this->getExcluEndPosition() == other.getExcluEndPosition());
+        for (size_t i = 0; i < symbolfield2pos2data.size(); i++) {
+            this->symbolfield2pos2data[i] += other.symbolfield2pos2data[i];
+        }
+        this->updateIndelMapsBySummation(other);
+    };
+};
+
+// Two-tier counterpart of CoveredRegion<std::array<T, NUM_ALIGNMENT_SYMBOLS>>. 
+// At almost all positions, only the reference symbol of each symbol type is observed. 
+// Hence, the data of the first observed symbol of each symbol type at each position is stored in a dense array, 
+//   and the data of any other (position, symbol) pair is allocated only when it is updated for the first time.
+// References returned by getRefByPos(pos)[symbol] stay valid after other (position, symbol) pairs are allocated.
+template <class T>
+class SparseSymbolCoveredRegion {
+
+protected:
+    
+    std::vector<std::array<AlignmentSymbol, NUM_SYMBOL_TYPES>> idx2symboltype2densesymbol; // END_ALIGNMENT_SYMBOLS if not observed yet
+    std::vector<std::array<T, NUM_SYMBOL_TYPES>> idx2symboltype2densedata;
+    std::unordered_map<size_t, T> idxsymbol2sparsedata; // key is (idx * NUM_ALIGNMENT_SYMBOLS + symbol)
+    
+    static SymbolType
+    symbolToSymbolType(const AlignmentSymbol symbol) {
+        return ((symbol < LINK_M) ? BASE_SYMBOL : LINK_SYMBOL);
+    };
+    
+    const T &
+    getByIdxSymbol(const size_t idx, const AlignmentSymbol symbol) const {
+        static const T THE_ZERO_DATA = T();
+        const SymbolType symboltype = symbolToSymbolType(symbol);
+        if (idx2symboltype2densesymbol[idx][symboltype] == symbol) {
+            return idx2symboltype2densedata[idx][symboltype];
+        }
+        const auto it = idxsymbol2sparsedata.find(idx * NUM_ALIGNMENT_SYMBOLS + symbol);
+        return ((it != idxsymbol2sparsedata.end()) ? (it->second) : THE_ZERO_DATA);
+    };
+    
+    T &
+    getRefByIdxSymbol(const size_t idx, const AlignmentSymbol symbol) {
+        const SymbolType symboltype = symbolToSymbolType(symbol);
+        auto & densesymbol = idx2symboltype2densesymbol[idx][symboltype];
+        if (END_ALIGNMENT_SYMBOLS == densesymbol) {
+            densesymbol = symbol;
+        }
+        if (densesymbol == symbol) {
+            return idx2symboltype2densedata[idx][symboltype];
+        }
+        return idxsymbol2sparsedata[idx * NUM_ALIGNMENT_SYMBOLS + symbol]; // value-initialized if absent
+    };
+    
+public:
+    
+    class SymbolRow {
+        SparseSymbolCoveredRegion<T> *region;
+        size_t idx;
+    public:
+        SymbolRow(SparseSymbolCoveredRegion<T> *region, size_t idx): region(region), idx(idx) {};
+        T &
+        operator[](size_t symbol) const {
+            assertUVC(symbol < NUM_ALIGNMENT_SYMBOLS);
+            return region->getRefByIdxSymbol(idx, (AlignmentSymbol)symbol);
+        };
+    };
+    
+    class ConstSymbolRow {
+        const SparseSymbolCoveredRegion<T> *region;
+        size_t idx;
+    public:
+        ConstSymbolRow(const SparseSymbolCoveredRegion<T> *region, size_t idx): region(region), idx(idx) {};
+        const T &
+        operator[](size_t symbol) const {
+            assertUVC(symbol < NUM_ALIGNMENT_SYMBOLS);
+            return region->getByIdxSymbol(idx, (AlignmentSymbol)symbol);
+        };
+    };
+    
+    const uvc1_refgpos_t tid;
+    const uvc1_refgpos_t incluBegPosition;
+    
+    SparseSymbolCoveredRegion() {};
+    SparseSymbolCoveredRegion(uvc1_refgpos_t tid, uvc1_refgpos_t beg, uvc1_refgpos_t end): tid(tid), incluBegPosition(beg) {
+        assertUVC (beg < end || !fprintf(stderr, "assertion %d < %d failed!\n", beg, end));
+        std::array<AlignmentSymbol, NUM_SYMBOL_TYPES> no_symbols;
+        no_symbols.fill(END_ALIGNMENT_SYMBOLS);
+        this->idx2symboltype2densesymbol = std::vector<std::array<AlignmentSymbol, NUM_SYMBOL_TYPES>>(end - beg, no_symbols);
+        this->idx2symboltype2densedata = std::vector<std::array<T, NUM_SYMBOL_TYPES>>(end - beg);
+    };
+    
+    // Not thread-safe because a (position, symbol) pair that is not observed yet is allocated. 
+    SymbolRow
+    getRefByPos(const uvc1_refgpos_t pos, const bam1_t *bam = NULL) {
+        assertUVC(pos >= this->incluBegPosition || !fprintf(stderr, "%d >= %d failed for qname %s !\n", pos, this->incluBegPosition, (NULL != bam ? bam_get_qname(bam) : "?")));
+        assertUVC(pos < this->getExcluEndPosition() || !fprintf(stderr, "%d < %d failed for qname %s !\n", pos, this->getExcluEndPosition(), (NULL != bam ? bam_get_qname(bam) : "?")));
+        return SymbolRow(this, pos - this->incluBegPosition);
+    };
+    
+    ConstSymbolRow
+    getByPos(const uvc1_refgpos_t pos, const bam1_t *bam = NULL) const {
+        assertUVC(pos >= this->incluBegPosition || !fprintf(stderr, "%d >= %d failed for qname %s !\n", pos, this->incluBegPosition, (NULL != bam ? bam_get_qname(bam) : "?")));
+        assertUVC(pos < this->getExcluEndPosition() || !fprintf(stderr, "%d < %d failed for qname %s !\n", pos, this->getExcluEndPosition(), (NULL != bam ? bam_get_qname(bam) : "?")));
+        return ConstSymbolRow(this, pos - this->incluBegPosition);
+    };
+    
+    uvc1_refgpos_t
+    getIncluBegPosition() const {
+        return this->incluBegPosition;
+    };
+    uvc1_refgpos_t
+    getExcluEndPosition() const {
+        return this->incluBegPosition + UNSIGN2SIGN(idx2symboltype2densesymbol.size());
+    };
+    
+    size_t
+    getNumSparseData() const {
+        return idxsymbol2sparsedata.size();
+    };
+    
+    // The allocated memory, where each node of the sparse tier is assumed to cost two pointers in addition to its key and data.
+    size_t
+    getNumBytes() const {
+        return idx2symboltype2densesymbol.capacity() * sizeof(std::array<AlignmentSymbol, NUM_SYMBOL_TYPES>)
+                + idx2symboltype2densedata.capacity() * sizeof(std::array<T, NUM_SYMBOL_TYPES>)
+                + idxsymbol2sparsedata.size() * (sizeof(std::pair<size_t, T>) + sizeof(void*) * 2)
+                + idxsymbol2sparsedata.bucket_count() * sizeof(void*);
+    };
+    
+    void
+    updateBySummation(const SparseSymbolCoveredRegion<T> & other) {
+        assertUVC(this->tid == other.tid);
+        assertUVC(this->getIncluBegPosition() == other.getIncluBegPosition() && this->getExcluEndPosition() == other.getExcluEndPosition());
+        for (size_t idx = 0; idx < other.idx2symboltype2densesymbol.size(); idx++) {
+            for (size_t symboltype = 0; symboltype < NUM_SYMBOL_TYPES; symboltype++) {
+                const AlignmentSymbol symbol = other.idx2symboltype2densesymbol[idx][symboltype];
+                if (END_ALIGNMENT_SYMBOLS != symbol) {
+                    ::updateBySummation(this->getRefByIdxSymbol(idx, symbol), other.idx2symboltype2densedata[idx][symboltype]);
+                }
+            }
+        }
+        for (const auto & idxsymbol2data : other.idxsymbol2sparsedata) {
+            const size_t idx = idxsymbol2data.first / NUM_ALIGNMENT_SYMBOLS;
+            const AlignmentSymbol symbol = (AlignmentSymbol)(idxsymbol2data.first % NUM_ALIGNMENT_SYMBOLS);
+            ::updateBySummation(this->getRefByIdxSymbol(idx, symbol), idxsymbol2data.second);
+        }
+    };
 };
 
 template <class TSymbol2Bucket2Count>
@@ -622,16 +1129,16 @@ typedef GenericSymbol2Bucket2CountCoverage<Symbol2Bucket2Count> Symbol2Bucket2Co
 
 typedef CoveredRegion<SegFormatPrepSet> SegFormatPrepSets;
 typedef CoveredRegion<SegFormatThresSet> SegFormatThresSets;
-typedef CoveredRegion<std::array<SegFormatInfoSet, NUM_ALIGNMENT_SYMBOLS>> Symbol2SegFormatInfoSets;
-typedef CoveredRegion<std::array<FamFormatInfoSet, NUM_ALIGNMENT_SYMBOLS>> Symbol2FamFormatInfoSets;
-typedef CoveredRegion<std::array<std::array<molcount_t, NUM_FRAG_FORMAT_DEPTH_SETS>, NUM_ALIGNMENT_SYMBOLS>> Symbol2FragFormatDepthSets;
-typedef CoveredRegion<std::array<std::array<molcount_t, NUM_FAM_FORMAT_DEPTH_SETS>, NUM_ALIGNMENT_SYMBOLS>> Symbol2FamFormatDepthSets;
-typedef CoveredRegion<std::array<std::array<molcount_t, NUM_DUPLEX_FORMAT_DEPTH_SETS>, NUM_ALIGNMENT_SYMBOLS>> Symbol2DuplexFormatDepthSets;
-typedef CoveredRegion<std::array<std::array<molcount_t, NUM_VQ_FORMAT_TAG_SETS>, NUM_ALIGNMENT_SYMBOLS>> Symbol2VQFormatTagSets;
+typedef SparseSymbolCoveredRegion<SegFormatInfoSet> Symbol2SegFormatInfoSets;
+typedef SparseSymbolCoveredRegion<FamFormatInfoSet> Symbol2FamFormatInfoSets;
+typedef SymbolFieldCoveredRegion<molcount_t, NUM_FRAG_FORMAT_DEPTH_SETS> Symbol2FragFormatDepthSets;
+typedef SymbolFieldCoveredRegion<molcount_t, NUM_FAM_FORMAT_DEPTH_SETS> Symbol2FamFormatDepthSets;
+typedef SymbolFieldCoveredRegion<molcount_t, NUM_DUPLEX_FORMAT_DEPTH_SETS> Symbol2DuplexFormatDepthSets;
+typedef SymbolFieldCoveredRegion<molcount_t, NUM_VQ_FORMAT_TAG_SETS> Symbol2VQFormatTagSets;
 
 const size_t SIZE_PER_GENOMIC_POS = sizeof(SegFormatPrepSet)
         + sizeof(SegFormatThresSet) 
-        + ((sizeof(SegFormatInfoSet) + 2 * sizeof(FamFormatInfoSet)) * NUM_ALIGNMENT_SYMBOLS)
+        + ((sizeof(SegFormatInfoSet) + sizeof(FamFormatInfoSet) + sizeof(AlignmentSymbol) * 2) * NUM_SYMBOL_TYPES) // dense tier of the info sets
         + sizeof(molcount_t) * (NUM_FRAG_FORMAT_DEPTH_SETS + NUM_FAM_FORMAT_DEPTH_SETS * 2 + NUM_DUPLEX_FORMAT_DEPTH_SETS + NUM_VQ_FORMAT_TAG_SETS) * NUM_ALIGNMENT_SYMBOLS
         + NUM_BUCKETS;
 
@@ -720,14 +1227,37 @@ is_indel_context_more_STR(uvc1_refgpos_t rulen1, uvc1_refgpos_t rc1, uvc1_refgpo
     }
 }
 
+// The exclusive end position of the repetition of the repeat unit of size repeatsize that begins at refpos. 
 template <class T1, class T2, class T3>
 uvc1_refgpos_t 
-indelpos_repeatsize_to_repeatnum(const T1 & refstring, const T2 refpos, const T3 repeatsize) {
+indelpos_repeatsize_to_repeatend(const T1 & refstring, const T2 refpos, const T3 repeatsize) {
     uvc1_refgpos_t qidx = refpos;
     while ((qidx + repeatsize < UNSIGN2SIGN(refstring.size())) && refstring[qidx] == refstring[qidx+repeatsize]) {
         qidx++;
     }
-    return (qidx - refpos) / repeatsize + 1;
+    return qidx + repeatsize;
+}
+
+// Find the short tandem repeat that begins at refpos, where the number of repeat units is (repeatend - refpos) / repeatsize. 
+void
+indelpos_to_STR(
+        uvc1_refgpos_t & repeatsize_at_max_repeatnum,
+        uvc1_refgpos_t & repeatend_at_max_repeatnum,
+        const std::string & refstring, 
+        uvc1_refgpos_t refpos, 
+        uvc1_refgpos_t indel_str_repeatsize_max) {
+    uvc1_refgpos_t max_repeatnum = 0;
+    repeatsize_at_max_repeatnum = 0;
+    repeatend_at_max_repeatnum = refpos;
+    for (uvc1_refgpos_t repeatsize = 1; repeatsize <= indel_str_repeatsize_max; repeatsize++) {
+        const uvc1_refgpos_t repeatend = indelpos_repeatsize_to_repeatend(refstring, refpos, repeatsize);
+        const uvc1_refgpos_t repeatnum = (repeatend - refpos) / repeatsize;
+        if (is_indel_context_more_STR(repeatsize, repeatnum, repeatsize_at_max_repeatnum, max_repeatnum, indel_str_repeatsize_max)) {
+            max_repeatnum = repeatnum;
+            repeatsize_at_max_repeatnum = repeatsize;
+            repeatend_at_max_repeatnum = repeatend;
+        }
+    }
 }
 
 int 
@@ -735,22 +1265,16 @@ indelpos_to_context(
         std::string & repeatunit, 
         uvc1_refgpos_t & max_repeatnum,
         const std::string & refstring, 
-        uvc1_refgpos_t refpos, 
-        uvc1_refgpos_t indel_str_repeatsize_max) {
+        const std::vector<RegionalTandemRepeat> & region_repeatvec,
+        uvc1_refgpos_t refpos) {
     max_repeatnum = 0;
     if (refpos >= UNSIGN2SIGN(refstring.size())) {
         repeatunit = "";
         return -1;
     }
-    uvc1_refgpos_t repeatsize_at_max_repeatnum = 0;
-    for (uvc1_refgpos_t repeatsize = 1; repeatsize <= indel_str_repeatsize_max; repeatsize++) {
-        uvc1_refgpos_t repeatnum = indelpos_repeatsize_to_repeatnum(refstring, refpos, repeatsize);
-        if (is_indel_context_more_STR(repeatsize, repeatnum, repeatsize_at_max_repeatnum, max_repeatnum, indel_str_repeatsize_max)) {
-            max_repeatnum = repeatnum;
-            repeatsize_at_max_repeatnum = repeatsize;
-        }
-    }
-    repeatunit = refstring.substr(refpos, repeatsize_at_max_repeatnum);
+    const RegionalTandemRepeat & rtr = region_repeatvec[refpos];
+    max_repeatnum = (rtr.fwdSTR_endpos - refpos) / MAX(rtr.fwdSTR_unitlen, 1);
+    repeatunit = refstring.substr(refpos, rtr.fwdSTR_unitlen);
     return 0;
 }
 
@@ -869,6 +1393,9 @@ refstring2repeatvec(
         const auto nbases_to_next = indel_str_repeatsize_max + repeatsize_at_max_repeatnum;
         refpos += MAX(repeatsize_at_max_repeatnum * max_repeatnum, nbases_to_next + 1) - (nbases_to_next);
     }
+    for (uvc1_refgpos_t refpos = 0; refpos < UNSIGN2SIGN(refstring.size()); refpos++) {
+        indelpos_to_STR(region_repeatvec[refpos].fwdSTR_unitlen, region_repeatvec[refpos].fwdSTR_endpos, refstring, refpos, indel_str_repeatsize_max);
+    }
     region_repeatvec.push_back(LAST(region_repeatvec));
     return region_repeatvec;
 }
@@ -1364,7 +1891,7 @@ dealwith_segbias(
         const T1 bq,
         const uvc1_refgpos_t rpos,
         T11 & symbol_to_seg_format_depth_set,
-        T12 & symbol_to_VQ_format_tag_set,
+        T12 && symbol_to_VQ_format_tag_set,
         const T2 & seg_format_thres_set,
         const bam1_t *aln,
         const T3 xm1500,
@@ -2353,6 +2880,17 @@ if ((is_normal_used_to_filter_vars_on_primers || !is_assay_amplicon) || (ibeg <=
 typedef GenericSymbol2CountCoverage<Symbol2Count> Symbol2CountCoverage; 
 typedef GenericSymbol2CountCoverage<std::array<std::string, NUM_ALIGNMENT_SYMBOLS>> Symbol2CountCoverageString; 
 
+// Returns the number of threads used to process the molecule families of one region, which is always at least one.
+// The threads in addition to the calling thread are acquired from the thread_budget (if not NULL) and must be released by the caller. 
+size_t
+calc_intra_region_nthreads(size_t nfams, const CommandLineArgs & paramset, ThreadBudget *thread_budget) {
+    if (nfams < (size_t)MAX(1, paramset.intra_region_min_nfams)) {
+        return 1;
+    }
+    const size_t max_nthreads = MAX(SIGN2UNSIGN(1), MIN(MIN(paramset.intra_region_max_nthreads, paramset.max_cpu_num), nfams));
+    return 1 + ((NULL != thread_budget) ? thread_budget->try_acquire(max_nthreads - 1) : (max_nthreads - 1));
+}
+
 struct Symbol2CountCoverageSet {
     uvc1_refgpos_t tid;
     uvc1_refgpos_t incluBegPosition;
@@ -2371,10 +2909,12 @@ struct Symbol2CountCoverageSet {
     std::array<Symbol2Bucket2CountCoverage, 2> dedup_ampDistr;
     Symbol2CountCoverageString additional_note;
     
-    std::array<std::array<std::map<uvc1_refgpos_t, std::map<uvc1_readpos_t, uvc1_readnum_t>>, NUM_INS_SYMBOLS>, 2> pos2dlen2data_cDP2;
-    std::array<std::array<std::map<uvc1_refgpos_t, std::map<uvc1_readpos_t, uvc1_readnum_t>>, NUM_INS_SYMBOLS>, 2> pos2dlen2data_c2dDP;
-    std::array<std::array<std::map<uvc1_refgpos_t, std::map<std::string,    uvc1_readnum_t>>, NUM_DEL_SYMBOLS>, 2> pos2iseq2data_cDP2;
-    std::array<std::array<std::map<uvc1_refgpos_t, std::map<std::string,    uvc1_readnum_t>>, NUM_DEL_SYMBOLS>, 2> pos2iseq2data_c2dDP;
+    std::array<std::array<PosToDlenToCountTable, NUM_INS_SYMBOLS>, 2> pos2dlen2data_cDP2;
+    std::array<std::array<PosToDlenToCountTable, NUM_INS_SYMBOLS>, 2> pos2dlen2data_c2dDP;
+    std::array<std::array<PosToIseqToCountTable, NUM_DEL_SYMBOLS>, 2> pos2iseq2data_cDP2;
+    std::array<std::array<PosToIseqToCountTable, NUM_DEL_SYMBOLS>, 2> pos2iseq2data_c2dDP;
+    
+    size_t intra_region_parts_nbytes = 0; // peak memory of the buffers of the extra threads that process the parts of this region
     
     Symbol2CountCoverageSet(uvc1_refgpos_t t, uvc1_refgpos_t beg, uvc1_refgpos_t end):
         tid(t), 
@@ -2404,6 +2944,31 @@ struct Symbol2CountCoverageSet {
         return excluEndPosition;
     };
     
+    // The memory allocated for all positions of this region, which is measured for the MemoryGovernor.
+    size_t
+    getNumBytes() const {
+        size_t ret = refstring.capacity() 
+                + seg_format_prep_sets.getNumBytes() 
+                + seg_format_thres_sets.getNumBytes() 
+                + symbol_to_seg_format_info_sets.getNumBytes() 
+                + symbol_to_fam_format_info_sets.getNumBytes() 
+                + symbol_to_duplex_format_depth_sets.getNumBytes() 
+                + symbol_to_VQ_format_tag_sets.getNumBytes() 
+                + additional_note.getNumBytes();
+        for (int strand = 0; strand < 2; strand++) {
+            ret += symbol_to_frag_format_depth_sets[strand].getNumBytes();
+            ret += symbol_to_fam_format_depth_sets_2strand[strand].getNumBytes();
+            ret += dedup_ampDistr[strand].getNumBytes();
+            for (size_t i = 0; i < NUM_INS_SYMBOLS; i++) {
+                ret += pos2dlen2data_cDP2[strand][i].getNumBytes() + pos2dlen2data_c2dDP[strand][i].getNumBytes();
+            }
+            for (size_t i = 0; i < NUM_DEL_SYMBOLS; i++) {
+                ret += pos2iseq2data_cDP2[strand][i].getNumBytes() + pos2iseq2data_c2dDP[strand][i].getNumBytes();
+            }
+        }
+        return ret;
+    };
+    
     size_t
     generate_consensus_fastq_data(
             auto & fastq_outstrings,
@@ -2545,6 +3110,7 @@ struct Symbol2CountCoverageSet {
             const T2 & baq_offsetarr,
             const T3 & baq_offsetarr2,
             
+            ThreadBudget *thread_budget,
             const CommandLineArgs & paramset,
             const uvc1_flag_t specialflag IGNORE_UNUSED_PARAM) {
         
@@ -2611,195 +3177,248 @@ struct Symbol2CountCoverageSet {
                 }
             }
         }
-        for (const auto & alns2pair2umibarcode : alns3) {
-            const auto & alns2pair = alns2pair2umibarcode.first;
-            for (int strand = 0; strand < 2; strand++) {
-                const auto & alns2 = alns2pair[strand];
-                for (const auto & alns1 : alns2) {
-                    uvc1_refgpos_t tid2, beg2, end2;
-                    fillTidBegEndFromAlns1(tid2, beg2, end2, alns1);
+        // The families are split into contiguous parts that are processed by multiple threads, and
+        //   the data computed from each part other than the first one is merged (summed up) after all threads are joined.
+        auto update_frag_format_sets = [&](
+                std::array<Symbol2FragFormatDepthSets, 2> & frag_format_depth_sets,
+                Symbol2VQFormatTagSets & VQ_format_tag_sets,
+                Symbol2Bucket2CountCoverage & ampDistr,
+                std::map<std::basic_string<std::pair<uvc1_refgpos_t, AlignmentSymbol>>, std::array<uvc1_readnum_t, 2>> & part_mutform2count4map,
+                const size_t beg_idx,
+                const size_t end_idx) {
+            // Reused by all fragments processed by this thread.
+            Symbol2CountCoverage read_ampBQerr_fragWithR1R2;
+            for (size_t alns3_idx = beg_idx; alns3_idx < end_idx; alns3_idx++) {
+                const auto & alns2pair2umibarcode = alns3[alns3_idx];
+                const auto & alns2pair = alns2pair2umibarcode.first;
+                for (int strand = 0; strand < 2; strand++) {
+                    const auto & alns2 = alns2pair[strand];
+                    for (const auto & alns1 : alns2) {
+                        uvc1_refgpos_t tid2, beg2, end2;
+                        fillTidBegEndFromAlns1(tid2, beg2, end2, alns1);
                     
-                    Symbol2CountCoverage read_ampBQerr_fragWithR1R2(tid, beg2, end2);
-                    read_ampBQerr_fragWithR1R2.updateByRead1Aln(
-                            alns1, 
+                        read_ampBQerr_fragWithR1R2.resetRegion(tid, beg2, end2);
+                        read_ampBQerr_fragWithR1R2.updateByRead1Aln(
+                                alns1, 
                             
-                            this->getUnifiedIncluBegPosition(), 
-                            region_symbolvec,
-                            region_repeatvec,
-                            baq_offsetarr,
-                            baq_offsetarr2,
+                                this->getUnifiedIncluBegPosition(), 
+                                region_symbolvec,
+                                region_repeatvec,
+                                baq_offsetarr,
+                                baq_offsetarr2,
 
-                            this->symbol_to_seg_format_info_sets,
-                            this->symbol_to_VQ_format_tag_sets,
-                            this->seg_format_prep_sets,
-                            this->seg_format_thres_sets,
+                                this->symbol_to_seg_format_info_sets,
+                                this->symbol_to_VQ_format_tag_sets,
+                                this->seg_format_prep_sets,
+                                this->seg_format_thres_sets,
                             
-                            alns2pair2umibarcode.second.duplexflag,
-                            paramset,
-                            0);
-                    uvc1_qual_t normMQ = 0;
-                    for (const bam1_t *aln : alns1) {
-                        normMQ = MAX(normMQ, aln->core.qual);
-                    }
-                    std::basic_string<std::pair<uvc1_refgpos_t, AlignmentSymbol>> pos_symbol_string;
-
-                    size_t tlen = read_ampBQerr_fragWithR1R2.getExcluEndPosition() - read_ampBQerr_fragWithR1R2.getIncluBegPosition();
-                    // 1 means is covered, 2 means has mut, 4 means is near mut.
-                    std::vector<int8_t> cov_mut_vec(tlen, 0);
-                    std::vector<AlignmentSymbol> cov_mut_base_symbol_vec(tlen, END_ALIGNMENT_SYMBOLS);
-                    std::vector<AlignmentSymbol> cov_mut_link_symbol_vec(tlen, END_ALIGNMENT_SYMBOLS);
-                    
-                    for (auto epos = read_ampBQerr_fragWithR1R2.getIncluBegPosition(); epos < read_ampBQerr_fragWithR1R2.getExcluEndPosition(); epos++) {
-                        for (SymbolType symboltype : SYMBOL_TYPES_IN_VCF_ORDER) {
-                            const AlignmentSymbol refsymbol = region_symbolvec[epos-this->getUnifiedIncluBegPosition()];
-                            AlignmentSymbol con_symbol;
-                            uvc1_qual_t con_count, tot_count;
-                            if (LINK_SYMBOL == symboltype) {
-                                read_ampBQerr_fragWithR1R2.getByPos(epos).template fillConsensusCounts<true >(con_symbol, con_count, tot_count, symboltype);
-                            } else {
-                                read_ampBQerr_fragWithR1R2.getByPos(epos).template fillConsensusCounts<false>(con_symbol, con_count, tot_count, symboltype); 
-                            }
-                            assertUVC (con_count * 2 >= tot_count);
-                            if (0 == tot_count) { continue; }                            
-                            uvc1_qual_t max_qual = 8 + get_avgBQ(bg_seg_bqsum_conslogo, symbol_to_seg_format_info_sets, epos, con_symbol);
-                            uvc1_qual_t phredlike = 0;
-                            uvc1_qual_t con_qual = con_count * 2 - tot_count;
-                            if ((0x1 & paramset.fam_flag)) {
-                                uvc1_qual_t phredlike_by_sscs= sscs_mut_table.toPhredErrRate(refsymbol, con_symbol);
-                                phredlike = MIN3(con_count * 2 - tot_count, max_qual, phredlike_by_sscs);
-                            } else {
-                                phredlike = MIN(con_count * 2 - tot_count, max_qual);
-                            }
-                            int pbucket = max_qual - phredlike;
-                            if (pbucket < -8) {
-                                std::string qnames;
-                                for (const auto *aln : alns1) { 
-                                    qnames += std::string("/") + bam_get_qname(aln) + "/" + std::to_string(aln->core.tid) + "/" + std::to_string(aln->core.pos); 
+                                alns2pair2umibarcode.second.duplexflag,
+                                paramset,
+                                0);
+                        uvc1_qual_t normMQ = 0;
+                        for (const bam1_t *aln : alns1) {
+                            normMQ = MAX(normMQ, aln->core.qual);
+                        }
+                        std::basic_string<std::pair<uvc1_refgpos_t, AlignmentSymbol>> pos_symbol_string;
+
+                        size_t tlen = read_ampBQerr_fragWithR1R2.getExcluEndPosition() - read_ampBQerr_fragWithR1R2.getIncluBegPosition();
+                        // 1 means is covered, 2 means has mut, 4 means is near mut.
+                        std::vector<int8_t> cov_mut_vec(tlen, 0);
+                        std::vector<AlignmentSymbol> cov_mut_base_symbol_vec(tlen, END_ALIGNMENT_SYMBOLS);
+                        std::vector<AlignmentSymbol> cov_mut_link_symbol_vec(tlen, END_ALIGNMENT_SYMBOLS);
+                    
+                        for (auto epos = read_ampBQerr_fragWithR1R2.getIncluBegPosition(); epos < read_ampBQerr_fragWithR1R2.getExcluEndPosition(); epos++) {
+                            for (SymbolType symboltype : SYMBOL_TYPES_IN_VCF_ORDER) {
+                                const AlignmentSymbol refsymbol = region_symbolvec[epos-this->getUnifiedIncluBegPosition()];
+                                AlignmentSymbol con_symbol;
+                                uvc1_qual_t con_count, tot_count;
+                                if (LINK_SYMBOL == symboltype) {
+                                    read_ampBQerr_fragWithR1R2.getByPos(epos).template fillConsensusCounts<true >(con_symbol, con_count, tot_count, symboltype);
+                                } else {
+                                    read_ampBQerr_fragWithR1R2.getByPos(epos).template fillConsensusCounts<false>(con_symbol, con_count, tot_count, symboltype); 
+                                }
+                                assertUVC (con_count * 2 >= tot_count);
+                                if (0 == tot_count) { continue; }                            
+                                uvc1_qual_t max_qual = 8 + get_avgBQ(bg_seg_bqsum_conslogo, symbol_to_seg_format_info_sets, epos, con_symbol);
+                                uvc1_qual_t phredlike = 0;
+                                uvc1_qual_t con_qual = con_count * 2 - tot_count;
+                                if ((0x1 & paramset.fam_flag)) {
+                                    uvc1_qual_t phredlike_by_sscs= sscs_mut_table.toPhredErrRate(refsymbol, con_symbol);
+                                    phredlike = MIN3(con_count * 2 - tot_count, max_qual, phredlike_by_sscs);
+                                } else {
+                                    phredlike = MIN(con_count * 2 - tot_count, max_qual);
+                                }
+                                int pbucket = max_qual - phredlike;
+                                if (pbucket < -8) {
+                                    std::string qnames;
+                                    for (const auto *aln : alns1) { 
+                                        qnames += std::string("/") + bam_get_qname(aln) + "/" + std::to_string(aln->core.tid) + "/" + std::to_string(aln->core.pos); 
+                                    }
+                                    LOG(logWARNING) << "The qname " << qnames << " has base quality " << phredlike << " at position " << epos << " which is higher than " << max_qual;
+                                }
+                                pbucket = MAX(0, pbucket);
+                                if (pbucket < NUM_BUCKETS) {
+                                    ampDistr.getRefByPos(epos).incSymbolBucketCount(con_symbol, pbucket, 1);
                                 }
-                                LOG(logWARNING) << "The qname " << qnames << " has base quality " << phredlike << " at position " << epos << " which is higher than " << max_qual;
-                            }
-                            pbucket = MAX(0, pbucket);
-                            if (pbucket < NUM_BUCKETS) {
-                                this->dedup_ampDistr[0].getRefByPos(epos).incSymbolBucketCount(con_symbol, pbucket, 1);
-                            }
                             
 #ifdef UVC_IN_DEBUG_MODE
-                            if (tid2 == paramset.debug_tid && epos == paramset.debug_pos) {
-                                const auto umifam = alns2pair2umibarcode.second;
-                                LOG(logINFO) << "DebugINFO:" << "UMI-GROUP-IS " << umifam.umistring << " " << umifam.beg_tidpos_pair.second << " " << umifam.end_tidpos_pair.second;
-                                LOG(logINFO) << "DebugINFO:" << "FRAG-GROUP-IS " << (alns1.size() > 0 ? bam_get_qname(alns1[0]) : "NONE");
-                                if (alns1.size()) {
-                                    for (const bam1_t* aln : alns1) {
-                                        assertUVC(0 == strcmp(bam_get_qname(alns1[0]), bam_get_qname(aln)) 
-                                                || !fprintf(stderr, "%s equals %s failed!\n", bam_get_qname(alns1[0]), bam_get_qname(aln)));
-                                        LOG(logINFO) << "DebugINFO:\tFRAG_bDP_inc: " << bam_get_qname(aln) 
-                                            << " flag=" << aln->core.flag << " tid=" << aln->core.tid << " pos=" << aln->core.pos << " symbol=" << con_symbol << " id=" << strand << "-" << this->symbol_to_frag_format_depth_sets[strand].getByPos(epos)[con_symbol][FRAG_bDP];
+                                if (tid2 == paramset.debug_tid && epos == paramset.debug_pos) {
+                                    const auto umifam = alns2pair2umibarcode.second;
+                                    LOG(logINFO) << "DebugINFO:" << "UMI-GROUP-IS " << umifam.umistring << " " << umifam.beg_tidpos_pair.second << " " << umifam.end_tidpos_pair.second;
+                                    LOG(logINFO) << "DebugINFO:" << "FRAG-GROUP-IS " << (alns1.size() > 0 ? bam_get_qname(alns1[0]) : "NONE");
+                                    if (alns1.size()) {
+                                        for (const bam1_t* aln : alns1) {
+                                            assertUVC(0 == strcmp(bam_get_qname(alns1[0]), bam_get_qname(aln)) 
+                                                    || !fprintf(stderr, "%s equals %s failed!\n", bam_get_qname(alns1[0]), bam_get_qname(aln)));
+                                            LOG(logINFO) << "DebugINFO:\tFRAG_bDP_inc: " << bam_get_qname(aln) 
+                                                << " flag=" << aln->core.flag << " tid=" << aln->core.tid << " pos=" << aln->core.pos << " symbol=" << con_symbol << " id=" << strand << "-" << frag_format_depth_sets[strand].getByPos(epos)[con_symbol][FRAG_bDP];
+                                        }
                                     }
                                 }
-                            }
 #endif
-                            this->symbol_to_frag_format_depth_sets[strand].getRefByPos(epos)[con_symbol][FRAG_bDP] += 1;
-                            this->symbol_to_VQ_format_tag_sets.getRefByPos(epos)[con_symbol][VQ_bMQ] += (normMQ * normMQ) / SQR_QUAL_DIV;
+                                frag_format_depth_sets[strand].getRefByPos(epos)[con_symbol][FRAG_bDP] += 1;
+                                VQ_format_tag_sets.getRefByPos(epos)[con_symbol][VQ_bMQ] += (normMQ * normMQ) / SQR_QUAL_DIV;
                             
-                            if (isSymbolIns(con_symbol)) {
-                                posToIndelToCount_updateByConsensus(this->symbol_to_frag_format_depth_sets[strand].getRefPosToIseqToData(con_symbol), 
-                                        read_ampBQerr_fragWithR1R2.getPosToIseqToData(con_symbol), epos, 1);
-                            }
-                            if (isSymbolDel(con_symbol)) {
-                                posToIndelToCount_updateByConsensus(this->symbol_to_frag_format_depth_sets[strand].getRefPosToDlenToData(con_symbol),
-                                        read_ampBQerr_fragWithR1R2.getPosToDlenToData(con_symbol), epos, 1);
-                            }
+                                if (isSymbolIns(con_symbol)) {
+                                    posToIndelToCount_updateByConsensus(frag_format_depth_sets[strand].getRefPosToIseqToData(con_symbol), 
+                                            read_ampBQerr_fragWithR1R2.getPosToIseqToData(con_symbol), epos, 1);
+                                }
+                                if (isSymbolDel(con_symbol)) {
+                                    posToIndelToCount_updateByConsensus(frag_format_depth_sets[strand].getRefPosToDlenToData(con_symbol),
+                                            read_ampBQerr_fragWithR1R2.getPosToDlenToData(con_symbol), epos, 1);
+                                }
                             
-                            cov_mut_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] |= 0x1;
-                            const bool is_var_of_highBQ = ((SEQUENCING_PLATFORM_IONTORRENT == paramset.inferred_sequencing_platform)
-                                ? (BASE_SYMBOL == symboltype || con_qual + 3 >= paramset.bias_thres_highBQ)
-                                : (LINK_SYMBOL == symboltype || con_qual >= paramset.bias_thres_highBQ));
-                            if (areSymbolsMutated(refsymbol, con_symbol) && is_var_of_highBQ) {
-                                pos_symbol_string.push_back(std::make_pair(epos, con_symbol));
-                                cov_mut_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] |= 0x2;
-                            }
-                            if (LINK_SYMBOL == symboltype) {
-                                cov_mut_link_symbol_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] = con_symbol;
-                            } else {
-                                cov_mut_base_symbol_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] = con_symbol;
+                                cov_mut_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] |= 0x1;
+                                const bool is_var_of_highBQ = ((SEQUENCING_PLATFORM_IONTORRENT == paramset.inferred_sequencing_platform)
+                                    ? (BASE_SYMBOL == symboltype || con_qual + 3 >= paramset.bias_thres_highBQ)
+                                    : (LINK_SYMBOL == symboltype || con_qual >= paramset.bias_thres_highBQ));
+                                if (areSymbolsMutated(refsymbol, con_symbol) && is_var_of_highBQ) {
+                                    pos_symbol_string.push_back(std::make_pair(epos, con_symbol));
+                                    cov_mut_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] |= 0x2;
+                                }
+                                if (LINK_SYMBOL == symboltype) {
+                                    cov_mut_link_symbol_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] = con_symbol;
+                                } else {
+                                    cov_mut_base_symbol_vec[epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition()] = con_symbol;
+                                }
                             }
                         }
-                    }
-                    if (pos_symbol_string.size() > 1) {
-                        mutform2count4map.insert(std::make_pair(pos_symbol_string, std::array<uvc1_readnum_t, 2>({0, 0})));
-                        mutform2count4map[pos_symbol_string][strand]++;
-                    }
-                    for (size_t i = 0; i < cov_mut_vec.size(); i++) {
-                        if (cov_mut_vec[i] & 0x2) {
-                            for (int j = (int)i - (int)paramset.syserr_mut_region_n_bases; j < (int)(i + paramset.syserr_mut_region_n_bases + 1); j++) {
-                                if ((0 <= j) && (j < (int)cov_mut_vec.size())) {
-                                    cov_mut_vec[j] |= 0x4;
+                        if (pos_symbol_string.size() > 1) {
+                            part_mutform2count4map.insert(std::make_pair(pos_symbol_string, std::array<uvc1_readnum_t, 2>({0, 0})));
+                            part_mutform2count4map[pos_symbol_string][strand]++;
+                        }
+                        for (size_t i = 0; i < cov_mut_vec.size(); i++) {
+                            if (cov_mut_vec[i] & 0x2) {
+                                for (int j = (int)i - (int)paramset.syserr_mut_region_n_bases; j < (int)(i + paramset.syserr_mut_region_n_bases + 1); j++) {
+                                    if ((0 <= j) && (j < (int)cov_mut_vec.size())) {
+                                        cov_mut_vec[j] |= 0x4;
+                                    }
                                 }
                             }
                         }
-                    }
-                    uvc1_base_t n_cov_positions = 0;
-                    uvc1_base_t n_near_mut_positions = 0;
-                    for (size_t i = 0; i < cov_mut_vec.size(); i++) {
-                        if ((cov_mut_vec[i]) & 0x1) {
-                            n_cov_positions++;
-                            if ((cov_mut_vec[i]) & 0x4) { n_near_mut_positions++; }
+                        uvc1_base_t n_cov_positions = 0;
+                        uvc1_base_t n_near_mut_positions = 0;
+                        for (size_t i = 0; i < cov_mut_vec.size(); i++) {
+                            if ((cov_mut_vec[i]) & 0x1) {
+                                n_cov_positions++;
+                                if ((cov_mut_vec[i]) & 0x4) { n_near_mut_positions++; }
+                            }
                         }
-                    }
-                    const auto b10xSeqTlen = n_cov_positions;
-                    const auto b10xSeqTNevents = n_near_mut_positions;
-                    for (auto epos = read_ampBQerr_fragWithR1R2.getIncluBegPosition(); epos < read_ampBQerr_fragWithR1R2.getExcluEndPosition(); epos++) {
-                        const auto ivec = epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition();
-                        for (const auto con_symbol : std::array<AlignmentSymbol, 2> {{ cov_mut_base_symbol_vec[ivec], cov_mut_link_symbol_vec[ivec] }} ) {
-                            if (con_symbol != END_ALIGNMENT_SYMBOLS) {
+                        const auto b10xSeqTlen = n_cov_positions;
+                        const auto b10xSeqTNevents = n_near_mut_positions;
+                        for (auto epos = read_ampBQerr_fragWithR1R2.getIncluBegPosition(); epos < read_ampBQerr_fragWithR1R2.getExcluEndPosition(); epos++) {
+                            const auto ivec = epos - read_ampBQerr_fragWithR1R2.getIncluBegPosition();
+                            for (const auto con_symbol : std::array<AlignmentSymbol, 2> {{ cov_mut_base_symbol_vec[ivec], cov_mut_link_symbol_vec[ivec] }} ) {
+                                if (con_symbol != END_ALIGNMENT_SYMBOLS) {
 #ifdef UVC_IN_DEBUG_MODE
-                                if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
-                                        std::string covstring;
-                                        for (const auto covflag : cov_mut_vec) {
-                                           covstring.push_back('0' + covflag);
-                                        }
-                                        LOG(logINFO) << "DebugINFO:" 
-                                            << " FRAG_GROUP_NAME=" << (alns1.size() > 0 ? bam_get_qname(alns1[0]) : "NONE")
-                                            << " FRAG_bTA_bTB_info:"
-                                            << " epos=" << epos 
-                                            << " strand=" << strand
-                                            << " symbol=" << SYMBOL_TO_DESC_ARR[con_symbol] 
-                                            << " FRAG_bTA+=" << b10xSeqTlen
-                                            << " FRAG_bTB+=" << b10xSeqTNevents
-                                            << " covstring=" << covstring;
-                                }
+                                    if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
+                                            std::string covstring;
+                                            for (const auto covflag : cov_mut_vec) {
+                                               covstring.push_back('0' + covflag);
+                                            }
+                                            LOG(logINFO) << "DebugINFO:" 
+                                                << " FRAG_GROUP_NAME=" << (alns1.size() > 0 ? bam_get_qname(alns1[0]) : "NONE")
+                                                << " FRAG_bTA_bTB_info:"
+                                                << " epos=" << epos 
+                                                << " strand=" << strand
+                                                << " symbol=" << SYMBOL_TO_DESC_ARR[con_symbol] 
+                                                << " FRAG_bTA+=" << b10xSeqTlen
+                                                << " FRAG_bTB+=" << b10xSeqTNevents
+                                                << " covstring=" << covstring;
+                                    }
 #endif
-                                this->symbol_to_frag_format_depth_sets[strand].getRefByPos(epos)[con_symbol][FRAG_bTA] += b10xSeqTlen;
-                                this->symbol_to_frag_format_depth_sets[strand].getRefByPos(epos)[con_symbol][FRAG_bTB] += b10xSeqTNevents;
-                            } else {
+                                    frag_format_depth_sets[strand].getRefByPos(epos)[con_symbol][FRAG_bTA] += b10xSeqTlen;
+                                    frag_format_depth_sets[strand].getRefByPos(epos)[con_symbol][FRAG_bTB] += b10xSeqTNevents;
+                                } else {
 #ifdef UVC_IN_DEBUG_MODE
-                                if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
-                                        LOG(logINFO) << "DebugINFO:" 
-                                            << " FRAG_GROUP_NAME=" << (alns1.size() > 0 ? bam_get_qname(alns1[0]) : "NONE")
-                                            << " FRAG_bTA_bTB_info:"
-                                            << " epos=" << epos 
-                                            << " strand=" << strand
-                                            << " symbol=" << SYMBOL_TO_DESC_ARR[con_symbol]
-                                            << " FRAG_bTA+=" << 0
-                                            << " FRAG_bTB+=" << 0;
-                                }
+                                    if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
+                                            LOG(logINFO) << "DebugINFO:" 
+                                                << " FRAG_GROUP_NAME=" << (alns1.size() > 0 ? bam_get_qname(alns1[0]) : "NONE")
+                                                << " FRAG_bTA_bTB_info:"
+                                                << " epos=" << epos 
+                                                << " strand=" << strand
+                                                << " symbol=" << SYMBOL_TO_DESC_ARR[con_symbol]
+                                                << " FRAG_bTA+=" << 0
+                                                << " FRAG_bTB+=" << 0;
+                                    }
 #endif
+                                }
                             }
                         }
                     }
                 }
             }
+        };
+        const size_t nparts = calc_intra_region_nthreads(alns3.size(), paramset, thread_budget);
+        std::vector<std::array<Symbol2FragFormatDepthSets, 2>> part_to_frag_format_depth_sets;
+        std::vector<Symbol2VQFormatTagSets> part_to_VQ_format_tag_sets;
+        std::vector<Symbol2Bucket2CountCoverage> part_to_ampDistr;
+        std::vector<std::map<std::basic_string<std::pair<uvc1_refgpos_t, AlignmentSymbol>>, std::array<uvc1_readnum_t, 2>>> part_to_mutform2count4map(nparts - 1);
+        for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+            part_to_frag_format_depth_sets.push_back({{
+                    Symbol2FragFormatDepthSets(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition()),
+                    Symbol2FragFormatDepthSets(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition())}});
+            part_to_VQ_format_tag_sets.push_back(Symbol2VQFormatTagSets(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition()));
+            part_to_ampDistr.push_back(Symbol2Bucket2CountCoverage(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition()));
+        }
+        parallel_for_parts(nparts, alns3.size(), [&](size_t part_idx, size_t beg_idx, size_t end_idx) {
+            if (0 == part_idx) {
+                update_frag_format_sets(this->symbol_to_frag_format_depth_sets, this->symbol_to_VQ_format_tag_sets, this->dedup_ampDistr[0], 
+                        mutform2count4map, beg_idx, end_idx);
+            } else {
+                update_frag_format_sets(part_to_frag_format_depth_sets[part_idx-1], part_to_VQ_format_tag_sets[part_idx-1], part_to_ampDistr[part_idx-1], 
+                        part_to_mutform2count4map[part_idx-1], beg_idx, end_idx);
+            }
+        });
+        if (NULL != thread_budget) { thread_budget->release(nparts - 1); }
+        size_t parts_nbytes = 0;
+        for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+            parts_nbytes += part_to_frag_format_depth_sets[part_idx-1][0].getNumBytes() + part_to_frag_format_depth_sets[part_idx-1][1].getNumBytes()
+                    + part_to_VQ_format_tag_sets[part_idx-1].getNumBytes() + part_to_ampDistr[part_idx-1].getNumBytes();
+        }
+        this->intra_region_parts_nbytes = MAX(this->intra_region_parts_nbytes, parts_nbytes);
+        for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+            for (int strand = 0; strand < 2; strand++) {
+                this->symbol_to_frag_format_depth_sets[strand].updateBySummation(part_to_frag_format_depth_sets[part_idx-1][strand]);
+            }
+            this->symbol_to_VQ_format_tag_sets.updateBySummation(part_to_VQ_format_tag_sets[part_idx-1]);
+            this->dedup_ampDistr[0].updateBySummation(part_to_ampDistr[part_idx-1]);
+            mutform2count4map_updateBySummation(mutform2count4map, part_to_mutform2count4map[part_idx-1]);
         }
         assertUVC(this->symbol_to_seg_format_info_sets.getIncluBegPosition() == this->dedup_ampDistr[0].getIncluBegPosition());
         assertUVC(this->symbol_to_seg_format_info_sets.getExcluEndPosition() == this->dedup_ampDistr[0].getExcluEndPosition());
+        std::array<std::vector<uvc1_readnum_t>, NUM_SYMBOL_TYPES> symboltype_to_totDPs;
+        for (SymbolType symboltype : SYMBOL_TYPE_ARR) {
+            symboltype_to_totDPs[symboltype].resize(this->getUnifiedExcluEndPosition() - this->getUnifiedIncluBegPosition(), 0);
+            for (int strand = 0; strand < 2; strand++) {
+                this->symbol_to_frag_format_depth_sets[strand].addFieldSumBySymbolType(symboltype_to_totDPs[symboltype], symboltype, FRAG_bDP, 
+                        this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition());
+            }
+        }
         for (auto epos = this->getUnifiedIncluBegPosition(); epos < this->getUnifiedExcluEndPosition(); epos++) {
             for (SymbolType symboltype : SYMBOL_TYPE_ARR) {
+                const auto totDP = symboltype_to_totDPs[symboltype][epos - this->getUnifiedIncluBegPosition()];
                 for (AlignmentSymbol symbol : SYMBOL_TYPE_TO_SYMBOLS[symboltype]) {
-                    const auto totDP = 
-                            formatSumBySymbolType(this->symbol_to_frag_format_depth_sets[0].getByPos(epos), 
-                            symboltype, FRAG_bDP) + 
-                            formatSumBySymbolType(this->symbol_to_frag_format_depth_sets[1].getByPos(epos), 
-                            symboltype, FRAG_bDP); 
                     uvc1_qual_t max_qual = 8 + get_avgBQ(bg_seg_bqsum_conslogo, symbol_to_seg_format_info_sets, epos, symbol);
                     uvc1_qual_t maxvqual = 0;
                     uvc1_readnum_t argmaxAD = 0;
@@ -2839,6 +3458,7 @@ struct Symbol2CountCoverageSet {
             const BedLine & prev_bedline,
             const BedLine & curr_bedline,
             
+            ThreadBudget *thread_budget,
             const CommandLineArgs & paramset,
             const uvc1_flag_t specialflag IGNORE_UNUSED_PARAM) {
         
@@ -2851,517 +3471,577 @@ struct Symbol2CountCoverageSet {
                 paramset.fam_phred_sscs_indel_ext,
                 (paramset.vcf_tumor_fname.size() > 0));
         
-        size_t niters = 0;
-        for (const auto & alns2pair2umibarcode : alns3) {
-            const auto & alns2pair = alns2pair2umibarcode.first;
-            niters++;
-            assertUVC (alns2pair[0].size() != 0 || alns2pair[1].size() != 0);
-            for (int strand = 0; strand < 2; strand++) {
-                FastqConsensusSeqSegment fq_baseBQ_pairs;
-                std::vector<uvc1_readnum_t> fq_family_sizes;
-                std::vector<float> fq_family_identities;
-                const auto & alns2 = alns2pair[strand];
-                if (alns2.size() == 0) { continue; }
+        // The families are split into contiguous parts that are processed by multiple threads, and
+        //   the data computed from each part other than the first one is merged (summed up) after all threads are joined.
+        // The consensus FASTQ records of each part are appended in the order of the parts so that the output does not depend on the number of threads.
+        auto update_fam_format_sets = [&](
+                std::array<Symbol2FamFormatDepthSets, 2> & fam_format_depth_sets_2strand,
+                std::array<std::array<PosToIseqToCountTable, NUM_DEL_SYMBOLS>, 2> & fam_pos2iseq2data_cDP2,
+                std::array<std::array<PosToDlenToCountTable, NUM_INS_SYMBOLS>, 2> & fam_pos2dlen2data_cDP2,
+                Symbol2FamFormatInfoSets & fam_format_info_sets,
+                std::array<std::string, NUM_FQLIKE_CON_OUT_FILES> & part_fastq_outstrings,
+                const size_t beg_idx,
+                const size_t end_idx) {
+            // Reused by all families and fragments processed by this thread.
+            Symbol2CountCoverage read_family_mmm_ampl;
+            Symbol2CountCoverage read_family_con_ampl;
+            Symbol2CountCoverage read_ampBQerr_fragWithR1R2;
+            for (size_t alns3_idx = beg_idx; alns3_idx < end_idx; alns3_idx++) {
+                const auto & alns2pair2umibarcode = alns3[alns3_idx];
+                const auto & alns2pair = alns2pair2umibarcode.first;
+                assertUVC (alns2pair[0].size() != 0 || alns2pair[1].size() != 0);
+                for (int strand = 0; strand < 2; strand++) {
+                    FastqConsensusSeqSegment fq_baseBQ_pairs;
+                    std::vector<uvc1_readnum_t> fq_family_sizes;
+                    std::vector<float> fq_family_identities;
+                    const auto & alns2 = alns2pair[strand];
+                    if (alns2.size() == 0) { continue; }
                 
-                uvc1_refgpos_t tid2, beg2, end2;
-                fillTidBegEndFromAlns2(tid2, beg2, end2, alns2);
+                    uvc1_refgpos_t tid2, beg2, end2;
+                    fillTidBegEndFromAlns2(tid2, beg2, end2, alns2);
                 
-                const bool is_consensus_applicable = ((paramset.fam_consensus_out_fastq.size() > 0) && ((size_t)paramset.fam_consensus_out_fastq_thres_dup1add <= alns2.size()));
-                const bool is_consensus_only_done_here = (
-                        ((prev_bedline.tid != tid2) || !(ARE_INTERVALS_OVERLAPPING(prev_bedline.beg_pos, prev_bedline.end_pos, beg2, end2)))
-                     && ((curr_bedline.tid == tid2) &&  (ARE_INTERVALS_OVERLAPPING(curr_bedline.beg_pos, curr_bedline.end_pos, beg2, end2))));
-                const bool is_consensus_to_fastq = (is_consensus_applicable && is_consensus_only_done_here);
-
-                Symbol2CountCoverage read_family_mmm_ampl(tid2, beg2, end2);
-                Symbol2CountCoverage read_family_con_ampl(tid2, beg2, end2); 
-                for (const auto & alns1 : alns2) {
-                    uvc1_refgpos_t tid1, beg1, end1;
-                    fillTidBegEndFromAlns1(tid1, beg1, end1, alns1);
-                    Symbol2CountCoverage read_ampBQerr_fragWithR1R2(tid1, beg1, end1);
-                    read_ampBQerr_fragWithR1R2.updateByRead1Aln<BASE_QUALITY_MAX, false, true>(
-                            alns1, 
+                    const bool is_consensus_applicable = ((paramset.fam_consensus_out_fastq.size() > 0) && ((size_t)paramset.fam_consensus_out_fastq_thres_dup1add <= alns2.size()));
+                    const bool is_consensus_only_done_here = (
+                            ((prev_bedline.tid != tid2) || !(ARE_INTERVALS_OVERLAPPING(prev_bedline.beg_pos, prev_bedline.end_pos, beg2, end2)))
+                         && ((curr_bedline.tid == tid2) &&  (ARE_INTERVALS_OVERLAPPING(curr_bedline.beg_pos, curr_bedline.end_pos, beg2, end2))));
+                    const bool is_consensus_to_fastq = (is_consensus_applicable && is_consensus_only_done_here);
+
+                    read_family_mmm_ampl.resetRegion(tid2, beg2, end2);
+                    read_family_con_ampl.resetRegion(tid2, beg2, end2); 
+                    for (const auto & alns1 : alns2) {
+                        uvc1_refgpos_t tid1, beg1, end1;
+                        fillTidBegEndFromAlns1(tid1, beg1, end1, alns1);
+                        read_ampBQerr_fragWithR1R2.resetRegion(tid1, beg1, end1);
+                        read_ampBQerr_fragWithR1R2.updateByRead1Aln<BASE_QUALITY_MAX, false, true>(
+                                alns1, 
                             
-                            this->getUnifiedIncluBegPosition(), 
-                            region_symbolvec,
-                            region_repeatvec,
-                            baq_offsetarr,
-                            baq_offsetarr2,
+                                this->getUnifiedIncluBegPosition(), 
+                                region_symbolvec,
+                                region_repeatvec,
+                                baq_offsetarr,
+                                baq_offsetarr2,
                             
-                            this->symbol_to_seg_format_info_sets,
-                            this->symbol_to_VQ_format_tag_sets,
-                            this->seg_format_prep_sets,
-                            this->seg_format_thres_sets,
-                            alns2pair2umibarcode.second.duplexflag,
+                                this->symbol_to_seg_format_info_sets,
+                                this->symbol_to_VQ_format_tag_sets,
+                                this->seg_format_prep_sets,
+                                this->seg_format_thres_sets,
+                                alns2pair2umibarcode.second.duplexflag,
 
-                            paramset,
-                            0);
+                                paramset,
+                                0);
                     
-                    read_family_con_ampl.updateByFiltering<true>(
-                            read_ampBQerr_fragWithR1R2, 
-                            std::array<uvc1_qual_t, NUM_SYMBOL_TYPES> {{ paramset.fam_thres_highBQ_snv, 0 }},
-                            (paramset.microadjust_padded_deletion_flag & ((SEQUENCING_PLATFORM_IONTORRENT == paramset.inferred_sequencing_platform) ? 0x2 : 0x1)));
-                    if (is_consensus_to_fastq) {
-                        read_family_mmm_ampl.updateByMajorMinusMinor<true>(read_ampBQerr_fragWithR1R2);
-                    } 
-                }
+                        read_family_con_ampl.updateByFiltering<true>(
+                                read_ampBQerr_fragWithR1R2, 
+                                std::array<uvc1_qual_t, NUM_SYMBOL_TYPES> {{ paramset.fam_thres_highBQ_snv, 0 }},
+                                (paramset.microadjust_padded_deletion_flag & ((SEQUENCING_PLATFORM_IONTORRENT == paramset.inferred_sequencing_platform) ? 0x2 : 0x1)));
+                        if (is_consensus_to_fastq) {
+                            read_family_mmm_ampl.updateByMajorMinusMinor<true>(read_ampBQerr_fragWithR1R2);
+                        } 
+                    }
 
-                // BEGIN of bias+consensus prep at family level
-                // std::vector<uvc1_refgpos_t> l2r_start_poss, r2l_start_poss;
-                std::vector<uvc1_refgpos_t> l2r_end_poss, r2l_end_poss; // cannot peform sum or average due to the possibility of overflow
-                // l2r_start_poss.reserve(alns2.size());
-                // r2l_start_poss.reserve(alns2.size());
-                l2r_end_poss.reserve(alns2.size());
-                r2l_end_poss.reserve(alns2.size());
+                    // BEGIN of bias+consensus prep at family level
+                    // std::vector<uvc1_refgpos_t> l2r_start_poss, r2l_start_poss;
+                    std::vector<uvc1_refgpos_t> l2r_end_poss, r2l_end_poss; // cannot peform sum or average due to the possibility of overflow
+                    // l2r_start_poss.reserve(alns2.size());
+                    // r2l_start_poss.reserve(alns2.size());
+                    l2r_end_poss.reserve(alns2.size());
+                    r2l_end_poss.reserve(alns2.size());
                 
-                std::vector<uvc1_refgpos_t> l2r_qseqlens, r2l_qseqlens; 
-                l2r_qseqlens.reserve(alns2.size());
-                r2l_qseqlens.reserve(alns2.size());
-                for (const auto & alns1 : alns2) {
-                    for (const bam1_t *aln : alns1) {
-                        const bool isrc = ((aln->core.flag & 0x10) == 0x10);
-                        if (isrc) {
-                            //r2l_start_poss.push_back(bam_endpos(aln));
-                            r2l_end_poss.push_back(aln->core.pos);
-                            r2l_qseqlens.push_back(aln->core.l_qseq);
-                        } else {
-                            //l2r_start_poss.push_back(aln->core.pos);
-                            l2r_end_poss.push_back(bam_endpos(aln));
-                            l2r_qseqlens.push_back(aln->core.l_qseq);
+                    std::vector<uvc1_refgpos_t> l2r_qseqlens, r2l_qseqlens; 
+                    l2r_qseqlens.reserve(alns2.size());
+                    r2l_qseqlens.reserve(alns2.size());
+                    for (const auto & alns1 : alns2) {
+                        for (const bam1_t *aln : alns1) {
+                            const bool isrc = ((aln->core.flag & 0x10) == 0x10);
+                            if (isrc) {
+                                //r2l_start_poss.push_back(bam_endpos(aln));
+                                r2l_end_poss.push_back(aln->core.pos);
+                                r2l_qseqlens.push_back(aln->core.l_qseq);
+                            } else {
+                                //l2r_start_poss.push_back(aln->core.pos);
+                                l2r_end_poss.push_back(bam_endpos(aln));
+                                l2r_qseqlens.push_back(aln->core.l_qseq);
+                            }
                         }
                     }
-                }
-                const uvc1_refgpos_t l2r_end_median_pos = ((l2r_end_poss.size() > 0) ? (MEDIAN(l2r_end_poss)) : read_family_con_ampl.getExcluEndPosition());
-                const uvc1_refgpos_t r2l_end_median_pos = ((r2l_end_poss.size() > 0) ? (MEDIAN(r2l_end_poss)) : read_family_con_ampl.getIncluBegPosition());
-                //const uvc1_refgpos_t l2r_start_median_pos = ((l2r_start_poss.size() > 0) ? (MEDIAN(l2r_start_poss)) : r2l_end_median_pos);
-                //const uvc1_refgpos_t r2l_start_median_pos = ((r2l_start_poss.size() > 0) ? (MEDIAN(r2l_start_poss)) : l2r_end_median_pos);
-                // without indel_adj_tracklen_dist it is exact non-overlap with <=
-                const bool fam_has_nonconf_middle = ((l2r_end_median_pos) <= (r2l_end_median_pos + paramset.indel_adj_tracklen_dist)); 
-
-                // BEGIN of the init of consensus-block
-                std::map<uvc1_refgpos_t, ConsensusBlock>::iterator consensusBlockSetsIts[NUM_CONSENSUS_BLOCK_CIGAR_TYPES];
-                std::map<uvc1_refgpos_t, ConsensusBlock>::const_iterator consensusBlockSetsEnds[NUM_CONSENSUS_BLOCK_CIGAR_TYPES];
-                if (is_consensus_to_fastq) {
-                    for (auto cigartype: ALL_CONSENSUS_BLOCK_CIGAR_TYPES) {
-                        consensusBlockSetsIts[cigartype] = read_family_mmm_ampl.getRefConsensusBlockSet(cigartype).pos2conblock.begin();
-                        consensusBlockSetsEnds[cigartype] = read_family_mmm_ampl.getConsensusBlockSet(cigartype).pos2conblock.end();
-                    };
-                }
-                // END of the init of consensus-block
-                // END of bias+consensus prep at family level
+                    const uvc1_refgpos_t l2r_end_median_pos = ((l2r_end_poss.size() > 0) ? (MEDIAN(l2r_end_poss)) : read_family_con_ampl.getExcluEndPosition());
+                    const uvc1_refgpos_t r2l_end_median_pos = ((r2l_end_poss.size() > 0) ? (MEDIAN(r2l_end_poss)) : read_family_con_ampl.getIncluBegPosition());
+                    //const uvc1_refgpos_t l2r_start_median_pos = ((l2r_start_poss.size() > 0) ? (MEDIAN(l2r_start_poss)) : r2l_end_median_pos);
+                    //const uvc1_refgpos_t r2l_start_median_pos = ((r2l_start_poss.size() > 0) ? (MEDIAN(r2l_start_poss)) : l2r_end_median_pos);
+                    // without indel_adj_tracklen_dist it is exact non-overlap with <=
+                    const bool fam_has_nonconf_middle = ((l2r_end_median_pos) <= (r2l_end_median_pos + paramset.indel_adj_tracklen_dist)); 
+
+                    // BEGIN of the init of consensus-block
+                    std::map<uvc1_refgpos_t, ConsensusBlock>::iterator consensusBlockSetsIts[NUM_CONSENSUS_BLOCK_CIGAR_TYPES];
+                    std::map<uvc1_refgpos_t, ConsensusBlock>::const_iterator consensusBlockSetsEnds[NUM_CONSENSUS_BLOCK_CIGAR_TYPES];
+                    if (is_consensus_to_fastq) {
+                        for (auto cigartype: ALL_CONSENSUS_BLOCK_CIGAR_TYPES) {
+                            consensusBlockSetsIts[cigartype] = read_family_mmm_ampl.getRefConsensusBlockSet(cigartype).pos2conblock.begin();
+                            consensusBlockSetsEnds[cigartype] = read_family_mmm_ampl.getConsensusBlockSet(cigartype).pos2conblock.end();
+                        };
+                    }
+                    // END of the init of consensus-block
+                    // END of bias+consensus prep at family level
                 
-                // CoveredRegion<bool> pos2iscon(tid2, beg2, end2);
-                uvc1_refgpos_t no_strict_bias_pos_min = read_family_con_ampl.getExcluEndPosition();
-                uvc1_refgpos_t no_strict_bias_pos_max = read_family_con_ampl.getIncluBegPosition();
+                    // CoveredRegion<bool> pos2iscon(tid2, beg2, end2);
+                    uvc1_refgpos_t no_strict_bias_pos_min = read_family_con_ampl.getExcluEndPosition();
+                    uvc1_refgpos_t no_strict_bias_pos_max = read_family_con_ampl.getIncluBegPosition();
                 
-                uvc1_refgpos_t qseqlen_sum = 0;
-                uvc1_refgpos_t n_qseqs = 0;
-                for (const auto qseqlen : l2r_qseqlens) {
-                    qseqlen_sum += qseqlen;
-                    n_qseqs += 1;
-                }
-                for (const auto qseqlen : r2l_qseqlens) {
-                    qseqlen_sum += qseqlen;
-                    n_qseqs += 1;
-                }
-                if ((UNSIGN2SIGN(alns2.size()) >= paramset.fam_thres_dup1add) && (qseqlen_sum >= n_qseqs * paramset.fam_thres_qseqlen)) {
-                    std::array<uvc1_refgpos_t, 2> no_strict_bias_poss = {{ read_family_con_ampl.getExcluEndPosition(), read_family_con_ampl.getIncluBegPosition() }};
-                    for (size_t i = 0; i < 2; i++) {
-                        int64_t begpos = (i ? (read_family_con_ampl.getExcluEndPosition() - 1) : read_family_con_ampl.getIncluBegPosition());
-                        int64_t endpos = (i ? ((int64_t)(read_family_con_ampl.getIncluBegPosition()) - 1) : (read_family_con_ampl.getExcluEndPosition()));
-                        int64_t inc = (i ? (-1) : 1);
-                        for (auto epos = begpos; epos != endpos; epos += inc) {
-                            const auto & con_ampl_symbol2count = read_family_con_ampl.getByPos(epos);
-                            const SymbolType symboltype = BASE_SYMBOL;
+                    uvc1_refgpos_t qseqlen_sum = 0;
+                    uvc1_refgpos_t n_qseqs = 0;
+                    for (const auto qseqlen : l2r_qseqlens) {
+                        qseqlen_sum += qseqlen;
+                        n_qseqs += 1;
+                    }
+                    for (const auto qseqlen : r2l_qseqlens) {
+                        qseqlen_sum += qseqlen;
+                        n_qseqs += 1;
+                    }
+                    if ((UNSIGN2SIGN(alns2.size()) >= paramset.fam_thres_dup1add) && (qseqlen_sum >= n_qseqs * paramset.fam_thres_qseqlen)) {
+                        std::array<uvc1_refgpos_t, 2> no_strict_bias_poss = {{ read_family_con_ampl.getExcluEndPosition(), read_family_con_ampl.getIncluBegPosition() }};
+                        for (size_t i = 0; i < 2; i++) {
+                            int64_t begpos = (i ? (read_family_con_ampl.getExcluEndPosition() - 1) : read_family_con_ampl.getIncluBegPosition());
+                            int64_t endpos = (i ? ((int64_t)(read_family_con_ampl.getIncluBegPosition()) - 1) : (read_family_con_ampl.getExcluEndPosition()));
+                            int64_t inc = (i ? (-1) : 1);
+                            for (auto epos = begpos; epos != endpos; epos += inc) {
+                                const auto & con_ampl_symbol2count = read_family_con_ampl.getByPos(epos);
+                                const SymbolType symboltype = BASE_SYMBOL;
+                                AlignmentSymbol con_symbol;
+                                uvc1_qual_t con_count, tot_count;
+                                con_ampl_symbol2count.fillConsensusCounts(con_symbol, con_count, tot_count, symboltype);
+                                if (0 == tot_count) { continue ; }
+                                const auto effective_tot_count = tot_count; // (uvc1_readnum_t)alns2.size() does not consider filtered out fragment support.
+                                const bool is_fam_big = (paramset.fam_thres_dup1add <= effective_tot_count);
+                                const bool is_fam_con = (con_count * 100 >= effective_tot_count * paramset.fam_thres_dup1perc);
+                                const bool is_fam_good = (is_fam_big && is_fam_con 
+                                        && ((alns2pair2umibarcode.second.duplexflag & 0x1) || (paramset.fam_flag & 0x2)));
+                                if (is_fam_good && (BASE_N != con_symbol) && (BASE_NN != con_symbol)) {
+                                    no_strict_bias_poss[i] = epos;
+                                    break;
+                                }
+                            }
+                        }
+                        no_strict_bias_pos_min = no_strict_bias_poss[0];
+                        no_strict_bias_pos_max = no_strict_bias_poss[1];
+                    }
+                    for (auto epos = read_family_con_ampl.getIncluBegPosition(); // MAX(read_family_con_ampl.getIncluBegPosition(), l2r_start_median_pos);
+                                epos < read_family_con_ampl.getExcluEndPosition(); // MIN(read_family_con_ampl.getExcluEndPosition(), r2l_start_median_pos);
+                                epos++) {
+                        const auto & con_ampl_symbol2count = read_family_con_ampl.getByPos(epos);
+                        for (SymbolType symboltype : SYMBOL_TYPES_IN_VCF_ORDER) {
                             AlignmentSymbol con_symbol;
                             uvc1_qual_t con_count, tot_count;
                             con_ampl_symbol2count.fillConsensusCounts(con_symbol, con_count, tot_count, symboltype);
-                            if (0 == tot_count) { continue ; }
+                        
                             const auto effective_tot_count = tot_count; // (uvc1_readnum_t)alns2.size() does not consider filtered out fragment support.
                             const bool is_fam_big = (paramset.fam_thres_dup1add <= effective_tot_count);
                             const bool is_fam_con = (con_count * 100 >= effective_tot_count * paramset.fam_thres_dup1perc);
                             const bool is_fam_good = (is_fam_big && is_fam_con 
                                     && ((alns2pair2umibarcode.second.duplexflag & 0x1) || (paramset.fam_flag & 0x2)));
-                            if (is_fam_good && (BASE_N != con_symbol) && (BASE_NN != con_symbol)) {
-                                no_strict_bias_poss[i] = epos;
-                                break;
-                            }
-                        }
-                    }
-                    no_strict_bias_pos_min = no_strict_bias_poss[0];
-                    no_strict_bias_pos_max = no_strict_bias_poss[1];
-                }
-                for (auto epos = read_family_con_ampl.getIncluBegPosition(); // MAX(read_family_con_ampl.getIncluBegPosition(), l2r_start_median_pos);
-                            epos < read_family_con_ampl.getExcluEndPosition(); // MIN(read_family_con_ampl.getExcluEndPosition(), r2l_start_median_pos);
-                            epos++) {
-                    const auto & con_ampl_symbol2count = read_family_con_ampl.getByPos(epos);
-                    for (SymbolType symboltype : SYMBOL_TYPES_IN_VCF_ORDER) {
-                        AlignmentSymbol con_symbol;
-                        uvc1_qual_t con_count, tot_count;
-                        con_ampl_symbol2count.fillConsensusCounts(con_symbol, con_count, tot_count, symboltype);
-                        
-                        const auto effective_tot_count = tot_count; // (uvc1_readnum_t)alns2.size() does not consider filtered out fragment support.
-                        const bool is_fam_big = (paramset.fam_thres_dup1add <= effective_tot_count);
-                        const bool is_fam_con = (con_count * 100 >= effective_tot_count * paramset.fam_thres_dup1perc);
-                        const bool is_fam_good = (is_fam_big && is_fam_con 
-                                && ((alns2pair2umibarcode.second.duplexflag & 0x1) || (paramset.fam_flag & 0x2)));
                         
-                        // BEGIN of consensus at family level
-                        if (is_consensus_to_fastq) {
-                            const bool is_fastq_fam_good = (is_fam_con && (paramset.fam_consensus_out_fastq_thres_dup1add <= effective_tot_count)
-                                && ((alns2pair2umibarcode.second.duplexflag & 0x1) || (paramset.fam_flag & 0x2)));
+                            // BEGIN of consensus at family level
+                            if (is_consensus_to_fastq) {
+                                const bool is_fastq_fam_good = (is_fam_con && (paramset.fam_consensus_out_fastq_thres_dup1add <= effective_tot_count)
+                                    && ((alns2pair2umibarcode.second.duplexflag & 0x1) || (paramset.fam_flag & 0x2)));
                             
-                            AlignmentSymbol con_mmm_symbol; // assign with the value AlignmentSymbol(NUM_ALIGNMENT_SYMBOLS) to flag for error
-                            uvc1_qual_t con_sumBQs, tot_sumBQs;
-                            read_family_mmm_ampl.getRefByPos(epos).fillConsensusCounts(con_mmm_symbol, con_sumBQs, tot_sumBQs, symboltype);
-                            uvc1_qual_t conBQ = non_neg_minus(con_sumBQs * 2, tot_sumBQs) / alns2.size();
-                            assertUVC(conBQ < 127 - 33 && conBQ >= 0);
-
-                            if ((LINK_SYMBOL == symboltype)) {
-                                const auto effective_tot_count = (uvc1_readnum_t)alns2.size();
-                                const auto cigarMD_count = con_ampl_symbol2count.getSymbolCount(LINK_M) 
-                                        + con_ampl_symbol2count.getSymbolCount(LINK_D1)
-                                        + con_ampl_symbol2count.getSymbolCount(LINK_D2)
-                                        + con_ampl_symbol2count.getSymbolCount(LINK_D3P);
-                                const bool is_nonMD_fam_good = (
-                                        ((effective_tot_count - cigarMD_count) * 100 >= effective_tot_count * paramset.fam_thres_dup1perc) 
-                                        && (paramset.fam_consensus_out_fastq_thres_dup1add <= effective_tot_count));
+                                AlignmentSymbol con_mmm_symbol; // assign with the value AlignmentSymbol(NUM_ALIGNMENT_SYMBOLS) to flag for error
+                                uvc1_qual_t con_sumBQs, tot_sumBQs;
+                                read_family_mmm_ampl.getRefByPos(epos).fillConsensusCounts(con_mmm_symbol, con_sumBQs, tot_sumBQs, symboltype);
+                                uvc1_qual_t conBQ = non_neg_minus(con_sumBQs * 2, tot_sumBQs) / alns2.size();
+                                assertUVC(conBQ < 127 - 33 && conBQ >= 0);
+
+                                if ((LINK_SYMBOL == symboltype)) {
+                                    const auto effective_tot_count = (uvc1_readnum_t)alns2.size();
+                                    const auto cigarMD_count = con_ampl_symbol2count.getSymbolCount(LINK_M) 
+                                            + con_ampl_symbol2count.getSymbolCount(LINK_D1)
+                                            + con_ampl_symbol2count.getSymbolCount(LINK_D2)
+                                            + con_ampl_symbol2count.getSymbolCount(LINK_D3P);
+                                    const bool is_nonMD_fam_good = (
+                                            ((effective_tot_count - cigarMD_count) * 100 >= effective_tot_count * paramset.fam_thres_dup1perc) 
+                                            && (paramset.fam_consensus_out_fastq_thres_dup1add <= effective_tot_count));
 #ifdef UVC_IN_DEBUG_MODE
-                                if (paramset.debug_tid == tid2 && (paramset.debug_pos - 3 <= epos) && (epos < paramset.debug_pos + 3)) {
-                                    std::string all_qnames;
-                                    for (const auto alns1 : alns2) {
-                                        for (const auto aln : alns1) {
-                                            all_qnames += std::string(",") + bam_get_qname(aln);
+                                    if (paramset.debug_tid == tid2 && (paramset.debug_pos - 3 <= epos) && (epos < paramset.debug_pos + 3)) {
+                                        std::string all_qnames;
+                                        for (const auto alns1 : alns2) {
+                                            for (const auto aln : alns1) {
+                                                all_qnames += std::string(",") + bam_get_qname(aln);
+                                            }
                                         }
+                                        LOG(logINFO) << "DebugINFO: CONSENSUS-PREP-CURR"
+                                                    << " con_symbol=" << SYMBOL_TO_DESC_ARR[con_symbol] 
+                                                    << " con_count=" << con_count
+                                                    << " tot_count=" << tot_count
+                                                    << " tot_size=" << alns2.size()
+                                                    << " cigarMD_count=" << cigarMD_count
+                                                    << " tid:pos=" << tid2 << ":" << epos
+                                                    << " qnames=" << all_qnames
+                                                    << " is_nonMD_fam_good=" << is_nonMD_fam_good
+                                                    ;
                                     }
-                                    LOG(logINFO) << "DebugINFO: CONSENSUS-PREP-CURR"
-                                                << " con_symbol=" << SYMBOL_TO_DESC_ARR[con_symbol] 
-                                                << " con_count=" << con_count
-                                                << " tot_count=" << tot_count
-                                                << " tot_size=" << alns2.size()
-                                                << " cigarMD_count=" << cigarMD_count
-                                                << " tid:pos=" << tid2 << ":" << epos
-                                                << " qnames=" << all_qnames
-                                                << " is_nonMD_fam_good=" << is_nonMD_fam_good
-                                                ;
-                                }
 #endif
-                                if (is_nonMD_fam_good) {
-                                    // Put insertions and soft-clips into the FASTQ files
-                                    for (auto cigartype: ALL_CONSENSUS_BLOCK_CIGAR_TYPES) {
-                                        const auto & morecenter_con_ampl_symbol2count = (is_ConsensusBlockCigarType_right2left(cigartype) 
-                                                ? read_family_con_ampl.getByPos(BETWEEN(epos + 1, read_family_con_ampl.getIncluBegPosition(), read_family_con_ampl.getExcluEndPosition() - 1)) 
-                                                : read_family_con_ampl.getByPos(BETWEEN(epos - 1, read_family_con_ampl.getIncluBegPosition(), read_family_con_ampl.getExcluEndPosition() - 1)));
-                                        const auto morecenter_cigarMD_count = morecenter_con_ampl_symbol2count.getSymbolCount(LINK_M)
-                                                + morecenter_con_ampl_symbol2count.getSymbolCount(LINK_D1)
-                                                + morecenter_con_ampl_symbol2count.getSymbolCount(LINK_D2)
-                                                + morecenter_con_ampl_symbol2count.getSymbolCount(LINK_D3P);
-                                        const bool is_morecenter_nonMD_fam_good = (
-                                                ((effective_tot_count - morecenter_cigarMD_count) * 100 >= effective_tot_count * paramset.fam_thres_dup1perc)
-                                                && (paramset.fam_consensus_out_fastq_thres_dup1add <= effective_tot_count));
+                                    if (is_nonMD_fam_good) {
+                                        // Put insertions and soft-clips into the FASTQ files
+                                        for (auto cigartype: ALL_CONSENSUS_BLOCK_CIGAR_TYPES) {
+                                            const auto & morecenter_con_ampl_symbol2count = (is_ConsensusBlockCigarType_right2left(cigartype) 
+                                                    ? read_family_con_ampl.getByPos(BETWEEN(epos + 1, read_family_con_ampl.getIncluBegPosition(), read_family_con_ampl.getExcluEndPosition() - 1)) 
+                                                    : read_family_con_ampl.getByPos(BETWEEN(epos - 1, read_family_con_ampl.getIncluBegPosition(), read_family_con_ampl.getExcluEndPosition() - 1)));
+                                            const auto morecenter_cigarMD_count = morecenter_con_ampl_symbol2count.getSymbolCount(LINK_M)
+                                                    + morecenter_con_ampl_symbol2count.getSymbolCount(LINK_D1)
+                                                    + morecenter_con_ampl_symbol2count.getSymbolCount(LINK_D2)
+                                                    + morecenter_con_ampl_symbol2count.getSymbolCount(LINK_D3P);
+                                            const bool is_morecenter_nonMD_fam_good = (
+                                                    ((effective_tot_count - morecenter_cigarMD_count) * 100 >= effective_tot_count * paramset.fam_thres_dup1perc)
+                                                    && (paramset.fam_consensus_out_fastq_thres_dup1add <= effective_tot_count));
 #ifdef UVC_IN_DEBUG_MODE
-                                        if (paramset.debug_tid == tid2 && (paramset.debug_pos - 3 < consensusBlockSetsIts[cigartype]->first) 
-                                                && (consensusBlockSetsIts[cigartype]->first < paramset.debug_pos + 3)) {
-                                            LOG(logINFO) << "DebugINFO: CONSENSUS-PREP2-CURR" 
-                                                << " is_morecenter_nonMD_fam_good=" << is_morecenter_nonMD_fam_good 
-                                                << " isRightToLeft=" << is_ConsensusBlockCigarType_right2left(cigartype);
-                                        }
+                                            if (paramset.debug_tid == tid2 && (paramset.debug_pos - 3 < consensusBlockSetsIts[cigartype]->first) 
+                                                    && (consensusBlockSetsIts[cigartype]->first < paramset.debug_pos + 3)) {
+                                                LOG(logINFO) << "DebugINFO: CONSENSUS-PREP2-CURR" 
+                                                    << " is_morecenter_nonMD_fam_good=" << is_morecenter_nonMD_fam_good 
+                                                    << " isRightToLeft=" << is_ConsensusBlockCigarType_right2left(cigartype);
+                                            }
 #endif
-                                        if (!is_morecenter_nonMD_fam_good) {
-                                            while (consensusBlockSetsIts[cigartype] != consensusBlockSetsEnds[cigartype] && consensusBlockSetsIts[cigartype]->first < epos) {
+                                            if (!is_morecenter_nonMD_fam_good) {
+                                                while (consensusBlockSetsIts[cigartype] != consensusBlockSetsEnds[cigartype] && consensusBlockSetsIts[cigartype]->first < epos) {
 #ifdef UVC_IN_DEBUG_MODE
-                                                if (paramset.debug_tid == tid2 && (paramset.debug_pos - 3 < consensusBlockSetsIts[cigartype]->first) && (consensusBlockSetsIts[cigartype]->first < paramset.debug_pos + 3)) {
-                                                    std::string all_qnames;
-                                                    for (const auto alns1 : alns2) {
-                                                        for (const auto aln : alns1) {
-                                                            all_qnames += std::string(",") + bam_get_qname(aln);
+                                                    if (paramset.debug_tid == tid2 && (paramset.debug_pos - 3 < consensusBlockSetsIts[cigartype]->first) && (consensusBlockSetsIts[cigartype]->first < paramset.debug_pos + 3)) {
+                                                        std::string all_qnames;
+                                                        for (const auto alns1 : alns2) {
+                                                            for (const auto aln : alns1) {
+                                                                all_qnames += std::string(",") + bam_get_qname(aln);
+                                                            }
                                                         }
+                                                        if (consensusBlockSetsIts[cigartype] != consensusBlockSetsEnds[cigartype]) {
+                                                            const uvc1_refgpos_t conpos = consensusBlockSetsIts[cigartype]->first;
+                                                            const FastqConsensusSeqSegment sqvec = consensusBlockToSeqQual(
+                                                                    consensusBlockSetsIts[cigartype]->second, 
+                                                                    is_ConsensusBlockCigarType_right2left(cigartype));
+                                                            LOG(logINFO) << "DebugINFO: CONSENSUS-PRE-PROCESSING" 
+                                                                        << " cigartype=" << cigartype 
+                                                                        << " conpos=" << conpos
+                                                                        << " sqvec.size()=" << sqvec.size()
+                                                                        << " qnames=" << all_qnames
+                                                                        << " tid:pos=" << tid2 << ":" << consensusBlockSetsIts[cigartype]->first
+                                                                        ;
+                                                        }
+                                                    }
+#endif
+                                                    consensusBlockSetsIts[cigartype]++; 
+                                                }
+
+                                                if (consensusBlockSetsIts[cigartype] != consensusBlockSetsEnds[cigartype] && consensusBlockSetsIts[cigartype]->first == epos) {
+                                                    const ConsensusBlock & conblock = consensusBlockSetsIts[cigartype]->second;
+                                                    const FastqConsensusSeqSegment sqvec = consensusBlockToSeqQual(conblock, is_ConsensusBlockCigarType_right2left(cigartype));
+                                                    for (const auto & sq : sqvec) {
+                                                        // const auto sq2 = std::make_pair(tolower(sq.base), sq.quality);
+                                                        fq_baseBQ_pairs.push_back(sq);
                                                     }
-                                                    if (consensusBlockSetsIts[cigartype] != consensusBlockSetsEnds[cigartype]) {
+#ifdef UVC_IN_DEBUG_MODE
+                                                    if ((paramset.debug_tid == tid2) && (paramset.debug_pos - 10 <= epos) && (epos <= paramset.debug_pos + 10)) {
+                                                        std::string all_qnames;
+                                                        for (const auto alns1 : alns2) {
+                                                            for (const auto aln : alns1) {
+                                                                all_qnames += std::string(",") + bam_get_qname(aln);
+                                                            }
+                                                        }
                                                         const uvc1_refgpos_t conpos = consensusBlockSetsIts[cigartype]->first;
-                                                        const FastqConsensusSeqSegment sqvec = consensusBlockToSeqQual(
-                                                                consensusBlockSetsIts[cigartype]->second, 
+                                                        /*const FastqConsensusSeqSegment sqvec = consensusBlockToSeqQual(
+                                                                consensusBlockSetsIts[cigartype]->second,
                                                                 is_ConsensusBlockCigarType_right2left(cigartype));
-                                                        LOG(logINFO) << "DebugINFO: CONSENSUS-PRE-PROCESSING" 
+                                                        */
+                                                        LOG(logINFO) << "DebugINFO: CONSENSUS-CIGAR-LAST-PROCESSING" 
                                                                     << " cigartype=" << cigartype 
                                                                     << " conpos=" << conpos
                                                                     << " sqvec.size()=" << sqvec.size()
-                                                                    << " qnames=" << all_qnames
-                                                                    << " tid:pos=" << tid2 << ":" << consensusBlockSetsIts[cigartype]->first
+                                                                    << " moleculeHash=" << anyuint2hexstring(alns2pair2umibarcode.second.hashvalue)
+                                                                    << " tid:pos=" << tid2 << ":" << epos
                                                                     ;
                                                     }
-                                                }
 #endif
-                                                consensusBlockSetsIts[cigartype]++; 
-                                            }
-
-                                            if (consensusBlockSetsIts[cigartype] != consensusBlockSetsEnds[cigartype] && consensusBlockSetsIts[cigartype]->first == epos) {
-                                                const ConsensusBlock & conblock = consensusBlockSetsIts[cigartype]->second;
-                                                const FastqConsensusSeqSegment sqvec = consensusBlockToSeqQual(conblock, is_ConsensusBlockCigarType_right2left(cigartype));
-                                                for (const auto & sq : sqvec) {
-                                                    // const auto sq2 = std::make_pair(tolower(sq.base), sq.quality);
-                                                    fq_baseBQ_pairs.push_back(sq);
                                                 }
-#ifdef UVC_IN_DEBUG_MODE
-                                                if ((paramset.debug_tid == tid2) && (paramset.debug_pos - 10 <= epos) && (epos <= paramset.debug_pos + 10)) {
-                                                    std::string all_qnames;
-                                                    for (const auto alns1 : alns2) {
-                                                        for (const auto aln : alns1) {
-                                                            all_qnames += std::string(",") + bam_get_qname(aln);
-                                                        }
-                                                    }
-                                                    const uvc1_refgpos_t conpos = consensusBlockSetsIts[cigartype]->first;
-                                                    /*const FastqConsensusSeqSegment sqvec = consensusBlockToSeqQual(
-                                                            consensusBlockSetsIts[cigartype]->second,
-                                                            is_ConsensusBlockCigarType_right2left(cigartype));
-                                                    */
-                                                    LOG(logINFO) << "DebugINFO: CONSENSUS-CIGAR-LAST-PROCESSING" 
-                                                                << " cigartype=" << cigartype 
-                                                                << " conpos=" << conpos
-                                                                << " sqvec.size()=" << sqvec.size()
-                                                                << " moleculeHash=" << anyuint2hexstring(alns2pair2umibarcode.second.hashvalue)
-                                                                << " tid:pos=" << tid2 << ":" << epos
-                                                                ;
-                                                }
-#endif
                                             }
-                                        }
-                                    };
+                                        };
                                     
-                                    // If each inserted-or-clipped sequence instead of each base at each position of the inserted-or-clipped sequence was counted,
-                                    //   then the following code becomes useful again. 
-
-                                    // const std::pair<uvc1_readnum_t, std::string> cnt_iseq_pair = read_family_con_ampl_getMajority_ins(read_family_con_ampl, epos);
-                                    // const std::pair<uvc1_readnum_t, uvc1_refgpos_t> cnt_dlen_pair = read_family_con_ampl_getMajority_del(read_family_con_ampl, epos);
-                                    /*
-                                    if (cnt_dlen_pair.first * 100 >= tot_count * paramset.fam_thres_dup1perc) {
-                                        // here we actually do nothing to simply skip the deleted bases
-                                    } else if (cnt_iseq_pair.first * 100 >= tot_count * paramset.fam_thres_dup1perc) {
-                                        // here we also do nothing since bases were already inserted
-                                        // const uvc1_qual_t conBQ = 39 - MIN(tot_count - cnt_iseq_pair.first, 9);
-                                        // for (const char ibase : cnt_iseq_pair.second) {
-                                        //    fq_baseBQ_pairs.push_back(std::make_pair(tolower(ibase), conBQ));
-                                        // }
-                                    } else { }
-                                    if (cnt_dlen_pair.first > cnt_iseq_pair.first 
-                                            && con_symbol == LINK_M
-                                            && cnt_dlen_pair.first * 100 < tot_count * paramset.fam_thres_dup1perc ) {
-                                        for (uvc1_readnum_t rn = 0; rn < cnt_dlen_pair.second; rn++) {
-                                            fq_baseBQ_pairs.push_back(std::make_pair('n', 0));
-                                        }
-                                    }*/
-                                } else { } // the family is sufficiently large and has strong consensus, so do not add any InDel.
-                            } else if (BASE_SYMBOL == symboltype) { // consider NA (not-available) bases, and split into multiple fastq lines later
-                                if (BASE_NN == con_symbol) {
-                                    // we do nothing for both padded deletion and uncovered position
-                                    // const char *desc = SYMBOL_TO_DESC_ARR[BASE_NN];
-                                    // assertUVC(strlen(desc) == 1);
-                                    // fq_baseBQ_pairs.push_back((std::make_pair(desc[0], 0)));
-                                } else if (is_fastq_fam_good) {
-                                    const char *desc = SYMBOL_TO_DESC_ARR[con_symbol];
-                                    assertUVC(strlen(desc) == 1);
-                                    FastqConsensusBase fcb;
-                                    fcb.base = desc[0];
-                                    fcb.quality = conBQ;
-                                    fcb.family_size = tot_count;
-                                    fcb.family_identity = (double)con_count / (double)MAX(1, tot_count);
-                                    fq_baseBQ_pairs.push_back(fcb);
-                                } else {
-                                    // 0/1 means the position-associated family is probably singleton/with-weak-consensus-base
-                                    FastqConsensusBase fcb;
-                                    fcb.base = 'N';
-                                    fcb.quality = (is_fam_big ? 1 : 0);
-                                    fcb.family_size = tot_count;
-                                    fcb.family_identity = (double)con_count / (double)MAX(1, tot_count);
-                                    fq_baseBQ_pairs.push_back(fcb);
+                                        // If each inserted-or-clipped sequence instead of each base at each position of the inserted-or-clipped sequence was counted,
+                                        //   then the following code becomes useful again. 
+
+                                        // const std::pair<uvc1_readnum_t, std::string> cnt_iseq_pair = read_family_con_ampl_getMajority_ins(read_family_con_ampl, epos);
+                                        // const std::pair<uvc1_readnum_t, uvc1_refgpos_t> cnt_dlen_pair = read_family_con_ampl_getMajority_del(read_family_con_ampl, epos);
+                                        /*
+                                        if (cnt_dlen_pair.first * 100 >= tot_count * paramset.fam_thres_dup1perc) {
+                                            // here we actually do nothing to simply skip the deleted bases
+                                        } else if (cnt_iseq_pair.first * 100 >= tot_count * paramset.fam_thres_dup1perc) {
+                                            // here we also do nothing since bases were already inserted
+                                            // const uvc1_qual_t conBQ = 39 - MIN(tot_count - cnt_iseq_pair.first, 9);
+                                            // for (const char ibase : cnt_iseq_pair.second) {
+                                            //    fq_baseBQ_pairs.push_back(std::make_pair(tolower(ibase), conBQ));
+                                            // }
+                                        } else { }
+                                        if (cnt_dlen_pair.first > cnt_iseq_pair.first 
+                                                && con_symbol == LINK_M
+                                                && cnt_dlen_pair.first * 100 < tot_count * paramset.fam_thres_dup1perc ) {
+                                            for (uvc1_readnum_t rn = 0; rn < cnt_dlen_pair.second; rn++) {
+                                                fq_baseBQ_pairs.push_back(std::make_pair('n', 0));
+                                            }
+                                        }*/
+                                    } else { } // the family is sufficiently large and has strong consensus, so do not add any InDel.
+                                } else if (BASE_SYMBOL == symboltype) { // consider NA (not-available) bases, and split into multiple fastq lines later
+                                    if (BASE_NN == con_symbol) {
+                                        // we do nothing for both padded deletion and uncovered position
+                                        // const char *desc = SYMBOL_TO_DESC_ARR[BASE_NN];
+                                        // assertUVC(strlen(desc) == 1);
+                                        // fq_baseBQ_pairs.push_back((std::make_pair(desc[0], 0)));
+                                    } else if (is_fastq_fam_good) {
+                                        const char *desc = SYMBOL_TO_DESC_ARR[con_symbol];
+                                        assertUVC(strlen(desc) == 1);
+                                        FastqConsensusBase fcb;
+                                        fcb.base = desc[0];
+                                        fcb.quality = conBQ;
+                                        fcb.family_size = tot_count;
+                                        fcb.family_identity = (double)con_count / (double)MAX(1, tot_count);
+                                        fq_baseBQ_pairs.push_back(fcb);
+                                    } else {
+                                        // 0/1 means the position-associated family is probably singleton/with-weak-consensus-base
+                                        FastqConsensusBase fcb;
+                                        fcb.base = 'N';
+                                        fcb.quality = (is_fam_big ? 1 : 0);
+                                        fcb.family_size = tot_count;
+                                        fcb.family_identity = (double)con_count / (double)MAX(1, tot_count);
+                                        fq_baseBQ_pairs.push_back(fcb);
+                                    }
                                 }
                             }
-                        }
-                        // END of consensus at family level
+                            // END of consensus at family level
                         
-                        if (0 == tot_count) { continue ; }
-                        this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP12] += 1;
-                        if (1 == tot_count) {
-                            this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP21] += 1;
-                        }
+                            if (0 == tot_count) { continue ; }
+                            fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP12] += 1;
+                            if (1 == tot_count) {
+                                fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP21] += 1;
+                            }
 
-if (paramset.inferred_is_vcf_generated) {
+    if (paramset.inferred_is_vcf_generated) {
 
-                        if (is_fam_good) {
-                            this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP2] += 1;
-                            if (isSymbolIns(con_symbol)) {
-                                posToIndelToCount_updateByConsensus(
-                                        this->pos2iseq2data_cDP2[strand][insSymbolToInsIdx(con_symbol)],
-                                        read_family_con_ampl.getPosToIseqToData(con_symbol), epos, 1);
-                            }
-                            if (isSymbolDel(con_symbol)) {
-                                posToIndelToCount_updateByConsensus(
-                                        this->pos2dlen2data_cDP2[strand][delSymbolToDelIdx(con_symbol)],
-                                        read_family_con_ampl.getPosToDlenToData(con_symbol), epos, 1);
-                            }
+                            if (is_fam_good) {
+                                fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP2] += 1;
+                                if (isSymbolIns(con_symbol)) {
+                                    posToIndelToCount_updateByConsensus(
+                                            fam_pos2iseq2data_cDP2[strand][insSymbolToInsIdx(con_symbol)],
+                                            read_family_con_ampl.getPosToIseqToData(con_symbol), epos, 1);
+                                }
+                                if (isSymbolDel(con_symbol)) {
+                                    posToIndelToCount_updateByConsensus(
+                                            fam_pos2dlen2data_cDP2[strand][delSymbolToDelIdx(con_symbol)],
+                                            read_family_con_ampl.getPosToDlenToData(con_symbol), epos, 1);
+                                }
 
-                            // BEGIN UPDATING-FAM2-BIAS // update_bidirectional_bias
-                            /* Please note that there is an edge case of having a position-biased family support for an ALT at the very small overlap between R1 and R2,
-                             * so r2l_end_median_pos and l2r_end_median_pos are needed */
-                            const auto rpos = epos;
-                            auto rbeg = MIN(no_strict_bias_pos_min, epos); // l2r_start_median_pos ; // read_family_con_ampl.getIncluBegPosition();
-                            auto rend = MAX(no_strict_bias_pos_max, epos); // r2l_start_median_pos; // read_family_con_ampl.getExcluEndPosition();
-                            if (fam_has_nonconf_middle && epos < r2l_end_median_pos) {
-                                rend = MAX(MIN3(l2r_end_median_pos, r2l_end_median_pos, rend), epos);
-                            }
-                            if (fam_has_nonconf_middle && l2r_end_median_pos < epos) {
-                                rbeg = MIN(MAX3(l2r_end_median_pos, r2l_end_median_pos, rbeg), epos);
-                            }
+                                // BEGIN UPDATING-FAM2-BIAS // update_bidirectional_bias
+                                /* Please note that there is an edge case of having a position-biased family support for an ALT at the very small overlap between R1 and R2,
+                                 * so r2l_end_median_pos and l2r_end_median_pos are needed */
+                                const auto rpos = epos;
+                                auto rbeg = MIN(no_strict_bias_pos_min, epos); // l2r_start_median_pos ; // read_family_con_ampl.getIncluBegPosition();
+                                auto rend = MAX(no_strict_bias_pos_max, epos); // r2l_start_median_pos; // read_family_con_ampl.getExcluEndPosition();
+                                if (fam_has_nonconf_middle && epos < r2l_end_median_pos) {
+                                    rend = MAX(MIN3(l2r_end_median_pos, r2l_end_median_pos, rend), epos);
+                                }
+                                if (fam_has_nonconf_middle && l2r_end_median_pos < epos) {
+                                    rbeg = MIN(MAX3(l2r_end_median_pos, r2l_end_median_pos, rbeg), epos);
+                                }
 
-                            const auto & seg_format_thres_set = this->seg_format_thres_sets.getRefByPos(rpos);
-                            auto & fam_info_set = this->symbol_to_fam_format_info_sets.getRefByPos(rpos)[con_symbol];
+                                const auto & seg_format_thres_set = this->seg_format_thres_sets.getRefByPos(rpos);
+                                auto & fam_info_set = fam_format_info_sets.getRefByPos(rpos)[con_symbol];
 
-                            const bool isGap = (LINK_SYMBOL == symboltype);
-                            const uvc1_qual_t bq = 90; // very big
-                            const uvc1_refgpos_t dist_to_interfering_indel = 1024*1024; // very big, TODO: check validity?
-                            if (((!isGap) && bq >= paramset.bias_thres_highBQ) || (isGap && dist_to_interfering_indel >= paramset.bias_thres_highBQ)) { 
-                                    const auto  bias_thres_veryhighBQ = paramset.bias_thres_highBQ;
-                                    const bool is_BQ_high_enough_for_tier2 = (isGap || bq >= bias_thres_veryhighBQ);
+                                const bool isGap = (LINK_SYMBOL == symboltype);
+                                const uvc1_qual_t bq = 90; // very big
+                                const uvc1_refgpos_t dist_to_interfering_indel = 1024*1024; // very big, TODO: check validity?
+                                if (((!isGap) && bq >= paramset.bias_thres_highBQ) || (isGap && dist_to_interfering_indel >= paramset.bias_thres_highBQ)) { 
+                                        const auto  bias_thres_veryhighBQ = paramset.bias_thres_highBQ;
+                                        const bool is_BQ_high_enough_for_tier2 = (isGap || bq >= bias_thres_veryhighBQ);
                                     
-                                    uvc1_refgpos_t fam2_l_nbases = non_neg_minus(epos + 1, rbeg);
-                                    uvc1_refgpos_t fam2_r_nbases = non_neg_minus(rend, epos);
+                                        uvc1_refgpos_t fam2_l_nbases = non_neg_minus(epos + 1, rbeg);
+                                        uvc1_refgpos_t fam2_r_nbases = non_neg_minus(rend, epos);
                                     
-                                    auto _const_LPxT = seg_format_thres_set.segthres_aLPxT; 
-                                    const auto const_RPxT = seg_format_thres_set.segthres_aRPxT; 
-                                    const auto const_LPxT = (isGap ? _const_LPxT : MIN(_const_LPxT, const_RPxT));
-                                    uvc1_refgpos_t indel_len = 0;
-                                    if (isSymbolIns(con_symbol)) {
-                                        std::pair<uvc1_readnum_t, std::string> ins_maj= read_family_con_ampl_getMajority_ins(read_family_con_ampl, epos);
-                                        indel_len = ins_maj.first;
-                                    } else if (isSymbolDel(con_symbol)) {
-                                        std::pair<uvc1_readnum_t, uvc1_refgpos_t> del_maj = read_family_con_ampl_getMajority_del(read_family_con_ampl, epos); 
-                                        indel_len = del_maj.first;
-                                    }
-                                    const bool is_far_from_edge = (fam2_l_nbases + ((isSymbolIns(con_symbol)) ? non_neg_minus(indel_len, paramset.microadjust_nobias_pos_indel_maxlen) : 0) >= const_LPxT) 
-                                            && (fam2_r_nbases >= const_RPxT);
-                                    if (is_far_from_edge) {
-                                        const auto bb_thres = BidirectionalBiasThreshold(
-                                                    seg_format_thres_set.segthres_aLP1t,
-                                                    seg_format_thres_set.segthres_aLP2t,
-                                                    seg_format_thres_set.segthres_aRP1t,
-                                                    seg_format_thres_set.segthres_aRP2t);
-                                        update_bidirectional_bias(
-                                                fam_info_set.faminfo_c2LP1,
-                                                fam_info_set.faminfo_c2LP2,
-                                                fam_info_set.faminfo_c2RP1,
-                                                fam_info_set.faminfo_c2RP2,
-                                                fam_info_set.faminfo_c2LPL,
-                                                fam_info_set.faminfo_c2RPL,
-                                                bb_thres,
-                                                fam2_l_nbases,
-                                                fam2_r_nbases,
-                                                true,
-                                                0);
-                                    }
-                                    uvc1_refgpos_t fam2_l_nbases_strict = non_neg_minus(epos + 1, no_strict_bias_pos_min);
-                                    uvc1_refgpos_t fam2_r_nbases_strict = non_neg_minus(no_strict_bias_pos_max, epos);
-                                    if (fam2_l_nbases_strict >= paramset.bias_thres_strict_c2LRP0) {
-                                        fam_info_set.faminfo_c2LP0++;
-                                    }
+                                        auto _const_LPxT = seg_format_thres_set.segthres_aLPxT; 
+                                        const auto const_RPxT = seg_format_thres_set.segthres_aRPxT; 
+                                        const auto const_LPxT = (isGap ? _const_LPxT : MIN(_const_LPxT, const_RPxT));
+                                        uvc1_refgpos_t indel_len = 0;
+                                        if (isSymbolIns(con_symbol)) {
+                                            std::pair<uvc1_readnum_t, std::string> ins_maj= read_family_con_ampl_getMajority_ins(read_family_con_ampl, epos);
+                                            indel_len = ins_maj.first;
+                                        } else if (isSymbolDel(con_symbol)) {
+                                            std::pair<uvc1_readnum_t, uvc1_refgpos_t> del_maj = read_family_con_ampl_getMajority_del(read_family_con_ampl, epos); 
+                                            indel_len = del_maj.first;
+                                        }
+                                        const bool is_far_from_edge = (fam2_l_nbases + ((isSymbolIns(con_symbol)) ? non_neg_minus(indel_len, paramset.microadjust_nobias_pos_indel_maxlen) : 0) >= const_LPxT) 
+                                                && (fam2_r_nbases >= const_RPxT);
+                                        if (is_far_from_edge) {
+                                            const auto bb_thres = BidirectionalBiasThreshold(
+                                                        seg_format_thres_set.segthres_aLP1t,
+                                                        seg_format_thres_set.segthres_aLP2t,
+                                                        seg_format_thres_set.segthres_aRP1t,
+                                                        seg_format_thres_set.segthres_aRP2t);
+                                            update_bidirectional_bias(
+                                                    fam_info_set.faminfo_c2LP1,
+                                                    fam_info_set.faminfo_c2LP2,
+                                                    fam_info_set.faminfo_c2RP1,
+                                                    fam_info_set.faminfo_c2RP2,
+                                                    fam_info_set.faminfo_c2LPL,
+                                                    fam_info_set.faminfo_c2RPL,
+                                                    bb_thres,
+                                                    fam2_l_nbases,
+                                                    fam2_r_nbases,
+                                                    true,
+                                                    0);
+                                        }
+                                        uvc1_refgpos_t fam2_l_nbases_strict = non_neg_minus(epos + 1, no_strict_bias_pos_min);
+                                        uvc1_refgpos_t fam2_r_nbases_strict = non_neg_minus(no_strict_bias_pos_max, epos);
+                                        if (fam2_l_nbases_strict >= paramset.bias_thres_strict_c2LRP0) {
+                                            fam_info_set.faminfo_c2LP0++;
+                                        }
 #ifdef UVC_IN_DEBUG_MODE
-                                    if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
-                                        LOG(logINFO) << "DebugINFO: fam_l_nbases " << fam2_l_nbases << " and " 
-                                            << fam2_l_nbases_strict << " >= " << paramset.bias_thres_strict_c2LRP0 << " in SSCS " 
-                                            <<  read_family_con_ampl.getIncluBegPosition() << "-" << read_family_con_ampl.getExcluEndPosition() 
-                                            << "#" << alns2pair2umibarcode.second.umistring 
-                                            << " at-TID-POS-ALT=" << tid2 << "-" << epos << "-" << SYMBOL_TO_DESC_ARR[con_symbol];
-                                    }
+                                        if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
+                                            LOG(logINFO) << "DebugINFO: fam_l_nbases " << fam2_l_nbases << " and " 
+                                                << fam2_l_nbases_strict << " >= " << paramset.bias_thres_strict_c2LRP0 << " in SSCS " 
+                                                <<  read_family_con_ampl.getIncluBegPosition() << "-" << read_family_con_ampl.getExcluEndPosition() 
+                                                << "#" << alns2pair2umibarcode.second.umistring 
+                                                << " at-TID-POS-ALT=" << tid2 << "-" << epos << "-" << SYMBOL_TO_DESC_ARR[con_symbol];
+                                        }
 #endif
-                                    if (fam2_r_nbases_strict >= paramset.bias_thres_strict_c2LRP0) {
-                                        fam_info_set.faminfo_c2RP0++;
-                                    }
+                                        if (fam2_r_nbases_strict >= paramset.bias_thres_strict_c2LRP0) {
+                                            fam_info_set.faminfo_c2RP0++;
+                                        }
 #ifdef UVC_IN_DEBUG_MODE
-                                    if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
-                                        LOG(logINFO) << "DebugINFO: fam2_r_nbases " << fam2_r_nbases << " and " 
-                                            << fam2_r_nbases_strict << " >= " << paramset.bias_thres_strict_c2LRP0 << " in SSCS " 
-                                            <<  read_family_con_ampl.getIncluBegPosition() << "-" << read_family_con_ampl.getExcluEndPosition() 
-                                            << "#" << alns2pair2umibarcode.second.umistring
-                                            << " at-TID-POS-ALT=" << tid2 << "-" << epos << "-" << SYMBOL_TO_DESC_ARR[con_symbol];
-                                    }
+                                        if (paramset.debug_tid == tid2 && paramset.debug_pos == epos) {
+                                            LOG(logINFO) << "DebugINFO: fam2_r_nbases " << fam2_r_nbases << " and " 
+                                                << fam2_r_nbases_strict << " >= " << paramset.bias_thres_strict_c2LRP0 << " in SSCS " 
+                                                <<  read_family_con_ampl.getIncluBegPosition() << "-" << read_family_con_ampl.getExcluEndPosition() 
+                                                << "#" << alns2pair2umibarcode.second.umistring
+                                                << " at-TID-POS-ALT=" << tid2 << "-" << epos << "-" << SYMBOL_TO_DESC_ARR[con_symbol];
+                                        }
 #endif
                                     
-                                    const uvc1_qual_t seg_l_baq = baq_offsetarr.getByPos(rpos) - baq_offsetarr.getByPos(MAX(rbeg, non_neg_minus(rpos, MAX_STR_N_BASES))) + 1;
-                                    const uvc1_qual_t _seg_r_baq = baq_offsetarr.getByPos(MIN3(rend-1, rpos + (MAX_STR_N_BASES), baq_offsetarr.getExcluEndPosition()-1)) - baq_offsetarr.getByPos(rpos) + 1;
-                                    const uvc1_qual_t seg_r_baq = (isGap ? MIN(_seg_r_baq, baq_offsetarr2.getByPos(MIN3(rend-1, rpos + MAX_STR_N_BASES, baq_offsetarr2.getExcluEndPosition()-1)) - baq_offsetarr2.getByPos(rpos) + 7) : _seg_r_baq);
-                                    const auto bias_thres_highBAQ = paramset.bias_thres_highBAQ + (isGap ? 0 : 3);
-                                    const bool is_unaffected_by_edge = (seg_l_baq >= bias_thres_highBAQ && seg_r_baq >= bias_thres_highBAQ);
-                                    if (is_unaffected_by_edge) {
-                                        const auto bb_thres = BidirectionalBiasThreshold(
-                                                paramset.bias_thres_BAQ1,
-                                                paramset.bias_thres_BAQ2,
-                                                paramset.bias_thres_BAQ1,
-                                                paramset.bias_thres_BAQ2);
-                                        update_bidirectional_bias(
-                                                fam_info_set.faminfo_c2LB1,
-                                                fam_info_set.faminfo_c2LB2,
-                                                fam_info_set.faminfo_c2RB1,
-                                                fam_info_set.faminfo_c2RB2,
-                                                fam_info_set.faminfo_c2LBL,
-                                                fam_info_set.faminfo_c2RBL,
-                                                bb_thres,
-                                                seg_l_baq,
-                                                seg_r_baq,
-                                                is_BQ_high_enough_for_tier2,
-                                                0);
-                                    }
-                                    fam_info_set.faminfo_c2BQ2 += 1;
+                                        const uvc1_qual_t seg_l_baq = baq_offsetarr.getByPos(rpos) - baq_offsetarr.getByPos(MAX(rbeg, non_neg_minus(rpos, MAX_STR_N_BASES))) + 1;
+                                        const uvc1_qual_t _seg_r_baq = baq_offsetarr.getByPos(MIN3(rend-1, rpos + (MAX_STR_N_BASES), baq_offsetarr.getExcluEndPosition()-1)) - baq_offsetarr.getByPos(rpos) + 1;
+                                        const uvc1_qual_t seg_r_baq = (isGap ? MIN(_seg_r_baq, baq_offsetarr2.getByPos(MIN3(rend-1, rpos + MAX_STR_N_BASES, baq_offsetarr2.getExcluEndPosition()-1)) - baq_offsetarr2.getByPos(rpos) + 7) : _seg_r_baq);
+                                        const auto bias_thres_highBAQ = paramset.bias_thres_highBAQ + (isGap ? 0 : 3);
+                                        const bool is_unaffected_by_edge = (seg_l_baq >= bias_thres_highBAQ && seg_r_baq >= bias_thres_highBAQ);
+                                        if (is_unaffected_by_edge) {
+                                            const auto bb_thres = BidirectionalBiasThreshold(
+                                                    paramset.bias_thres_BAQ1,
+                                                    paramset.bias_thres_BAQ2,
+                                                    paramset.bias_thres_BAQ1,
+                                                    paramset.bias_thres_BAQ2);
+                                            update_bidirectional_bias(
+                                                    fam_info_set.faminfo_c2LB1,
+                                                    fam_info_set.faminfo_c2LB2,
+                                                    fam_info_set.faminfo_c2RB1,
+                                                    fam_info_set.faminfo_c2RB2,
+                                                    fam_info_set.faminfo_c2LBL,
+                                                    fam_info_set.faminfo_c2RBL,
+                                                    bb_thres,
+                                                    seg_l_baq,
+                                                    seg_r_baq,
+                                                    is_BQ_high_enough_for_tier2,
+                                                    0);
+                                        }
+                                        fam_info_set.faminfo_c2BQ2 += 1;
+                                }
+                                // END UPDATING-FAM2-BIAS
                             }
-                            // END UPDATING-FAM2-BIAS
-                        }
                         
-                        if (paramset.fam_thres_dup2add <= tot_count && (con_count * 100 >= tot_count * paramset.fam_thres_dup2perc)) {
-                            this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP3] += 1;
+                            if (paramset.fam_thres_dup2add <= tot_count && (con_count * 100 >= tot_count * paramset.fam_thres_dup2perc)) {
+                                fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDP3] += 1;
                             
-                        }
+                            }
                         
-                        if (isSymbolIns(con_symbol)) {
-                            posToIndelToCount_updateByConsensus(
-                                    this->symbol_to_fam_format_depth_sets_2strand[strand].getRefPosToIseqToData(con_symbol),
-                                    read_family_con_ampl.getPosToIseqToData(con_symbol), epos, 1);
-                        }
-                        if (isSymbolDel(con_symbol)) {
-                            posToIndelToCount_updateByConsensus(
-                                    this->symbol_to_fam_format_depth_sets_2strand[strand].getRefPosToDlenToData(con_symbol),
-                                    read_family_con_ampl.getPosToDlenToData(con_symbol), epos, 1);
-                        }
-                        // This is one round of bootstrapping for EM. We can use a full EM algorithm to improve this estimator, but it is probably overkill
-                        // 0 means no coverage, 1 means no error correction, 2 means low quality family if the symbols disagree with each other, 
-                        // 3 means up to 1 erroneous basecall is tolerated, 4 means up to 2 erroneous basecalls are tolerated
-                        const auto fam_thres_emperr_all_flat = (isSymbolSubstitution(con_symbol) ? 
-                                paramset.fam_thres_emperr_all_flat_snv : paramset.fam_thres_emperr_all_flat_indel);
-                        const auto fam_thres_emperr_con_perc = (isSymbolSubstitution(con_symbol) ? 
-                                paramset.fam_thres_emperr_con_perc_snv : paramset.fam_thres_emperr_con_perc_indel);
-                        if (tot_count < fam_thres_emperr_all_flat) { continue; } 
-                        if (con_count * 100 < tot_count * fam_thres_emperr_con_perc) { continue; }
-                        for (AlignmentSymbol symbol : SYMBOL_TYPE_TO_SYMBOLS[symboltype]) {
-                            if (con_symbol != symbol) {
-                                this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDPm] += 
-                                        con_ampl_symbol2count.getSymbolCount(symbol);
-                                this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDPM] += tot_count;
+                            if (isSymbolIns(con_symbol)) {
+                                posToIndelToCount_updateByConsensus(
+                                        fam_format_depth_sets_2strand[strand].getRefPosToIseqToData(con_symbol),
+                                        read_family_con_ampl.getPosToIseqToData(con_symbol), epos, 1);
+                            }
+                            if (isSymbolDel(con_symbol)) {
+                                posToIndelToCount_updateByConsensus(
+                                        fam_format_depth_sets_2strand[strand].getRefPosToDlenToData(con_symbol),
+                                        read_family_con_ampl.getPosToDlenToData(con_symbol), epos, 1);
+                            }
+                            // This is one round of bootstrapping for EM. We can use a full EM algorithm to improve this estimator, but it is probably overkill
+                            // 0 means no coverage, 1 means no error correction, 2 means low quality family if the symbols disagree with each other, 
+                            // 3 means up to 1 erroneous basecall is tolerated, 4 means up to 2 erroneous basecalls are tolerated
+                            const auto fam_thres_emperr_all_flat = (isSymbolSubstitution(con_symbol) ? 
+                                    paramset.fam_thres_emperr_all_flat_snv : paramset.fam_thres_emperr_all_flat_indel);
+                            const auto fam_thres_emperr_con_perc = (isSymbolSubstitution(con_symbol) ? 
+                                    paramset.fam_thres_emperr_con_perc_snv : paramset.fam_thres_emperr_con_perc_indel);
+                            if (tot_count < fam_thres_emperr_all_flat) { continue; } 
+                            if (con_count * 100 < tot_count * fam_thres_emperr_con_perc) { continue; }
+                            for (AlignmentSymbol symbol : SYMBOL_TYPE_TO_SYMBOLS[symboltype]) {
+                                if (con_symbol != symbol) {
+                                    fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDPm] += 
+                                            con_ampl_symbol2count.getSymbolCount(symbol);
+                                    fam_format_depth_sets_2strand[strand].getRefByPos(epos)[con_symbol][FAM_cDPM] += tot_count;
+                                }
                             }
+    }
                         }
-}
                     }
-                }
-                if (paramset.fam_consensus_out_fastq.size() > 0 && fq_baseBQ_pairs.size() >= 20) {
-                    generate_consensus_fastq_data(
-                            fastq_outstrings, 
-                            fq_baseBQ_pairs,
-                            //read_family_con_ampl.getIncluBegPosition(),
-                            //read_family_con_ampl.getExcluEndPosition(),
-                            l2r_qseqlens,
-                            r2l_qseqlens,
-                            strand, 
-                            alns2pair2umibarcode.second,
-                            alns2);
+                    if (paramset.fam_consensus_out_fastq.size() > 0 && fq_baseBQ_pairs.size() >= 20) {
+                        generate_consensus_fastq_data(
+                                part_fastq_outstrings, 
+                                fq_baseBQ_pairs,
+                                //read_family_con_ampl.getIncluBegPosition(),
+                                //read_family_con_ampl.getExcluEndPosition(),
+                                l2r_qseqlens,
+                                r2l_qseqlens,
+                                strand, 
+                                alns2pair2umibarcode.second,
+                                alns2);
+                    }
                 }
             }
-        }
 
+        };
+        const size_t nparts = calc_intra_region_nthreads(alns3.size(), paramset, thread_budget);
+        std::vector<std::array<Symbol2FamFormatDepthSets, 2>> part_to_fam_format_depth_sets_2strand;
+        std::vector<std::array<std::array<PosToIseqToCountTable, NUM_DEL_SYMBOLS>, 2>> part_to_pos2iseq2data_cDP2(nparts - 1);
+        std::vector<std::array<std::array<PosToDlenToCountTable, NUM_INS_SYMBOLS>, 2>> part_to_pos2dlen2data_cDP2(nparts - 1);
+        std::vector<Symbol2FamFormatInfoSets> part_to_fam_format_info_sets;
+        std::vector<std::array<std::string, NUM_FQLIKE_CON_OUT_FILES>> part_to_fastq_outstrings(nparts - 1);
+        for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+            part_to_fam_format_depth_sets_2strand.push_back({{
+                    Symbol2FamFormatDepthSets(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition()),
+                    Symbol2FamFormatDepthSets(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition())}});
+            part_to_fam_format_info_sets.push_back(Symbol2FamFormatInfoSets(tid, this->getUnifiedIncluBegPosition(), this->getUnifiedExcluEndPosition()));
+        }
+        parallel_for_parts(nparts, alns3.size(), [&](size_t part_idx, size_t beg_idx, size_t end_idx) {
+            if (0 == part_idx) {
+                update_fam_format_sets(this->symbol_to_fam_format_depth_sets_2strand, this->pos2iseq2data_cDP2, this->pos2dlen2data_cDP2, 
+                        this->symbol_to_fam_format_info_sets, fastq_outstrings, beg_idx, end_idx);
+            } else {
+                update_fam_format_sets(part_to_fam_format_depth_sets_2strand[part_idx-1], part_to_pos2iseq2data_cDP2[part_idx-1], part_to_pos2dlen2data_cDP2[part_idx-1], 
+                        part_to_fam_format_info_sets[part_idx-1], part_to_fastq_outstrings[part_idx-1], beg_idx, end_idx);
+            }
+        });
+        if (NULL != thread_budget) { thread_budget->release(nparts - 1); }
+        size_t parts_nbytes = 0;
+        for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+            parts_nbytes += part_to_fam_format_info_sets[part_idx-1].getNumBytes();
+            for (int strand = 0; strand < 2; strand++) {
+                parts_nbytes += part_to_fam_format_depth_sets_2strand[part_idx-1][strand].getNumBytes();
+                for (const auto & pos2iseq2data : part_to_pos2iseq2data_cDP2[part_idx-1][strand]) { parts_nbytes += pos2iseq2data.getNumBytes(); }
+                for (const auto & pos2dlen2data : part_to_pos2dlen2data_cDP2[part_idx-1][strand]) { parts_nbytes += pos2dlen2data.getNumBytes(); }
+            }
+            for (const auto & fastq_outstring : part_to_fastq_outstrings[part_idx-1]) { parts_nbytes += fastq_outstring.capacity(); }
+        }
+        this->intra_region_parts_nbytes = MAX(this->intra_region_parts_nbytes, parts_nbytes);
+        for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+            for (int strand = 0; strand < 2; strand++) {
+                this->symbol_to_fam_format_depth_sets_2strand[strand].updateBySummation(part_to_fam_format_depth_sets_2strand[part_idx-1][strand]);
+                posToIndelToCount_updateBySummation(this->pos2iseq2data_cDP2[strand], part_to_pos2iseq2data_cDP2[part_idx-1][strand]);
+                posToIndelToCount_updateBySummation(this->pos2dlen2data_cDP2[strand], part_to_pos2dlen2data_cDP2[part_idx-1][strand]);
+            }
+            this->symbol_to_fam_format_info_sets.updateBySummation(part_to_fam_format_info_sets[part_idx-1]);
+            for (size_t i = 0; i < NUM_FQLIKE_CON_OUT_FILES; i++) {
+                fastq_outstrings[i] += part_to_fastq_outstrings[part_idx-1][i];
+            }
+        }
+        size_t niters = 0;
 if (paramset.inferred_is_vcf_generated) {
         
         niters = 0;
@@ -3464,8 +4144,8 @@ if (paramset.inferred_is_vcf_generated) {
                         }
                         
                         const uvc1_qual_t avgBQ = ((0 == tot_nfrags) ? 1 : (con_sumBQs / tot_nfrags));
-                        const uvc1_readnum_t majorcount = this->symbol_to_fam_format_depth_sets_2strand[strand].getByPos(epos).at(con_symbol).at(FAM_cDPM);
-                        const uvc1_readnum_t minorcount = this->symbol_to_fam_format_depth_sets_2strand[strand].getByPos(epos).at(con_symbol).at(FAM_cDPm);
+                        const uvc1_readnum_t majorcount = this->symbol_to_fam_format_depth_sets_2strand[strand].getByPos(epos)[con_symbol][FAM_cDPM];
+                        const uvc1_readnum_t minorcount = this->symbol_to_fam_format_depth_sets_2strand[strand].getByPos(epos)[con_symbol][FAM_cDPm];
                         const double prior_weight = 1.0 / (minorcount + 1.0);
                         const double realphred = prob2realphred((minorcount + prior_weight) / 
                                 (majorcount + minorcount + prior_weight / phred2prob(avgBQ)));
@@ -3552,7 +4232,7 @@ if (paramset.inferred_is_vcf_generated) {
             for (uvc1_refgpos_t epos = this->getUnifiedIncluBegPosition(); epos < this->getUnifiedExcluEndPosition(); epos++) {
                 for (SymbolType symboltype : SYMBOL_TYPE_ARR) {
                     AlignmentSymbol ref_symbol = region_symbolvec[epos - this->getUnifiedIncluBegPosition()];
-                    const uvc1_readnum_t totDP = formatSumBySymbolType(this->symbol_to_fam_format_depth_sets_2strand[strand].getRefByPos(epos), symboltype, FAM_cDP1);
+                    const uvc1_readnum_t totDP = formatSumBySymbolType(this->symbol_to_fam_format_depth_sets_2strand[strand].getByPos(epos), symboltype, FAM_cDP1);
                     for (AlignmentSymbol symbol : SYMBOL_TYPE_TO_SYMBOLS[symboltype]) {
                         const uvc1_qual_t max_qual = sscs_mut_table.toPhredErrRate(ref_symbol, symbol) + (ISNT_PROVIDED(paramset.vcf_tumor_fname) ? 0 : 4);
                         uvc1_qual_t maxvqual = 0;
@@ -3673,6 +4353,7 @@ if (paramset.inferred_is_vcf_generated) {
             const BedLine & prev_bedline,
             const BedLine & bedline,
             
+            ThreadBudget *thread_budget,
             const CommandLineArgs & paramset,
             const uvc1_flag_t specialflag IGNORE_UNUSED_PARAM) {
         
@@ -3693,6 +4374,7 @@ if (paramset.inferred_is_vcf_generated) {
                 baq_offsetarr,
                 baq_offsetarr2,
                 
+                thread_budget,
                 paramset,
                 0);
         mutform2count4vec_bq = updateHapMap(
@@ -3716,6 +4398,7 @@ if (paramset.inferred_is_vcf_generated) {
                 prev_bedline,
                 bedline,
                 
+                thread_budget,
                 paramset,
                 0);
         mutform2count4vec_fq = updateHapMap(
@@ -5101,7 +5784,7 @@ BcfFormat_symbol_calc_qual(
     const bool is_indel_penal_applied = ((SEQUENCING_PLATFORM_IONTORRENT == paramset.inferred_sequencing_platform) && (ISNT_PROVIDED(paramset.vcf_tumor_fname)));
     const uvc1_qual_t indel_penal_base = (is_indel_penal_applied 
                 ? ((uvc1_qual_t)round(paramset.indel_multiallele_samepos_penal / log(2) 
-                * log((double)MAX3(aDP + eps, fmt.APDP[1], fmt.APDP[2]) / (double)(aDP + eps)))) 
+                * uvc_log((double)MAX3(aDP + eps, fmt.APDP[1], fmt.APDP[2]) / (double)(aDP + eps)))) 
                 : 0);
     if (paramset.should_add_note) {
         fmt.note += std::string("/pb/") + std::to_string(indel_penal_base) + "/" 
@@ -5135,15 +5818,15 @@ BcfFormat_symbol_calc_qual(
         // assertUVC (nearInDelDP >= aDP || !fprintf(stderr, "nearInDelDP >= aDP failed (%d >= %d failed) at tid %d pos %d!\n", nearInDelDP, aDP, tid, refpos));
         
         auto indel_penal4multialleles1 = (uvc1_qual_t)round(paramset.indel_multiallele_samepos_penal / log(2.0) 
-                * log((double)(indelcdepth + eps) / (double)(fmt.cDP0a[a] + eps)));
+                * uvc_log((double)(indelcdepth + eps) / (double)(fmt.cDP0a[a] + eps)));
         // Thermo/Life/IonTorrent is more error prone with complex InDels, so be more lenient
         const auto homopol_n_units = MAX(((1 == rtr1.unitlen) ? rtr1.tracklen : 0), ((1 == rtr2.unitlen) ? rtr2.tracklen : 0));
         if (SEQUENCING_PLATFORM_IONTORRENT == paramset.inferred_sequencing_platform) {
             indel_penal4multialleles1 = non_neg_minus(indel_penal4multialleles1, paramset.indel_multiallele_samepos_penal);
         }
         const auto indel_penal4multialleles2 = (uvc1_qual_t)round(paramset.indel_multiallele_diffpos_penal / log(2.0) 
-                * log((double)(nearInDelDP + eps) / (double)(MAX(aDP, nearInDelDP) + eps)));
-        indel_penal4multialleles_g = (uvc1_qual_t)round(paramset.indel_tetraallele_germline_penal_value /log(2.0) * log((double)(ins_cdepth + del_cdepth + eps) / (double)(fmt.cDP0a[a] + eps))) - paramset.indel_tetraallele_germline_penal_thres;
+                * uvc_log((double)(nearInDelDP + eps) / (double)(MAX(aDP, nearInDelDP) + eps)));
+        indel_penal4multialleles_g = (uvc1_qual_t)round(paramset.indel_tetraallele_germline_penal_value /log(2.0) * uvc_log((double)(ins_cdepth + del_cdepth + eps) / (double)(fmt.cDP0a[a] + eps))) - paramset.indel_tetraallele_germline_penal_thres;
         
         if (isSymbolIns(symbol)) {
             indel_penal4multialleles = (indel_penal4multialleles1 * paramset.indel_ins_penal_pseudocount / 
@@ -5472,9 +6155,24 @@ ALODQ(const T x) {
     return x->gVQ1[x->gVQ1.size() - 1];
 };
 
+// The FORMAT tags of the germline, gVCF-block, and additional-indel-candidate records that are not in bcfrec. 
+// Their indexes in BcfOutputHeader::tag_to_hdr_id follow the ones of the tags in bcfrec. 
+enum EXTRA_FORMAT_ENUM {
+    EXTRA_FORMAT_GL4 = bcfrec::FORMAT_NUM,
+    EXTRA_FORMAT_GST,
+    EXTRA_FORMAT_CDP1,
+    EXTRA_FORMAT_cDP1,
+    EXTRA_FORMAT_POS_VT_BDP_CDP_HomRefQ,
+    EXTRA_FORMAT_clipDP,
+    EXTRA_FORMAT_END
+};
+const char *const EXTRA_FORMAT_IDS[] = {"GL4", "GST", "CDP1", "cDP1", "POS_VT_BDP_CDP_HomRefQ", "clipDP"};
+STATIC_ASSERT_WITH_DEFAULT_MSG(sizeof(EXTRA_FORMAT_IDS) / sizeof(EXTRA_FORMAT_IDS[0]) == EXTRA_FORMAT_END - bcfrec::FORMAT_NUM);
+
 auto
 output_germline(
         std::string & out_string,
+        BcfLineEncoder *bcf_line_encoder,
         AlignmentSymbol refsymbol, 
         std::vector<std::pair<AlignmentSymbol, bcfrec::BcfFormat*>> symbol_format_vec,
         const char *tname,
@@ -5725,6 +6423,29 @@ output_germline(
         germ_ADR.push_back(collectget(ref_alt1_alt2_alt3[2].second->cDP0a, 1, 0));
     }
     
+    const std::array<uvc1_readnum_t, 2> germ_CDP1 = {{ SUMPAIR(symbol_format_vec[0].second->CDP1b), SUMPAIR(symbol_format_vec[0].second->CDP1d) }};
+    const std::array<uvc1_qual_t, 4> germ_GL4 = {{ GL4raw[0].second, GL4raw[1].second, GL4raw[2].second, GL4raw[3].second }};
+    const std::array<uvc1_qual_t, 8> germ_GST = {{ a0LODQ, a1LODQ, a2LODQ, a3LODQ, a0a1LODQ, a1a0LODQ, a1a2LODQ, a2a1LODQ }};
+    if (NULL != bcf_line_encoder && bcf_line_encoder->hasSingleSample()) {
+        BcfSitesEncoder & sites_encoder = bcf_line_encoder->sites_encoder;
+        BcfFormatEncoder & format_encoder = bcf_line_encoder->format_encoder;
+        const std::array<uvc1_qual_t, 2> germ_HQ = {{ 0, 0 }};
+        sites_encoder.encodeSite(tname, vcfpos, vcfref, vcfalt, (float)germ_GQ, "PASS");
+        sites_encoder.encodeInfoFlag("GERMLINE");
+        format_encoder.clear();
+        format_encoder.encodeGenotype(bcfrec::GT, germ_GT);
+        format_encoder.encodeInt32s(bcfrec::GQ, &germ_GQ, 1);
+        format_encoder.encodeInt32s(bcfrec::HQ, germ_HQ.data(), germ_HQ.size());
+        format_encoder.encodeString(bcfrec::FT, "PASS", 4);
+        format_encoder.encodeInt32s(EXTRA_FORMAT_CDP1, germ_CDP1.data(), germ_CDP1.size());
+        format_encoder.encodeInt32s(EXTRA_FORMAT_cDP1, germ_ADR.data(), germ_ADR.size());
+        format_encoder.encodeInt32s(EXTRA_FORMAT_GL4, germ_GL4.data(), germ_GL4.size());
+        format_encoder.encodeInt32s(EXTRA_FORMAT_GST, germ_GST.data(), germ_GST.size());
+        format_encoder.encodeString(bcfrec::note, ref_alt1_alt2_alt3[0].second->note.c_str(), ref_alt1_alt2_alt3[0].second->note.size());
+        bcf_line_encoder->appendSitesAndFormat(out_string);
+        return std::make_tuple(ret, fmtptr1, fmtptr2);
+    }
+    
     std::string bcfline = string_join(std::array<std::string, 10>
     {{
         std::string(tname), 
@@ -5742,27 +6463,14 @@ output_germline(
             std::to_string(germ_GQ), 
             std::string("0,0"), 
             "PASS",
-            other_join(std::array<uvc1_readnum_t, 2> {{
-                SUMPAIR(symbol_format_vec[0].second->CDP1b),
-                SUMPAIR(symbol_format_vec[0].second->CDP1d)
-                //(symbol_format_vec[0].second->CDP1f[0] + symbol_format_vec[0].second->CDP1r[0]), 
-                //(symbol_format_vec[0].second->CDP1f[1] + symbol_format_vec[0].second->CDP1r[1]) 
-                }}, ","
-            ),
+            other_join(germ_CDP1, std::string(",")),
             other_join(germ_ADR, std::string(",")), 
-            other_join(std::array<uvc1_readnum_t, 4>
-            {{ 
-                GL4raw[0].second, GL4raw[1].second, GL4raw[2].second, GL4raw[3].second, 
-            }}, ","),
-            other_join(std::array<uvc1_readnum_t, 8>
-            {{
-                a0LODQ, a1LODQ, a2LODQ, a3LODQ,
-                a0a1LODQ, a1a0LODQ, a1a2LODQ, a2a1LODQ
-            }}, ","),
+            other_join(germ_GL4, std::string(",")),
+            other_join(germ_GST, std::string(",")),
             ref_alt1_alt2_alt3[0].second->note
         }}, ":")
-    }}, "\t") + "\n";
-    out_string += bcfline;
+    }}, "\t");
+    append_vcf_line(out_string, bcf_line_encoder, bcfline);
     return std::make_tuple(ret, fmtptr1, fmtptr2);
 }
 
@@ -5827,6 +6535,9 @@ generate_vcf_header(
     ret += "##INFO=<ID=RU,Number=1,Type=String,Description=\"The shortest repeating unit in the reference\">\n";
     ret += "##INFO=<ID=RC,Number=1,Type=Integer,Description=\"The number of non-interrupted RUs in the reference\">\n";
     ret += "##INFO=<ID=R3X2,Number=6,Type=Integer,Description=\"Repeat start position, repeat track length, and repeat unit size at the two positions before and after this VCF position. \">\n"; 
+    if ((paramset.debug_note_flag & DEBUG_NOTE_FLAG_BITMASK_BAQ_OFFSETARR)) {
+        ret += "##INFO=<ID=RBAQ,Number=1,Type=Integer,Description=\"Offset of BAQ (base alignment quality) at this position, which is used for debugging only. \">\n";
+    }
     
     for (size_t i = 0; i < bcfrec::FORMAT_NUM; i++) {
         ret += std::string("") + bcfrec::FORMAT_LINES[i] + "\n";
@@ -5901,6 +6612,12 @@ bcf1_to_string(const bcf_hdr_t *tki_bcf1_hdr, const bcf1_t *bcf1_record) {
     return ret;
 }
 
+// The FORMAT values of the tumor sample with the leading tab, either from the record of the tumor VCF or from the tumor pass of the joint calling. 
+std::string
+tki_to_tumor_format_string(const bcf_hdr_t *tki_bcf1_hdr, const TumorKeyInfo & tki) {
+    return ((NULL != tki.bcf1_record) ? bcf1_to_string(tki_bcf1_hdr, tki.bcf1_record) : tki.tumor_format_string);
+}
+
 int 
 fill_tki(TumorKeyInfo & tki, const bcfrec::BcfFormat & fmt, size_t a = 1) {
     tki.BDP = SUMPAIR(fmt.BDPb); // fmt.BDPf.at(0) +fmt.BDPr.at(0);
@@ -5971,6 +6688,31 @@ fill_conditional_tki(TumorKeyInfo & tki, const bcfrec::BcfFormat & fmt, const Al
     return TIsFmtTumor;
 }
 
+// Same as bcf1_to_tumor_key_info for a non-symbolic record of the tumor VCF except that the info is filled from the FORMAT fields in memory. 
+int
+fmt_to_tumor_key_info(
+        TumorKeyInfo & tki, 
+        const bcfrec::BcfFormat & fmt, 
+        const uvc1_refgpos_t pos, 
+        const std::string & vcfref, 
+        const std::string & vcfalt, 
+        const bool is_tumor_format_retrieved) {
+    fill_tki(tki, fmt);
+    tki.VTI = LAST(fmt.VTI);
+    tki.tDP = SUMPAIR(fmt.CDP1b);
+    tki.tADR = {{ fmt.cDP1f[0] + fmt.cDP1r[0], fmt.cDP1f[1] + fmt.cDP1r[1] }};
+    tki.tDPC = SUMPAIR(fmt.CDP2b);
+    tki.tADCR = {{ fmt.cDP2f[0] + fmt.cDP2r[0], fmt.cDP2f[1] + fmt.cDP2r[1] }};
+    tki.pos = pos;
+    tki.ref_alt = vcfref + "\t" + vcfalt;
+    tki.enable_tier2_consensus_format_tags = fmt.enable_tier2_consensus_format_tags;
+    if (is_tumor_format_retrieved) {
+        tki.tumor_format_string = "\t";
+        bcfrec::streamAppendBcfFormat(tki.tumor_format_string, fmt);
+    }
+    return 0;
+}
+
 const auto
 calc_binom_powlaw_syserr_normv_quals(
         double tAD, 
@@ -6016,10 +6758,12 @@ calc_binom_powlaw_syserr_normv_quals2(
     return std::array<uvc1_qual_t, 4> {{binom_b10log10like, powlaw_b10log10like, nVQ, tnVQ }};
 };
 
+// If joint_tki is not NULL, then it is filled instead of appending the record to out_string, and 1 is returned if it is filled. 
 template <class T>
 int
 append_vcf_record(
         std::string & out_string,
+        BcfLineEncoder *bcf_line_encoder,
         const char *tname,
         const uvc1_refgpos_t refpos,
         const uvc1_refgpos_t region_offset,
@@ -6033,6 +6777,8 @@ append_vcf_record(
         const AlignmentSymbol symbol,
         const bcfrec::BcfFormat & fmt,
         TumorKeyInfo & tki,
+        TumorKeyInfo *joint_tki,
+        const bool is_joint_tumor_format_retrieved,
 
         const uvc1_qual_t nlodq1,
         const AlignmentSymbol argmin_nlodq_symbol,
@@ -6196,32 +6942,7 @@ append_vcf_record(
     const auto nlodq = nlodq1 - tn_dec_both_tlodq_nlodq;
     uvc1_qual_t somaticq = MIN(tlodq, nlodq);
     float vcfqual = calc_non_negative(is_processing_normal ? ((float)somaticq) : MAX((float)tlodq, lowestVAQ));
-    std::string infostring = std::string(is_processing_normal ? "SOMATIC" : "ANY_VAR");
-    infostring += std::string(";SomaticQ=") + std::to_string(somaticq);
-    infostring += std::string(";TLODQ=") + std::to_string(tlodq);
-    infostring += std::string(";NLODQ=") + std::to_string(nlodq);
-    infostring += std::string(";NLODV=") + SYMBOL_TO_DESC_ARR[argmin_nlodq_symbol];
-    infostring += std::string(";TNBQF=") + other_join(b_binom_powlaw_syserr_normv_q4filter);
-    infostring += std::string(";TNCQF=") + other_join(c_binom_powlaw_syserr_normv_q4);
-
-    infostring += std::string(";tbDP=") + std::to_string(tki.BDP);
-    infostring += std::string(";tDP=") + std::to_string(tki.tDP);
-    infostring += std::string(";tAD=") + other_join(tki.tADR, ",");
-    infostring += std::string(";t2DP=") + std::to_string(tki.tDPC);
-    infostring += std::string(";t2AD=") + other_join(tki.tADCR, ",");
-    
-    if (is_processing_normal) {
-        infostring += std::string(";nDP=") + std::to_string(tki.nDP);
-        infostring += std::string(";nAD=") + other_join(tki.nADR, ",");
-        infostring += std::string(";n2AD=") + other_join(tki.nADCR, ",");
-    }
-
-    infostring += std::string(";RU=") + repeatunit + ";RC=" + std::to_string(repeatnum);
-    // This can be useful for debugging only.
-    if ((paramset.debug_note_flag & DEBUG_NOTE_FLAG_BITMASK_BAQ_OFFSETARR)) { 
-        infostring += std::string(";RBAQ=") + std::to_string(baq_offsetarr.getByPos(refpos)); 
-    }
-    infostring += std::string(";R3X2=") + other_join(std::array<int32_t, 6>{{rtr1_tpos, rtr1.tracklen, rtr1.unitlen, rtr2_tpos, rtr2.tracklen, rtr2.unitlen}});
+    const std::array<int32_t, 6> R3X2 = {{rtr1_tpos, rtr1.tracklen, rtr1.unitlen, rtr2_tpos, rtr2.tracklen, rtr2.unitlen}};
     
     std::string vcffilter = "";
     if (vcfqual < 10) {
@@ -6253,12 +6974,91 @@ append_vcf_record(
             && (symbol != refsymbol || (should_output_ref_allele)));
     const auto min_ad = ((symbol == refsymbol) ? paramset.min_r_ad : paramset.min_a_ad);
     if (keep_var && tki.bDP >= min_ad) {
+        if (NULL != joint_tki) {
+            // The variant of the tumor pass of the joint calling is passed to the normal pass in memory without being formatted, 
+            //   and the symbolic alleles are skipped as they would be by the parsing of the tumor VCF. 
+            if ('<' == vcfalt[0]) { return 0; }
+            fmt_to_tumor_key_info(*joint_tki, fmt, vcfpos - 1, vcfref, vcfalt, is_joint_tumor_format_retrieved);
+            return 1;
+        }
+        const bool is_tumor_format_appended = (is_processing_normal && paramset.is_tumor_format_retrieved);
+        if (NULL != bcf_line_encoder && bcf_line_encoder->hasSingleSample() && !is_tumor_format_appended) {
+            // The record is encoded into BCF directly from the values, without being formatted into text and then parsed. 
+            BcfSitesEncoder & sites_encoder = bcf_line_encoder->sites_encoder;
+            const float somaticq_float = somaticq;
+            const float tlodq_float = tlodq;
+            const float nlodq_float = nlodq;
+            std::array<float, 4> tnbqf;
+            std::array<float, 4> tncqf;
+            for (size_t i = 0; i < 4; i++) {
+                tnbqf[i] = b_binom_powlaw_syserr_normv_q4filter[i];
+                tncqf[i] = c_binom_powlaw_syserr_normv_q4[i];
+            }
+            sites_encoder.encodeSite(tname, vcfpos, vcfref, vcfalt, vcfqual, vcffilter.c_str());
+            sites_encoder.encodeInfoFlag(is_processing_normal ? "SOMATIC" : "ANY_VAR");
+            sites_encoder.encodeInfoFloats("SomaticQ", &somaticq_float, 1);
+            sites_encoder.encodeInfoFloats("TLODQ", &tlodq_float, 1);
+            sites_encoder.encodeInfoFloats("NLODQ", &nlodq_float, 1);
+            sites_encoder.encodeInfoString("NLODV", SYMBOL_TO_DESC_ARR[argmin_nlodq_symbol]);
+            sites_encoder.encodeInfoFloats("TNBQF", tnbqf.data(), tnbqf.size());
+            sites_encoder.encodeInfoFloats("TNCQF", tncqf.data(), tncqf.size());
+            sites_encoder.encodeInfoInt32s("tbDP", &tki.BDP, 1);
+            sites_encoder.encodeInfoInt32s("tDP", &tki.tDP, 1);
+            sites_encoder.encodeInfoInt32s("tAD", tki.tADR.data(), tki.tADR.size());
+            sites_encoder.encodeInfoInt32s("t2DP", &tki.tDPC, 1);
+            sites_encoder.encodeInfoInt32s("t2AD", tki.tADCR.data(), tki.tADCR.size());
+            if (is_processing_normal) {
+                sites_encoder.encodeInfoInt32s("nDP", &tki.nDP, 1);
+                sites_encoder.encodeInfoInt32s("nAD", tki.nADR.data(), tki.nADR.size());
+                sites_encoder.encodeInfoInt32s("n2AD", tki.nADCR.data(), tki.nADCR.size());
+            }
+            sites_encoder.encodeInfoString("RU", repeatunit);
+            sites_encoder.encodeInfoInt32s("RC", &repeatnum, 1);
+            if ((paramset.debug_note_flag & DEBUG_NOTE_FLAG_BITMASK_BAQ_OFFSETARR)) { 
+                const int32_t rbaq = baq_offsetarr.getByPos(refpos);
+                sites_encoder.encodeInfoInt32s("RBAQ", &rbaq, 1);
+            }
+            sites_encoder.encodeInfoInt32s("R3X2", R3X2.data(), R3X2.size());
+            bcf_line_encoder->format_encoder.clear();
+            bcfrec::streamEncodeBcfFormat(bcf_line_encoder->format_encoder, fmt);
+            bcf_line_encoder->appendSitesAndFormat(out_string);
+            return 0;
+        }
+        
+        std::string infostring = std::string(is_processing_normal ? "SOMATIC" : "ANY_VAR");
+        infostring += std::string(";SomaticQ=") + std::to_string(somaticq);
+        infostring += std::string(";TLODQ=") + std::to_string(tlodq);
+        infostring += std::string(";NLODQ=") + std::to_string(nlodq);
+        infostring += std::string(";NLODV=") + SYMBOL_TO_DESC_ARR[argmin_nlodq_symbol];
+        infostring += std::string(";TNBQF=") + other_join(b_binom_powlaw_syserr_normv_q4filter);
+        infostring += std::string(";TNCQF=") + other_join(c_binom_powlaw_syserr_normv_q4);
+
+        infostring += std::string(";tbDP=") + std::to_string(tki.BDP);
+        infostring += std::string(";tDP=") + std::to_string(tki.tDP);
+        infostring += std::string(";tAD=") + other_join(tki.tADR, ",");
+        infostring += std::string(";t2DP=") + std::to_string(tki.tDPC);
+        infostring += std::string(";t2AD=") + other_join(tki.tADCR, ",");
+        
+        if (is_processing_normal) {
+            infostring += std::string(";nDP=") + std::to_string(tki.nDP);
+            infostring += std::string(";nAD=") + other_join(tki.nADR, ",");
+            infostring += std::string(";n2AD=") + other_join(tki.nADCR, ",");
+        }
+
+        infostring += std::string(";RU=") + repeatunit + ";RC=" + std::to_string(repeatnum);
+        // This can be useful for debugging only.
+        if ((paramset.debug_note_flag & DEBUG_NOTE_FLAG_BITMASK_BAQ_OFFSETARR)) { 
+            infostring += std::string(";RBAQ=") + std::to_string(baq_offsetarr.getByPos(refpos)); 
+        }
+        infostring += std::string(";R3X2=") + other_join(R3X2);
+        
         const auto format_name_string = ((fmt.enable_tier2_consensus_format_tags) ? (bcfrec::FORMAT_STRING_PER_REC) : (bcfrec::FORMAT_STRING_PER_REC_WITHOUT_SSCS));
-        out_string += string_join(std::array<std::string, 9>{{
+        std::string vcfline = string_join(std::array<std::string, 9>{{
                 std::string(tname), std::to_string(vcfpos), ".", vcfref, vcfalt, std::to_string(vcfqual), vcffilter, 
                 infostring, format_name_string }}, "\t") + "\t";
-        bcfrec::streamAppendBcfFormat(out_string, fmt);
-        out_string += ((is_processing_normal && paramset.is_tumor_format_retrieved) ? bcf1_to_string(g_bcf_hdr, tki.bcf1_record) : std::string("")) + "\n";
+        bcfrec::streamAppendBcfFormat(vcfline, fmt);
+        vcfline += (is_tumor_format_appended ? tki_to_tumor_format_string(g_bcf_hdr, tki) : std::string(""));
+        append_vcf_line(out_string, bcf_line_encoder, vcfline);
     }
     return 0;
 };
@@ -210,7 +210,7 @@ static_assert(odds2prob(prob2odds(0.66)) < 0.67);
 
 double
 logit(double p) {
-    return log(prob2odds(p));
+    return uvc_log(prob2odds(p));
 }
 
 double
@@ -230,7 +230,10 @@ calc_binom_10log10_likeratio(double prob, double a, double b) {
     double A = (      prob) * (a + b);
     double B = (1.0 - prob) * (a + b);
     if (TIsBiDirectional || a > A) {
-        return 10.0 / log(10.0) * (a * log(a / A) + b * log(b / B));
+        // log is used if the result must be exact so that this function can still be evaluated at compile time
+        return (COMPILATION_EXACT_MATH 
+                ? (10.0 / log(10.0) * (a *    log(a / A) + b *    log(b / B)))
+                : (10.0 / log(10.0) * (a * uvc_log(a / A) + b * uvc_log(b / B))));
     } else {
         return 0.0;
     }
@@ -248,10 +251,12 @@ main(int argc, char **argv) {
 }
 #endif
 
+#if COMPILATION_EXACT_MATH
 STATIC_ASSERT_WITH_DEFAULT_MSG(abs(calc_binom_10log10_likeratio(0.1, 10, 90)) < 1e-4);
 STATIC_ASSERT_WITH_DEFAULT_MSG(calc_binom_10log10_likeratio(0.1, 90, 10) > 763); // 10/log(10) * (90*log(9)+10*log(1/9))
 STATIC_ASSERT_WITH_DEFAULT_MSG(calc_binom_10log10_likeratio(0.1, 90, 10) < 764); // 10/log(10) * (90*log(9)+10*log(1/9))
 STATIC_ASSERT_WITH_DEFAULT_MSG(abs(calc_binom_10log10_likeratio(0.1, 1, 99)) < 1e-4); // 10/log(10) * (90*log(9)+10*log(1/9))
+#endif
 
 template <class T=int, class T1>
 T
@@ -509,6 +514,7 @@ struct TumorKeyInfo {
     uvc1_qual_t bNMQ = 0;
     uvc1_qual_t vHGQ = 0;
     bcf1_t *bcf1_record = NULL;
+    std::string tumor_format_string; // the FORMAT values of the tumor sample with the leading tab, filled instead of bcf1_record by the joint calling
     
     uvc1_readnum_t tDP = 0;
     std::array<uvc1_readnum_t, 2> tADR = {{ 0 }};
@@ -884,17 +890,18 @@ phred2char(const uvc1_qual_t phredvalue) {
 
 double 
 phred2prob(const uvc1_qual_t phredvalue) {
+    if (phredvalue >= 0 && phredvalue <= MATH_TABLE_MAX_PHRED) { return STATIC_MATH_TABLES.phred_to_prob[phredvalue]; }
     return pow(10, -((float)phredvalue) / 10);
 }
 
 uvc1_qual_t 
 prob2phred(const double probvalue) {
-    return floor(-10 * log(probvalue) / log(10));
+    return floor(-10 * uvc_log(probvalue) / log(10));
 }
 
 double 
 prob2realphred(const double probvalue) {
-    return -10 * log(probvalue) / log(10);
+    return -10 * uvc_log(probvalue) / log(10);
 }
 
 template <class T1, class T2, class T3, class T4>
@@ -0,0 +1,282 @@
+#ifndef pipeline_hpp_INCLUDED
+#define pipeline_hpp_INCLUDED
+
+#include "common.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded multi-worker pipeline in which the results are consumed in the same order as the tasks are pushed.
+// Each worker has its own deque of tasks. A worker takes tasks from the front of its own deque,
+//   and if its own deque is empty, then it steals the back half of the longest deque of the other workers.
+// The tasks are coarse-grained (one task can take seconds), so one mutex guarding all deques is not a bottleneck.
+template <class TTask, class TResult>
+class OrderedPipeline {
+    std::mutex mtx;
+    std::condition_variable producer_cv;
+    std::condition_variable worker_cv;
+    std::condition_variable writer_cv;
+
+    std::vector<std::deque<std::pair<size_t, TTask>>> worker_to_seq_task_deque;
+    std::map<size_t, TResult> seq_to_result;
+    size_t n_pushed_tasks = 0;
+    size_t n_queued_tasks = 0;
+    size_t n_popped_results = 0;
+    size_t n_stolen_tasks = 0;
+    bool is_closed = false;
+    const size_t max_n_inflight;
+
+public:
+    OrderedPipeline(size_t n_workers, size_t a_max_n_inflight)
+            : worker_to_seq_task_deque(n_workers > 0 ? n_workers : 1), max_n_inflight(a_max_n_inflight > 0 ? a_max_n_inflight : 1) {};
+
+    // Called by the producer with the tasks in the order in which their results should be consumed.
+    // Blocks until the number of tasks that are pushed but whose results are not consumed yet is less than max_n_inflight, 
+    //   and then pushes the task to the deque of the worker so that each worker starts with a contiguous run of tasks. 
+    // The tasks are pushed one by one so that the tasks of the next tier-1 region are admitted as soon as any inflight task is done. 
+    void
+    push_task(size_t worker_idx, TTask && task) {
+        std::unique_lock<std::mutex> lock(mtx);
+        producer_cv.wait(lock, [this]{ return (n_pushed_tasks - n_popped_results < max_n_inflight); });
+        worker_to_seq_task_deque[worker_idx % worker_to_seq_task_deque.size()].push_back(std::make_pair(n_pushed_tasks, std::move(task)));
+        n_pushed_tasks++;
+        n_queued_tasks++;
+        worker_cv.notify_all();
+    };
+
+    // Called by the producer after the last task is pushed.
+    void
+    close() {
+        std::unique_lock<std::mutex> lock(mtx);
+        is_closed = true;
+        worker_cv.notify_all();
+        writer_cv.notify_all();
+    };
+
+    // Called by the workers. Returns false if there is no task left after the pipeline is closed.
+    bool
+    pop_task(size_t worker_idx, size_t & seq, TTask & task) {
+        std::unique_lock<std::mutex> lock(mtx);
+        worker_cv.wait(lock, [this]{ return (n_queued_tasks > 0 || is_closed); });
+        if (0 == n_queued_tasks) {
+            return false;
+        }
+        auto & own_deque = worker_to_seq_task_deque[worker_idx];
+        if (0 == own_deque.size()) {
+            size_t victim_idx = worker_idx;
+            for (size_t i = 0; i < worker_to_seq_task_deque.size(); i++) {
+                if (worker_to_seq_task_deque[i].size() > worker_to_seq_task_deque[victim_idx].size()) {
+                    victim_idx = i;
+                }
+            }
+            auto & victim_deque = worker_to_seq_task_deque[victim_idx];
+            const size_t n_stolen = (victim_deque.size() + 1) / 2;
+            for (size_t i = victim_deque.size() - n_stolen; i < victim_deque.size(); i++) {
+                own_deque.push_back(std::move(victim_deque[i]));
+            }
+            victim_deque.resize(victim_deque.size() - n_stolen);
+            n_stolen_tasks += n_stolen;
+        }
+        seq = own_deque.front().first;
+        task = std::move(own_deque.front().second);
+        own_deque.pop_front();
+        n_queued_tasks--;
+        return true;
+    };
+
+    // Called by a worker that popped a task but cannot process it now. 
+    // The task is put back to the front of the deque of the worker, from which it can be popped again or stolen by any other worker. 
+    void
+    unpop_task(size_t worker_idx, size_t seq, TTask && task) {
+        std::unique_lock<std::mutex> lock(mtx);
+        worker_to_seq_task_deque[worker_idx].push_front(std::make_pair(seq, std::move(task)));
+        n_queued_tasks++;
+        worker_cv.notify_all();
+    };
+    
+    // Called by the workers.
+    void
+    push_result(size_t seq, TResult && result) {
+        std::unique_lock<std::mutex> lock(mtx);
+        seq_to_result.insert(std::make_pair(seq, std::move(result)));
+        if (seq == n_popped_results) {
+            writer_cv.notify_all();
+        }
+    };
+
+    // Called by the writer. Returns false if all results are consumed after the pipeline is closed.
+    bool
+    pop_next_result(TResult & result) {
+        std::unique_lock<std::mutex> lock(mtx);
+        writer_cv.wait(lock, [this]{
+                return (seq_to_result.find(n_popped_results) != seq_to_result.end()) || (is_closed && n_popped_results == n_pushed_tasks);
+        });
+        auto it = seq_to_result.find(n_popped_results);
+        if (it == seq_to_result.end()) {
+            return false;
+        }
+        result = std::move(it->second);
+        seq_to_result.erase(it);
+        n_popped_results++;
+        producer_cv.notify_one();
+        return true;
+    };
+
+    size_t
+    get_n_stolen_tasks() {
+        std::unique_lock<std::mutex> lock(mtx);
+        return n_stolen_tasks;
+    };
+};
+
+// Admission control of the memory held by the regions that are pushed into the pipeline but whose results are not written yet. 
+// The number of bytes per read, per reference position, and per reference position of output are measured from the regions already processed, 
+//   starting from the initial estimates, so that the sizes of the regions adapt to the actual sequencing depth and data. 
+class MemoryGovernor {
+    std::mutex mtx;
+    std::condition_variable release_cv;
+    const size_t max_nbytes;
+    size_t held_nbytes = 0;
+    size_t peak_held_nbytes = 0;
+    // the initial estimates are weighted as if they were measured from this number of reads or positions
+    const double prior_weight = 1024 * 16;
+    std::array<double, 3> sum_nbytes;
+    std::array<double, 3> sum_counts;
+
+public:
+    enum Kind { BYTES_PER_READ = 0, BYTES_PER_REF_POS = 1, OUT_BYTES_PER_REF_POS = 2 };
+    
+    MemoryGovernor(size_t a_max_nbytes, size_t init_nbytes_per_read, size_t init_nbytes_per_ref_pos, size_t init_out_nbytes_per_ref_pos)
+            : max_nbytes(a_max_nbytes) {
+        sum_nbytes = {{ prior_weight * init_nbytes_per_read, prior_weight * init_nbytes_per_ref_pos, prior_weight * init_out_nbytes_per_ref_pos }};
+        sum_counts = {{ prior_weight, prior_weight, prior_weight }};
+    };
+    
+    std::array<size_t, 3>
+    get_rates() {
+        std::unique_lock<std::mutex> lock(mtx);
+        std::array<size_t, 3> ret;
+        for (size_t i = 0; i < ret.size(); i++) {
+            ret[i] = (size_t)(sum_nbytes[i] / sum_counts[i]) + 1;
+        }
+        return ret;
+    };
+    
+    size_t
+    estimate(size_t nreads, size_t npositions) {
+        const auto rates = get_rates();
+        return nreads * rates[BYTES_PER_READ] + npositions * (rates[BYTES_PER_REF_POS] + rates[OUT_BYTES_PER_REF_POS]);
+    };
+    
+    // Called by the producer. Blocks until the held bytes plus nbytes are within the limit unless nothing is held. 
+    void
+    acquire(size_t nbytes) {
+        std::unique_lock<std::mutex> lock(mtx);
+        release_cv.wait(lock, [this, nbytes]{ return (0 == held_nbytes || held_nbytes + nbytes <= max_nbytes); });
+        held_nbytes += nbytes;
+        peak_held_nbytes = MAX(peak_held_nbytes, held_nbytes);
+    };
+    
+    // Called by the workers after processing one region that was estimated to hold est_nbytes, and that is measured to have held 
+    //   read_nbytes for nreads reads and pos_nbytes for npositions positions, and to still hold out_nbytes of output for out_npositions positions. 
+    // Returns the number of bytes that is still held and must be released later. 
+    size_t
+    record(size_t est_nbytes, size_t nreads, size_t read_nbytes, size_t npositions, size_t pos_nbytes, size_t out_npositions, size_t out_nbytes) {
+        std::unique_lock<std::mutex> lock(mtx);
+        peak_held_nbytes = MAX(peak_held_nbytes, held_nbytes - MIN(held_nbytes, est_nbytes) + read_nbytes + pos_nbytes + out_nbytes);
+        if (nreads > 0) {
+            sum_nbytes[BYTES_PER_READ] += read_nbytes;
+            sum_counts[BYTES_PER_READ] += nreads;
+        }
+        if (npositions > 0) {
+            sum_nbytes[BYTES_PER_REF_POS] += pos_nbytes;
+            sum_counts[BYTES_PER_REF_POS] += npositions;
+        }
+        if (out_npositions > 0) {
+            sum_nbytes[OUT_BYTES_PER_REF_POS] += out_nbytes;
+            sum_counts[OUT_BYTES_PER_REF_POS] += out_npositions;
+        }
+        held_nbytes = held_nbytes - MIN(held_nbytes, est_nbytes) + out_nbytes;
+        release_cv.notify_all();
+        return out_nbytes;
+    };
+    
+    // Called by the writer after the output of one region is handed over to the compressor. 
+    void
+    release(size_t nbytes) {
+        std::unique_lock<std::mutex> lock(mtx);
+        held_nbytes -= MIN(held_nbytes, nbytes);
+        release_cv.notify_all();
+    };
+    
+    size_t
+    get_peak_held_nbytes() {
+        std::unique_lock<std::mutex> lock(mtx);
+        return peak_held_nbytes;
+    };
+};
+
+// Number of threads that are allowed to run at the same time, shared by the pipeline workers and by the extra threads 
+//   that process the parts of one deep region, so that the extra threads only use the cores of the idle workers. 
+class ThreadBudget {
+    std::mutex mtx;
+    std::condition_variable release_cv;
+    size_t n_free_threads;
+
+public:
+    ThreadBudget(size_t n_threads) : n_free_threads(n_threads) {};
+    
+    // Called by a worker that cannot acquire any thread without holding any task. Blocks until at least one thread is free. 
+    void
+    wait_until_any_free() {
+        std::unique_lock<std::mutex> lock(mtx);
+        release_cv.wait(lock, [this]{ return (n_free_threads > 0); });
+    };
+    
+    // Called by a worker for itself before processing a task and for the extra threads of one region. 
+    // Returns the number of acquired threads, which is at most max_n_threads, without blocking. 
+    size_t
+    try_acquire(size_t max_n_threads) {
+        std::unique_lock<std::mutex> lock(mtx);
+        const size_t ret = MIN(n_free_threads, max_n_threads);
+        n_free_threads -= ret;
+        return ret;
+    };
+    
+    void
+    release(size_t n_threads) {
+        if (0 == n_threads) { return; }
+        std::unique_lock<std::mutex> lock(mtx);
+        n_free_threads += n_threads;
+        release_cv.notify_all();
+    };
+};
+
+// Split the items from 0 to nitems into nparts contiguous parts and call func(part_idx, beg_item_idx, end_item_idx) for each part.
+// Part 0 is run by the calling thread, and each of the other parts is run by one new thread.
+template <class F>
+void
+parallel_for_parts(size_t nparts, size_t nitems, F func) {
+    nparts = ((nparts > nitems) ? nitems : nparts);
+    if (nparts <= 1) {
+        func(0, 0, nitems);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(nparts - 1);
+    for (size_t part_idx = 1; part_idx < nparts; part_idx++) {
+        threads.push_back(std::thread(func, part_idx, nitems * part_idx / nparts, nitems * (part_idx + 1) / nparts));
+    }
+    func(0, 0, nitems / nparts);
+    for (auto & t : threads) {
+        t.join();
+    }
+}
+
+#endif